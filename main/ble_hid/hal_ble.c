@@ -88,9 +88,30 @@ uint8_t keyboard_report[8];
 
 /** @brief Currently active mouse report
  * This report is changed and sent on an incoming command
- * 1. byte is the button map, bytes 2-5 are X/Y/wheel/AC pan (int8_t)
+ * 1. byte is the button map, followed by X/Y/wheel.
+ * X/Y are either int16_t (HID_MOUSE_16BIT) or int8_t, offsets are
+ * HID_MOUSE_RPT_X/HID_MOUSE_RPT_Y/HID_MOUSE_RPT_WHEEL.
  */
-uint8_t mouse_report[5];
+uint8_t mouse_report[HID_MOUSE_IN_RPT_LEN];
+
+/** @brief Set one relative axis in the mouse report
+ * @param offset Byte offset of this axis (HID_MOUSE_RPT_X or HID_MOUSE_RPT_Y)
+ * @param value Relative value, limited to +-HID_MOUSE_RPT_MAX */
+static void halBLEMouseAxis(uint8_t offset, int32_t value)
+{
+  if(value > HID_MOUSE_RPT_MAX) value = HID_MOUSE_RPT_MAX;
+  if(value < -HID_MOUSE_RPT_MAX) value = -HID_MOUSE_RPT_MAX;
+  mouse_report[offset] = (uint8_t)(value & 0xFF);
+  #if HID_MOUSE_16BIT
+  mouse_report[offset+1] = (uint8_t)((value >> 8) & 0xFF);
+  #endif
+}
+
+/** @brief Reset all relative values (X/Y/wheel) of the mouse report, buttons are kept */
+static void halBLEMouseClearRel(void)
+{
+  memset(&mouse_report[1],0,sizeof(mouse_report)-1);
+}
 
 
 /** @brief Currently active joystick report
@@ -194,10 +215,11 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
  */
 void halBLETask(void * params)
 {
-  hid_cmd_t rx;
+  hid_report_t rx;
   
   //Empty queue if initialized (there might be something left from last connection)
-  if(hid_ble != NULL) xQueueReset(hid_ble);
+  if(hid_ble != NULL) eventQueueReset(EVENT_QUEUE_HID_BLE);
+  hidCoalesceReset(HID_COALESCE_BLE);
   
   //check if queue is initialized
   if(hid_ble != NULL)
@@ -205,8 +227,35 @@ void halBLETask(void * params)
     while(1)
     {
       //pend on MQ, if timeout triggers, just wait again.
-      if(xQueueReceive(hid_ble,&rx,portMAX_DELAY))
+      if(eventQueueReceive(EVENT_QUEUE_HID_BLE,&rx,portMAX_DELAY))
       {
+        //coalesced mouse movement: send all pending movement
+        //(merged until now) in full X/Y reports
+        if(rx.cmd[0] == HID_COALESCE_CMD)
+        {
+          //with 16bit reports, the whole movement fits into one report
+          int32_t x,y;
+          //if we are not connected, discard the report of this marker.
+          if(sec_conn == false) 
+          {
+            while(hidCoalesceFetchMove(HID_COALESCE_BLE,HID_MOUSE_RPT_MAX,&x,&y));
+            continue;
+          }
+          while(hidCoalesceFetchMove(HID_COALESCE_BLE,HID_MOUSE_RPT_MAX,&x,&y))
+          {
+            halBLEMouseAxis(HID_MOUSE_RPT_X,x);
+            halBLEMouseAxis(HID_MOUSE_RPT_Y,y);
+            hid_dev_send_report(hidd_le_env.gatt_if, hid_conn_id,
+              HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, HID_MOUSE_IN_RPT_LEN, mouse_report);
+            halBLEMouseClearRel();
+          }
+          #if HID_REPORT_LATENCY
+          latencyRecord(LATENCY_STAGE_BLE,rx.queued);
+          latencyRecord(LATENCY_STAGE_TOTAL,rx.timestamp);
+          #endif
+          continue;
+        }
+        
         //if we are not connected, discard.
         if(sec_conn == false) continue;
         
@@ -223,13 +272,12 @@ void halBLETask(void * params)
                 break;
               //mouse X/Y report
               case 1:
-                mouse_report[1] = rx.cmd[1];
-                mouse_report[2] = rx.cmd[2];
+                halBLEMouseAxis(HID_MOUSE_RPT_X,(int8_t)rx.cmd[1]);
+                halBLEMouseAxis(HID_MOUSE_RPT_Y,(int8_t)rx.cmd[2]);
                 hid_dev_send_report(hidd_le_env.gatt_if, hid_conn_id,
                   HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, HID_MOUSE_IN_RPT_LEN, mouse_report);
-                //reset the mouse_report's relative values (X/Y/wheel/pan)
-                mouse_report[1] = 0;
-                mouse_report[2] = 0;
+                //reset the mouse_report's relative values (X/Y/wheel)
+                halBLEMouseClearRel();
                 break;
               default: break;
             }
@@ -240,13 +288,13 @@ void halBLETask(void * params)
             switch(rx.cmd[0] & 0x0F)
             {
               case 0: //move X
-                mouse_report[1] = rx.cmd[1];
+                halBLEMouseAxis(HID_MOUSE_RPT_X,(int8_t)rx.cmd[1]);
                 break;
               case 1: //move Y
-                mouse_report[2] = rx.cmd[1];
+                halBLEMouseAxis(HID_MOUSE_RPT_Y,(int8_t)rx.cmd[1]);
                 break;
               case 2: //move wheel
-                mouse_report[3] = rx.cmd[1];
+                mouse_report[HID_MOUSE_RPT_WHEEL] = rx.cmd[1];
                 break;
               /* Press & release */
               case 3: //left
@@ -306,11 +354,8 @@ void halBLETask(void * params)
             }
             hid_dev_send_report(hidd_le_env.gatt_if, hid_conn_id,
               HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, HID_MOUSE_IN_RPT_LEN, mouse_report);
-            //reset the mouse_report's relative values (X/Y/wheel/pan)
-            mouse_report[1] = 0;
-            mouse_report[2] = 0;
-            mouse_report[3] = 0;
-            mouse_report[4] = 0;
+            //reset the mouse_report's relative values (X/Y/wheel)
+            halBLEMouseClearRel();
             break;
           //Keyboard handling
           case 0x20:
@@ -462,6 +507,11 @@ void halBLETask(void * params)
               HID_RPT_ID_JOY_IN, HID_REPORT_TYPE_INPUT, HID_JOYSTICK_IN_RPT_LEN, joystick_report);
             break;
           }   
+        #if HID_REPORT_LATENCY
+        //latency: queue & transmit, complete path from the origin
+        latencyRecord(LATENCY_STAGE_BLE,rx.queued);
+        latencyRecord(LATENCY_STAGE_TOTAL,rx.timestamp);
+        #endif
       }
     }
   } else {
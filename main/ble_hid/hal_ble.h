@@ -29,6 +29,7 @@
 #include <esp_log.h>
 #include <keyboard.h>
 #include "common.h"
+#include "hid_coalesce.h"
 
 #include "esp_bt.h"
 #include "esp_bt_defs.h"
@@ -44,7 +45,7 @@
 #define TASK_BLE_STACKSIZE 2048
 
 /** @brief Queue for sending mouse/keyboard/joystick reports
- * @see hid_cmd_t */
+ * @see hid_report_t */
 extern QueueHandle_t hid_ble;
 
 /** @brief Activate/deactivate pairing mode
@@ -232,8 +232,38 @@ typedef uint8_t consumer_cmd_t;
 // HID LED output report length
 #define HID_LED_OUT_RPT_LEN         1
 
-// HID mouse input report length
+/** @brief Use 16bit relative X/Y axes for the BLE mouse report
+ *
+ * If set to 1, X & Y are sent as int16_t (little endian), followed by an
+ * 8bit wheel. One report can carry a whole (coalesced) movement, instead of
+ * splitting it into several saturated 8bit reports.
+ * If set to 0 (default), the classic 8bit X/Y/wheel report is used.
+ * @note Hosts cache the report map, a changed setting requires a new pairing.
+ * Therefore, the 8bit report stays the default for already paired hosts.
+ * */
+#ifndef HID_MOUSE_16BIT
+#define HID_MOUSE_16BIT             0
+#endif
+
+#if HID_MOUSE_16BIT
+// HID mouse input report length (buttons, X lo/hi, Y lo/hi, wheel)
+#define HID_MOUSE_IN_RPT_LEN        6
+// Byte offsets of the relative values in the mouse report
+#define HID_MOUSE_RPT_X             1
+#define HID_MOUSE_RPT_Y             3
+#define HID_MOUSE_RPT_WHEEL         5
+// Maximum value per axis in one report
+#define HID_MOUSE_RPT_MAX           32767
+#else
+// HID mouse input report length (buttons, X, Y, wheel, pan)
 #define HID_MOUSE_IN_RPT_LEN        5
+// Byte offsets of the relative values in the mouse report
+#define HID_MOUSE_RPT_X             1
+#define HID_MOUSE_RPT_Y             2
+#define HID_MOUSE_RPT_WHEEL         3
+// Maximum value per axis in one report
+#define HID_MOUSE_RPT_MAX           127
+#endif
 
 // HID consumer control input report length
 #define HID_CC_IN_RPT_LEN           2
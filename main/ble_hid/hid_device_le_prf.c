@@ -59,6 +59,21 @@ static const uint8_t hidReportMap[] = {
     0x95, 0x01,  //     Report Count (1)
     0x81, 0x01,  //     Input (Constant) - Padding or Reserved bits
     0x05, 0x01,  //     Usage Page (Generic Desktop)
+#if HID_MOUSE_16BIT
+    0x09, 0x30,  //     Usage (X)
+    0x09, 0x31,  //     Usage (Y)
+    0x16, 0x01, 0x80,  //     Logical Minimum (-32767)
+    0x26, 0xFF, 0x7F,  //     Logical Maximum (32767)
+    0x75, 0x10,  //     Report Size (16)
+    0x95, 0x02,  //     Report Count (2)
+    0x81, 0x06,  //     Input (Data, Variable, Relative) - X & Y coordinate
+    0x09, 0x38,  //     Usage (Wheel)
+    0x15, 0x81,  //     Logical Minimum (-127)
+    0x25, 0x7F,  //     Logical Maximum (127)
+    0x75, 0x08,  //     Report Size (8)
+    0x95, 0x01,  //     Report Count (1)
+    0x81, 0x06,  //     Input (Data, Variable, Relative) - Wheel
+#else
     0x09, 0x30,  //     Usage (X)
     0x09, 0x31,  //     Usage (Y)
     0x09, 0x38,  //     Usage (Wheel)
@@ -67,6 +82,7 @@ static const uint8_t hidReportMap[] = {
     0x75, 0x08,  //     Report Size (8)
     0x95, 0x03,  //     Report Count (3)
     0x81, 0x06,  //     Input (Data, Variable, Relative) - X & Y coordinate
+#endif
     0xC0,        //   End Collection
     0xC0,        // End Collection
 
@@ -30,6 +30,8 @@
  * 
  * */
 #include "config_switcher.h"
+#include "fct_infrared.h"
+#include "handler_hid.h"
 
 /** @brief Tag for ESP_LOG logging */
 #define LOG_TAG "cfgsw"
@@ -40,6 +42,9 @@
  * @see configSwitcherTask */
 #define CONFIGSWITCHERTASK_PERMANENT_STACKSIZE 4096
 
+/** @brief Maximum time to wait for task_commands processing a slot loaded from AT text [ms] */
+#define CONFIGSWITCHER_TEXT_TIMEOUT_MS 2000
+
 /** @brief Task handle for the config switcher */
 TaskHandle_t configswitcher_handle;
 
@@ -129,12 +134,78 @@ esp_err_t configUpdate(TickType_t time)
   if(currentConfigLoaded.usb_active != 0)  xEventGroupSetBits(connectionRoutingStatus,DATATO_USB);
   else xEventGroupClearBits(connectionRoutingStatus,DATATO_USB);
   
+  //button learning (AT BL) needs events of all mouthpiece directions,
+  //even without an assigned command. Strong sip/puff VBs are not
+  //published, the ADC task would enter strong mode instead of sending them.
+  if(currentConfigLoaded.button_learn != 0)
+  {
+    vbUsagePublish(VB_USAGE_LEARN,VB_USAGE_BIT(VB_UP) | VB_USAGE_BIT(VB_DOWN) | \
+      VB_USAGE_BIT(VB_LEFT) | VB_USAGE_BIT(VB_RIGHT));
+  } else vbUsagePublish(VB_USAGE_LEARN,0);
+  
   //reset HID channels (USB&BLE)
   halBLEReset(0);
   halSerialReset(0);
   return ESP_OK;
 }
 
+/** @brief Build & store the binary image of a slot loaded from AT text
+ * 
+ * Slots stored by an older firmware (or with an image of another version)
+ * are loaded from their AT text once, afterwards the image is used.
+ * @note Call only after all AT commands of this slot are processed.
+ * @param slotnumber Number of the loaded slot
+ * */
+static void configStoreImage(uint8_t slotnumber)
+{
+  uint32_t tid = 0;
+  char slotname[SLOTNAME_LENGTH+1];
+  uint8_t *image = NULL;
+  uint32_t len = 0;
+  
+  if(halStorageStartTransaction(&tid,100,LOG_TAG) != ESP_OK) return;
+  if(halStorageGetNameForNumber(tid,slotnumber,slotname) == ESP_OK && \
+    slotImageBuild(slotname,&image,&len) == ESP_OK)
+  {
+    halStorageStoreImage(tid,slotnumber,image,len);
+    free(image);
+  }
+  halStorageFinishTransaction(tid);
+}
+
+/** @brief Reset the per-slot settings to their defaults before loading a slot
+ * 
+ * These settings are stored by storeSlot, but slots stored by an older
+ * firmware do not contain them. Without a reset, such slots would use
+ * the values of the previously loaded slot.
+ * */
+static void configResetSlotDefaults(void)
+{
+  adc_config_t *adc = &currentConfigLoaded.adc;
+  
+  //gestures (AT GE), no gesture is defined
+  memset(currentConfigLoaded.gestures,0,sizeof(currentConfigLoaded.gestures));
+  //hysteresis bands (AT HY), default is the bare threshold
+  memset(adc->hyst_enter,0,sizeof(adc->hyst_enter));
+  memset(adc->hyst_exit,0,sizeof(adc->hyst_exit));
+  //sample rates (AT SF, AT SI) & on-the-fly calibration (AT OC, AT OT)
+  adc->rate_active = HAL_ADC_RATE_ACTIVE;
+  adc->rate_idle = HAL_ADC_RATE_IDLE;
+  adc->otf_count = HAL_IO_ADC_OTF_COUNT;
+  adc->otf_idle = HAL_IO_ADC_OTF_THRESHOLD;
+  //filter pipeline (AT FM, AT FI, AT FC, AT FS), all stages off
+  adc->filter_median = 0;
+  adc->filter_iir = 0;
+  adc->filter_oe_mincutoff = 0;
+  adc->filter_oe_beta = 0;
+  //joystick mode (AT JA, AT JE): X/Y axis, any change is sent
+  adc->axis = 0;
+  adc->joystick_epsilon = 0;
+  //strong sip/puff mode (AT SD, AT ST)
+  adc->strong_delay = HAL_ADC_DELAY_STRONGMODE;
+  adc->strong_timeout = HAL_ADC_TIMEOUT_STRONGMODE;
+}
+
 /** @brief TASK - Config switcher task, internal config reloading
  * 
  * This task is used to change the full configuration of this device
@@ -175,7 +246,7 @@ void configSwitcherTask(void * params)
       }
       //signal system that we are updating config now.
       xEventGroupSetBits(systemStatus, SYSTEM_LOADCONFIG);
-      xEventGroupClearBits(systemStatus, SYSTEM_STABLECONFIG);
+      xEventGroupClearBits(systemStatus, SYSTEM_STABLECONFIG | SYSTEM_SLOT_CMDS_DONE);
       
       //request storage access
       while(halStorageStartTransaction(&tid,100,LOG_TAG) != ESP_OK)
@@ -185,6 +256,10 @@ void configSwitcherTask(void * params)
       }
       //just to be sure: normally we are not updating...
       justupdate = 0;
+      //measure the slot switch duration (AT LT, slottext/slotimage)
+      uint32_t started = latencyNow();
+      //reset all settings which are not contained in older slots
+      configResetSlotDefaults();
       
       //command received, load new slot:
       //__NEXT, __PREV, __DEFAULT, __UPDATE, __RESTOREFACTORY
@@ -242,14 +317,30 @@ void configSwitcherTask(void * params)
       ESP_LOGD(LOG_TAG,"storage");
       
       //now we wait for finished processing of AT commands.
-      if((xEventGroupWaitBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE, \
-        pdFALSE,pdFALSE,10) & SYSTEM_EMPTY_CMD_QUEUE) == 0)
+      //an image is already installed, an AT text might take longer:
+      //wait for the end marker of this slot (the command queue might be
+      //empty before the first command is parsed).
+      uint8_t image = halStorageLoadedImage();
+      EventBits_t done = (image || ret != ESP_OK) ? SYSTEM_EMPTY_CMD_QUEUE : SYSTEM_SLOT_CMDS_DONE;
+      TickType_t wait = image ? 10 : CONFIGSWITCHER_TEXT_TIMEOUT_MS/portTICK_PERIOD_MS;
+      if((xEventGroupWaitBits(systemStatus,done, \
+        pdFALSE,pdFALSE,wait) & done) == 0)
       {
         ESP_LOGW(LOG_TAG,"command queue not emptied in time!");
+      } else if(ret == ESP_OK) {
+        uint32_t us = latencyRecord(image ? LATENCY_STAGE_SLOT_IMAGE : LATENCY_STAGE_SLOT_TEXT,started) - started;
+        ESP_LOGI(LOG_TAG,"Slot switch (%s): %uus",image ? "image" : "AT text",us);
+        //the next switch to this slot should use an image
+        if(image == 0) configStoreImage(slotnr - 1);
       }
+      //load all IR commands of this slot, button presses must not wait for the storage
+      fct_infrared_warm();
       
       ESP_LOGD(LOG_TAG,"wait for cmds");
       
+      //compile HID commands, if the end marker was not processed in time
+      handler_hid_commit();
+      
       //calibrate
       halAdcCalibrate();
       
@@ -37,6 +37,7 @@
 #include "esp_log.h"
 #include "common.h"
 #include "tones.h"
+#include "latency.h"
 
 //include all hal tasks, making config structs available
 #include "hal_adc.h"
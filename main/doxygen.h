@@ -28,21 +28,22 @@
  * the following way:<br>
  * * A triggered action will be sent to the debouncer (via the debouncer_in queue)
  * * The debouncer will start an esp_timer (has a much higher resolution than the FreeRTOS SW timers)
- * * After the timer has expired, an esp_event will be sent (event base: VB_EVENT; event id: vb_event_t)
- * * Each handler is registered to this event loop and will receive these events.
+ * * After the timer has expired, the event (vb_event_t & vb_event_data_t) is posted to vb_dispatch
+ * * Each handler is registered as sink to vb_dispatch, with its own queue & task, and will receive these events.
  * * If a handler has an active action for this triggered VB, it will be sent.
  * 
  * Currently, there are 2 different handlers implemented:
  * * handler_hid: handles all HID related actions (they are sent to the LPC chip via I2C)
  * * handler_vb: handles all other actions (infrared, house-keeping, slot switching,...)
  * 
- * @note Currently, we are using the system event loop. This might be changed to an extra event loop
+ * @note The system event loop is not used for VB events, a full sink queue or a failed
+ * handler is counted per sink (AT VS).
  * 
  * @see handler_hid
  * @see handler_vb
  * @see vb_event_t
  * @see debouncer_in
- * @see VB_EVENT
+ * @see vb_dispatch.h
  */
  
 /** @defgroup cmdchain Activating a VB in handler_hid/handler_vb
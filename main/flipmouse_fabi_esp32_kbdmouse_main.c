@@ -54,9 +54,6 @@
 /** @brief Logging tag for this module */
 #define LOG_TAG "app_main"
 
-/** @brief Defining a new event base for VB actions */
-ESP_EVENT_DEFINE_BASE(VB_EVENT);
-
 
 EventGroupHandle_t connectionRoutingStatus;
 EventGroupHandle_t systemStatus;
@@ -136,13 +133,18 @@ void app_main()
         xEventGroupSetBits(systemStatus, SYSTEM_STABLECONFIG | SYSTEM_EMPTY_CMD_QUEUE);
         //queues
         config_switcher = xQueueCreate(5,sizeof(char)*SLOTNAME_LENGTH);
-        hid_ble = xQueueCreate(32,sizeof(hid_cmd_t));
-        hid_usb = xQueueCreate(32,sizeof(hid_cmd_t));
-        debouncer_in = xQueueCreate(32,sizeof(raw_action_t));
+        //instrumented event queues (see AT QS / AT QD)
+        hid_ble = eventQueueCreate(EVENT_QUEUE_HID_BLE,HID_QUEUE_CAPACITY,HID_QUEUE_DEPTH,sizeof(hid_report_t));
+        hid_usb = eventQueueCreate(EVENT_QUEUE_HID_USB,HID_QUEUE_CAPACITY,HID_QUEUE_DEPTH,sizeof(hid_report_t));
+        debouncer_in = eventQueueCreate(EVENT_QUEUE_DEBOUNCER,EVENT_QUEUE_CAPACITY, \
+          EVENT_QUEUE_DEPTH_DEFAULT,sizeof(raw_action_t));
         
     //exit critical section & resume all tasks for initialising
     xTaskResumeAll();
     
+    //IR command cache, used by hal_storage & fct_infrared
+    if(irCacheInit() != ESP_OK) ESP_LOGE(LOG_TAG,"error initializing IR cache");
+    
     //start IO continous task
     if(halIOInit() == ESP_OK)
     {
@@ -41,6 +41,8 @@
 #include <esp_event.h>
 
 #include "keyboard.h"
+#include "gesture.h"
+#include "event_queue.h"
 #include "driver/rmt.h"
 
 /** @brief Enable v2.5 compatibility
@@ -134,6 +136,14 @@
 /** @brief AT command queue is empty */
 #define SYSTEM_EMPTY_CMD_QUEUE (1<<2)
 
+/** @brief All AT commands of a loaded slot (text) are processed.
+ * Cleared by config_switcher before loading a slot, set by task_commands
+ * on receiving the end marker, queued by halStorageLoadNumber after the
+ * last AT command of the slot.
+ * @see HAL_SERIAL_ATCMD_END
+ * */
+#define SYSTEM_SLOT_CMDS_DONE (1<<3)
+
 /** @brief This flag group is used to determine the routing
  * of different data to either USB, BLE or both, as well as the wifi status. 
  * 
@@ -153,12 +163,15 @@ extern EventGroupHandle_t connectionRoutingStatus;
  * @see SYSTEM_LOADCONFIG
  * @see SYSTEM_STABLECONFIG
  * @see SYSTEM_EMPTY_CMD_QUEUE
+ * @see SYSTEM_SLOT_CMDS_DONE
 */
 extern EventGroupHandle_t systemStatus;
 
-/** @brief Queue for sending HID commands to USB */
+/** @brief Queue for sending HID commands (hid_report_t) to USB
+ * @note Send via eventQueueSend(EVENT_QUEUE_HID_USB,...) */
 extern QueueHandle_t hid_usb;
-/** @brief Queue for sending HID commands to BLE */
+/** @brief Queue for sending HID commands (hid_report_t) to BLE
+ * @note Send via eventQueueSend(EVENT_QUEUE_HID_BLE,...) */
 extern QueueHandle_t hid_ble;
 
 /** @brief Queue to receive config changing commands. 
@@ -188,9 +201,10 @@ extern QueueHandle_t config_switcher;
  * an element of type raw_action_t can be sent to this queue.
  * The debouncer will get these elements & start the debouncing timer
  * accordingly. If the time has passed, the event will be dispatched
- * via the system event loop.
+ * to all handlers via vb_dispatch.
+ * @note Send via eventQueueSend(EVENT_QUEUE_DEBOUNCER,...)
  * @see raw_action_t
- * @see VB_EVENT
+ * @see vbDispatchPost
  * @see VB_PRESS_EVENT
  * @see VB_RELEASE_EVENT
  * */
@@ -302,12 +316,25 @@ extern QueueHandle_t debouncer_in;
  * immediately, instead of attaching it to a VB. */
 #define VB_SINGLESHOT   32
 
-/** @brief Event ID for the event loop of press/release events for VBs
+/** @brief Count of gesture VBs
+ * 
+ * Each gesture (see AT GE, gesture.h) is signalled as an own VB,
+ * numbered after all physical VBs: VB_GESTURE_FIRST to VB_MAX_ALL-1.
+ * @note VB_MAX_ALL must be smaller than VB_SINGLESHOT & VB_USAGE_MAX */
+#define VB_GESTURE_COUNT  GESTURE_MAX
+
+/** @brief First gesture VB */
+#define VB_GESTURE_FIRST  VB_MAX
+
+/** @brief Count of all VBs (physical & gesture VBs), used by the command handlers */
+#define VB_MAX_ALL        (VB_MAX + VB_GESTURE_COUNT)
+
+/** @brief Type of press/release events for VBs
  * 
  * If there is a button pressed, the sip/puff is triggered,..., an event
- * will be posted (by the debouncer) to the system event queue.
- * Any task can subscribe to these events, currently these are task_vb
- * and task_hid.
+ * will be posted (by the debouncer) to vb_dispatch.
+ * Any handler can register as sink for these events, currently these are
+ * handler_vb and handler_hid.
  * @note This enum is used for sending an action to the debouncer as well.*/
 typedef enum {
   /** Press event issued */
@@ -318,14 +345,15 @@ typedef enum {
 
 
 
-/** @brief Declaring a new event base for VB actions */
-ESP_EVENT_DECLARE_BASE(VB_EVENT);
-
 /*++++ TASK PRIORITY ASSIGNMENT ++++*/
 /** @brief ADC task priority. Not high. */
 #define HAL_ADC_TASK_PRIORITY     (tskIDLE_PRIORITY + 5)
 /** @brief Debouncer task priority. Highest priority (for short response time) */
 #define DEBOUNCER_TASK_PRIORITY  (configMAX_PRIORITIES)
+/** @brief HID handler (vb_dispatch sink) priority. High, directly below the debouncer */
+#define HANDLER_HID_TASK_PRIORITY  (configMAX_PRIORITIES - 2)
+/** @brief VB handler (vb_dispatch sink) priority. Slow actions (macros, IR), below the command parser */
+#define HANDLER_VB_TASK_PRIORITY  (tskIDLE_PRIORITY + 4)
 /** @brief BLE task priority. Not high. */
 #define HAL_BLE_TASK_PRIORITY_BASE  (tskIDLE_PRIORITY + 2)
 /** @brief Config switcher task priority. Higher than basic tasks. */
@@ -358,6 +386,7 @@ typedef enum mouthpiece_mode {
     *              * deadzone_x/y
     *              * sensitivity_x/y
     *              * axis
+    *              * joystick_epsilon
     */
   JOYSTICK, 
   /** Mouthpiece triggers virtual buttons <br>
@@ -367,6 +396,23 @@ typedef enum mouthpiece_mode {
     */
   THRESHOLD} mouthpiece_mode_t;
 
+/** @brief Channels with a hysteresis band (threshold mode directions & pressure levels)
+ * 
+ * Index into adc_config_t's hyst_enter & hyst_exit.
+ * @see adc_config_t */
+typedef enum adc_hyst_channel {
+  ADC_HYST_UP,
+  ADC_HYST_DOWN,
+  ADC_HYST_LEFT,
+  ADC_HYST_RIGHT,
+  ADC_HYST_SIP,
+  ADC_HYST_PUFF,
+  ADC_HYST_STRONGSIP,
+  ADC_HYST_STRONGPUFF,
+  /** @brief Count of channels, no valid channel */
+  ADC_HYST_MAX
+} adc_hyst_channel_t;
+
 /**
  * @brief Config for the ADC task & the analog mode of operation
  * 
@@ -402,8 +448,10 @@ typedef struct adc_config {
   uint16_t threshold_strongpuff;
   /** Enable report RAW values (!=0), values are sent via halSerialSendUSBSerial */
   uint8_t reportraw;
-  /** joystick axis assignment TBD: assign axis to numbers*/
+  /** joystick axis assignment: 0 = X/Y, 1 = Z/Z-rotate, 2 = slider left/right */
   uint8_t axis;
+  /** joystick mode, minimum change of an axis value before it is sent again (0 = any change) */
+  uint8_t joystick_epsilon;
   /** FLipMouse orientation, 0,90,180 or 270° */
   uint16_t orientation;
   /** On-the-fly calibration, count of idle events before triggering calibration */
@@ -411,6 +459,30 @@ typedef struct adc_config {
   /** On-the-fly calibration, level of detecting idle (all raw values need to change less
    * than this value to be detected as idle) */
   uint8_t otf_idle;
+  /** Strong sip/puff mode, delay [ms] before a mouthpiece movement triggers a strong sip/puff + direction VB */
+  uint16_t strong_delay;
+  /** Strong sip/puff mode, timeout [ms] for leaving the strong mode without any action */
+  uint16_t strong_timeout;
+  /** Sample rate [Hz] while the mouthpiece is in use */
+  uint16_t rate_active;
+  /** Sample rate [Hz] while the mouthpiece is idle (detected via otf_idle) */
+  uint8_t rate_idle;
+  /** Filter pipeline, median window size for spike rejection (0 = off, 3/5/7) */
+  uint8_t filter_median;
+  /** Filter pipeline, IIR smoothing factor (0 = off, 1-255; higher is smoother) */
+  uint8_t filter_iir;
+  /** Filter pipeline, 1€ filter minimum cutoff frequency [0.1Hz] (0 = off) */
+  uint8_t filter_oe_mincutoff;
+  /** Filter pipeline, 1€ filter speed coefficient [mHz per count/s] */
+  uint8_t filter_oe_beta;
+  /** Hysteresis, enter threshold per channel: a VB is pressed if the value exceeds
+   * the channel's threshold (deadzone for directions, sip/puff thresholds) by more than this value.
+   * @see adc_hyst_channel_t */
+  uint8_t hyst_enter[ADC_HYST_MAX];
+  /** Hysteresis, exit threshold per channel: a pressed VB is released if the value
+   * exceeds the channel's threshold by this value or less (<= hyst_enter).
+   * @see adc_hyst_channel_t */
+  uint8_t hyst_exit[ADC_HYST_MAX];
 } adc_config_t;
 
 /** @brief Type of VB command
@@ -470,6 +542,9 @@ typedef struct generalConfig {
   uint16_t debounce_release_vb[VB_MAX];
   /** @brief Anti-tremor (debounce) time for idle of each VB */
   uint16_t debounce_idle_vb[VB_MAX];
+  /** @brief Gesture definitions, gesture n is signalled as VB_GESTURE_FIRST+n
+   * @see gesture.h */
+  gesture_cfg_t gestures[VB_GESTURE_COUNT];
   /** @brief Slotname of this config */
   char slotName[SLOTNAME_LENGTH];
 } generalConfig_t;
@@ -535,6 +610,58 @@ typedef struct hid_cmd {
   struct hid_cmd *next;
 } hid_cmd_t;
 
+/** @brief Carry latency timestamps in each hid_report_t
+ * 
+ * By default, hid_report_t contains only the command & flags (4 bytes)
+ * and the usb/ble/total stages of the latency measurement (AT LT) are
+ * not recorded. If set to 1, each report carries two timestamps
+ * (12 bytes) and the HID queues get a third of the elements.
+ * @see latency.h */
+#ifndef HID_REPORT_LATENCY
+#define HID_REPORT_LATENCY 0
+#endif
+
+/** @brief Memory of one HID queue [bytes]
+ * 
+ * Same as before hid_report_t was used: 32 elements of hid_cmd_t
+ * (12 bytes with 32bit pointers). */
+#define HID_QUEUE_BYTES (32*12)
+
+/** @brief Allocated element count of hid_usb & hid_ble (maximum depth, AT QD)
+ * 
+ * 96 with 4 byte reports, 32 with latency timestamps. */
+#define HID_QUEUE_CAPACITY (HID_QUEUE_BYTES / sizeof(hid_report_t))
+
+/** @brief Default depth of hid_usb & hid_ble
+ * @note Limited to HID_QUEUE_CAPACITY by eventQueueCreate */
+#define HID_QUEUE_DEPTH 64
+
+/** @brief Flag in hid_report_t.flags: command of a VB press action */
+#define HID_REPORT_PRESS 0x80
+
+/** @brief Mask for the VB number in hid_report_t.flags (0 for direct commands) */
+#define HID_REPORT_VB_MASK 0x7F
+
+/** @brief One HID command, sent via hid_usb/hid_ble to the USB/BLE HAL
+ * 
+ * In contrast to hid_cmd_t (element of a command chain), this type
+ * contains only the data needed by the consumer tasks
+ * (halSerialHIDTask, halBLETask). No pointers are copied into the queues.
+ * @see hid_cmd_t */
+typedef struct hid_report {
+  /** @brief Command to be sent, same as hid_cmd_t.cmd */
+  uint8_t cmd[3];
+  /** @brief Flags: HID_REPORT_PRESS & the VB number (HID_REPORT_VB_MASK) */
+  uint8_t flags;
+  #if HID_REPORT_LATENCY
+  /** @brief Timestamp of the origin of this command, 0 if not measured.
+   * @see latency.h */
+  uint32_t timestamp;
+  /** @brief Timestamp of queueing this command to hid_usb/hid_ble */
+  uint32_t queued;
+  #endif
+} hid_report_t;
+
 /** @brief State of IR receiver
  * @see TASK_HAL_IR_RECEV_MINIMUM_EDGES
  * @see TASK_HAL_IR_RECV_MAXIMUM_EDGES*/
@@ -563,6 +690,14 @@ typedef struct halIOIR {
   irstate_t status;
 } halIOIR_t;
 
+/** @brief Byte budget of the IR command cache (RMT items of all cached commands)
+ * @see ir_cache.h */
+#define IR_CACHE_BYTES 8192
+
+/** @brief Maximum count of commands in the IR command cache
+ * @see ir_cache.h */
+#define IR_CACHE_ENTRIES 16
+
 /** @brief RAW VB action type, sent to debouncer_in queue.
  * @see debouncer_in
  */
@@ -572,11 +707,24 @@ typedef struct raw_action {
   uint32_t vb;
   /** @brief Type of event */
   vb_event_t type;
-  /** @brief Any additional payload.
-   * @note Currently unused. Might be used in future versions */
-  void *payload;
+  /** @brief Timestamp of the origin (ISR/ADC sample) for latency measurement.
+   * @note Set via latencyNow, 0 if not measured.
+   * @see latency.h */
+  uint32_t timestamp;
 } raw_action_t;
 
+/** @brief Event data of a VB event, posted by the debouncer to vb_dispatch
+ * @note vb is the first member, handlers may read the VB number as uint32_t
+ * @see raw_action_t */
+typedef struct vb_event_data {
+  /** @brief VB number */
+  uint32_t vb;
+  /** @brief Timestamp of the origin, see raw_action_t.timestamp */
+  uint32_t timestamp;
+  /** @brief Timestamp of posting this event (end of debouncing) */
+  uint32_t posted;
+} vb_event_data_t;
+
 /** @brief Strips away \\r\\t and \\n */
 void strip(char *s);
 
@@ -29,6 +29,7 @@
  * @see hal_io.c
  */
 #include "fct_infrared.h"
+#include "handler_vb.h"
 
 /** @brief Logging tag for this module */
 #define LOG_TAG "fct_IR"
@@ -39,7 +40,11 @@
  * This task is used to trigger an IR command on a VB action.
  * The IR command which should be sent is identified by a name.
  * 
+ * The command is taken from the IR cache (no storage access). If it is
+ * not cached, it is loaded from storage and added to the cache.
+ * 
  * @see taskInfraredConfig_t
+ * @see ir_cache.h
  * @param param Task config
  * @see VB_SINGLESHOT
  * */
@@ -49,20 +54,32 @@ void fct_infrared_send(char* cmdName)
   halIOIR_t *cfg = malloc(sizeof(halIOIR_t));
   //transaction ID for IR data
   uint32_t tid;
+  if(cfg == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"IR cfg is NULL!");
+    return;
+  }
+  
+  //cached: send without touching the storage
+  if(irCacheGet(cmdName,&cfg->buffer,&cfg->count) == ESP_OK)
+  {
+    ESP_LOGI(LOG_TAG,"Triggering cached IR cmd, length %d",cfg->count);
+    //buffer is freed by SENDIR
+    SENDIRSTRUCT(cfg);
+    free(cfg);
+    TONE(TONE_IR_SEND_FREQ,TONE_IR_SEND_DURATION);
+    return;
+  }
+  
   if(halStorageStartTransaction(&tid,20,LOG_TAG) == ESP_OK)
   {
     if(halStorageLoadIR(cmdName,cfg,tid) == ESP_OK)
     {
+      //next press is served from the cache
+      irCachePut(cmdName,cfg->buffer,cfg->count);
       //send pointer to IR send queue
-      if(cfg != NULL)
-      {
-        ESP_LOGI(LOG_TAG,"Triggering IR cmd, length %d",cfg->count);
-        SENDIRSTRUCT(cfg);
-        //free config afterwards (whole config is saved to queue)
-        free(cfg);
-      } else {
-        ESP_LOGE(LOG_TAG,"IR cfg is NULL!");
-      }
+      ESP_LOGI(LOG_TAG,"Triggering IR cmd, length %d",cfg->count);
+      SENDIRSTRUCT(cfg);
       //create tone
       TONE(TONE_IR_SEND_FREQ,TONE_IR_SEND_DURATION);
     } else {
@@ -72,6 +89,53 @@ void fct_infrared_send(char* cmdName)
   } else {
     ESP_LOGE(LOG_TAG,"Error starting transaction for IR cmd");
   }
+  //free config afterwards (whole config is saved to queue)
+  free(cfg);
+}
+
+/**@brief FUNCTION - Load all IR commands of the current slot into the IR cache
+ * 
+ * Called after a slot is loaded, so the first press of a button with an
+ * IR command (T_SENDIR) does not need a storage access either.
+ * IR commands which are already cached are not loaded again.
+ * 
+ * @see ir_cache.h
+ * */
+void fct_infrared_warm(void)
+{
+  uint32_t tid = 0;
+  uint8_t loaded = 0;
+  halIOIR_t cfg;
+  
+  char (*names)[SLOTNAME_LENGTH+1] = malloc(IR_CACHE_ENTRIES*(SLOTNAME_LENGTH+1));
+  if(names == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot malloc for IR cache warming");
+    return;
+  }
+  uint8_t count = handler_vb_getIRNames(names,IR_CACHE_ENTRIES);
+  
+  for(uint8_t i = 0; i<count; i++)
+  {
+    if(irCacheContains(names[i])) continue;
+    //only start a transaction if anything needs to be loaded
+    if(tid == 0 && halStorageStartTransaction(&tid,100,LOG_TAG) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"Error starting transaction for IR cache");
+      tid = 0;
+      break;
+    }
+    if(halStorageLoadIR(names[i],&cfg,tid) == ESP_OK)
+    {
+      if(irCachePut(names[i],cfg.buffer,cfg.count) == ESP_OK) loaded++;
+      free(cfg.buffer);
+    } else {
+      ESP_LOGW(LOG_TAG,"IR cmd %s of this slot is not available",names[i]);
+    }
+  }
+  if(tid != 0) halStorageFinishTransaction(tid);
+  free(names);
+  ESP_LOGD(LOG_TAG,"IR cache: %d cmds in slot, %d loaded",count,loaded);
 }
 
 /** @brief FUNCTION - Trigger an IR command recording.
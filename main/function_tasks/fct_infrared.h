@@ -41,6 +41,7 @@
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "../config_switcher.h"
+#include "ir_cache.h"
 
 /**@brief FUNCTION - Set the time between two IR edges which will trigger the timeout
  * (end of received command)
@@ -78,11 +79,25 @@ esp_err_t fct_infrared_record(char* cmdName, uint8_t outputtoserial);
  * This task is used to trigger an IR command on a VB action.
  * The IR command which should be sent is identified by a name.
  * 
+ * The command is taken from the IR cache (no storage access). If it is
+ * not cached, it is loaded from storage and added to the cache.
+ * 
  * @see taskInfraredConfig_t
+ * @see ir_cache.h
  * @param param Task config
  * @see VB_SINGLESHOT
  * */
 void fct_infrared_send(char* cmdName);
 
+/**@brief FUNCTION - Load all IR commands of the current slot into the IR cache
+ * 
+ * Called after a slot is loaded, so the first press of a button with an
+ * IR command (T_SENDIR) does not need a storage access either.
+ * IR commands which are already cached are not loaded again.
+ * 
+ * @see ir_cache.h
+ * */
+void fct_infrared_warm(void);
+
 
 #endif
@@ -28,10 +28,14 @@
  * * Joystick press,hold,release & axis movement
  * 
  * handler_hid_init is initializing the mutex for adding a command to the
- * chained list and adding handler_hid to the system event queue.
+ * chained list and registering handler_hid as sink to vb_dispatch.
  *
- * @note Currently, we use the system event queue (because there is already
- * a task attached). Maybe we switch to an unique one.
+ * Commands are stored in a per-slot arena (cmd_arena.h) & compiled to a
+ * dispatch table after each change, a VB event is dispatched by one
+ * lookup of its VB & press/release (no walk through all commands).
+ *
+ * @note VB events are not received via the system event loop, handler_hid
+ * is a sink of vb_dispatch with its own (high priority) task.
  * @note Mouse/keyboard/joystick control by mouthpiece is done in hal_adc!
  * @see hal_adc
  */
@@ -43,106 +47,277 @@
 /** @brief Set a global log limit for this file */
 #define LOG_LEVEL_HID ESP_LOG_INFO
 
+/** @brief Count of dispatch table entries (press & release for each VB) */
+#define HID_TABLE_SLOTS (VB_MAX_ALL*2)
+
+/** @brief Dispatch table index of a VB number (MSB set for press) */
+#define HID_TABLE_IDX(vb) (((uint32_t)((vb) & 0x7F) << 1) | (((vb) & 0x80) ? 1 : 0))
+
+/** @brief Compiled HID commands, indexed by VB & press/release
+ * 
+ * All commands of one table index are stored contiguous in cmds
+ * (in the same order as in the command chain), from cmds[start[idx]] to
+ * cmds[start[idx+1]-1]. The table is allocated at once & never modified
+ * after it is published.
+ * @see handler_hid_compile
+ * @see cmd_table.h */
+typedef struct hid_cmd_table {
+  /** @brief First command of each table index, start[HID_TABLE_SLOTS] is the count of all commands */
+  uint16_t start[HID_TABLE_SLOTS+1];
+  /** @brief All commands, as they are sent to hid_usb/hid_ble (timestamps are 0) */
+  hid_report_t cmds[];
+} hid_cmd_table_t;
+
 /** @brief Beginning of all HID commands
  * 
  * This pointer is the beginning of the HID command chain.
- * Each time an active VB posted to the event loop, handler_hid walks through this
- * chained list for a corresponding command and sends it either to the
- * USB queue, the BLE queue or both.
+ * It is the editable form of all HID commands, stored in hidArena.
+ * Changes are compiled to cmd_table (which is used by handler_hid) by
+ * handler_hid_commit, after a batch of AT commands is processed.
  * 
  * Adding a new command is done via handler_hid_addCmd, the full list
  * is freed and cleared via handler_hid_clearCmds.
  * 
- * @see handler_hid
+ * @note Only accessed with hidCmdSem taken.
  * @see handler_hid_addCmd
  * @see handler_hid_clearCmds*/
 static hid_cmd_t *cmd_chain = NULL;
 
-/** @brief Synchronization mutex for accessing the HID command chain */
+/** @brief Link (head or next of the last element) for appending to cmd_chain
+ * @note Only accessed with hidCmdSem taken. */
+static hid_cmd_t **cmd_tail = &cmd_chain;
+
+/** @brief Set if cmd_chain was changed after compiling cmd_table
+ * @note Only accessed with hidCmdSem taken.
+ * @see handler_hid_commit */
+static uint8_t cmd_dirty = 0;
+
+/** @brief Storage for cmd_chain (elements & AT strings) of the current slot
+ * @see cmd_arena.h */
+static cmd_arena_t hidArena = CMD_ARENA_INITIALIZER;
+
+/** @brief Dispatch table of all HID commands
+ * 
+ * Each time an active VB is dispatched (vb_dispatch), handler_hid looks up
+ * the commands of this VB (press or release) in this table and sends them
+ * either to the USB queue, the BLE queue or both.
+ * 
+ * @note Published via CMD_RCU_STORE & read lock-free, see hidCmdRcu
+ * @see handler_hid
+ * @see handler_hid_compile */
+static hid_cmd_table_t *cmd_table = NULL;
+
+/** @brief Synchronization mutex for modifying the HID command chain
+ * @note handler_hid reads the dispatch table without this mutex, see hidCmdRcu */
 SemaphoreHandle_t hidCmdSem = NULL;
 
+/** @brief RCU state of the HID dispatch table
+ * 
+ * A table is never modified while published, a replaced table is
+ * freed after handler_hid left its read section.
+ * @see cmd_rcu.h */
+static cmd_rcu_t hidCmdRcu = CMD_RCU_INITIALIZER;
+
 /** @brief Bitmap for active VBs. Corresponding bit will be set, if active. 
- * @see handler_hid_active */
-static uint64_t vb_active = 0;
+ * @see handler_hid_active
+ * @see handler_hid_compile */
+static uint32_t vb_active = 0;
 
-/**
- * @brief VB event handler, triggering HID actions.
- *
- * @param event_handler_arg handler specific arguments
- * @param event_base event base, here is fixed to VB_EVENT
- * @param event_id event id, subscribed to all events
- * @param event_data Contains the VB number
- */
-static void handler_hid(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+/** @brief Copy a HID command (including the AT string) into an arena
+ * @param a Arena
+ * @param src Command to copy
+ * @return New element (next is NULL), NULL if out of memory */
+static hid_cmd_t *handler_hid_copyCmd(cmd_arena_t *a, hid_cmd_t *src)
 {
-  //if we don't have a stable config, simply return...
-  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0) return;
-  //still commands to be processed, shouldn't continue
-  if((xEventGroupGetBits(systemStatus) & SYSTEM_EMPTY_CMD_QUEUE) == 0) return;
-
-  //use the mutex to ensure a valid chained list. 
-  if(xSemaphoreTake(hidCmdSem,4) != pdTRUE)
+  hid_cmd_t *new = cmdArenaAlloc(a,sizeof(hid_cmd_t));
+  if(new == NULL) return NULL;
+  memcpy(new,src,sizeof(hid_cmd_t));
+  new->next = NULL;
+  if(src->atoriginal != NULL)
   {
-    ESP_LOGW(LOG_TAG,"HID mutex not free for handler");
-    return;
+    new->atoriginal = cmdArenaStrdup(a,src->atoriginal);
+    if(new->atoriginal == NULL)
+    {
+      cmdArenaRelease(a,sizeof(hid_cmd_t));
+      return NULL;
+    }
   }
-  //if command chain is empty, we cannot do anything.
-  if(cmd_chain == NULL) 
+  return new;
+}
+
+/** @brief Mark the arena memory of an unlinked HID command as dead
+ * @param cmd Element, unlinked from cmd_chain */
+static void handler_hid_releaseCmd(hid_cmd_t *cmd)
+{
+  if(cmd->atoriginal != NULL) cmdArenaRelease(&hidArena,strlen(cmd->atoriginal)+1);
+  cmdArenaRelease(&hidArena,sizeof(hid_cmd_t));
+}
+
+/** @brief Compact hidArena, if too much memory of removed commands is dead
+ * 
+ * All elements of cmd_chain are copied into a new arena, the old one
+ * is freed. If there is not enough memory, the old arena is kept.
+ * @note Call only with hidCmdSem taken */
+static void handler_hid_compactArena(void)
+{
+  cmd_arena_t a = CMD_ARENA_INITIALIZER;
+  hid_cmd_t *head = NULL;
+  hid_cmd_t **link = &head;
+  
+  if(hidArena.dead < HANDLER_HID_ARENA_COMPACT || hidArena.dead < hidArena.used/2) return;
+  
+  for(hid_cmd_t *current = cmd_chain; current != NULL; current = current->next)
   {
-    xSemaphoreGive(hidCmdSem);
-    return;
+    *link = handler_hid_copyCmd(&a,current);
+    if(*link == NULL)
+    {
+      ESP_LOGW(LOG_TAG,"No memory for compacting");
+      cmdArenaReset(&a);
+      return;
+    }
+    link = &(*link)->next;
   }
-  
-  uint8_t vb = 0;
+  #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Compacted arena: %d -> %d bytes",hidArena.used,a.used);
+  #endif
+  cmdArenaReset(&hidArena);
+  hidArena = a;
+  cmd_chain = head;
+  cmd_tail = (head != NULL) ? link : &cmd_chain;
+}
+
+/** @brief Compile the command chain to a new dispatch table & publish it
+ * 
+ * Called by handler_hid_commit (after a batch of changes), by
+ * handler_hid_setCmdChain & handler_hid_clearCmds. The commands are sorted
+ * by table index (counting sort, the order of one VB is kept), the
+ * table is published with one pointer store & the old one is retired.
+ * The bitmap of active VBs is published to vb_usage (combined with all
+ * other command handlers).
+ * @note Call only with hidCmdSem taken
+ * @return ESP_OK on success, ESP_FAIL if out of memory (old table is still used)
+ * @see vbUsagePublish */
+static esp_err_t handler_hid_compile(void)
+{
+  uint32_t active = 0;
   uint32_t count = 0;
-  switch(event_id)
+  hid_cmd_table_t *table = NULL;
+  hid_cmd_table_t *old;
+  hid_cmd_t *current;
+  
+  for(current = cmd_chain; current != NULL; current = current->next) count++;
+  
+  if(count != 0)
   {
-    case VB_PRESS_EVENT: vb |= 0x80; //set uppermost bit for press event.
-    case VB_RELEASE_EVENT:
-      break;
-    default: //might be another type of event, we don't care of.
-      return;
+    table = malloc(sizeof(hid_cmd_table_t) + count*sizeof(hid_report_t));
+    if(table == NULL)
+    {
+      ESP_LOGE(LOG_TAG,"No memory for dispatch table (%d cmds)",count);
+      return ESP_FAIL;
+    }
+    cmdTableInit(table->start,HID_TABLE_SLOTS);
+    //count commands per index...
+    for(current = cmd_chain; current != NULL; current = current->next)
+    {
+      cmdTableCount(table->start,HID_TABLE_IDX(current->vb));
+      if((current->vb & 0x7F) < VB_USAGE_MAX) active |= VB_USAGE_BIT(current->vb & 0x7F);
+    }
+    //...sum up to the first command of each index...
+    cmdTablePrefix(table->start,HID_TABLE_SLOTS);
+    //...and place each command
+    for(current = cmd_chain; current != NULL; current = current->next)
+    {
+      hid_report_t *dst = &table->cmds[cmdTablePlace(table->start,HID_TABLE_IDX(current->vb))];
+      memset(dst,0,sizeof(hid_report_t));
+      memcpy(dst->cmd,current->cmd,sizeof(dst->cmd));
+      dst->flags = current->vb;
+    }
+    cmdTableFinish(table->start,HID_TABLE_SLOTS);
   }
   
-  //we need an VB number as event data.
-  if(event_data == 0)
+  //publish the new table with one pointer store,
+  //the old one is freed after handler_hid is done with it.
+  old = cmd_table;
+  CMD_RCU_STORE(cmd_table,table);
+  if(old != NULL) cmdRcuRetire(&hidCmdRcu,old,free);
+  #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Compiled %d cmds, arena %d bytes (%d dead)",count,hidArena.used,hidArena.dead);
+  #endif
+  
+  vb_active = active;
+  vbUsagePublish(VB_USAGE_HID,active);
+  cmd_dirty = 0;
+  return ESP_OK;
+}
+
+/**
+ * @brief VB event sink, triggering HID actions.
+ *
+ * Called by the handler_hid task of vb_dispatch.
+ * The commands of this VB are looked up in the dispatch table, which is
+ * read lock-free (hidCmdRcu). A chain which is modified (e.g., on slot
+ * loading) never blocks this handler.
+ * @param type Press or release
+ * @param data Contains the VB number & timestamps
+ * @return ESP_OK
+ */
+static esp_err_t handler_hid(vb_event_t type, const vb_event_data_t *data)
+{
+  //if we don't have a stable config, simply return...
+  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0) return ESP_OK;
+  //still commands to be processed, shouldn't continue
+  if((xEventGroupGetBits(systemStatus) & SYSTEM_EMPTY_CMD_QUEUE) == 0) return ESP_OK;
+  //only VBs with commands are in the table
+  if((data->vb & 0x7F) >= VB_MAX_ALL) return ESP_OK;
+
+  //enter read section, the table stays valid until we leave.
+  cmdRcuReadLock(&hidCmdRcu);
+  //if the table is empty, we cannot do anything.
+  hid_cmd_table_t *table = CMD_RCU_LOAD(cmd_table);
+  if(table == NULL) 
   {
-    ESP_LOGE(LOG_TAG,"Empty event data, cannot proceed!");
-    return;
+    cmdRcuReadUnlock(&hidCmdRcu);
+    return ESP_OK;
   }
   
-  vb |= (*((uint32_t*) event_data)) & 0x7F;
-  //begin with head of chain
-  hid_cmd_t *current = cmd_chain;
-  hid_cmd_t *firsttriggered = NULL;
-  //iterate through all available hid cmds
-  while(current != NULL)
+  uint8_t vb = 0;
+  if(type == VB_PRESS_EVENT) vb |= 0x80; //set uppermost bit for press event.
+  vb |= data->vb & 0x7F;
+  //all commands for this VB (press or release) are contiguous
+  //this way, we can do more button presses on one VB (e.g. AT KW, AT KP KEY_SHIFT KEY_A)
+  uint32_t first;
+  uint32_t count = cmdTableLookup(table->start,HID_TABLE_IDX(vb),&first);
+  //copy of the command, sent with timestamps for latency measurement
+  hid_report_t tx;
+  uint32_t queued = 0;
+  //latency: posted by the debouncer until the first command is queued
+  if(count != 0) queued = latencyRecord(LATENCY_STAGE_DISPATCH,data->posted);
+  for(uint32_t i = 0; i<count; i++)
   {
-    //send HID command(s), if VB matches
-    //this way, we can do more button presses on one VB (e.g. AT KW, AT KP KEY_SHIFT KEY_A)
-    if(current->vb == vb)
-    {
-      count++;
-      //save the first triggered action for log output
-      if(firsttriggered ==NULL) firsttriggered = current;
-      if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB) 
-      { xQueueSend(hid_usb,current,2); }
-      if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE) 
-      { xQueueSend(hid_ble,current,2); }
-    }
-    current = current->next;
+    memcpy(&tx,&table->cmds[first+i],sizeof(hid_report_t));
+    #if HID_REPORT_LATENCY
+    tx.timestamp = data->timestamp;
+    tx.queued = queued;
+    #else
+    (void) queued;
+    #endif
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB) 
+    { eventQueueSend(EVENT_QUEUE_HID_USB,EVENT_SRC_HID,&tx,2); }
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE) 
+    { eventQueueSend(EVENT_QUEUE_HID_BLE,EVENT_SRC_HID,&tx,2); }
   }
   #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
   if(count == 0) ESP_LOGD(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
   #endif
   if(count != 0) ESP_LOGI(LOG_TAG,"Sent %d cmds for VB %d: 0x%02X:0x%02X:0x%02X", \
-    count, vb & 0x7F,firsttriggered->cmd[0],firsttriggered->cmd[1],firsttriggered->cmd[2]);
-  xSemaphoreGive(hidCmdSem);
+    count, vb & 0x7F,table->cmds[first].cmd[0],table->cmds[first].cmd[1],table->cmds[first].cmd[2]);
+  cmdRcuReadUnlock(&hidCmdRcu);
+  return ESP_OK;
 }
 
 /** @brief Init for the HID handler
  * 
- * We create the mutex and add handler_hid to the system event queue.
+ * We create the mutex and register handler_hid as sink to vb_dispatch.
  * @return ESP_OK on success, ESP_FAIL on an error.*/
 esp_err_t handler_hid_init(void)
 {
@@ -158,21 +333,21 @@ esp_err_t handler_hid_init(void)
   //set log level to given log level
   esp_log_level_set(LOG_TAG,LOG_LEVEL_HID);
   
-  return esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,handler_hid,NULL);
+  return vbDispatchRegister("handler_hid",handler_hid,HANDLER_HID_TASK_PRIORITY,HANDLER_HID_TASK_STACKSIZE);
 }
 
-/** @brief Remove HID command for a virtual button
- * 
- * This method removes any HID command from the list of HID commands
- * which are assigned to this VB.
+/** @brief Remove HID command for a virtual button (mutex already taken)
  * 
+ * Each matching element is unlinked, its memory is dead until the
+ * arena is compacted or reset.
+ * @note Call only with hidCmdSem taken, the chain is compiled by handler_hid_commit.
  * @param vb VB which should be removed
  * @return ESP_OK if deleted, ESP_FAIL if not in list */
-esp_err_t handler_hid_delCmd(uint8_t vb)
+static esp_err_t handler_hid_delCmdLocked(uint8_t vb)
 {
-  //existing chain, add to end
   hid_cmd_t *current = cmd_chain;
-  hid_cmd_t *prev = NULL;
+  //pointer to the link which points to current (head or previous next)
+  hid_cmd_t **link = &cmd_chain;
   uint count = 0;
   
   //do as long as we don't have a null pointer
@@ -181,31 +356,56 @@ esp_err_t handler_hid_delCmd(uint8_t vb)
     //if the VB number matches (discarding press/release flag)
     if((current->vb & 0x7F) == (vb & 0x7F))
     {
-      //set pointer from previous element to next one
-      //but only if we are not at the head (no previous element)
-      if(prev != NULL) prev->next = current->next;
-      //if no previous element -> replace 
-      else cmd_chain = current->next;
-      //free an AT string
-      if(current->atoriginal != NULL) free(current->atoriginal);
-      //free this element
-      free(current);
-      
-      //just begin at the front again (easiest way if we removed the head)
-      current = cmd_chain;
-      prev = NULL;
-      if((vb & 0x7F) <= 63) vb_active &= ~(1<<(vb & 0x7F)); //delete active flag
+      //unlink: previous element (or head) points to the next one.
+      *link = current->next;
+      handler_hid_releaseCmd(current);
+      current = *link;
       count++;
     } else { //does not match
       //set pointers to next element
-      prev = current;
+      link = &current->next;
       current = current->next;
     }
   }
-  if(count != 0) return ESP_OK;
+  //link is the next pointer of the last element now (or the head)
+  cmd_tail = link;
+  if(count != 0)
+  {
+    cmd_dirty = 1;
+    return ESP_OK;
+  }
   else return ESP_FAIL;
 }
 
+/** @brief Remove HID command for a virtual button
+ * 
+ * This method removes any HID command from the list of HID commands
+ * which are assigned to this VB.
+ * @note The dispatch table is updated by handler_hid_commit.
+ * 
+ * @param vb VB which should be removed
+ * @return ESP_OK if deleted, ESP_FAIL if not in list (or mutex not free) */
+esp_err_t handler_hid_delCmd(uint8_t vb)
+{
+  esp_err_t ret;
+  if(hidCmdSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
+    return ESP_FAIL;
+  }
+  //take mutex for modifying
+  if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"HID mutex not free for deleting");
+    return ESP_FAIL;
+  }
+  cmdRcuReclaim(&hidCmdRcu);
+  ret = handler_hid_delCmdLocked(vb);
+  if(ret == ESP_OK) handler_hid_compactArena();
+  xSemaphoreGive(hidCmdSem);
+  return ret;
+}
+
 /** @brief Add a new HID command for a virtual button
  * 
  * This method adds the given HID command to the list of HID commands
@@ -213,12 +413,16 @@ esp_err_t handler_hid_delCmd(uint8_t vb)
  * 
  * @note Highest bit determines press/release action. If set, it is a press!
  * @note If VB number is set to VB_SINGLESHOT, the command will be sent immediately.
- * @note We will malloc for each command here. To free the memory, call handler_hid_clearCmds .
+ * @note The command & its AT string are copied into the arena of this slot.
+ * newCmd->atoriginal is freed (and set to NULL) in any case.
+ * To free the memory, call handler_hid_clearCmds .
+ * @note The dispatch table is updated by handler_hid_commit.
  * @param newCmd New command to be added.
  * @param replace If set to != 0, any previously assigned command is removed from list.
  * @return ESP_OK if added, ESP_FAIL if not added (out of memory) */
 esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace)
 {
+  esp_err_t ret = ESP_OK;
   //sanitizing...
   if(newCmd == NULL)
   {
@@ -230,7 +434,7 @@ esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
     return ESP_FAIL;
   }
-  if((newCmd->vb & 0x7F) >= VB_MAX)
+  if((newCmd->vb & 0x7F) >= VB_MAX_ALL)
   {
     ESP_LOGE(LOG_TAG,"newCmd->vb out of range");
     return ESP_FAIL;
@@ -242,78 +446,71 @@ esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"HID mutex not free for adding");
     return ESP_FAIL;
   }
+  //free previously replaced tables, if handler_hid is done with them
+  cmdRcuReclaim(&hidCmdRcu);
   
-  //set pointer of next element to NULL, so we have a defined
-  //invalid pointer to check for.
-  newCmd->next = NULL;
-  
-  //existing chain, add to end
-  hid_cmd_t *current = cmd_chain;
-  int count = 0;
+  //if set, remove any previously set commands.
+  if(replace) handler_hid_delCmdLocked(newCmd->vb);
   
-  //debugging...
-  #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
-  while(current!=NULL)
+  //copy new command into the arena
+  hid_cmd_t *new = handler_hid_copyCmd(&hidArena,newCmd);
+  //the AT string is copied (or not used), free the original one
+  if(newCmd->atoriginal != NULL)
   {
-    count++;
-    ESP_LOGD(LOG_TAG,"%d:%2d:0x%X",count,current->vb,(uint32_t)current);
-    current = current->next;
+    free(newCmd->atoriginal);
+    newCmd->atoriginal = NULL;
   }
-  current = cmd_chain;
-  count = 0;
-  #endif
-  
-  //if set, remove any previously set commands.
-  if(replace) handler_hid_delCmd(newCmd->vb);
-  
-  //allocate new command
-  current = cmd_chain;
-  hid_cmd_t *new;
-  new = malloc(sizeof(*new));
   
   if(new != NULL)
   {
-    memcpy(new, newCmd, sizeof(*new));
-    //save pointer of new config to end of chain
-    new->next = NULL;
-    //use as head if the head was not here before.
-    if(cmd_chain == NULL) {
-      cmd_chain = new;
-    } else {
-      //otherwise append to the tail.
-      while(current->next != NULL)
-      {
-        #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
-        ESP_LOGD(LOG_TAG,"Nr %d, @0x%8X",count,(uint32_t)current);
-        #endif
-        count++;
-        current = current->next;
-      }
-      current->next = new;
-    }
-    if((new->vb & 0x7F) <= 63) vb_active |= (1<<(new->vb & 0x7F)); //set active flag
-    count++;
+    //append to the tail (or use as head if the chain is empty)
+    *cmd_tail = new;
+    cmd_tail = &new->next;
+    cmd_dirty = 1;
     #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
-    ESP_LOGI(LOG_TAG,"Added new cmd nr %d, new: 0x%8X, prev: 0x%8X",count,(uint32_t)new,(uint32_t)current);
+    ESP_LOGD(LOG_TAG,"Added new cmd for VB %d, new: 0x%8X",new->vb,(uint32_t)new);
     #endif
-    
-    current = new;
-    xSemaphoreGive(hidCmdSem);
-    return ESP_OK;
   } else {
     ESP_LOGE(LOG_TAG,"Cannot allocate memory for new HID cmd!");
-    xSemaphoreGive(hidCmdSem);
-    return ESP_FAIL;
+    ret = ESP_FAIL;
   }
+  
+  //commands might be removed by replacing
+  handler_hid_compactArena();
+  xSemaphoreGive(hidCmdSem);
+  return ret;
+}
 
-  //should not be here, but return ok anyway
+/** @brief Compile all changes of the command chain to the dispatch table
+ * 
+ * handler_hid_addCmd & handler_hid_delCmd only change the chain, this
+ * function compiles it once after a batch of changes (e.g., all AT
+ * commands of a slot). Nothing is done if the chain is unchanged.
+ * @return ESP_OK on success, ESP_FAIL otherwise (lock not free, out of memory) */
+esp_err_t handler_hid_commit(void)
+{
+  esp_err_t ret = ESP_OK;
+  if(hidCmdSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
+    return ESP_FAIL;
+  }
+  //take mutex for compiling
+  if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"HID mutex not free for compiling");
+    return ESP_FAIL;
+  }
+  cmdRcuReclaim(&hidCmdRcu);
+  if(cmd_dirty) ret = handler_hid_compile();
   xSemaphoreGive(hidCmdSem);
-  return ESP_OK;
+  return ret;
 }
 
 /** @brief Get current root of HID command chain
- * @warning Modifying this chain without acquiring the hidCmdSem could result in
- * undefined behaviour!
+ * @warning Reading this chain without acquiring the hidCmdSem could result in
+ * undefined behaviour (elements might be freed)! The elements are stored in
+ * the arena of this slot, never free them.
  * @return Pointer to root of HID chain
  */
 hid_cmd_t *handler_hid_getCmdChain(void)
@@ -321,26 +518,46 @@ hid_cmd_t *handler_hid_getCmdChain(void)
   return cmd_chain;
 }
 
+/** @brief Lock the HID command chain for reading via handler_hid_getCmdChain
+ * 
+ * Takes hidCmdSem, no command can be added or removed until
+ * handler_hid_unlockCmdChain is called.
+ * @return ESP_OK if locked, ESP_FAIL otherwise (lock was not free)
+ */
+esp_err_t handler_hid_lockCmdChain(void)
+{
+  if(hidCmdSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
+    return ESP_FAIL;
+  }
+  if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"cannot enter critical section");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Unlock the HID command chain (see handler_hid_lockCmdChain) */
+void handler_hid_unlockCmdChain(void)
+{
+  if(hidCmdSem != NULL) xSemaphoreGive(hidCmdSem);
+}
+
 /** @brief Set current root of HID command chain!
+ * 
+ * All elements (including the AT strings) are copied into a new arena,
+ * the given chain is still owned by the caller.
  * @warning By using this function, previously used HID commands are cleared!
  * @param chain Pointer to root of HID chain
- * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, deleting old chain failed..)
+ * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, out of memory..)
  */
 esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain)
 {
-  esp_err_t ret = ESP_OK;
-  
-  //check if chain is currently active,
-  //if yes clear it before setting a new one
-  if(cmd_chain != NULL)
-  {
-    ret = handler_hid_clearCmds();
-    if(ret != ESP_OK)
-    {
-      ESP_LOGE(LOG_TAG,"Cannot clear old chain");
-      return ret;
-    }
-  }
+  cmd_arena_t a = CMD_ARENA_INITIALIZER;
+  hid_cmd_t *head = NULL;
+  hid_cmd_t **link = &head;
   
   //enter critical section for setting new cmd chain
   if(hidCmdSem == NULL)
@@ -354,8 +571,26 @@ esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain)
     ESP_LOGE(LOG_TAG,"cannot enter critical section");
     return ESP_FAIL;
   }
-  //save the pointer
-  cmd_chain = chain;
+  cmdRcuReclaim(&hidCmdRcu);
+  //build the new chain off to the side
+  for(hid_cmd_t *current = chain; current != NULL; current = current->next)
+  {
+    *link = handler_hid_copyCmd(&a,current);
+    if(*link == NULL)
+    {
+      ESP_LOGE(LOG_TAG,"No memory for new chain");
+      cmdArenaReset(&a);
+      xSemaphoreGive(hidCmdSem);
+      return ESP_FAIL;
+    }
+    link = &(*link)->next;
+  }
+  //replace the arena of the old chain at once
+  cmdArenaReset(&hidArena);
+  hidArena = a;
+  cmd_chain = head;
+  cmd_tail = (head != NULL) ? link : &cmd_chain;
+  handler_hid_compile();
 
   //release mutex
   xSemaphoreGive(hidCmdSem);
@@ -364,7 +599,8 @@ esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain)
 
 /** @brief Clear all stored HID commands.
  * 
- * This method clears all stored HID commands and frees the allocated memory.
+ * This method clears all stored HID commands and frees the allocated memory
+ * (the arena of this slot is freed at once).
  * 
  * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
  * */
@@ -388,32 +624,15 @@ esp_err_t handler_hid_clearCmds(void)
     return ESP_FAIL;
   }
   
-  //pointers for next and current command
-  hid_cmd_t *next = NULL;
-  hid_cmd_t *current = cmd_chain;
-  int count = 0;
-  
-  do {
-    //load next block
-    next = current->next;
-    //if set, free the original AT command
-    if(current->atoriginal != NULL) free(current->atoriginal);
-    current->atoriginal = NULL;
-    //free the current one
-    free(current);
-    //count for statistics
-    count++;
-    //previous next is current for next while iteration
-    current = next;
-    //break the loop if current is NULL (we reached end of chain)
-  } while(current != NULL);
-  
+  cmdRcuReclaim(&hidCmdRcu);
   #if LOG_LEVEL_HID >= ESP_LOG_INFO
-  ESP_LOGI(LOG_TAG,"Cleared %d HID cmds",count);
+  ESP_LOGI(LOG_TAG,"Freed HID cmds, %d bytes",hidArena.used);
   #endif
-
   cmd_chain = NULL;
-  vb_active = 0;
+  cmd_tail = &cmd_chain;
+  cmdArenaReset(&hidArena);
+  //publishes an empty table, the old one is freed after handler_hid is done with it.
+  handler_hid_compile();
   //release mutex
   xSemaphoreGive(hidCmdSem);
   return ESP_OK;
@@ -485,13 +704,13 @@ esp_err_t handler_hid_getAT(char* output, uint8_t vb)
  * @note We don't care if press/release is active here. Any associated action will return true. */
 bool handler_hid_active(uint8_t vb)
 {
-  //we check for VB_MAX (firmware specfic) and 63 (size of vb_active)
-  if(vb >= VB_MAX || vb >= 63)
+  //we check for VB_MAX_ALL (firmware specfic, incl. gestures) and VB_USAGE_MAX (size of vb_active)
+  if(vb >= VB_MAX_ALL || vb >= VB_USAGE_MAX)
   {
     ESP_LOGE(LOG_TAG,"Cannot detect state of VB %d, out of range!",vb);
     return false;
   } else {
-    if((vb_active & (1<<(vb&0x7F))) != 0) return true;
+    if((vb_active & VB_USAGE_BIT(vb&0x7F)) != 0) return true;
     else return false;
   }
   return false;
@@ -28,10 +28,14 @@
  * * Joystick press,hold,release & axis movement
  * 
  * handler_hid_init is initializing the mutex for adding a command to the
- * chained list and adding handler_hid to the system event queue.
+ * chained list and registering handler_hid as sink to vb_dispatch.
  *
- * @note Currently, we use the system event queue (because there is already
- * a task attached). Maybe we switch to an unique one.
+ * Commands are stored in a per-slot arena (cmd_arena.h) & compiled to a
+ * dispatch table after each change, a VB event is dispatched by one
+ * lookup of its VB & press/release (no walk through all commands).
+ *
+ * @note VB events are not received via the system event loop, handler_hid
+ * is a sink of vb_dispatch with its own (high priority) task.
  * @note Mouse/keyboard/joystick control by mouthpiece is done in hal_adc!
  * @see hal_adc
  */
@@ -43,29 +47,56 @@
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
 #include <esp_log.h>
-#include <esp_event.h>
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "fct_macros.h"
 #include "../config_switcher.h"
+#include "vb_usage.h"
+#include "latency.h"
+#include "vb_dispatch.h"
+#include "cmd_rcu.h"
+#include "cmd_arena.h"
+#include "cmd_table.h"
+
+/** @brief Stack size of the handler_hid sink task */
+#define HANDLER_HID_TASK_STACKSIZE 2048
+
+/** @brief Dead memory [bytes] of removed commands in the arena, which
+ * triggers a compaction (if it is also more than half of the arena) */
+#define HANDLER_HID_ARENA_COMPACT 2048
 
 /** @brief Init for the HID handler
  * 
- * We create the mutex and add handler_hid to the system event queue.
+ * We create the mutex and register handler_hid as sink to vb_dispatch.
  * @return ESP_OK on success, ESP_FAIL on an error.*/
 esp_err_t handler_hid_init(void);
 
 /** @brief Get current root of HID command chain
- * @warning Modifying this chain without acquiring the hidCmdSem could result in
- * undefined behaviour!
+ * @warning Reading this chain without acquiring the hidCmdSem could result in
+ * undefined behaviour (elements might be freed)! The elements are stored in
+ * the arena of this slot, never free them.
  * @return Pointer to root of HID chain
  */
 hid_cmd_t *handler_hid_getCmdChain(void);
 
+/** @brief Lock the HID command chain for reading via handler_hid_getCmdChain
+ * 
+ * Takes hidCmdSem, no command can be added or removed until
+ * handler_hid_unlockCmdChain is called.
+ * @return ESP_OK if locked, ESP_FAIL otherwise (lock was not free)
+ */
+esp_err_t handler_hid_lockCmdChain(void);
+
+/** @brief Unlock the HID command chain (see handler_hid_lockCmdChain) */
+void handler_hid_unlockCmdChain(void);
+
 /** @brief Set current root of HID command chain!
+ * 
+ * All elements (including the AT strings) are copied into a new arena,
+ * the given chain is still owned by the caller.
  * @warning By using this function, previously used HID commands are cleared!
  * @param chain Pointer to root of HID chain
- * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, deleting old chain failed..)
+ * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, out of memory..)
  */
 esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain);
 
@@ -76,7 +107,10 @@ esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain);
  * 
  * @note Highest bit determines press/release action. If set, it is a press!
  * @note If VB number is set to VB_SINGLESHOT, the command will be sent immediately.
- * @note We will malloc for each command here. To free the memory, call handler_hid_clearCmds .
+ * @note The command & its AT string are copied into the arena of this slot.
+ * newCmd->atoriginal is freed (and set to NULL) in any case.
+ * To free the memory, call handler_hid_clearCmds .
+ * @note The dispatch table is updated by handler_hid_commit.
  * @param newCmd New command to be added.
  * @param replace If set to != 0, any previously assigned command is removed from list.
  * @return ESP_OK if added, ESP_FAIL if not added (out of memory) */
@@ -86,14 +120,24 @@ esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace);
  * 
  * This method removes any HID command from the list of HID commands
  * which are assigned to this VB.
+ * @note The dispatch table is updated by handler_hid_commit.
  * 
  * @param vb VB which should be removed
- * @return ESP_OK if deleted, ESP_FAIL if not in list */
+ * @return ESP_OK if deleted, ESP_FAIL if not in list (or mutex not free) */
 esp_err_t handler_hid_delCmd(uint8_t vb);
 
+/** @brief Compile all changes of the command chain to the dispatch table
+ * 
+ * handler_hid_addCmd & handler_hid_delCmd only change the chain, this
+ * function compiles it once after a batch of changes (e.g., all AT
+ * commands of a slot). Nothing is done if the chain is unchanged.
+ * @return ESP_OK on success, ESP_FAIL otherwise (lock not free, out of memory) */
+esp_err_t handler_hid_commit(void);
+
 /** @brief Clear all stored HID commands.
  * 
- * This method clears all stored HID commands and frees the allocated memory.
+ * This method clears all stored HID commands and frees the allocated memory
+ * (the arena of this slot is freed at once).
  * 
  * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
  * */
@@ -28,8 +28,9 @@
  * * Macro execution
  * * Calibration
  * * Slot switching
- * @note Currently, we use the system event queue (because there is already
- * a task attached). Maybe we switch to an unique one.
+ * @note VB events are not received via the system event loop, handler_vb
+ * is a sink of vb_dispatch with its own task (slow actions like macros
+ * or IR do not delay HID actions).
  */
  
 #include "handler_vb.h"
@@ -53,63 +54,104 @@
  * @see handler_vb_clearCmds*/
 static vb_cmd_t *cmd_chain = NULL;
 
-/** @brief Synchronization mutex for accessing the VB command chain */
+/** @brief Synchronization mutex for modifying the VB command chain
+ * @note handler_vb reads the chain without this mutex, see vbCmdRcu */
 SemaphoreHandle_t vbCmdSem = NULL;
 
+/** @brief RCU state of the VB command chain
+ * 
+ * Elements are never modified while linked, unlinked elements are
+ * freed after handler_vb left its read section (which might take long,
+ * e.g., for a macro; writers are never blocked by this).
+ * @see cmd_rcu.h */
+static cmd_rcu_t vbCmdRcu = CMD_RCU_INITIALIZER;
+
+/** @brief Free one unlinked VB command (cmd_rcu reclaim function)
+ * @param obj Element of type vb_cmd_t */
+static void handler_vb_freeCmd(void *obj)
+{
+  vb_cmd_t *cmd = (vb_cmd_t *)obj;
+  if(cmd->atoriginal != NULL) free(cmd->atoriginal);
+  if(cmd->cmdparam != NULL) free(cmd->cmdparam);
+  free(cmd);
+}
+
+/** @brief Free an unlinked VB command chain (cmd_rcu reclaim function)
+ * @param obj Head of the chain, type vb_cmd_t */
+static void handler_vb_freeChain(void *obj)
+{
+  vb_cmd_t *current = (vb_cmd_t *)obj;
+  vb_cmd_t *next = NULL;
+  int count = 0;
+  while(current != NULL)
+  {
+    next = current->next;
+    handler_vb_freeCmd(current);
+    current = next;
+    count++;
+  }
+  #if LOG_LEVEL_VB >= ESP_LOG_INFO
+  ESP_LOGI(LOG_TAG,"Freed %d VB cmds",count);
+  #endif
+}
+
 /** @brief Bitmap for active VBs. Corresponding bit will be set, if active. 
- * @see handler_vb_active */
-static uint64_t vb_active = 0;
+ * @see handler_vb_active
+ * @see handler_vb_updateActive */
+static uint32_t vb_active = 0;
+
+/** @brief Rebuild the bitmap of active VBs & publish it
+ * 
+ * Called after each change of the command chain, the bitmap is
+ * published to vb_usage (combined with all other command handlers).
+ * @note Call only with vbCmdSem taken (or if the chain cannot be accessed otherwise)
+ * @see vbUsagePublish */
+static void handler_vb_updateActive(void)
+{
+  uint32_t active = 0;
+  vb_cmd_t *current = cmd_chain;
+  while(current != NULL)
+  {
+    if((current->vb & 0x7F) < VB_USAGE_MAX) active |= VB_USAGE_BIT(current->vb & 0x7F);
+    current = current->next;
+  }
+  vb_active = active;
+  vbUsagePublish(VB_USAGE_VB,active);
+}
 
 /**
- * @brief VB event handler, triggering VB general actions.
+ * @brief VB event sink, triggering VB general actions.
  *
- * @param event_handler_arg handler specific arguments
- * @param event_base event base, here is fixed to VB_EVENT
- * @param event_id event id, subscribed to all events
- * @param event_data Contains the VB number
+ * Called by the handler_vb task of vb_dispatch.
+ * The command chain is read lock-free (vbCmdRcu), a chain which is modified
+ * (e.g., on slot loading) never blocks this handler.
+ * @param type Press or release
+ * @param data Contains the VB number & timestamps
+ * @return ESP_OK
  */
-static void handler_vb(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+static esp_err_t handler_vb(vb_event_t type, const vb_event_data_t *data)
 {
   //if we don't have a stable config, simply return...
-  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0) return;
+  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0) return ESP_OK;
   //still commands to be processed, shouldn't continue
-  if((xEventGroupGetBits(systemStatus) & SYSTEM_EMPTY_CMD_QUEUE) == 0) return;
+  if((xEventGroupGetBits(systemStatus) & SYSTEM_EMPTY_CMD_QUEUE) == 0) return ESP_OK;
 
-  //use the mutex to ensure a valid chained list. 
-  if(xSemaphoreTake(vbCmdSem,4) != pdTRUE)
-  {
-    ESP_LOGW(LOG_TAG,"VB mutex not free for handler");
-    return;
-  }
+  //enter read section, all elements stay valid until we leave.
+  cmdRcuReadLock(&vbCmdRcu);
   //if command chain is empty, we cannot do anything.
-  if(cmd_chain == NULL) 
+  vb_cmd_t *current = CMD_RCU_LOAD(cmd_chain);
+  if(current == NULL) 
   {
-    xSemaphoreGive(vbCmdSem);
-    return;
+    cmdRcuReadUnlock(&vbCmdRcu);
+    return ESP_OK;
   }
   
   uint8_t vb = 0;
   uint32_t count = 0;
-  switch(event_id)
-  {
-    case VB_PRESS_EVENT: vb |= 0x80; //set uppermost bit for press event.
-    case VB_RELEASE_EVENT:
-      break;
-    default: //might be another type of event, we don't care of.
-      return;
-  }
-  
-  //we need an VB number as event data.
-  if(event_data == 0)
-  {
-    ESP_LOGE(LOG_TAG,"Empty event data, cannot proceed!");
-    return;
-  }
+  if(type == VB_PRESS_EVENT) vb |= 0x80; //set uppermost bit for press event.
+  vb |= data->vb & 0x7F;
   
-  vb |= (*((uint32_t*) event_data)) & 0x7F;
-  
-  //begin with head of chain
-  vb_cmd_t *current = cmd_chain;
+  //begin with head of chain (loaded above)
   //iterate through all available vb cmds
   while(current != NULL)
   {
@@ -175,18 +217,19 @@ static void handler_vb(void *event_handler_arg, esp_event_base_t event_base, int
           break;
       }
     }
-    current = current->next;
+    current = CMD_RCU_LOAD(current->next);
   }
   #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
   if(count == 0) ESP_LOGD(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
   #endif
   if(count != 0) ESP_LOGI(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
-  xSemaphoreGive(vbCmdSem);
+  cmdRcuReadUnlock(&vbCmdRcu);
+  return ESP_OK;
 }
 
 /** @brief Init for the VB handler
  * 
- * We create the mutex and add handler_vb to the system event queue.
+ * We create the mutex and register handler_vb as sink to vb_dispatch.
  * @return ESP_OK on success, ESP_FAIL on an error.*/
 esp_err_t handler_vb_init(void)
 {
@@ -202,53 +245,73 @@ esp_err_t handler_vb_init(void)
   //set log level to given log level
   esp_log_level_set(LOG_TAG,LOG_LEVEL_VB);
   
-  return esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,handler_vb,NULL);
+  return vbDispatchRegister("handler_vb",handler_vb,HANDLER_VB_TASK_PRIORITY,HANDLER_VB_TASK_STACKSIZE);
 }
 
-/** @brief Remove command for a virtual button
- * 
- * This method removes any command from the list of commands
- * which are assigned to this VB.
+/** @brief Remove command for a virtual button (mutex already taken)
  * 
+ * Each matching element is unlinked by one pointer store & retired,
+ * it is freed after handler_vb left its read section.
+ * @note Call only with vbCmdSem taken
  * @param vb VB which should be removed
  * @return ESP_OK if deleted, ESP_FAIL if not in list */
-esp_err_t handler_vb_delCmd(uint8_t vb)
+static esp_err_t handler_vb_delCmdLocked(uint8_t vb)
 {
-  //existing chain
   vb_cmd_t *current = cmd_chain;
-  vb_cmd_t *prev = NULL;
+  //pointer to the link which points to current (head or previous next)
+  vb_cmd_t **link = &cmd_chain;
   uint count = 0;
 
-  heap_caps_check_integrity_all(true);
   //do as long as we don't have a null pointer
   while(current != NULL)
   {
     //if the VB number matches (discarding press/release flag)
     if((current->vb & 0x7F) == (vb & 0x7F))
     {
-      //set pointer from previous element to next one
-      //but only if we are not at the head (no previous element)
-      if(prev != NULL) prev->next = current->next;
-      //if no previous element -> replace 
-      else cmd_chain = current->next;
-      //free an AT string
-      if(current->atoriginal != NULL) free(current->atoriginal);
-      //if set, free param string
-      if(current->cmdparam != NULL) free(current->cmdparam);
-      //free this element
-      free(current);
-      //just begin at the front again (easiest way if we removed the head)
-      current = cmd_chain;
-      prev = NULL;
-      if((vb & 0x7F) <= 63) vb_active &= ~(1<<(vb & 0x7F)); //delete active flag
+      //unlink: previous element (or head) points to the next one.
+      //current->next stays valid for a reader which is at this element.
+      CMD_RCU_STORE(*link,current->next);
+      cmdRcuRetire(&vbCmdRcu,current,handler_vb_freeCmd);
+      current = *link;
+      count++;
     } else { //does not match
       //set pointers to next element
-      prev = current;
+      link = &current->next;
       current = current->next;
     }
   }
-  if(count != 0) return ESP_OK;
-  else return ESP_FAIL;
+  if(count != 0)
+  {
+    handler_vb_updateActive();
+    return ESP_OK;
+  } else return ESP_FAIL;
+}
+
+/** @brief Remove command for a virtual button
+ * 
+ * This method removes any command from the list of commands
+ * which are assigned to this VB.
+ * 
+ * @param vb VB which should be removed
+ * @return ESP_OK if deleted, ESP_FAIL if not in list (or mutex not free) */
+esp_err_t handler_vb_delCmd(uint8_t vb)
+{
+  esp_err_t ret;
+  if(vbCmdSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
+    return ESP_FAIL;
+  }
+  //take mutex for modifying
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"VB mutex not free for deleting");
+    return ESP_FAIL;
+  }
+  cmdRcuReclaim(&vbCmdRcu);
+  ret = handler_vb_delCmdLocked(vb);
+  xSemaphoreGive(vbCmdSem);
+  return ret;
 }
 
 /** @brief Add a new VB command for a virtual button
@@ -275,7 +338,7 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
     return ESP_FAIL;
   }
-  if((newCmd->vb & 0x7F) >= VB_MAX)
+  if((newCmd->vb & 0x7F) >= VB_MAX_ALL)
   {
     ESP_LOGE(LOG_TAG,"newCmd->vb out of range");
     return ESP_FAIL;
@@ -287,6 +350,8 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"VB mutex not free for adding");
     return ESP_FAIL;
   }
+  //free previously removed elements, if handler_vb is done with them
+  cmdRcuReclaim(&vbCmdRcu);
   
   //existing chain, add to end
   vb_cmd_t *current = cmd_chain;
@@ -305,7 +370,7 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
   #endif
   
   //if set, remove any previously set commands.
-  if(replace) handler_vb_delCmd(newCmd->vb);
+  if(replace) handler_vb_delCmdLocked(newCmd->vb);
   
   //allocate new command
   current = cmd_chain;
@@ -317,9 +382,10 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
     memcpy(new, newCmd, sizeof(vb_cmd_t));
     //save pointer of new config to end of chain
     new->next = NULL;
+    //the new element is complete, publish it with one pointer store.
     //if we don't have a head, use this one
     if(cmd_chain == NULL) {
-      cmd_chain = new;
+      CMD_RCU_STORE(cmd_chain,new);
     } else {
       //otherwise append to tail.
       while(current->next != NULL)
@@ -330,9 +396,9 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
         count++;
         current = current->next;
       }
-      current->next = new;
+      CMD_RCU_STORE(current->next,new);
     }
-    if((new->vb & 0x7F) <= 63) vb_active |= (1<<(new->vb & 0x7F)); //set active flag
+    handler_vb_updateActive();
     count++;
     #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
     ESP_LOGI(LOG_TAG,"Added new cmd nr %d, new: 0x%8X, prev: 0x%8X",count,(uint32_t)new,(uint32_t)current);
@@ -353,8 +419,8 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
 }
 
 /** @brief Get current root of VB command chain
- * @warning Modifying this chain without acquiring the vbCmdSem could result in
- * undefined behaviour!.
+ * @warning Reading or modifying this chain without acquiring the vbCmdSem could result in
+ * undefined behaviour (elements might be freed)!
  * @return Pointer to root of VB chain
  */
 vb_cmd_t *handler_vb_getCmdChain(void)
@@ -362,6 +428,33 @@ vb_cmd_t *handler_vb_getCmdChain(void)
   return cmd_chain;
 }
 
+/** @brief Lock the VB command chain for reading via handler_vb_getCmdChain
+ * 
+ * Takes vbCmdSem, no command can be added or removed until
+ * handler_vb_unlockCmdChain is called.
+ * @return ESP_OK if locked, ESP_FAIL otherwise (lock was not free)
+ */
+esp_err_t handler_vb_lockCmdChain(void)
+{
+  if(vbCmdSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
+    return ESP_FAIL;
+  }
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"cannot enter critical section");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Unlock the VB command chain (see handler_vb_lockCmdChain) */
+void handler_vb_unlockCmdChain(void)
+{
+  if(vbCmdSem != NULL) xSemaphoreGive(vbCmdSem);
+}
+
 /** @brief Set current root of VB command chain
  * @warning By using this function, previously used VB commands are cleared!
  * @param chain Pointer to root of VB chain
@@ -369,19 +462,7 @@ vb_cmd_t *handler_vb_getCmdChain(void)
  */
 esp_err_t handler_vb_setCmdChain(vb_cmd_t *chain)
 {
-  esp_err_t ret = ESP_OK;
-  
-  //check if chain is currently active,
-  //if yes clear it before setting a new one
-  if(cmd_chain != NULL)
-  {
-    ret = handler_vb_clearCmds();
-    if(ret != ESP_OK)
-    {
-      ESP_LOGE(LOG_TAG,"Cannot clear old chain");
-      return ret;
-    }
-  }
+  vb_cmd_t *old;
   
   //enter critical section for setting new cmd chain
   if(vbCmdSem == NULL)
@@ -395,8 +476,13 @@ esp_err_t handler_vb_setCmdChain(vb_cmd_t *chain)
     ESP_LOGE(LOG_TAG,"cannot enter critical section");
     return ESP_FAIL;
   }
-  //save the pointer
-  cmd_chain = chain;
+  cmdRcuReclaim(&vbCmdRcu);
+  //publish the new chain (built off to the side) with one pointer store,
+  //the old one is freed after handler_vb is done with it.
+  old = cmd_chain;
+  CMD_RCU_STORE(cmd_chain,chain);
+  if(old != NULL) cmdRcuRetire(&vbCmdRcu,old,handler_vb_freeChain);
+  handler_vb_updateActive();
   //release mutex
   xSemaphoreGive(vbCmdSem);
   return ESP_OK;
@@ -428,35 +514,13 @@ esp_err_t handler_vb_clearCmds(void)
     return ESP_FAIL;
   }
   
-  //pointers for next and current command
-  vb_cmd_t *next = NULL;
-  vb_cmd_t *current = cmd_chain;
-  int count = 0;
-  
-  do {
-    //load next block
-    next = current->next;
-    //if set, free the original AT command
-    if(current->atoriginal != NULL) free(current->atoriginal);
-    current->atoriginal = NULL;
-    //if set, free param string
-    if(current->cmdparam != NULL) free(current->cmdparam);
-    current->cmdparam = NULL;
-    //free the current one
-    free(current);
-    //count for statistics
-    count++;
-    //previous next is current for next while iteration
-    current = next;
-    //break the loop if current is NULL (we reached end of chain)
-  } while(current != NULL);
-  
-  #if LOG_LEVEL_VB >= ESP_LOG_INFO
-  ESP_LOGI(LOG_TAG,"Cleared %d VB cmds",count);
-  #endif
-
-  cmd_chain = NULL;
-  vb_active = 0;
+  cmdRcuReclaim(&vbCmdRcu);
+  //unpublish the chain with one pointer store,
+  //it is freed after handler_vb is done with it.
+  vb_cmd_t *old = cmd_chain;
+  CMD_RCU_STORE(cmd_chain,NULL);
+  if(old != NULL) cmdRcuRetire(&vbCmdRcu,old,handler_vb_freeChain);
+  handler_vb_updateActive();
   //release mutex
   xSemaphoreGive(vbCmdSem);
   return ESP_OK;
@@ -528,15 +592,52 @@ esp_err_t handler_vb_getAT(char* output, uint8_t vb)
  * @note We don't care if press/release is active here. Any associated action will return true. */
 bool handler_vb_active(uint8_t vb)
 {
-  //we check for VB_MAX (firmware specfic) and 63 (size of vb_active)
-  if(vb >= VB_MAX || vb >= 63)
+  //we check for VB_MAX_ALL (firmware specfic, incl. gestures) and VB_USAGE_MAX (size of vb_active)
+  if(vb >= VB_MAX_ALL || vb >= VB_USAGE_MAX)
   {
     ESP_LOGE(LOG_TAG,"Cannot detect state of VB %d, out of range!",vb);
     return false;
   } else {
-    if((vb_active & (1<<(vb&0x7F))) != 0) return true;
+    if((vb_active & VB_USAGE_BIT(vb&0x7F)) != 0) return true;
     else return false;
   }
   return false;
 }
 
+
+/** @brief Get the names of all IR commands (T_SENDIR) in the command chain
+ * 
+ * Used to warm the IR cache after loading a slot. The chain is read
+ * with vbCmdSem taken (like a writer), vbCmdRcu only supports the one
+ * reader in the VB sink task. Each name is returned once.
+ * 
+ * @param names Buffer for the names
+ * @param max Size of the buffer [names]
+ * @return Count of names */
+uint8_t handler_vb_getIRNames(char (*names)[SLOTNAME_LENGTH+1], uint8_t max)
+{
+  uint8_t count = 0;
+  if(names == NULL || vbCmdSem == NULL) return 0;
+  
+  //no read section: a second reader would break the reclaim of vbCmdRcu
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"VB mutex not free for reading IR names");
+    return 0;
+  }
+  for(vb_cmd_t *current = CMD_RCU_LOAD(cmd_chain); current != NULL; \
+    current = CMD_RCU_LOAD(current->next))
+  {
+    if(current->cmd != T_SENDIR || current->cmdparam == NULL) continue;
+    //skip names which are already in the list
+    uint8_t i;
+    for(i = 0; i<count; i++) if(strcmp(names[i],current->cmdparam) == 0) break;
+    if(i != count) continue;
+    if(count == max) break;
+    strncpy(names[count],current->cmdparam,SLOTNAME_LENGTH);
+    names[count][SLOTNAME_LENGTH] = '\0';
+    count++;
+  }
+  xSemaphoreGive(vbCmdSem);
+  return count;
+}
@@ -28,8 +28,9 @@
  * * Macro execution
  * * Calibration
  * * Slot switching
- * @note Currently, we use the system event queue (because there is already
- * a task attached). Maybe we switch to an unique one.
+ * @note VB events are not received via the system event loop, handler_vb
+ * is a sink of vb_dispatch with its own task (slow actions like macros
+ * or IR do not delay HID actions).
  */
 
 #ifndef _HANDLER_VB_H
@@ -42,14 +43,20 @@
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "../config_switcher.h"
+#include "vb_usage.h"
+#include "vb_dispatch.h"
+#include "cmd_rcu.h"
 #include "fct_macros.h"
 #include "fct_infrared.h"
 #include "task_smarthome.h"
 
+/** @brief Stack size of the handler_vb sink task (macros, IR, MQTT/REST) */
+#define HANDLER_VB_TASK_STACKSIZE 4096
+
 
 /** @brief Init for the VB handler
  * 
- * We create the mutex and add handler_vb to the system event queue.
+ * We create the mutex and register handler_vb as sink to vb_dispatch.
  * @return ESP_OK on success, ESP_FAIL on an error.*/
 esp_err_t handler_vb_init(void);
 
@@ -60,6 +67,17 @@ esp_err_t handler_vb_init(void);
  */
 vb_cmd_t *handler_vb_getCmdChain(void);
 
+/** @brief Lock the VB command chain for reading via handler_vb_getCmdChain
+ * 
+ * Takes vbCmdSem, no command can be added or removed until
+ * handler_vb_unlockCmdChain is called.
+ * @return ESP_OK if locked, ESP_FAIL otherwise (lock was not free)
+ */
+esp_err_t handler_vb_lockCmdChain(void);
+
+/** @brief Unlock the VB command chain (see handler_vb_lockCmdChain) */
+void handler_vb_unlockCmdChain(void);
+
 
 /** @brief Set current root of VB command chain
  * @warning By using this function, previously used VB commands are cleared!
@@ -117,4 +135,15 @@ esp_err_t handler_vb_getAT(char* output, uint8_t vb);
  * @return true if active, false if not */
 bool handler_vb_active(uint8_t vb);
 
+/** @brief Get the names of all IR commands (T_SENDIR) in the command chain
+ * 
+ * Used to warm the IR cache after loading a slot. The chain is read
+ * with vbCmdSem taken (like a writer), vbCmdRcu only supports the one
+ * reader in the VB sink task. Each name is returned once.
+ * 
+ * @param names Buffer for the names
+ * @param max Size of the buffer [names]
+ * @return Count of names */
+uint8_t handler_vb_getIRNames(char (*names)[SLOTNAME_LENGTH+1], uint8_t max);
+
 #endif /* _HANDLER_VB_H */
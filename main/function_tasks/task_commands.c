@@ -170,6 +170,19 @@ static int checkqueues(void)
   return 1;
 }
 
+/** @brief Send a HID cmd directly to a HID queue (without latency timestamps)
+ * @param queue HID queue (EVENT_QUEUE_HID_USB or EVENT_QUEUE_HID_BLE)
+ * @param cmd Hid command
+ * @param wait Maximum time to wait for a free element [ticks] */
+static void sendHIDReport(event_queue_t queue, hid_cmd_t *cmd, TickType_t wait)
+{
+  hid_report_t report;
+  memset(&report,0,sizeof(hid_report_t));
+  memcpy(report.cmd,cmd->cmd,sizeof(report.cmd));
+  report.flags = cmd->vb;
+  eventQueueSend(queue,EVENT_SRC_COMMANDS,&report,wait);
+}
+
 /** @brief Helper to route a HID cmd either directly to queue or add it to the list
  * @param sendCmd Hid command */
 void sendHIDCmd(hid_cmd_t *sendCmd, uint8_t vb, uint8_t* atorig, uint8_t replace)
@@ -184,10 +197,10 @@ void sendHIDCmd(hid_cmd_t *sendCmd, uint8_t vb, uint8_t* atorig, uint8_t replace
   {
     //post values to mouse queue (USB and/or BLE)
     if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
-    { xQueueSend(hid_usb,sendCmd,0); }
+    { sendHIDReport(EVENT_QUEUE_HID_USB,sendCmd,0); }
     
     if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
-    { xQueueSend(hid_ble,sendCmd,0); }
+    { sendHIDReport(EVENT_QUEUE_HID_BLE,sendCmd,0); }
     
     if(sendCmd->atoriginal != NULL) free(sendCmd->atoriginal);
   } else {
@@ -288,18 +301,24 @@ esp_err_t cmdTt(char* orig, void* p1, void* p2) {
 esp_err_t cmdAp(char* orig, void* p1, void* p2) {
   if(currentCfg == NULL) return ESP_FAIL;
   if(requestVBUpdate == VB_SINGLESHOT) currentCfg->debounce_press = (int32_t)p1;
+  //gesture VBs are not debounced
+  else if(requestVBUpdate >= VB_MAX) return ESP_FAIL;
   else currentCfg->debounce_press_vb[requestVBUpdate] = (int32_t)p1;
   return ESP_OK;
 }
 esp_err_t cmdAr(char* orig, void* p1, void* p2) {
   if(currentCfg == NULL) return ESP_FAIL;
   if(requestVBUpdate == VB_SINGLESHOT) currentCfg->debounce_release = (int32_t)p1;
+  //gesture VBs are not debounced
+  else if(requestVBUpdate >= VB_MAX) return ESP_FAIL;
   else currentCfg->debounce_release_vb[requestVBUpdate] = (int32_t)p1;
   return ESP_OK;
 }
 esp_err_t cmdAi(char* orig, void* p1, void* p2) {
   if(currentCfg == NULL) return ESP_FAIL;
   if(requestVBUpdate == VB_SINGLESHOT) currentCfg->debounce_idle = (int32_t)p1;
+  //gesture VBs are not debounced
+  else if(requestVBUpdate >= VB_MAX) return ESP_FAIL;
   else currentCfg->debounce_idle_vb[requestVBUpdate] = (int32_t)p1;
   return ESP_OK;
 }
@@ -711,6 +730,15 @@ esp_err_t cmdDn(char* orig, void* p1, void* p2) {
   halStorageFinishTransaction(tid);
   return retval;
 }
+esp_err_t cmdMo(char* orig, void* p1, void* p2) {
+  uint32_t tid;
+  esp_err_t retval;
+  retval = halStorageStartTransaction(&tid,20,LOG_TAG);
+  if(retval != ESP_OK) return retval;
+  retval = halStorageMoveSlot(tid,(int32_t)p1,(int32_t)p2);
+  halStorageFinishTransaction(tid);
+  return retval;
+}
 esp_err_t cmdNc(char* orig, void* p1, void* p2) {
   if(requestVBUpdate != VB_SINGLESHOT)
   {
@@ -753,6 +781,140 @@ esp_err_t cmdEr(char* orig, void* p1, void* p2) {
   currentCfg->adc.reportraw = 0;
   return ESP_OK;
 }
+esp_err_t cmdMc(char* orig, void* p1, void* p2) {
+  char str[96];
+  hid_coalesce_stats_t usb,ble;
+  if(hidCoalesceGetStats(HID_COALESCE_USB,&usb) != ESP_OK) return ESP_FAIL;
+  if(hidCoalesceGetStats(HID_COALESCE_BLE,&ble) != ESP_OK) return ESP_FAIL;
+  sprintf(str,"COALESCE:usb,%u,%u,%u;ble,%u,%u,%u",usb.reports,usb.merged,usb.dropped, \
+    ble.reports,ble.merged,ble.dropped);
+  halSerialSendUSBSerial(str,strnlen(str,96),20);
+  return ESP_OK;
+}
+esp_err_t cmdFt(char* orig, void* p1, void* p2) {
+  char str[128];
+  int len = sprintf(str,"FILTER:");
+  adc_filter_cost_t cost;
+  for(uint8_t i = 0; i<FILTER_STAGE_MAX; i++)
+  {
+    if(halAdcFilterGetCost(i,&cost) != ESP_OK) return ESP_FAIL;
+    len += sprintf(&str[len],"%s%s,%u,%u,%u",(i==0)?"":";",halAdcFilterGetName(i), \
+      cost.samples,(cost.samples!=0)?(uint32_t)(cost.cycles/cost.samples):0,cost.cycles_max);
+  }
+  halSerialSendUSBSerial(str,strnlen(str,128),20);
+  return ESP_OK;
+}
+esp_err_t cmdHy(char* orig, void* p1, void* p2) {
+  int ch, enter, exit;
+  if(currentCfg == NULL) return ESP_FAIL;
+  //AT HY <channel> <enter> <exit>
+  if(sscanf((char*)p1,"%d %d %d",&ch,&enter,&exit) != 3) return ESP_FAIL;
+  if(ch < 0 || ch >= ADC_HYST_MAX) return ESP_FAIL;
+  if(enter < 0 || enter > 255 || exit < 0 || exit > enter) return ESP_FAIL;
+  currentCfg->adc.hyst_enter[ch] = enter;
+  currentCfg->adc.hyst_exit[ch] = exit;
+  return ESP_OK;
+}
+esp_err_t cmdHs(char* orig, void* p1, void* p2) {
+  char str[64];
+  uint32_t emitted, suppressed;
+  halAdcGetHysteresisStats(&emitted,&suppressed);
+  sprintf(str,"HYSTERESIS:%u,%u",emitted,suppressed);
+  halSerialSendUSBSerial(str,strnlen(str,64),20);
+  //AT HS 1: clear counters after reporting
+  if((int32_t)p1 == 1) halAdcResetHysteresisStats();
+  return ESP_OK;
+}
+esp_err_t cmdLt(char* orig, void* p1, void* p2) {
+  char str[600];
+  int len = sprintf(str,"LATENCY:");
+  latency_stats_t stats;
+  for(uint8_t i = 0; i<LATENCY_STAGE_MAX; i++)
+  {
+    if(latencyGetStats(i,&stats) != ESP_OK) return ESP_FAIL;
+    len += sprintf(&str[len],"%s%s,%u,%u,%u,%u,%u",(i==0)?"":";",latencyGetName(i), \
+      stats.count,stats.p50,stats.p95,stats.p99,stats.max);
+  }
+  halSerialSendUSBSerial(str,strnlen(str,600),20);
+  //2nd line: latency of mouthpiece mode switches (last & max)
+  uint32_t last, max;
+  halAdcGetModeSwitchLatency(&last,&max);
+  sprintf(str,"MODESWITCH:%u,%u",last,max);
+  halSerialSendUSBSerial(str,strnlen(str,600),20);
+  //3rd line: samples which were processed while a new ADC config was published
+  sprintf(str,"ADCCONFIG:%u",halAdcGetConfigChangeCount());
+  halSerialSendUSBSerial(str,strnlen(str,600),20);
+  //AT LT 1: clear all histograms after reporting
+  if((int32_t)p1 == 1) latencyReset();
+  return ESP_OK;
+}
+esp_err_t cmdVs(char* orig, void* p1, void* p2) {
+  char str[256];
+  int len = sprintf(str,"VBDISPATCH:");
+  vb_dispatch_stats_t stats;
+  for(uint8_t i = 0; i<vbDispatchGetSinkCount(); i++)
+  {
+    if(vbDispatchGetStats(i,&stats) != ESP_OK) return ESP_FAIL;
+    len += sprintf(&str[len],"%s%s,%u,%u,%u,%u,%u",(i==0)?"":";",stats.name, \
+      stats.posted,stats.dropped,stats.failed,stats.depth,stats.highwater);
+  }
+  halSerialSendUSBSerial(str,strnlen(str,256),20);
+  return ESP_OK;
+}
+esp_err_t cmdQs(char* orig, void* p1, void* p2) {
+  char str[512];
+  //maximum length of the text, a truncated line ends here
+  const int max = sizeof(str) - 1;
+  int len = snprintf(str,sizeof(str),"QUEUES:");
+  event_queue_stats_t stats;
+  event_queue_src_stats_t src;
+  for(uint8_t i = 0; i<EVENT_QUEUE_MAX && len < max; i++)
+  {
+    if(eventQueueGetStats(i,&stats) != ESP_OK) return ESP_FAIL;
+    len += snprintf(&str[len],sizeof(str)-len,"%s%s,%u,%u,%u,%u,%u,%u,%u",(i==0)?"":";",stats.name, \
+      stats.sent,stats.dropped,stats.flushed,stats.waiting,stats.highwater,stats.depth,stats.capacity);
+    if(len > max) len = max;
+  }
+  halSerialSendUSBSerial(str,strnlen(str,512),20);
+  //2nd line: each source which sent at least one event to a queue
+  len = snprintf(str,sizeof(str),"QSOURCES:");
+  for(uint8_t i = 0; i<EVENT_QUEUE_MAX && len < max; i++)
+  {
+    if(eventQueueGetStats(i,&stats) != ESP_OK) return ESP_FAIL;
+    for(uint8_t j = 0; j<EVENT_SRC_MAX && len < max; j++)
+    {
+      if(eventQueueGetSourceStats(i,j,&src) != ESP_OK) return ESP_FAIL;
+      if(src.seq == 0) continue;
+      len += snprintf(&str[len],sizeof(str)-len,"%s%s/%s,%u,%u,%u",(len==9)?"":";", \
+        stats.name,src.name,src.seq,src.dropped,src.lastdrop);
+      //truncated: stop both loops, the line is sent as far as it fits
+      if(len > max) len = max;
+    }
+  }
+  halSerialSendUSBSerial(str,strnlen(str,512),20);
+  //AT QS 1: clear all counters after reporting
+  if((int32_t)p1 == 1) eventQueueResetStats();
+  return ESP_OK;
+}
+esp_err_t cmdQd(char* orig, void* p1, void* p2) {
+  return eventQueueSetDepth((int32_t)p1,(int32_t)p2);
+}
+esp_err_t cmdGe(char* orig, void* p1, void* p2) {
+  int n, type, vb, vb2, time;
+  if(currentCfg == NULL) return ESP_FAIL;
+  //AT GE <nr> <type> <vb> <vb2> <time>
+  if(sscanf((char*)p1,"%d %d %d %d %d",&n,&type,&vb,&vb2,&time) != 5) return ESP_FAIL;
+  if(n < 0 || n >= VB_GESTURE_COUNT) return ESP_FAIL;
+  if(type < GESTURE_NONE || type >= GESTURE_TYPE_MAX) return ESP_FAIL;
+  if(vb < 0 || vb >= VB_MAX || vb2 < 0 || vb2 >= VB_MAX) return ESP_FAIL;
+  if(time < 0 || time > 5000) return ESP_FAIL;
+  currentCfg->gestures[n].type = type;
+  currentCfg->gestures[n].vb = vb;
+  currentCfg->gestures[n].vb2 = vb2;
+  currentCfg->gestures[n].time = time;
+  //compile gesture table in the debouncer
+  return debouncerGesturesChanged();
+}
 esp_err_t cmdCa(char* orig, void* p1, void* p2) {
   if(requestVBUpdate == VB_SINGLESHOT)
   {
@@ -983,7 +1145,7 @@ esp_err_t cmdWh(char* orig, void* p1, void* p2) {
 const onecmd_t commands[] = {
   // general commands
   {"ID", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdId,0,NOCAST},
-  {"BM", {PARAM_NUMBER,PARAM_NONE},{0,0},{VB_MAX-1,0},cmdBm,0,NOCAST},
+  {"BM", {PARAM_NUMBER,PARAM_NONE},{0,0},{VB_MAX_ALL-1,0},cmdBm,0,NOCAST},
   {"BL", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},NULL,offsetof(CMD_TARGET_TYPE,button_learn),UINT8},
   {"MA", {PARAM_STRING,PARAM_NONE},{5,0},{ATCMD_LENGTH-strlen(CMD_PREFIX)-CMD_LENGTH,0},cmdMa,0,NOCAST},
   {"WA", {PARAM_NUMBER,PARAM_NONE},{0,0},{30000,0},cmdWa,0,NOCAST},
@@ -998,6 +1160,11 @@ const onecmd_t commands[] = {
   {"FB", {PARAM_NUMBER,PARAM_NONE},{0,0},{3,0},NULL,offsetof(CMD_TARGET_TYPE,feedback),UINT8},
   {"PW", {PARAM_STRING,PARAM_NONE},{8,0},{32,0},cmdPw,0,NOCAST},
   {"FW", {PARAM_NUMBER,PARAM_NONE},{2,0},{3,0},cmdFw,0,NOCAST},
+  {"LT", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},cmdLt,0,NOCAST},
+  {"VS", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdVs,0,NOCAST},
+  {"GE", {PARAM_STRING,PARAM_NONE},{9,0},{32,0},cmdGe,0,NOCAST},
+  {"QS", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},cmdQs,0,NOCAST},
+  {"QD", {PARAM_NUMBER,PARAM_NUMBER},{0,1},{EVENT_QUEUE_MAX-1,HID_QUEUE_CAPACITY},cmdQd,0,NOCAST},
   // HID - mouse commands
   {"CL", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdCl,0,NOCAST},
   {"CR", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdCr,0,NOCAST},
@@ -1020,6 +1187,7 @@ const onecmd_t commands[] = {
   {"WS", {PARAM_NUMBER,PARAM_NONE},{1,0},{127,0},cmdWs,0,NOCAST},
   {"MX", {PARAM_NUMBER,PARAM_NONE},{-127,0},{127,0},cmdMx,0,NOCAST},
   {"MY", {PARAM_NUMBER,PARAM_NONE},{-127,0},{127,0},cmdMy,0,NOCAST},
+  {"MC", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdMc,0,NOCAST},
   // HID - keyboard commands
   {"KW", {PARAM_STRING,PARAM_NONE},{1,0},{ATCMD_LENGTH-strlen(CMD_PREFIX)-CMD_LENGTH,0},cmdKw,0,NOCAST},
   {"KP", {PARAM_STRING,PARAM_NONE},{5,0},{ATCMD_LENGTH-strlen(CMD_PREFIX)-CMD_LENGTH,0},cmdKp,0,NOCAST},
@@ -1036,6 +1204,7 @@ const onecmd_t commands[] = {
   {"DE", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdDe,0,NOCAST},
   {"DL", {PARAM_NUMBER,PARAM_NONE},{0,0},{250,0},cmdDl,0,NOCAST},
   {"DN", {PARAM_STRING,PARAM_NONE},{1,0},{SLOTNAME_LENGTH,0},cmdDn,0,NOCAST},
+  {"MO", {PARAM_NUMBER,PARAM_NUMBER},{0,0},{249,249},cmdMo,0,NOCAST},
   {"NC", {PARAM_NONE,PARAM_NONE},{0,0},{3,0},cmdNc,0,NOCAST},
   // mouthpiece / ADC settings
   {"MM", {PARAM_NUMBER,PARAM_NONE},{0,0},{2,0},cmdMm,0,NOCAST},
@@ -1053,6 +1222,19 @@ const onecmd_t commands[] = {
   {"SS", {PARAM_NUMBER,PARAM_NONE},{0,0},{512,0},NULL,offsetof(CMD_TARGET_TYPE,adc.threshold_strongsip),UINT16},
   {"TP", {PARAM_NUMBER,PARAM_NONE},{512,0},{1023,0},NULL,offsetof(CMD_TARGET_TYPE,adc.threshold_puff),UINT16},
   {"SP", {PARAM_NUMBER,PARAM_NONE},{512,0},{1023,0},NULL,offsetof(CMD_TARGET_TYPE,adc.threshold_strongpuff),UINT16},
+  {"OT", {PARAM_NUMBER,PARAM_NONE},{0,0},{15,0},NULL,offsetof(CMD_TARGET_TYPE,adc.otf_idle),UINT8},
+  {"OC", {PARAM_NUMBER,PARAM_NONE},{5,0},{15,0},NULL,offsetof(CMD_TARGET_TYPE,adc.otf_count),UINT8},
+  {"SF", {PARAM_NUMBER,PARAM_NONE},{50,0},{500,0},NULL,offsetof(CMD_TARGET_TYPE,adc.rate_active),UINT16},
+  {"SI", {PARAM_NUMBER,PARAM_NONE},{5,0},{100,0},NULL,offsetof(CMD_TARGET_TYPE,adc.rate_idle),UINT8},
+  {"SD", {PARAM_NUMBER,PARAM_NONE},{50,0},{5000,0},NULL,offsetof(CMD_TARGET_TYPE,adc.strong_delay),UINT16},
+  {"ST", {PARAM_NUMBER,PARAM_NONE},{500,0},{10000,0},NULL,offsetof(CMD_TARGET_TYPE,adc.strong_timeout),UINT16},
+  {"FM", {PARAM_NUMBER,PARAM_NONE},{0,0},{HAL_ADC_FILTER_MEDIAN_MAX,0},NULL,offsetof(CMD_TARGET_TYPE,adc.filter_median),UINT8},
+  {"FI", {PARAM_NUMBER,PARAM_NONE},{0,0},{255,0},NULL,offsetof(CMD_TARGET_TYPE,adc.filter_iir),UINT8},
+  {"FC", {PARAM_NUMBER,PARAM_NONE},{0,0},{255,0},NULL,offsetof(CMD_TARGET_TYPE,adc.filter_oe_mincutoff),UINT8},
+  {"FS", {PARAM_NUMBER,PARAM_NONE},{0,0},{255,0},NULL,offsetof(CMD_TARGET_TYPE,adc.filter_oe_beta),UINT8},
+  {"FT", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdFt,0,NOCAST},
+  {"HY", {PARAM_STRING,PARAM_NONE},{5,0},{16,0},cmdHy,0,NOCAST},
+  {"HS", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},cmdHs,0,NOCAST},
   
   // joystick commands
   {"JX", {PARAM_NUMBER,PARAM_NUMBER},{0,0},{1023,1},cmdJx,0,NOCAST},
@@ -1061,6 +1243,8 @@ const onecmd_t commands[] = {
   {"JT", {PARAM_NUMBER,PARAM_NUMBER},{0,0},{1023,1},cmdJt,0,NOCAST},
   {"JS", {PARAM_NUMBER,PARAM_NUMBER},{0,0},{1023,1},cmdJs,0,NOCAST},
   {"JU", {PARAM_NUMBER,PARAM_NUMBER},{0,0},{1023,1},cmdJu,0,NOCAST},
+  {"JA", {PARAM_NUMBER,PARAM_NONE},{0,0},{HAL_ADC_JOYSTICK_AXIS_MAX,0},NULL,offsetof(CMD_TARGET_TYPE,adc.axis),UINT8},
+  {"JE", {PARAM_NUMBER,PARAM_NONE},{0,0},{100,0},NULL,offsetof(CMD_TARGET_TYPE,adc.joystick_epsilon),UINT8},
   
   {"JP", {PARAM_NUMBER,PARAM_NONE},{1,0},{32,0},cmdJp,0,NOCAST},
   {"JC", {PARAM_NUMBER,PARAM_NONE},{1,0},{32,0},cmdJc,0,NOCAST},
@@ -1425,6 +1609,29 @@ parserstate_t doKeyboardParsing(uint8_t *cmdBuffer, int length)
 }
 
 #endif
+/** @brief All queued AT commands are processed
+ * 
+ * If there are no more commands in the queue, the HID dispatch table
+ * is compiled, the config is updated & SYSTEM_EMPTY_CMD_QUEUE is set.
+ * While a slot is loaded, the table is compiled after its end marker
+ * only (the queue might run empty before the next line is read).
+ * */
+static void commandsProcessed(void)
+{
+  //check if there are still elements in the queue
+  if(uxQueueMessagesWaiting(halSerialATCmds) == 0)
+  {
+    //compile all HID commands of this batch at once (not within a slot text)
+    if((xEventGroupGetBits(systemStatus) & (SYSTEM_LOADCONFIG | SYSTEM_SLOT_CMDS_DONE)) \
+      != SYSTEM_LOADCONFIG) handler_hid_commit();
+    //no more commands, ready to update config
+    if(configUpdate(20) != ESP_OK) ESP_LOGE(LOG_TAG,"Error updating general config!");
+    else ESP_LOGD(LOG_TAG,"requesting config update");
+    //yeah, processed everything, tell it to the whole firmware :-)
+    xEventGroupSetBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE);
+  }
+}
+
 void task_commands(void *params)
 {
   uint8_t queuesready = checkqueues();
@@ -1439,6 +1646,15 @@ void task_commands(void *params)
       //wait for incoming data
       received = halSerialReceiveUSBSerial(&commandBuffer);
       
+      //end marker of a loaded slot: all its commands are processed
+      if(received == 0 && commandBuffer == NULL)
+      {
+        handler_hid_commit();
+        commandsProcessed();
+        xEventGroupSetBits(systemStatus,SYSTEM_SLOT_CMDS_DONE);
+        continue;
+      }
+      
       //if no command received, try again...
       if(received == -1 || commandBuffer == NULL) continue;
       
@@ -1515,7 +1731,7 @@ void task_commands(void *params)
         {
 			//we will wait for 10 ticks maximum, this command should 
 			//not be discarded
-			xQueueSend(hid_usb,&general,10);
+			sendHIDReport(EVENT_QUEUE_HID_USB,&general,10);
 		}
         
         //HID related
@@ -1542,15 +1758,7 @@ void task_commands(void *params)
 
       //if we have processed all commands (queue is empty),
       //we set the corresponding flag
-      //check if there are still elements in the queue
-      if(uxQueueMessagesWaiting(halSerialATCmds) == 0)
-      {
-        //no more commands, ready to update config
-        if(configUpdate(20) != ESP_OK) ESP_LOGE(LOG_TAG,"Error updating general config!");
-        else ESP_LOGD(LOG_TAG,"requesting config update");
-        //yeah, processed everything, tell it to the whole firmware :-)
-        xEventGroupSetBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE);
-      }
+      commandsProcessed();
     } else {
       //check again for initialized queues
       ESP_LOGE(LOG_TAG,"Queues uninitialized, rechecking in 1s");
@@ -1713,8 +1921,44 @@ void storeSlot(char* slotname)
   
   sprintf(outputstring,"AT RO %d\n",currentcfg->adc.orientation);
   halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT OT %d\n",currentcfg->adc.otf_idle);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT OC %d\n",currentcfg->adc.otf_count);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT SF %d\n",currentcfg->adc.rate_active);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT SI %d\n",currentcfg->adc.rate_idle);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT SD %d\n",currentcfg->adc.strong_delay);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT ST %d\n",currentcfg->adc.strong_timeout);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT FM %d\n",currentcfg->adc.filter_median);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT FI %d\n",currentcfg->adc.filter_iir);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT FC %d\n",currentcfg->adc.filter_oe_mincutoff);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT FS %d\n",currentcfg->adc.filter_oe_beta);
+  halStorageStore(tid,outputstring,250);
+  for(uint8_t j = 0; j<ADC_HYST_MAX; j++)
+  {
+    sprintf(outputstring,"AT HY %d %d %d\n",j,currentcfg->adc.hyst_enter[j],currentcfg->adc.hyst_exit[j]);
+    halStorageStore(tid,outputstring,250);
+  }
+  sprintf(outputstring,"AT JA %d\n",currentcfg->adc.axis);
+  halStorageStore(tid,outputstring,250);
+  sprintf(outputstring,"AT JE %d\n",currentcfg->adc.joystick_epsilon);
+  halStorageStore(tid,outputstring,250);
   sprintf(outputstring,"AT FB %d\n",currentcfg->feedback);
   halStorageStore(tid,outputstring,250);
+  //all gestures (unused ones as well, clearing gestures of the previous slot)
+  for(uint8_t j = 0; j<VB_GESTURE_COUNT; j++)
+  {
+    sprintf(outputstring,"AT GE %d %d %d %d %d\n",j,currentcfg->gestures[j].type, \
+      currentcfg->gestures[j].vb,currentcfg->gestures[j].vb2,currentcfg->gestures[j].time);
+    halStorageStore(tid,outputstring,250);
+  }
   
   
   //return: 0 if nothing is active, 1 for USB only, 2 for BLE only, 3 for both
@@ -1725,7 +1969,7 @@ void storeSlot(char* slotname)
   halStorageStore(tid,outputstring,250);
       
   //iterate over all possible VBs.
-  for(uint8_t j = 0; j<VB_MAX; j++)
+  for(uint8_t j = 0; j<VB_MAX_ALL; j++)
   {
     //print AT BM (button mode) command first
     sprintf(outputstring,"AT BM %02d\n",j);
@@ -1745,6 +1989,18 @@ void storeSlot(char* slotname)
     halStorageStore(tid,"\n",250);
     ESP_LOGD(LOG_TAG,"%s",outputstring);
   }
+  
+  //compile the binary image, which is loaded on slot switches
+  uint8_t *image = NULL;
+  uint32_t imagelen = 0;
+  if(slotImageBuild(slotname,&image,&imagelen) == ESP_OK)
+  {
+    if(halStorageStoreImage(tid,slotnumber,image,imagelen) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"Cannot store slot image, AT text is used");
+    }
+    free(image);
+  }
 
   //release storage
   free(outputstring);
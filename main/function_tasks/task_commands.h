@@ -62,6 +62,10 @@
 #include "fct_macros.h"
 #include "handler_hid.h"
 #include "handler_vb.h"
+#include "latency.h"
+#include "vb_dispatch.h"
+#include "slot_image.h"
+#include "task_debouncer.h"
 #include "keyboard.h"
 #include "../config_switcher.h"
 
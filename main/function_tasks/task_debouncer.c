@@ -25,9 +25,22 @@
  * 
  * This debouncer task (task_debouncer) waits for incoming events (of
  * type raw_action_t)on the debouncer_in queue. If an incoming event
- * is registered, a timer (esp_timer) will be started. On a finished
- * debounce event, the corresponding event is sent to the system event
- * loop.
+ * is registered, a deadline for this VB is set. On a finished
+ * debounce event, the corresponding event is sent to all handlers
+ * via vb_dispatch.
+ * 
+ * All deadlines are stored in a preallocated table (indexed by VB) and
+ * one single esp_timer is armed for the earliest deadline. On expiry, this
+ * timer only queues a DEBOUNCER_VB_TIMER marker to debouncer_in, all
+ * debouncing states are modified by the debouncer task only.
+ * No timer is created or deleted per event.
+ * 
+ * All debounced events are fed into a gesture engine (gesture.h),
+ * recognized gestures (double/triple tap, long hold, chords) are sent
+ * as press/release of gesture VBs (VB_GESTURE_FIRST...). The gestures
+ * of a slot are compiled when the config is stable again (slot load) or
+ * on a DEBOUNCER_VB_GESTURES marker (AT GE). Long hold deadlines are
+ * handled by the same esp_timer as the debounce deadlines.
  * 
  * The debouncing itself can be controlled via following variables
  * (these settings are located in the global config):
@@ -41,8 +54,12 @@
  * there is no default setting for this device, a hardcoded debounce time
  * of DEBOUNCETIME_MS is used.
  * 
- * @note For each VB, a debouncer_cfg_t element will be used. The size
- * of this array is determined by VB_MAX. Please set this define accordingly!
+ * The debouncing logic itself is a pure-C state machine (debounce_core.h)
+ * with injected clock, time lookup & event sink. This task only feeds it
+ * and connects it to the config, the timer and vb_dispatch.
+ * 
+ * @note The state machine holds one element for each VB (VB_MAX).
+ * Please set this define accordingly!
  * 
  * @see VB_MAX
  * @see DEBOUNCETIME_MS
@@ -61,118 +78,118 @@
 /** @brief Debouncer log level */
 #define LOG_LEVEL_DEBOUNCE ESP_LOG_INFO
 
-/** @brief Debounce timer, current direction for this timer
- * When a debounce timer is started, a parameter struct of
- * type debouncer_param_t is used for starting this timer.
- * It includes the given direction of the timer as it is defined here.
- * @see debouncer_param_t
- */
-typedef enum {
-  TIMER_IDLE,
-  /** @brief Timer is in idle and should not be triggering */
-  TIMER_PRESS,
-  /** @brief Debouncer timer is active for a press event */
-  TIMER_RELEASE,
-  /** @brief Debouncer timer is active for a release event */
-  TIMER_DEADTIME,
-  /** @brief Debouncer timer is active for a deadtime between next event
-   * (lock-out) */
-  TIMER_ERROR
-  /** @brief We have an error. Might be a virtualbutton out of range. */
-} debouncer_direction_t;
+/** @brief Debouncing state machine of all VBs
+ * @note Only accessed by the debouncer task
+ * @see debounce_core.h */
+static debounce_core_t debounceCore;
 
+/** @brief The one esp_timer, armed for the earliest deadline
+ * @see debouncerArm */
+static esp_timer_handle_t debounceTimer = NULL;
 
-/** @brief Timer config struct
- * This struct is used to control one timer for debouncing */
-typedef struct debouncer_cfg {
-  debouncer_direction_t dir;
-  /** @brief Direction/function for this timer */
-  uint32_t vb;
-  /** @brief VB number for this timer */
-  esp_timer_handle_t handle;
-  /** @brief Timer handle for starting/stopping */
-} debouncer_cfg_t;
+/** @brief Deadline [us] debounceTimer is currently armed for, 0 if stopped
+ * @note Cleared by the esp_timer task, use debounceTimerLock
+ * (64bit accesses are not atomic). */
+static int64_t debounceTimerArmed = 0;
 
-/** @brief Start a timer with a given config and debounce time
- * @param cfg Config for the timer to be started
- * @param debounceTime Timeout for the new timer, unit: [ms]
- * @return ESP_OK on success, ESP_FAIL if timer cannot be started */
-esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime);
-
-/** @brief Array of timer configs
- * 
- * This array contains all possible running timer handles.
- * A maximum of DEBOUNCERCHANNELS timers can be concurrently running.
- * 
- * @see DEBOUNCERCHANNELS
- * @see debouncer_cfg_t
- */
-debouncer_cfg_t xTimers[VB_MAX];
+/** @brief Spinlock for debounceTimerArmed (debouncer task & esp_timer task) */
+static portMUX_TYPE debounceTimerLock = portMUX_INITIALIZER_UNLOCKED;
 
+/** @brief Gesture engine, fed with all debounced events
+ * @note Only accessed by the debouncer task */
+static gesture_engine_t debounceGestures;
 
-/** @brief Look for a possibly running debouncing timer
- * 
- * This method does a look-up in the xTimers array to return the
- * timer status for the given VB number (stored within the debouncer_cfg_t struct).
- * @see debouncer_cfg_t
- * @param virtualButton Number of VB to look for a running timer
- * @return Timer direction of this VB.
- * */
-debouncer_direction_t isDebouncerActive(uint32_t virtualButton)
+/** @brief Get the current time for the gesture engine
+ * @return Time [ms] (32bit, wraps around) */
+static inline uint32_t debouncerGestureNow(void)
 {
-  if(virtualButton >= VB_MAX) return TIMER_ERROR;
-  return xTimers[virtualButton].dir;
+  return (uint32_t)(esp_timer_get_time() / 1000);
 }
 
+/** @brief Get the earliest deadline of the debouncer & the gesture engine
+ * @return Earliest deadline [us], 0 if no deadline is running */
+static int64_t debouncerNextDeadline(void)
+{
+  int64_t next = 0;
+  uint32_t gesture;
+  if(debounceNextDeadline(&debounceCore,&next) == 0) next = 0;
+  //long hold deadline of a gesture [ms], converted to [us]
+  if(gestureNextDeadline(&debounceGestures,&gesture))
+  {
+    int64_t deadline = esp_timer_get_time() + \
+      (int64_t)(int32_t)(gesture - debouncerGestureNow()) * 1000;
+    if(next == 0 || deadline < next) next = deadline;
+  }
+  return next;
+}
 
-/** @brief Cancel a possibly running debouncing timer
+/** @brief Arm debounceTimer for the earliest deadline
  * 
- * This method does a look-up in the xTimers array to find a running
- * timer with the given VB number (used as timer id) and cancel it
- * @param virtualButton Number of VB to look for a running timer, use
- * VB_MAX to cancel all timers.
- * @param stop Should we stop the timer before deleting (if set != 0)
- * @return Array offset where this running timer was found & canceled,\
- *  -1 if no timer was found (or all were cleared)
- * @note If VB_MAX is given, all timers are canceled.
+ * The esp_timer is only restarted if the earliest deadline changed.
+ * If no timer is running, the esp_timer is left as it is (an expiry
+ * without a due deadline is ignored).
+ * @param next Earliest deadline, see debouncerNextDeadline
  * */
-int cancelTimer(uint32_t virtualButton, uint8_t stop)
+static void debouncerArm(int64_t next)
 {
-  //if we have VB_MAX here, cancel all of them
-  if(virtualButton >= VB_MAX)
-  {
-    for(int i = 0; i<VB_MAX; i++)
-    {
-      if(xTimers[i].handle != NULL)
-      {
-        if(stop != 0) esp_timer_stop(xTimers[i].handle);
-        esp_timer_delete(xTimers[i].handle);
-        xTimers[i].handle = NULL;
-      }
-      xTimers[i].dir = TIMER_IDLE;
-    }
-    ESP_LOGD(LOG_TAG,"Canceled ALL timers");
-    return -1;
-  }
+  int64_t armed;
+  if(debounceTimer == NULL) return;
+  portENTER_CRITICAL(&debounceTimerLock);
+  armed = debounceTimerArmed;
+  portEXIT_CRITICAL(&debounceTimerLock);
+  if(next == 0 || next == armed) return;
   
-  //else: cancel only requested timer
-  if(xTimers[virtualButton].handle != NULL)
+  int64_t timeout = next - esp_timer_get_time();
+  if(timeout < 0) timeout = 0;
+  esp_timer_stop(debounceTimer);
+  if(esp_timer_start_once(debounceTimer,timeout) != ESP_OK)
   {
-    if(stop != 0)
-    {
-      if(esp_timer_stop(xTimers[virtualButton].handle) != ESP_OK)
-      { ESP_LOGW(LOG_TAG,"Error stopping timer %d",virtualButton); }
-    }
-    if(esp_timer_delete(xTimers[virtualButton].handle) != ESP_OK)
-    { ESP_LOGW(LOG_TAG,"Error deleting timer %d",virtualButton); }
-    xTimers[virtualButton].handle = NULL; //set handle to NULL, so we remember a stopped timer
-    xTimers[virtualButton].dir = TIMER_IDLE;
-    return virtualButton;
-  } else {
-    ESP_LOGD(LOG_TAG,"Cannot cancel, no timer");
-    //no timer found...
-    return -1;
+    ESP_LOGE(LOG_TAG,"Cannot start timer");
+    next = 0;
   }
+  portENTER_CRITICAL(&debounceTimerLock);
+  debounceTimerArmed = next;
+  portEXIT_CRITICAL(&debounceTimerLock);
+}
+
+/** @brief esp_timer callback, signal an expired deadline to the debouncer task
+ * 
+ * Runs in the esp_timer task, only a DEBOUNCER_VB_TIMER marker is queued.
+ * If the queue is full, the debouncer task handles the expiry on its
+ * receive timeout.
+ * @param arg Unused
+ * */
+static void debouncerTimerCallback(void *arg)
+{
+  raw_action_t evt = {.vb = DEBOUNCER_VB_TIMER, .type = VB_PRESS_EVENT, .timestamp = 0};
+  portENTER_CRITICAL(&debounceTimerLock);
+  debounceTimerArmed = 0;
+  portEXIT_CRITICAL(&debounceTimerLock);
+  eventQueueSendToFront(EVENT_QUEUE_DEBOUNCER,EVENT_SRC_MARKER,&evt);
+}
+
+/** @brief Post a debounced VB event to all handlers (vb_dispatch)
+ * 
+ * The event data (vb_event_data_t) contains the origin timestamp of the
+ * raw event, the time spent in the debouncer is recorded for latency measurement.
+ * @param vb Virtual button
+ * @param type Press or release
+ * @param origin Origin timestamp of the raw event (0 if not measured)
+ * @param start Timestamp of receiving the raw event in the debouncer
+ * @return ESP_OK on success, ESP_FAIL if at least one handler dropped this event
+ * */
+static esp_err_t debouncerPost(uint32_t vb, vb_event_t type, uint32_t origin, uint32_t start)
+{
+  vb_event_data_t data;
+  esp_err_t ret;
+  data.vb = vb;
+  data.timestamp = origin;
+  data.posted = latencyRecord(LATENCY_STAGE_DEBOUNCE,(origin != 0) ? start : 0);
+  ret = vbDispatchPost(type,&data);
+  //feed the gesture engine (gesture VBs are ignored there)
+  gestureInput(&debounceGestures,vb,(type == VB_PRESS_EVENT) ? 1 : 0, \
+    debouncerGestureNow(),origin);
+  return ret;
 }
 
 /** @brief Send feedback on pressed buttons to host (for button learning)
@@ -205,150 +222,135 @@ void sendButtonLearn(uint32_t vb, vb_event_t press, generalConfig_t *cfg)
   return;
 }
 
-/** @brief Timer callback for debouncing
+/** @brief Lookup function of debounceCore, get debounce times from the current config
  * 
- * This callback is executed on an expired debounce timer.
- * Depending on the timer functionality (determined by the argument struct),
- * either the PRESS or RELEASE events are sent via the event loop.
- * 
- * @see debouncer_cfg_t
- * @todo Add/test the deadtime functionality here
- * @param arg Timer argument, of type debouncer_cfg_t
+ * If a value is set for this VB, it will be used. Otherwise the global value is used.
+ * @param ctx Unused
+ * @param vb Virtual button
+ * @param which Type of the requested time
+ * @return Configured time [ms], 0 if not set (or no config available)
  * */
-void debouncerCallback(void *arg) {
-  //get own ID (virtual button)
-  debouncer_cfg_t *debcfg = (debouncer_cfg_t *)arg;
-  
-  if(debcfg == NULL)
-  {
-    ESP_LOGE(LOG_TAG,"Illegal argument");
-    return;
-  }
-  
-  uint32_t virtualButton = debcfg->vb;
+static uint16_t debouncerTime(void *ctx, uint32_t vb, debounce_time_t which)
+{
   generalConfig_t *cfg = configGetCurrent();
-  uint16_t deadtime = 0;
-  
-  if(cfg == NULL)
+  if(cfg == NULL || vb >= VB_MAX) return 0;
+  switch(which)
   {
-    ESP_LOGE(LOG_TAG,"Cannot do deadtime for VB %d, global config is NULL!",virtualButton);
-    deadtime = 0;
-  } else {
-    //check if an individual deadtime is set
-    if(cfg->debounce_idle_vb[virtualButton] != 0) deadtime = cfg->debounce_idle_vb[virtualButton];
-    //check if we have to use global deadtime
-    if(deadtime == 0 && cfg->debounce_idle != 0) deadtime = cfg->debounce_idle;
+    case DEBOUNCE_TIME_PRESS:
+      if(cfg->debounce_press_vb[vb] != 0) return cfg->debounce_press_vb[vb];
+      return cfg->debounce_press;
+    case DEBOUNCE_TIME_RELEASE:
+      if(cfg->debounce_release_vb[vb] != 0) return cfg->debounce_release_vb[vb];
+      return cfg->debounce_release;
+    case DEBOUNCE_TIME_IDLE:
+      if(cfg->debounce_idle_vb[vb] != 0) return cfg->debounce_idle_vb[vb];
+      return cfg->debounce_idle;
+    default: return 0;
   }
+}
 
-  switch(debcfg->dir)
+/** @brief Sink of debounceCore, post an event to all handlers
+ * 
+ * Events which are sent after an expired debounce time are fed back to
+ * the host (button learning) and a press creates a tone (sip/puff/strong modes).
+ * @param ctx Unused
+ * @param vb Virtual button
+ * @param press 1 for press, 0 for release
+ * @param origin Origin timestamp of the raw event
+ * @param start Timestamp of receiving the raw event in the debouncer
+ * @param debounced 1 if sent after an expired debounce time, 0 if sent directly
+ * */
+static void debouncerSink(void *ctx, uint32_t vb, uint8_t press, uint32_t origin, \
+  uint32_t start, uint8_t debounced)
+{
+  vb_event_t type = press ? VB_PRESS_EVENT : VB_RELEASE_EVENT;
+  ESP_LOGD(LOG_TAG,"Map VB%d / T: %d (debounced: %d)",vb,type,debounced);
+  if(debouncerPost(vb,type,origin,start) != ESP_OK)
   {
-    case TIMER_IDLE:
-      ESP_LOGE(LOG_TAG,"Major error: debounceCallback but timer should be idle %d",virtualButton);
-      return;
-    case TIMER_PRESS:
-      ESP_LOGD(LOG_TAG,"Debounce finished, map in to out for press VB%d",virtualButton);
-      //map in to out and clear from in...
-      if(esp_event_post(VB_EVENT,VB_PRESS_EVENT,(void*)&virtualButton,sizeof(uint32_t),0) != ESP_OK)
-      {
-        ESP_LOGW(LOG_TAG,"Cannot post event!");
-      }
-      //stop timer
-      if(cancelTimer(virtualButton,0) == -1) ESP_LOGE(LOG_TAG,"Cannot cancel timer (CB)!");
-      //send feedback to host, if enabled
-      sendButtonLearn(virtualButton,VB_PRESS_EVENT,cfg);
-      //create tones, according to issued VB
-      ///@todo Maybe we can replace this switch statement with a more flexible solution.
-      switch(virtualButton & 0x7F)
-      {
-        //tones for sip/puff
-        case VB_SIP: TONE(TONE_SIP_FREQ,TONE_SIP_DURATION); break;
-        case VB_PUFF: TONE(TONE_PUFF_FREQ,TONE_PUFF_DURATION); break;
-        //tones for StrongPuff + XXX 
-        case VB_STRONGPUFF_UP:
-        case VB_STRONGPUFF_DOWN:
-        case VB_STRONGPUFF_LEFT:
-        case VB_STRONGPUFF_RIGHT: TONE(TONE_STRONGPUFF_ACTION_FREQ,TONE_STRONGPUFF_ACTION_DURATION); break;
-        //tones for StrongSip + XXX 
-        case VB_STRONGSIP_UP:
-        case VB_STRONGSIP_DOWN:
-        case VB_STRONGSIP_LEFT:
-        case VB_STRONGSIP_RIGHT: TONE(TONE_STRONGSIP_ACTION_FREQ,TONE_STRONGSIP_ACTION_DURATION); break;
-        default: break;
-      }
-      break;
-    case TIMER_RELEASE:
-      ESP_LOGD(LOG_TAG,"Debounce finished, map in to out for release VB%d",virtualButton);
-      //map in to out and clear from in...
-      if(esp_event_post(VB_EVENT,VB_RELEASE_EVENT,(void*)&virtualButton,sizeof(uint32_t),0) != ESP_OK)
-      {
-        ESP_LOGW(LOG_TAG,"Cannot post event!");
-      }
-      //stop timer
-      if(cancelTimer(virtualButton,0) == -1) ESP_LOGE(LOG_TAG,"Cannot cancel timer (CB)!");
-      //send feedback to host, if enabled
-      sendButtonLearn(virtualButton,VB_RELEASE_EVENT,cfg);
-      break;
-    case TIMER_DEADTIME:
-      ESP_LOGD(LOG_TAG,"Deadtime finished, ready");
-      if(cancelTimer(virtualButton,0) == -1) ESP_LOGE(LOG_TAG,"Cannot cancel timer (CB)!");
-      return;
-    default: return;
+    ESP_LOGW(LOG_TAG,"Cannot post event!");
   }
-  //if necessary, start timer again for deadtime.
-  if(deadtime != 0)
+  if(debounced == 0) return;
+  
+  //send feedback to host, if enabled
+  sendButtonLearn(vb,type,configGetCurrent());
+  if(type != VB_PRESS_EVENT) return;
+  //create tones, according to issued VB
+  ///@todo Maybe we can replace this switch statement with a more flexible solution.
+  switch(vb & 0x7F)
   {
-    if(cancelTimer(virtualButton,0) == -1) ESP_LOGE(LOG_TAG,"Cannot cancel timer (CB)!");
-    debcfg->dir = TIMER_DEADTIME;
-    if(startTimer(debcfg,deadtime) != ESP_OK) 
-    {
-      ESP_LOGE(LOG_TAG,"Cannot start timer... (CB)");
-    } else {
-      ESP_LOGD(LOG_TAG,"Deadtime start for VB %d",virtualButton);
-    }
+    //tones for sip/puff
+    case VB_SIP: TONE(TONE_SIP_FREQ,TONE_SIP_DURATION); break;
+    case VB_PUFF: TONE(TONE_PUFF_FREQ,TONE_PUFF_DURATION); break;
+    //tones for StrongPuff + XXX 
+    case VB_STRONGPUFF_UP:
+    case VB_STRONGPUFF_DOWN:
+    case VB_STRONGPUFF_LEFT:
+    case VB_STRONGPUFF_RIGHT: TONE(TONE_STRONGPUFF_ACTION_FREQ,TONE_STRONGPUFF_ACTION_DURATION); break;
+    //tones for StrongSip + XXX 
+    case VB_STRONGSIP_UP:
+    case VB_STRONGSIP_DOWN:
+    case VB_STRONGSIP_LEFT:
+    case VB_STRONGSIP_RIGHT: TONE(TONE_STRONGSIP_ACTION_FREQ,TONE_STRONGSIP_ACTION_DURATION); break;
+    default: break;
   }
 }
 
-/** @brief Start a timer with a given config and debounce time
- * @param cfg Config for the timer to be started
- * @param debounceTime Timeout for the new timer, unit: [ms]
- * @return ESP_OK on success, ESP_FAIL if timer cannot be started */
-esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime)
+/** @brief Sink of the gesture engine, post a gesture VB to all handlers
+ * @param ctx Unused
+ * @param vb Gesture VB
+ * @param press 1 for press, 0 for release
+ * @param origin Origin timestamp of the triggering event
+ * */
+static void debouncerGestureSink(void *ctx, uint32_t vb, uint8_t press, uint32_t origin)
 {
-  //check if there is a valid VB number (used as index)
-  if(cfg->vb >= VB_MAX) return ESP_FAIL;
-  
-  //if there is a timer running, cancel it before.
-  if(isDebouncerActive(cfg->vb) != TIMER_IDLE) cancelTimer(cfg->vb,1);
-  
-  //create the timer
-  esp_timer_create_args_t args;
-  xTimers[cfg->vb].dir = cfg->dir;
-  args.callback = debouncerCallback; //always the same callback
-  args.arg = (void *)&xTimers[cfg->vb]; //we assign a pointer to this array member
-  args.dispatch_method = ESP_TIMER_TASK; //no other option possible
-  esp_err_t ret = esp_timer_create(&args,&xTimers[cfg->vb].handle);
-  
-  if(ret != ESP_OK)
-  {
-    ESP_LOGE(LOG_TAG,"Cannot create timer, ret: %d",ret);
-    return ESP_FAIL;
-  }
-  
-  //now start this timer (only one-shot)
-  //we need to multiply the given time (in [ms]) to have the
-  //necessary [us] parameter.
-  ret = esp_timer_start_once(xTimers[cfg->vb].handle, debounceTime * 1000);
-  
-  if(ret != ESP_OK)
+  ESP_LOGD(LOG_TAG,"Gesture VB%d %s",vb,press ? "press" : "release");
+  if(debouncerPost(vb,press ? VB_PRESS_EVENT : VB_RELEASE_EVENT,origin,latencyNow()) != ESP_OK)
   {
-    ESP_LOGE(LOG_TAG,"Cannot start timer, ret: %d",ret);
-    return ESP_FAIL;
+    ESP_LOGW(LOG_TAG,"Cannot post gesture event!");
   }
-  
-  //yeah, everything fine...
+}
+
+/** @brief Compile the gestures of the current config
+ * 
+ * The input VBs of all gestures are published to vb_usage (an input
+ * VB without any command must still send events).
+ * @param cfg Current config
+ * */
+static void debouncerGesturesCompile(generalConfig_t *cfg)
+{
+  uint8_t count = gestureCompile(&debounceGestures,cfg->gestures,VB_GESTURE_COUNT, \
+    VB_MAX,VB_GESTURE_FIRST,debouncerGestureSink,NULL);
+  vbUsagePublish(VB_USAGE_GESTURE,gestureGetUsed(&debounceGestures));
+  ESP_LOGI(LOG_TAG,"Compiled %d gestures",count);
+}
+
+/** @brief Request a new compilation of the gestures (e.g., after AT GE)
+ * 
+ * A DEBOUNCER_VB_GESTURES marker is queued, the gestures are compiled by
+ * the debouncer task.
+ * @return ESP_OK on success, ESP_FAIL if the marker cannot be queued
+ * */
+esp_err_t debouncerGesturesChanged(void)
+{
+  raw_action_t evt = {.vb = DEBOUNCER_VB_GESTURES, .type = VB_PRESS_EVENT, .timestamp = 0};
+  if(debouncer_in == NULL) return ESP_FAIL;
+  if(eventQueueSend(EVENT_QUEUE_DEBOUNCER,EVENT_SRC_MARKER,&evt,10) == 0) return ESP_FAIL;
   return ESP_OK;
 }
 
+/** @brief Handle all expired deadlines
+ * 
+ * Processes expired debounce deadlines (debounceCore) and
+ * expired gesture deadlines (long hold).
+ * @return Earliest remaining deadline [us], 0 if no deadline is running
+ * */
+static int64_t debouncerProcessExpired(void)
+{
+  debounceProcess(&debounceCore,esp_timer_get_time());
+  gestureProcess(&debounceGestures,debouncerGestureNow());
+  return debouncerNextDeadline();
+}
+
 /** @brief Debouncing main task
  * 
  * This task is pending on raw actions, sent to the debouncer_in queue.
@@ -357,19 +359,18 @@ esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime)
  * * Cancels a running timer (timer is running in the opposite debouncer direction)
  * * Does nothing (timer is already running in the same direction)
  * 
- * @see DEBOUNCERCHANNELS
  * @see DEBOUNCE_RESOLUTION_MS
- * @see xTimers
- * @see debouncerCallback
+ * @see debounce_core_t
+ * @see debounceInput
  * @todo Add anti-tremor & deadtime functionality
  * */
 void task_debouncer(void *param)
 {
   generalConfig_t *cfg = configGetCurrent();
   raw_action_t evt;
-  debouncer_cfg_t debcfg;
-  debcfg.handle = NULL;
-  uint16_t time = 0;
+  uint32_t received = 0;
+  int64_t next = 0;
+  TickType_t wait;
   esp_log_level_set(LOG_TAG,LOG_LEVEL_DEBOUNCE);
   
   //test if eventgroup is created
@@ -378,12 +379,21 @@ void task_debouncer(void *param)
     ESP_LOGE(LOG_TAG,"Eventgroup uninitialized, retry in 1s");
     vTaskDelay(1000/portTICK_PERIOD_MS);
   }
-  //clear the xTimers array
-  for(int i = 0; i<VB_MAX; i++)
+  //initialize the debouncing state machine of all VBs
+  debounceInit(&debounceCore,VB_MAX,DEBOUNCETIME_MS,DEBOUNCETIME_MIN_MS, \
+    debouncerTime,debouncerSink,NULL);
+  
+  //create the one & only debounce timer
+  esp_timer_create_args_t args = {
+    .callback = debouncerTimerCallback,
+    .arg = NULL,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "debounce"
+  };
+  if(esp_timer_create(&args,&debounceTimer) != ESP_OK)
   {
-    xTimers[i].dir = TIMER_IDLE;
-    xTimers[i].handle = NULL;
-    xTimers[i].vb = i;
+    ESP_LOGE(LOG_TAG,"Cannot create timer, exiting");
+    vTaskDelete(NULL);
   }
   
   //wait until config is valid
@@ -394,6 +404,7 @@ void task_debouncer(void *param)
     cfg = configGetCurrent();
   }
   
+  debouncerGesturesCompile(cfg);
   ESP_LOGI(LOG_TAG,"Debouncer started");
 
   while(1)
@@ -402,9 +413,10 @@ void task_debouncer(void *param)
     if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0)
     {
       //cancel all timers
-      cancelTimer(VB_MAX,1);
+      debounceCancel(&debounceCore,VB_MAX);
+      gestureReset(&debounceGestures);
       //clear all VB events
-      xQueueReset(debouncer_in);
+      eventQueueReset(EVENT_QUEUE_DEBOUNCER);
       //wait 5 ticks to check again
       //If not set in time, wait again
       if((xEventGroupWaitBits(systemStatus,SYSTEM_STABLECONFIG, \
@@ -413,116 +425,45 @@ void task_debouncer(void *param)
         ESP_LOGD(LOG_TAG,"Waiting for config");
         continue;
       }
+      //config is stable again (e.g., new slot loaded): compile its gestures
+      debouncerGesturesCompile(cfg);
+    }
+    
+    //handle expired deadlines & arm the timer for the next one
+    next = debouncerProcessExpired();
+    debouncerArm(next);
+    
+    //wait for the next event. If the timer marker cannot be queued,
+    //we process the expired deadline after this timeout anyway.
+    if(next == 0) wait = portMAX_DELAY;
+    else {
+      int64_t remaining = next - esp_timer_get_time();
+      if(remaining < 0) remaining = 0;
+      wait = (remaining / 1000) / portTICK_PERIOD_MS + 2;
     }
     
-    if(xQueueReceive(debouncer_in,&evt,portMAX_DELAY) == pdTRUE)
+    if(eventQueueReceive(EVENT_QUEUE_DEBOUNCER,&evt,wait) == pdTRUE)
     {
+      //timer marker: expired deadlines are handled on the next iteration
+      if(evt.vb == DEBOUNCER_VB_TIMER) continue;
+      //gestures changed (AT GE)
+      if(evt.vb == DEBOUNCER_VB_GESTURES)
+      {
+        debouncerGesturesCompile(cfg);
+        continue;
+      }
+      
       if(evt.vb >= VB_MAX)
       {
         ESP_LOGE(LOG_TAG,"VB out of range!");
         continue;
       }
-      //if timer is not running, start one with the corresponding
-      //edge and set xTimerDirection.
-      if(isDebouncerActive(evt.vb) == TIMER_IDLE) 
-      {
-        //check which time to use (either VB, global value or default)
-        uint8_t t_type = TIMER_IDLE;
-        
-        switch(evt.type)
-        {
-          case VB_PRESS_EVENT:
-            t_type = TIMER_PRESS;
-            //is a VB value set in config?
-            if(cfg->debounce_press_vb[evt.vb] != 0) time = cfg->debounce_press_vb[evt.vb];
-            //is a global value set in config?
-            if(time == 0 && cfg->debounce_press != 0) time = cfg->debounce_press;
-            //no? just use the default value
-            if(time == 0) time = DEBOUNCETIME_MS;
-          break;
-          case VB_RELEASE_EVENT:
-            t_type = TIMER_RELEASE;
-            //is a VB value set in config?
-            if(cfg->debounce_release_vb[evt.vb] != 0) time = cfg->debounce_release_vb[evt.vb];
-            //is a global value set in config?
-            if(time == 0 && cfg->debounce_release != 0) time = cfg->debounce_release;
-            //no? just use the default value
-            if(time == 0) time = DEBOUNCETIME_MS;
-          break;
-          default: break;
-        }
-        if(time > DEBOUNCETIME_MIN_MS)
-        {
-          debcfg.vb = evt.vb;
-          debcfg.dir = t_type;
-          if(startTimer(&debcfg,time) != ESP_OK) ESP_LOGE(LOG_TAG,"Cannot start timer...");
-          else {
-            ESP_LOGD(LOG_TAG,"Debounce started for VB%d / T: %d",evt.vb,t_type);
-          }
-          continue;
-        //note: currently, following branch is unused, but maybe we need a directly mapped VB.
-        } else {
-          //if no debounce time is used
-          ESP_LOGD(LOG_TAG,"Map VB%d / T: %d",evt.vb,evt.type);
-          if(esp_event_post(VB_EVENT,evt.type,(void*)&evt.vb,sizeof(evt.vb),0) != ESP_OK)
-          {
-            ESP_LOGW(LOG_TAG,"Cannot post event!");
-          }
-          continue;
-        }
-      } else {
-        //if timer is running, check if this flag requests the
-        //opposite direction OR the same direction is cleared
-        //if yes -> stop & delete this timer
-        switch(xTimers[evt.vb].dir)
-        {
-          case TIMER_PRESS:
-            //if release is wanted, but press timer is running
-            //->cancel timer
-            if(evt.type == VB_RELEASE_EVENT)
-            {
-              ESP_LOGD(LOG_TAG,"Press canceled for VB%d, sending release",evt.vb);
-              if(cancelTimer(evt.vb,1) == -1) //stop current press debouncer
-              { ESP_LOGE(LOG_TAG,"Cannot cancel press timer!"); }
-              ///@note We send here an additional release, just to be sure
-              /// to release any actions (avoiding sticky actions for keys...)
-              if(esp_event_post(VB_EVENT,evt.type,(void*)&evt.vb,sizeof(evt.vb),0) != ESP_OK)
-              {
-                ESP_LOGW(LOG_TAG,"Cannot post event!");
-              }
-            }
-            break;
-          case TIMER_RELEASE:
-            //if press is wanted, but release timer is running
-            //->cancel timer
-            ///@note I think we should cancel only in the event of a
-            /// set anti-tremor time. Otherwise we might loose e.g., key
-            /// release events -> sticky keys...
-            time = 0;
-            //is a VB value set in config?
-            if(cfg->debounce_release_vb[evt.vb] != 0) time = cfg->debounce_release_vb[evt.vb];
-            //is a global value set in config?
-            if(time == 0 && cfg->debounce_release != 0) time = cfg->debounce_release;
-            if(evt.type == VB_PRESS_EVENT && time != 0)
-            {
-              ESP_LOGD(LOG_TAG,"Release canceled for VB%d",evt.vb);
-              if(cancelTimer(evt.vb,1) == -1) //stop current press debouncer
-              { ESP_LOGE(LOG_TAG,"Cannot cancel release timer!"); }
-            }
-            break;
-          case TIMER_IDLE:
-            ESP_LOGE(LOG_TAG,"Timer is idle but a valid ID?");
-            break;
-          case TIMER_DEADTIME:
-            ESP_LOGD(LOG_TAG,"Deadtime active, waiting.");
-            break;
-          case TIMER_ERROR:
-            ESP_LOGE(LOG_TAG,"Timer is in error state [%d]",evt.vb);
-          default:
-            ESP_LOGE(LOG_TAG,"Unknown status in xTimers[%d].dir",evt.vb);
-            break;
-        }
-      } /* else -> timerId != TIMER_IDLE */
+      //latency: origin (ISR/ADC) until received here
+      received = latencyRecord(LATENCY_STAGE_INPUT,evt.timestamp);
+      //feed the state machine, it posts (via debouncerSink) immediately or
+      //after the debounce time (via debouncerProcessExpired)
+      debounceInput(&debounceCore,evt.vb,(evt.type == VB_PRESS_EVENT) ? 1 : 0, \
+        esp_timer_get_time(),evt.timestamp,received);
     } /* if(xQueueReceive... */
   } /* while(1) */
 } /* task_debouncer */
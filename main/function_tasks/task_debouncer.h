@@ -25,9 +25,13 @@
  * 
  * This debouncer task (task_debouncer) waits for incoming events (of
  * type raw_action_t)on the debouncer_in queue. If an incoming event
- * is registered, a timer (esp_timer) will be started. On a finished
- * debounce event, the corresponding event is sent to the system event
- * loop.
+ * is registered, a deadline for this VB is set (one single, preallocated
+ * esp_timer is armed for the earliest deadline). On a finished
+ * debounce event, the corresponding event is sent to all handlers
+ * via vb_dispatch.
+ * 
+ * Debounced events are fed into a gesture engine (gesture.h), recognized
+ * gestures are sent as gesture VBs (VB_GESTURE_FIRST...).
  * 
  * The debouncing itself can be controlled via following variables
  * (these settings are located in the global config):
@@ -41,8 +45,12 @@
  * there is no default setting for this device, a hardcoded debounce time
  * of DEBOUNCETIME_MS is used.
  * 
- * @note For each VB, a debouncer_cfg_t element will be used. The size
- * of this array is determined by VB_MAX. Please set this define accordingly!
+ * The debouncing logic itself is a pure-C state machine (debounce_core.h)
+ * with injected clock, time lookup & event sink. This task only feeds it
+ * and connects it to the config, the timer and vb_dispatch.
+ * 
+ * @note The state machine holds one element for each VB (VB_MAX).
+ * Please set this define accordingly!
  * 
  * @see VB_MAX
  * @see DEBOUNCETIME_MS
@@ -62,10 +70,15 @@
 #include <esp_timer.h>
 //common definitions & data for all of these functional tasks
 #include "common.h"
+#include "latency.h"
+#include "vb_dispatch.h"
+#include "vb_usage.h"
+#include "gesture.h"
+#include "debounce_core.h"
 #include "../config_switcher.h"
 
 /** @brief Default time before debounce kicks in and a raw_action input
- * event is sent to the system event loop.
+ * event is sent to vb_dispatch.
  * @note This debounce time is used, if no values are set in generalconfig.
  * */
 #define DEBOUNCETIME_MS 50
@@ -73,6 +86,19 @@
 /** @brief Minimum debounce time, anything below will be mapped directly. */
 #define DEBOUNCETIME_MIN_MS 10
 
+/** @brief VB number of the internal timer marker in debouncer_in
+ * 
+ * Queued by the debounce timer on an expired deadline, never sent
+ * by any input module.
+ * */
+#define DEBOUNCER_VB_TIMER 0xFFFFFFFF
+
+/** @brief VB number of the internal gesture marker in debouncer_in
+ * 
+ * Queued by debouncerGesturesChanged, the gestures are compiled again.
+ * */
+#define DEBOUNCER_VB_GESTURES 0xFFFFFFFE
+
 /** Stack size for debouncer task */
 #define TASK_DEBOUNCER_STACKSIZE 2048
 
@@ -83,20 +109,27 @@
  * wakeups). If a change is detected (either press or release flag for
  * a virtualbutton is set), a timer is started.<br>
  * Either the timer expires and the flag is mapped to virtualButtonsOut
- * by debouncerCallback.<br>
+ * by debounceProcess (debounce_core.h).<br>
  * Or the input flag is cleared again by the responsible task and the
  * debouncer cancels the timer as well (input was too short).
  * 
  * 
- * @see DEBOUNCERCHANNELS
  * @see DEBOUNCE_RESOLUTION_MS
- * @see xTimers
- * @see debouncerCallback
+ * @see debounce_core_t
+ * @see debounceInput
  * @see virtualButtonsIn
  * @see virtualButtonsOut
  * @note This task is persistently running
  * */
 void task_debouncer(void *param);
 
+/** @brief Request a new compilation of the gestures (e.g., after AT GE)
+ * 
+ * A DEBOUNCER_VB_GESTURES marker is queued, the gestures are compiled by
+ * the debouncer task.
+ * @return ESP_OK on success, ESP_FAIL if the marker cannot be queued
+ * */
+esp_err_t debouncerGesturesChanged(void);
+
 
 #endif /*_TASK_DEBOUNCER_H*/
@@ -23,16 +23,17 @@
  * 
  * The hal_adc files are used to measure all ADC inputs (4 direction
  * sensors and 1 pressure sensor).
- * In addition, depending on the configuration, different ADC tasks are
- * loaded.
- * One of these tasks is loaded:<br>
- * * halAdcMouse - Use the ADC values as mouse input <br>
- * * halAdcThreshold - Use the ADC values to trigger virtual buttons 
+ * One ADC task (halAdcTask) is started, which reads all sensors and
+ * passes the data to one of these mode strategies, depending on the
+ * configuration:<br>
+ * * Mouse - Use the ADC values as mouse input <br>
+ * * Threshold - Use the ADC values to trigger virtual buttons 
  * (keyboard actions for example) <br>
- * * halAdcJoystick - Use the ADC input to control the HID joystick <br>
+ * * Joystick - Use the ADC input to control the HID joystick <br>
  * 
- * These tasks are HAL tasks, which means they might be reloaded/changed,
- * but they are not managed outside this module.<br>
+ * This task is a HAL task, which means it is not managed outside this
+ * module. A mode change is done on the next sample, without
+ * deleting/creating a task.<br>
  * In addition, the FUNCTIONAL task task_calibration can be used to
  * trigger a zero-point calibration of the mouthpiece.
  * 
@@ -71,16 +72,24 @@ typedef struct adcData {
     int32_t y;
     uint8_t calibrate_request;
     strong_action_t strongmode;
+    /** timestamp [us] of entering the current strong mode (valid if strongmode != STRONG_NORMAL) */
+    int64_t strongsince;
+    /** timestamp [us] of this sample, all time dependent processing of one sample uses this value */
+    int64_t now;
+    /** sample period [us] in active state, used to scale time dependent calculations */
+    uint32_t period;
 } adcData_t;
 
-/** current loaded ADC task handle, used to delete & recreate an ADC task
- * @see halAdcTaskMouse
- * @see halAdcTaskJoystick
- * @see halAdcTaskThreshold */
+/** ADC task handle, this task is created once in halAdcInit
+ * @see halAdcTask */
 TaskHandle_t adcHandle = NULL;
 
-/** current activated ADC config.
+/** current activated ADC config, used by the ADC task for one sample.
+ * 
+ * This is a copy of the published config, loaded by the ADC task at
+ * the beginning of each sample (halAdcLoadConfig).
  * @see adc_config_t
+ * @see halAdcLoadConfig
  * */
 adc_config_t adc_conf;
 
@@ -93,8 +102,7 @@ TickType_t adcCalibLast = 0;
 
 /** @brief Semaphore for ADC readings.
  * 
- * This semaphore is used to switch between halADCTask<Joystick,Mouse,Threshold>
- * and calibration.
+ * This semaphore is used to switch between halAdcTask and calibration.
  * In addition, it is used for strong sip&puff + up/down/left/right.
  * */
 SemaphoreHandle_t adcSem = NULL;
@@ -105,18 +113,101 @@ esp_adc_cal_characteristics_t characteristics;
 /** offset values, calibrated via "Calibration middle position" */
 static int32_t offsetx,offsety;
 
-/** @brief Timer for strong mode timeout
- * This timer is used for a timeout moving back to STRONG_NORMAL if
- * we entered a STRONG_PUFF or STRONG_SIP mode and no action was triggered*/
-TimerHandle_t adcStrongTimeoutTimerHandle;
+#ifdef DEVICE_FLIPMOUSE
+/** @brief VB usage mask of all strong sip + direction VBs
+ * 
+ * If any of these VBs has a command assigned, strong sip enters the
+ * strong mode instead of triggering VB_STRONGSIP.
+ * @see vbUsageGet */
+#define HAL_ADC_STRONGSIP_COMBO (VB_USAGE_BIT(VB_STRONGSIP_UP) | VB_USAGE_BIT(VB_STRONGSIP_DOWN) | \
+    VB_USAGE_BIT(VB_STRONGSIP_LEFT) | VB_USAGE_BIT(VB_STRONGSIP_RIGHT))
+
+/** @brief VB usage mask of all strong puff + direction VBs
+ * @see HAL_ADC_STRONGSIP_COMBO */
+#define HAL_ADC_STRONGPUFF_COMBO (VB_USAGE_BIT(VB_STRONGPUFF_UP) | VB_USAGE_BIT(VB_STRONGPUFF_DOWN) | \
+    VB_USAGE_BIT(VB_STRONGPUFF_LEFT) | VB_USAGE_BIT(VB_STRONGPUFF_RIGHT))
+#endif
+
+/** @brief Currently active kernel coefficients, copy for one sample
+ * @see adcKernel_t
+ * @see halAdcLoadConfig */
+static adcKernel_t adcKernel;
+
+/** @brief One published ADC config, including the precomputed kernel
+ * @see adcConfigBuffer */
+typedef struct adcConfigSnapshot {
+    /** @brief ADC config */
+    adc_config_t conf;
+    /** @brief Kernel coefficients, built from conf */
+    adcKernel_t kernel;
+} adcConfigSnapshot_t;
+
+/** @brief Double buffer for published ADC configs
+ * 
+ * The ADC config is published lock-free (seqlock):
+ * The active buffer is (adcConfigSeq >> 1) & 1, halAdcUpdateConfig
+ * writes to the other buffer while adcConfigSeq is odd and publishes
+ * it by incrementing adcConfigSeq again.
+ * The ADC task never blocks on a config update, it copies the active
+ * buffer and retries only if the buffer was overwritten while copying.
+ * 
+ * @see halAdcUpdateConfig
+ * @see halAdcLoadConfig
+ * */
+static adcConfigSnapshot_t adcConfigBuffer[2];
+
+/** @brief Sequence number of the published ADC config
+ * 
+ * Incremented twice per config update (odd while writing).
+ * @see adcConfigBuffer */
+static uint32_t adcConfigSeq = 0;
+
+/** @brief Count of samples which saw a config change while being processed
+ * @see halAdcGetConfigChangeCount */
+static uint32_t adcConfigChangedMidSample = 0;
 
-/** @brief Timer for strong mode delay
- * This timer is used for waiting before checking for the additional action
- * (up,down,left,right)*/
-TimerHandle_t adcStrongTimerHandle;
+/** @brief Mutex for serializing config writers (halAdcUpdateConfig),
+ * it is never taken by the ADC task. */
+static SemaphoreHandle_t adcConfigWriteSem = NULL;
+
+/** @brief Load the currently published ADC config (lock-free)
+ * 
+ * Copies the active config buffer into adc_conf & adcKernel, which are
+ * used by the ADC task for one sample.
+ * The writer only touches the inactive buffer, so the copy is valid
+ * if no further update was started on the copied buffer (at least
+ * 3 increments of the sequence number).
+ * 
+ * @see adcConfigBuffer
+ * @return Sequence number of the loaded config
+ * */
+static uint32_t halAdcLoadConfig(void)
+{
+    uint32_t seq,seqend;
+    do {
+        seq = __atomic_load_n(&adcConfigSeq,__ATOMIC_ACQUIRE);
+        const adcConfigSnapshot_t *snap = &adcConfigBuffer[(seq >> 1) & 1];
+        memcpy(&adc_conf,&snap->conf,sizeof(adc_config_t));
+        memcpy(&adcKernel,&snap->kernel,sizeof(adcKernel_t));
+        //the copy must be complete before the sequence number is checked again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seqend = __atomic_load_n(&adcConfigSeq,__ATOMIC_RELAXED);
+    //buffer is overwritten on the 2nd update after an even sequence number
+    } while((seqend - (seq & ~1UL)) >= 3);
+    return seq;
+}
 
-/** @brief Semaphore, to signal a short delay for checking strong mode */
-SemaphoreHandle_t adcStrongSem;
+/** @brief Get the number of samples which saw a config change mid-flight
+ * 
+ * Incremented by the ADC task if a new config was published while a
+ * sample was processed (this sample was processed with the previous config).
+ * 
+ * @return Count of samples since startup
+ * */
+uint32_t halAdcGetConfigChangeCount(void)
+{
+    return adcConfigChangedMidSample;
+}
 
 /** @brief Validate the input value and replace with default if not matching
  * @param value Value to be validated
@@ -134,6 +225,92 @@ uint32_t validate(uint32_t value, uint32_t min, uint32_t max, uint32_t defaultVa
     return value;
 }
 
+/** @brief Hysteresis state of all channels (1<<adc_hyst_channel_t is set if active)
+ * @see halAdcHysteresis */
+static uint8_t adcHystActive = 0;
+
+/** @brief State of all channels without hysteresis band (bare threshold)
+ * @see halAdcHysteresis */
+static uint8_t adcHystRaw = 0;
+
+/** @brief Count of VB events sent to debouncer_in by the ADC task
+ * @see halAdcGetHysteresisStats */
+static uint32_t adcHystEmitted = 0;
+
+/** @brief Count of threshold crossings, which were held back by a hysteresis band
+ * @see halAdcGetHysteresisStats */
+static uint32_t adcHystSuppressed = 0;
+
+/** @brief Send a VB event to the debouncer (counted for hysteresis statistics)
+ * @param evt Event to be sent */
+static void halAdcSendEvent(raw_action_t *evt)
+{
+    eventQueueSend(EVENT_QUEUE_DEBOUNCER,EVENT_SRC_ADC,evt,0);
+    adcHystEmitted++;
+}
+
+/** @brief Apply the hysteresis band of one channel
+ * 
+ * An idle channel becomes active if the value exceeds the threshold by
+ * more than hyst_enter, an active channel stays active until the value
+ * exceeds the threshold by hyst_exit or less.
+ * With both values set to 0, the bare threshold is used.
+ * 
+ * Each crossing of the bare threshold which does not change the state
+ * is counted as suppressed.
+ * 
+ * @param ch Channel
+ * @param depth Value beyond the channel's threshold (<= 0 is on the idle side)
+ * @return 1 if the channel is active, 0 otherwise
+ * */
+static uint8_t halAdcHysteresis(adc_hyst_channel_t ch, int32_t depth)
+{
+    uint8_t active = (adcHystActive >> ch) & 1;
+    uint8_t raw = (depth > 0) ? 1 : 0;
+    
+    if(active) active = (depth > adc_conf.hyst_exit[ch]) ? 1 : 0;
+    else active = (depth > adc_conf.hyst_enter[ch]) ? 1 : 0;
+    
+    //bare threshold crossed, but band holds the state -> one event less
+    if(raw != ((adcHystRaw >> ch) & 1) && raw != active) adcHystSuppressed++;
+    
+    adcHystRaw = (adcHystRaw & ~(1<<ch)) | (raw<<ch);
+    adcHystActive = (adcHystActive & ~(1<<ch)) | (active<<ch);
+    return active;
+}
+
+/** @brief Get the count of emitted & suppressed VB events
+ * 
+ * @param emitted Count of VB events sent to debouncer_in, might be NULL
+ * @param suppressed Count of threshold crossings held back by the hysteresis, might be NULL
+ * */
+void halAdcGetHysteresisStats(uint32_t *emitted, uint32_t *suppressed)
+{
+    if(emitted != NULL) *emitted = adcHystEmitted;
+    if(suppressed != NULL) *suppressed = adcHystSuppressed;
+}
+
+/** @brief Reset the counters of emitted & suppressed VB events */
+void halAdcResetHysteresisStats(void)
+{
+    adcHystEmitted = 0;
+    adcHystSuppressed = 0;
+}
+
+/** @brief Enter a strong sip/puff mode
+ * 
+ * The entry time is taken from the current sample, the delay & timeout
+ * of halAdcProcessStrongMode are measured from this timestamp.
+ * 
+ * @param D ADC data from calling task
+ * @param mode Strong mode to enter (STRONG_SIP or STRONG_PUFF)
+ * */
+static void halAdcEnterStrongMode(adcData_t *D, strong_action_t mode)
+{
+    D->strongmode = mode;
+    D->strongsince = D->now;
+}
+
 /** @brief Trigger strong sip/puff + action according to input data
  * 
  * This method is used to trigger VBs for actions of type STRONG_SIP or
@@ -141,10 +318,15 @@ uint32_t validate(uint32_t value, uint32_t min, uint32_t max, uint32_t defaultVa
  * It should only be triggered if there is no VB_STRONGPUFF / VB_STRONGSIP
  * action is defined (this is handled in halAdcProcessPressure ).
  * 
- * We use 2 RTOS timers here: One for a delay between entering strong mode
- * and triggering an action. The second timer is used for a timeout,
- * if no additional action is triggered and we should leave the strong
- * mode.
+ * This is a per-sample state machine, driven by the timestamp of the
+ * sample (D->now) and the time of entering the strong mode (D->strongsince):<br>
+ * * Until strong_delay [ms] has passed, any movement is ignored <br>
+ * * The first movement afterwards triggers the corresponding VB and
+ * returns to STRONG_NORMAL <br>
+ * * If no movement is detected until strong_timeout [ms], the strong mode
+ * is left without any action <br>
+ * 
+ * No timers or semaphores are used, the state is only modified by the ADC task.
  * 
  * @see halAdcProcessPressure
  * @see VB_STRONGPUFF
@@ -162,6 +344,7 @@ uint32_t validate(uint32_t value, uint32_t min, uint32_t max, uint32_t defaultVa
 void halAdcProcessStrongMode(adcData_t *D)
 {
     raw_action_t evt;
+    evt.timestamp = (uint32_t)D->now;
     //on a FABI device, we cannot do this combination with analog values.
     //maybe it will be done on another firmware part.
     #ifdef DEVICE_FABI
@@ -173,83 +356,45 @@ void halAdcProcessStrongMode(adcData_t *D)
     if(D->strongmode == STRONG_NORMAL) return;
     
     #ifdef DEVICE_FLIPMOUSE
-    if(adcStrongTimerHandle == NULL || adcStrongTimeoutTimerHandle == NULL)
-    {
-        ESP_LOGE(LOG_TAG,"Strong mode timer uninitialized!!!");
-        return;
-    }
+    //time since entering the strong mode [ms]
+    int64_t elapsed = (D->now - D->strongsince) / 1000;
     
-    //timer is not started
-    if(xTimerIsTimerActive(adcStrongTimeoutTimerHandle) == pdFALSE)
+    //timeout: set strong mode back to normal
+    if(elapsed >= adc_conf.strong_timeout)
     {
-        //than we need to start a timer for the timeout moving back to NORMAL
-        xTimerReset(adcStrongTimeoutTimerHandle,0);
-        //in addition, we start a timer to wait for a defined delay
-        xTimerReset(adcStrongTimerHandle,0);
-        //return in this case & wait for next iteration
+        if(D->strongmode == STRONG_PUFF)
+        {
+            ESP_LOGI(LOG_TAG,"Exit STRONG PUFF, timeout");
+            TONE(TONE_STRONGPUFF_EXIT_FREQ,TONE_STRONGPUFF_EXIT_DURATION);
+        } else {
+            ESP_LOGI(LOG_TAG,"Exit STRONG SIP, timeout");
+            TONE(TONE_STRONGSIP_EXIT_FREQ,TONE_STRONGSIP_EXIT_DURATION);
+        }
+        D->strongmode = STRONG_NORMAL;
         return;
     }
     
-    //check if we have a movement in any direction
-    if(D->x != 0 || D->y != 0)
+    //delay not passed yet or no movement in any direction
+    if(elapsed < adc_conf.strong_delay) return;
+    if(D->x == 0 && D->y == 0) return;
+    
+    //trigger action (depending on SIP/PUFF mode)
+    if(abs(D->x) > abs(D->y))
     {
-        //check if it is possible to trigger the next action
-        //(delay has passed -> adcStrongSem is free)
-        if(uxSemaphoreGetCount(adcStrongSem) == 0) return;
-        xSemaphoreTake(adcStrongSem,0);
-        
-        //cancel timer for idle time
-        xTimerStop(adcStrongTimerHandle,0);
+        //x has higher values -> use LEFT/RIGHT
+        if(D->strongmode == STRONG_PUFF) evt.vb = (D->x > 0) ? VB_STRONGPUFF_RIGHT : VB_STRONGPUFF_LEFT;
+        else evt.vb = (D->x > 0) ? VB_STRONGSIP_RIGHT : VB_STRONGSIP_LEFT;
+    } else {
+        //y has higher values -> use UP/DOWN
+        if(D->strongmode == STRONG_PUFF) evt.vb = (D->y > 0) ? VB_STRONGPUFF_DOWN : VB_STRONGPUFF_UP;
+        else evt.vb = (D->y > 0) ? VB_STRONGSIP_DOWN : VB_STRONGSIP_UP;
+    }
+    evt.type = VB_PRESS_EVENT;
+    halAdcSendEvent(&evt);
+    ESP_LOGI(LOG_TAG,"Exit STRONG: %s + VB %d",(D->strongmode == STRONG_PUFF) ? "PUFF" : "SIP",evt.vb);
     
-        //if yes, trigger action (depending on SIP/PUFF mode)
-        if(D->strongmode == STRONG_PUFF)
-        {
-            if(abs(D->x) > abs(D->y))
-            {
-                //x has higher values -> use LEFT/RIGHT
-                if(D->x > 0) evt.vb = VB_STRONGPUFF_RIGHT;
-                else evt.vb = VB_STRONGPUFF_LEFT;
-                evt.type = VB_PRESS_EVENT;
-                xQueueSendToBack(debouncer_in,&evt,0);
-                ESP_LOGI(LOG_TAG,"Exit STRONG: PUFF + LEFT/RIGHT");
-            } else {
-                //y has higher values -> use UP/DOWN
-                if(D->y > 0) evt.vb = VB_STRONGPUFF_DOWN;
-                else evt.vb = VB_STRONGPUFF_UP;
-                evt.type = VB_PRESS_EVENT;
-                xQueueSendToBack(debouncer_in,&evt,0);
-                ESP_LOGI(LOG_TAG,"Exit STRONG: PUFF + UP/DOWN");
-                
-            }
-            //stop the timeout timer
-            xTimerStop(adcStrongTimeoutTimerHandle,0);
-            //reset strong mode after sending the action
-            D->strongmode = STRONG_NORMAL;
-        }
-        if(D->strongmode == STRONG_SIP)
-        {
-            if(abs(D->x) > abs(D->y))
-            {
-                //x has higher values -> use LEFT/RIGHT
-                if(D->x > 0) evt.vb = VB_STRONGSIP_RIGHT;
-                else evt.vb = VB_STRONGSIP_LEFT;
-                evt.type = VB_PRESS_EVENT;
-                xQueueSendToBack(debouncer_in,&evt,0);
-                ESP_LOGI(LOG_TAG,"Exit STRONG: SIP + LEFT/RIGHT");
-            } else {
-                //y has higher values -> use UP/DOWN
-                if(D->y > 0) evt.vb = VB_STRONGSIP_DOWN;
-                else evt.vb = VB_STRONGSIP_UP;
-                evt.type = VB_PRESS_EVENT;
-                xQueueSendToBack(debouncer_in,&evt,0);
-                ESP_LOGI(LOG_TAG,"Exit STRONG: SIP + UP/DOWN");
-            }
-            //stop the timeout timer
-            xTimerStop(adcStrongTimeoutTimerHandle,0);
-            //reset strong mode after sending the action
-            D->strongmode = STRONG_NORMAL;
-        }
-    }  
+    //reset strong mode after sending the action
+    D->strongmode = STRONG_NORMAL;
     #endif
 }
 
@@ -269,18 +414,20 @@ void halAdcProcessStrongMode(adcData_t *D)
  * */
 void halAdcReportRaw(uint32_t up, uint32_t down, uint32_t left, uint32_t right, uint32_t pressure, int32_t x, int32_t y)
 {
-    #define REPORT_RAW_COUNT 8
-    static int prescaler = 0;
+    //report interval [us], independent of the sample rate
+    #define REPORT_RAW_INTERVAL 80000
+    static int64_t lastreport = 0;
     
     if(adc_conf.reportraw != 0)
     {
-        if(prescaler % REPORT_RAW_COUNT == 0)
+        int64_t now = esp_timer_get_time();
+        if((now - lastreport) >= REPORT_RAW_INTERVAL)
         {
             char data[48];
             sprintf(data,"VALUES:%d,%d,%d,%d,%d,%d,%d",pressure,up,down,left,right,x,y);
             halSerialSendUSBSerial(data, strnlen(data,48), 0);
+            lastreport = now;
         }
-        prescaler++;
     }
 }
 
@@ -296,13 +443,13 @@ void halAdcReportRaw(uint32_t up, uint32_t down, uint32_t left, uint32_t right,
  * @note You need to take adcSem before calling this function!
  * 
  * @param values Pointer to struct of all analog values
+ * @return 0 if measurement was done, -1 if discarded
  * @see adcData_t
  * @see adcSem
  */
-void halAdcReadData(adcData_t *values)
+int halAdcReadData(adcData_t *values)
 {
     //read all sensors
-    int32_t tmp = 0;
     int32_t pressure = 0;
 
     #ifdef HAL_IO_ADC_CHANNEL_PRESSURE
@@ -310,11 +457,13 @@ void halAdcReadData(adcData_t *values)
     #endif
     if(pressure == -1) 
     { 
-        ESP_LOGE(LOG_TAG,"Cannot read channel pressure"); return;
+        ESP_LOGE(LOG_TAG,"Cannot read channel pressure"); return -1;
     } else { 
-        //save value
+        //filter & save value
+        halAdcFilterApply(&adc_conf,&pressure,1);
         values->pressure= pressure;       
     }
+    return 0;
 }
 
 #endif /* DEVICE_FABI */
@@ -327,13 +476,15 @@ void halAdcReadData(adcData_t *values)
  * Furthermore, X&Y values are calculated by subtracting left/right and
  * up/down, offset is used as well. 
  * In addition, the deadzone is calculated as well (based on an elliptic curve).
+ * All raw values are passed through the filter pipeline before.
  * 
  * @note You need to take adcSem before calling this function!
  * 
  * @param values Pointer to struct of all analog values
- * @return 0 if measurement was done, -1 if discarded
+ * @return 0 if measurement was done, -1 if sensors cannot be read
  * @see adcData_t
  * @see adcSem
+ * @see halAdcFilterApply
  */
 int halAdcReadData(adcData_t *values)
 {
@@ -341,7 +492,6 @@ int halAdcReadData(adcData_t *values)
     int32_t tmp = 0;
     int32_t x,y;
     int32_t up,down,left,right,pressure;
-    static int32_t up_p,down_p,left_p,right_p,pressure_p;
     up = down = left = right = pressure = 0;
     ///@see HAL_ADC_RAW_DIVIDER
     static uint32_t debug_out_cnt = 0;
@@ -353,33 +503,24 @@ int halAdcReadData(adcData_t *values)
     if(rcv != 10)
     {
         ESP_LOGW(LOG_TAG,"I2C recv: 0x%X",rcv);
+        return -1;
     }
-    left = (int32_t)((uint16_t)(adc[2] + (adc[3] << 8)));
-    right = (int32_t)((uint16_t)(adc[6] + (adc[7] << 8)));
-    up = (int32_t)((uint16_t)(adc[4] + (adc[5] << 8)));
-    down = (int32_t)((uint16_t)(adc[0] + (adc[1] << 8)));
-    pressure = (int32_t)((uint16_t)(adc[8] + (adc[9] << 8)));
-    //ESP_LOGE(LOG_TAG,"%d,%d,%d,%d,%d",up,down,left,right,pressure);
     
-    //before any further processing, check if we have an unusual
-    //sensor reading (deviation to last measuring > 200)
-    //in this case, discard this measurement and wait for next iteration
-    //if it is a wanted high mouthpiece movement, next iteration will be
-    //triggering the action (we save the last value, even if discarded)
-    int toohigh = 0;
-    if((abs(left-left_p) > 200) || (abs(right-right_p) > 200) || (abs(up-up_p) > 200) || \
-		(abs(down-down_p) > 200) || (abs(pressure-pressure_p) > 200)) { toohigh = 1; }
-		
-	left_p = left;
-	right_p = right;
-	up_p = up;
-	down_p = down;
-	pressure_p = pressure;
-	if(toohigh != 0)
-	{
-		ESP_LOGW(LOG_TAG,"sensor deviation over rate,discarding");
-		return -1;
-	}
+    //pass raw values through the filter pipeline (spike rejection & smoothing),
+    //sample is never discarded.
+    int32_t raw[HAL_ADC_FILTER_CHANNELS];
+    raw[0] = (int32_t)((uint16_t)(adc[4] + (adc[5] << 8)));
+    raw[1] = (int32_t)((uint16_t)(adc[0] + (adc[1] << 8)));
+    raw[2] = (int32_t)((uint16_t)(adc[2] + (adc[3] << 8)));
+    raw[3] = (int32_t)((uint16_t)(adc[6] + (adc[7] << 8)));
+    raw[4] = (int32_t)((uint16_t)(adc[8] + (adc[9] << 8)));
+    halAdcFilterApply(&adc_conf,raw,HAL_ADC_FILTER_CHANNELS);
+    up = raw[0];
+    down = raw[1];
+    left = raw[2];
+    right = raw[3];
+    pressure = raw[4];
+    //ESP_LOGE(LOG_TAG,"%d,%d,%d,%d,%d",up,down,left,right,pressure);
 
     //do the mouse rotation
     switch (adc_conf.orientation) {
@@ -419,59 +560,9 @@ int halAdcReadData(adcData_t *values)
     
     #else
     
-    //in this case, we use an elliptic deadzone
-    
-    //apply elliptic deadzone
-    //formula:
-    //https://sebadorn.de/2012/01/02/herausfinden-ob-ein-punkt-in-einer-ellipse-liegt
-    //A point in an elliptic curve:
-    //(px - cx)² / rx² + (py - cy)² / ry² <= 1
-    //cx/cy is 0 (we start at 0/0)
-    //py/py is our x/y
-    //rx/ry are deadzone values
-    //to shorten the formulas
-    uint8_t a = adc_conf.deadzone_x;
-    uint8_t b = adc_conf.deadzone_y;
-    float status = pow(x,2) / pow(a,2) + pow(y,2) / pow(b,2);
-    
-    //check if point is outside deadzone
-    if(status > 1.0)
-    {
-        //if outside deadzone, subtract ellipse itself to start with
-        //0 for a movement
-        
-        //formula for ellipse point:
-        //https://math.stackexchange.com/questions/22064/calculating-a-point-that-lies-on-an-ellipse-given-an-angle
-        float deadzoneX = 0;
-        float deadzoneY = 0;
-       
-        //angle of the given mouthpiece
-        //calculate only if x&y is != 0
-        if((x < 0 || x > 0) && (y < 0 || y > 0))
-        {
-            float angle = atan(y/x);
-            deadzoneX = abs((a*b)/sqrt(pow(b,2)+pow(a,2)*pow(tan(angle),2)));
-            deadzoneY = abs((a*b)/sqrt(pow(a,2)+ pow(b,2)/pow(tan(angle),2)));
-        }
-              
-        //subtract calculated ellipse coordinates from output X/Y values
-        if(x > 0)
-        {
-            values->x = x - (int)deadzoneX;
-        } else {
-            values->x = x + (int)deadzoneX;
-        }
-        if(y > 0)
-        {
-            values->y = y - (int)deadzoneY;
-        } else {
-            values->y = y + (int)deadzoneY;
-        }
-    } else {
-        //otherwise, x&y is 0
-        values->x = 0;
-        values->y = 0;
-    }
+    //in this case, we use an elliptic deadzone, precomputed
+    //by halAdcKernelBuild (integer only).
+    halAdcKernelDeadzone(&adcKernel,x,y,&values->x,&values->y);
     #endif 
     if(debug_out_cnt++%HAL_ADC_RAW_DIVIDER == 0)
     {
@@ -495,7 +586,11 @@ int halAdcReadData(adcData_t *values)
  * If VB_STRONGPUFF_UP/DOWN/LEFT/RIGHT is unset (none of these are active),
  * the VB_STRONGPUFF action is triggered immediately. 
  * 
+ * Each level has its own hysteresis band (hyst_enter/hyst_exit), avoiding
+ * event storms of a noisy sensor close to a threshold.
+ * 
  * @see halAdcProcessStrongMode
+ * @see halAdcHysteresis
  * @param D Currently measured ADC data.
  * */
 void halAdcProcessPressure(adcData_t *D)
@@ -508,8 +603,9 @@ void halAdcProcessPressure(adcData_t *D)
     uint32_t pressurevalue = D->pressure;
     //currently active general config
     generalConfig_t *cfg = configGetCurrent();
-    //the raw event, sent to the debouncer
+    //the raw event, sent to the debouncer (origin for latency: this sample)
     raw_action_t evt;
+    evt.timestamp = (uint32_t)D->now;
     //cannot proceed if no global config is available
     if(cfg == NULL) return;
     
@@ -518,16 +614,25 @@ void halAdcProcessPressure(adcData_t *D)
         if(D->strongmode != STRONG_NORMAL) return;
     #endif
     
+    //check all levels against their thresholds, including hysteresis band
+    uint8_t sip = halAdcHysteresis(ADC_HYST_SIP, \
+        (int32_t)cfg->adc.threshold_sip - (int32_t)pressurevalue);
+    uint8_t strongsip = halAdcHysteresis(ADC_HYST_STRONGSIP, \
+        (int32_t)cfg->adc.threshold_strongsip - (int32_t)pressurevalue);
+    uint8_t puff = halAdcHysteresis(ADC_HYST_PUFF, \
+        (int32_t)pressurevalue - (int32_t)cfg->adc.threshold_puff);
+    uint8_t strongpuff = halAdcHysteresis(ADC_HYST_STRONGPUFF, \
+        (int32_t)pressurevalue - (int32_t)cfg->adc.threshold_strongpuff);
+    
     //SIP triggered
-    if(pressurevalue < cfg->adc.threshold_sip && \
-        pressurevalue > cfg->adc.threshold_strongsip)
+    if(sip && !strongsip)
     {
         if(fired[0] != 1)
         {
             //set/clear VBs
             evt.type = VB_PRESS_EVENT;
             evt.vb = VB_SIP;
-            xQueueSendToBack(debouncer_in,&evt,0);
+            halAdcSendEvent(&evt);
             //save fired state
             fired[0] = 1;
         }
@@ -537,26 +642,23 @@ void halAdcProcessPressure(adcData_t *D)
             //set/clear VBs
             evt.type = VB_RELEASE_EVENT;
             evt.vb = VB_SIP;
-            xQueueSendToBack(debouncer_in,&evt,0);
+            halAdcSendEvent(&evt);
             //track fired state
             fired[0] = 0;
         }
     }
     
     //STRONGSIP triggered
-    if(pressurevalue < cfg->adc.threshold_strongsip)
+    if(strongsip)
     {
         //check if strong sip + up/down/left/right is set.
         //if this is the case, we will proceed with strong mode.
         //Otherwise the VB_STRONGSIP will be triggered.
         #ifdef DEVICE_FLIPMOUSE
-        if(handler_hid_active(VB_STRONGSIP_UP) || handler_vb_active(VB_STRONGSIP_UP) || \
-            handler_hid_active(VB_STRONGSIP_DOWN) || handler_vb_active(VB_STRONGSIP_DOWN) || \
-            handler_hid_active(VB_STRONGSIP_LEFT) || handler_vb_active(VB_STRONGSIP_LEFT) || \
-            handler_hid_active(VB_STRONGSIP_RIGHT) || handler_vb_active(VB_STRONGSIP_RIGHT))
+        if(vbUsageGet() & HAL_ADC_STRONGSIP_COMBO)
         {
             //if at least one strong action is defined, enter strong sip mode
-            D->strongmode = STRONG_SIP;
+            halAdcEnterStrongMode(D,STRONG_SIP);
             ESP_LOGI(LOG_TAG,"Enter STRONG SIP");
             TONE(TONE_STRONGSIP_ENTER_FREQ,TONE_STRONGSIP_ENTER_DURATION);
         } else {
@@ -569,7 +671,7 @@ void halAdcProcessPressure(adcData_t *D)
                 
                 evt.type = VB_PRESS_EVENT;
                 evt.vb = VB_STRONGSIP;
-                xQueueSendToBack(debouncer_in,&evt,0);
+                halAdcSendEvent(&evt);
                 //save fired stated
                 fired[1] = 1;
             }
@@ -582,15 +684,14 @@ void halAdcProcessPressure(adcData_t *D)
             //set/clear VBs
             evt.type = VB_RELEASE_EVENT;
             evt.vb = VB_STRONGSIP;
-            xQueueSendToBack(debouncer_in,&evt,0);
+            halAdcSendEvent(&evt);
             //track fired state
             fired[1] = 2;
         }
     }
     
     //PUFF triggered
-    if(pressurevalue > cfg->adc.threshold_puff && \
-        pressurevalue < cfg->adc.threshold_strongpuff)
+    if(puff && !strongpuff)
     {
         
         if(fired[2] != 1)
@@ -598,7 +699,7 @@ void halAdcProcessPressure(adcData_t *D)
             //set/clear VBs
             evt.type = VB_PRESS_EVENT;
             evt.vb = VB_PUFF;
-            xQueueSendToBack(debouncer_in,&evt,0);
+            halAdcSendEvent(&evt);
             //save fired state
             fired[2] = 1;
         }
@@ -608,26 +709,23 @@ void halAdcProcessPressure(adcData_t *D)
             //set/clear VBs
             evt.type = VB_RELEASE_EVENT;
             evt.vb = VB_PUFF;
-            xQueueSendToBack(debouncer_in,&evt,0);
+            halAdcSendEvent(&evt);
             //track fired state
             fired[2] = 0;
         }
     }
     
     //STRONGPUFF triggered
-    if(pressurevalue > cfg->adc.threshold_strongpuff)
+    if(strongpuff)
     {
         //check if strong puff + up/down/left/right is set.
         //if this is the case, we will proceed with strong mode.
         //Otherwise the VB_STRONGPUFF will be triggered.
         #ifdef DEVICE_FLIPMOUSE
-        if(handler_hid_active(VB_STRONGPUFF_UP) || handler_vb_active(VB_STRONGPUFF_UP) || \
-            handler_hid_active(VB_STRONGPUFF_DOWN) || handler_vb_active(VB_STRONGPUFF_DOWN) || \
-            handler_hid_active(VB_STRONGPUFF_LEFT) || handler_vb_active(VB_STRONGPUFF_LEFT) || \
-            handler_hid_active(VB_STRONGPUFF_RIGHT) || handler_vb_active(VB_STRONGPUFF_RIGHT))
+        if(vbUsageGet() & HAL_ADC_STRONGPUFF_COMBO)
         {
             //if at least one strong action is defined, enter strong puff mode
-            D->strongmode = STRONG_PUFF;
+            halAdcEnterStrongMode(D,STRONG_PUFF);
             ESP_LOGI(LOG_TAG,"Enter STRONG PUFF");
             TONE(TONE_STRONGPUFF_ENTER_FREQ,TONE_STRONGPUFF_ENTER_DURATION);
         } else {
@@ -640,7 +738,7 @@ void halAdcProcessPressure(adcData_t *D)
                 // is used, trigger strong puff VB.
                 evt.type = VB_PRESS_EVENT;
                 evt.vb = VB_STRONGPUFF;
-                xQueueSendToBack(debouncer_in,&evt,0);
+                halAdcSendEvent(&evt);
                 //save fired state
                 fired[3] = 1;
             }
@@ -654,263 +752,13 @@ void halAdcProcessPressure(adcData_t *D)
             //set/clear VBs
             evt.type = VB_RELEASE_EVENT;
             evt.vb = VB_STRONGPUFF;
-            xQueueSendToBack(debouncer_in,&evt,0);
+            halAdcSendEvent(&evt);
             //track fired state
             fired[3] = 2;
         }
     }
 }
 
-#ifdef DEVICE_FLIPMOUSE
-/** @brief HAL TASK - Mouse task for ADC
- * 
- * This task is used for the mouse moving mode of the moutpiece.
- * It is invoked on config changes and reads out all 4 sensors,
- * calculates x and y values for processing with acceleration and
- * maximum speed.
- * 
- * The calculated mouse movements are sent to the corresponding
- * mouse movement queues (either BLE, USB or BOTH).
- * 
- * @note This task is not available on a FABI device.
- * @see DEVICE_FABI
- * @see DEVICE_FLIPMOUSE
- * */
-void halAdcTaskMouse(void * pvParameters)
-{
-    //analog values
-    adcData_t D;
-    D.strongmode = STRONG_NORMAL;
-    //int32_t x,y;
-    static uint16_t accelTimeX=0,accelTimeY=0;
-    int32_t tempX,tempY;
-    float moveVal, accumXpos = 0, accumYpos = 0;
-    float accelFactor= 20 / 100000000.0f;
-    hid_cmd_t command,command2;
-    TickType_t xLastWakeTime = xTaskGetTickCount();
-    //set adc data reference for timer
-    vTimerSetTimerID(adcStrongTimeoutTimerHandle,&D);
-    uint32_t debug_out_cnt = 0;
-    
-    while(1)
-    {
-        //get mutex
-        if(xSemaphoreTake(adcSem, (TickType_t) 30) != pdTRUE)
-        {
-            ESP_LOGW(LOG_TAG,"Cannot obtain mutex for reading");
-            continue;
-        }
-        
-        //read out the analog voltages from all 5 channels (including deadzone)
-        //& set calibrate request to 0 before
-        D.calibrate_request = 0;
-        uint8_t retry = 0;
-        while((halAdcReadData(&D) != 0) && (retry++ < 10));
-        if(retry == 10)
-        {
-			ESP_LOGE(LOG_TAG,"Cannot read ADC");
-			vTaskDelay(1000/portTICK_PERIOD_MS);
-			xSemaphoreGive(adcSem);
-		}
-        
-        
-        //if you want to slow down, uncomment following two lines
-        //ESP_LOGD(LOG_TAG,"X/Y square, X/Y ellipse: %d/%d, %d/%d",tempX,tempY,D.x,D.y);
-        //vTaskDelay(10);
-        
-        //report raw values.
-        halAdcReportRaw(D.up, D.down, D.left, D.right, D.pressure, D.x, D.y);
-        
-        //if we are in a special strong mode, do NOT send accumulated data
-        //to USB/BLE. Instead, call halAdcProcessStrongMode
-        //if in normal mode, proceed with mouse
-        if(D.strongmode == STRONG_NORMAL)
-        {
-            //apply acceleration
-            if (D.x==0) accelTimeX=0;
-            else if (accelTimeX < ACCELTIME_MAX) accelTimeX+=adc_conf.acceleration;
-            if (D.y==0) accelTimeY=0;
-            else if (accelTimeY < ACCELTIME_MAX) accelTimeY+=adc_conf.acceleration;
-                            
-            //calculate the current X movement by using acceleration, accel factor and sensitivity
-            moveVal = D.x * adc_conf.sensitivity_x * accelFactor * accelTimeX;
-            //limit value
-            if (moveVal>adc_conf.max_speed) moveVal=adc_conf.max_speed;
-            if (moveVal< -adc_conf.max_speed) moveVal=-adc_conf.max_speed;
-            //add to accumulated movement value
-            accumXpos+=moveVal;
-            
-            //do the same calculations for Y axis
-            moveVal = D.y * adc_conf.sensitivity_y * accelFactor * accelTimeY;
-            if (moveVal>adc_conf.max_speed) moveVal=adc_conf.max_speed;
-            if (moveVal< -adc_conf.max_speed) moveVal=-adc_conf.max_speed;
-            accumYpos+=moveVal;
-            
-            //cast to int again
-            tempX = accumXpos;
-            tempY = accumYpos;
-            
-            //limit to int8 values (to fit into mouse report)
-            if(tempX > 127) tempX = 127;
-            if(tempX < -127) tempX = -127;
-            if(tempY > 127) tempY = 127;
-            if(tempY < -127) tempY = -127;
-            
-            #if LOG_LEVEL_ADC >= ESP_LOG_DEBUG
-            if(debug_out_cnt++%HAL_ADC_RAW_DIVIDER == 0)
-            {
-                ESP_LOGD(LOG_TAG,"mouse x/y %d/%d; ",tempX,tempY);
-            }
-            #endif
-        
-            if(tempX != 0 && tempY != 0)
-            {
-                command.cmd[0] = 0x01;
-                command.cmd[1] = tempX;
-                command.cmd[2] = tempY;
-                
-                accumXpos -= tempX;
-                accumYpos -= tempY;
-                
-                //post values to mouse queue (USB and/or BLE)
-                if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
-                { xQueueSend(hid_usb,&command,0); }
-                
-                if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
-                { xQueueSend(hid_ble,&command,0); }
-            }
-            
-            if(tempX != 0 && tempY == 0)
-            {
-                command.cmd[1] = tempX;
-                accumXpos -= tempX;
-                command.cmd[0] = 0x10; //send X axis
-                
-                //post values to mouse queue (USB and/or BLE)
-                if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
-                { xQueueSend(hid_usb,&command,0); }
-                
-                if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
-                { xQueueSend(hid_ble,&command,0); }
-            }
-            if(tempY != 0 && tempX == 0)
-            {
-                command2.cmd[1] = tempY;
-                accumYpos -= tempY;
-                command2.cmd[0] = 0x11; //send Y axis
-                
-                //post values to mouse queue (USB and/or BLE)
-                if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
-                { xQueueSend(hid_usb,&command2,0); }
-                
-                if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
-                { xQueueSend(hid_ble,&command2,0); }
-            }
-            
-            //pressure sensor is handled in another function
-            halAdcProcessPressure(&D);
-        } else {
-            //in special mode, process strong mdoe
-            halAdcProcessStrongMode(&D);
-        }
-        
-        //give mutex
-        xSemaphoreGive(adcSem);
-        
-        //if OTF calibration is requested:
-        if(D.calibrate_request != 0) halAdcCalibrate();
-        
-        //delay the task.
-        vTaskDelayUntil( &xLastWakeTime, 10/portTICK_PERIOD_MS);
-    }
-}
-
-#endif
-#ifdef DEVICE_FLIPMOUSE
-/** @brief HAL TASK - Joystick task for ADC
- * 
- * This task is used for the joystick mode of the moutpiece.
- * It is invoked on config changes and reads out all 4 sensors,
- * calculates 2 axis values (depending on config which ones)
- * for processing with sensitivity
- * 
- * The calculated joystick movements are sent to the corresponding
- * joystick command queues (either BLE, USB or BOTH).
- * 
- * @todo Implement the full joystick interface. Currently completely unimplemented.
- * @note This task is not available on a FABI device.
- * @see DEVICE_FABI
- * @see DEVICE_FLIPMOUSE
- * */
-void halAdcTaskJoystick(void * pvParameters)
-{
-    //analog values
-    adcData_t D;
-    D.strongmode = STRONG_NORMAL;
-    //int32_t x,y;
-    //joystick_command_t command;
-    TickType_t xLastWakeTime;
-    //set adc data reference for timer
-    vTimerSetTimerID(adcStrongTimeoutTimerHandle,&D);
-    
-    while(1)
-    {
-        //get mutex
-        if(xSemaphoreTake(adcSem, (TickType_t) 30) != pdTRUE)
-        {
-            ESP_LOGW(LOG_TAG,"Cannot obtain mutex for reading");
-            continue;
-        }
-        
-        //read out the analog voltages from all 5 channels
-        uint8_t retry = 0;
-        while((halAdcReadData(&D) != 0) && (retry++ < 10));
-        if(retry == 10)
-        {
-			ESP_LOGE(LOG_TAG,"Cannot read ADC");
-			vTaskDelay(1000/portTICK_PERIOD_MS);
-			xSemaphoreGive(adcSem);
-		}
-        halAdcReportRaw(D.up, D.down, D.left, D.right, D.pressure, D.x, D.y);
-        
-        
-        //if we are in a special strong mode, do NOT send accumulated data
-        //to USB/BLE. Instead, call halAdcProcessStrongMode
-        //if in normal mode, proceed with mouse
-        if(D.strongmode == STRONG_NORMAL)
-        {
-            
-            //TODO: acceleration & max speed calc
-            
-            //TODO: do everything...
-            
-            //post values to mouse queue (USB and/or BLE)
-            /*if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
-            {
-                xQueueSend(joystick_movement_usb,&command,0);
-            }
-            
-            if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
-            {
-                xQueueSend(joystick_movement_ble,&command,0);
-            }*/
-                    
-            //pressure sensor is handled in another function
-            halAdcProcessPressure(&D);
-        } else {
-            //in special mode, process strong mdoe
-            halAdcProcessStrongMode(&D);
-        }
-        
-        //give mutex
-        xSemaphoreGive(adcSem);
-        
-        //delay the task.
-        vTaskDelayUntil(&xLastWakeTime, 20/portTICK_PERIOD_MS); 
-    }
-}
-
-#endif
 /** @brief Calibration function
  * 
  * This method is called to calibrate the offset value for x and y
@@ -1002,31 +850,588 @@ void halAdcCalibrate(void)
     return;
 }
 
-/** @brief HAL TASK - Threshold task for ADC
+
+/** @brief Strategy for one mouthpiece mode
+ * 
+ * The ADC task is started once and reads all sensors once per sample.
+ * The sensor data is dispatched to the strategy of the currently
+ * active mode (mouse, joystick, threshold).
+ * A mode change is done by the ADC task itself, on the next sample
+ * boundary (no task is deleted/created).
+ * 
+ * @see halAdcModes
+ * @see halAdcTask
+ * */
+typedef struct adcModeStrategy {
+    /** @brief Name of this mode, used for logging */
+    const char *name;
+    /** @brief Called on the first sample after switching to this mode, might be NULL */
+    void (*enter)(void);
+    /** @brief Called on the last sample before switching to another mode, might be NULL */
+    void (*leave)(void);
+    /** @brief Called for each sample with new sensor data.
+     * If NULL, no sensors are read in this mode (idle sample rate is used). */
+    void (*process)(adcData_t *D);
+} adcModeStrategy_t;
+
+/** @brief Timestamp (see latencyNow) of the last requested mode change, 0 if none is pending
+ * @note Written by the config updater, read & cleared by the ADC task. 32bit
+ * with atomic access, an int64_t might tear on this 32bit CPU.
+ * @see halAdcGetModeSwitchLatency */
+static uint32_t adcModeSwitchRequest = 0;
+
+/** @brief Latency [us] of the last mode change (request until first sample in new mode) */
+static uint32_t adcModeSwitchLatency = 0;
+
+/** @brief Maximum latency [us] of all mode changes since startup */
+static uint32_t adcModeSwitchLatencyMax = 0;
+
+#ifdef DEVICE_FLIPMOUSE
+/** @brief State of the mouse strategy, reset on entering mouse mode
+ * @see halAdcMouseEnter
+ * @see halAdcMouseProcess */
+static struct {
+    /** @brief Acceleration time X/Y axis (Q8) */
+    uint32_t accelTimeX, accelTimeY;
+    /** @brief Accumulated movement (Q16), not yet sent */
+    int32_t accumXpos, accumYpos;
+} adcMouse;
+
+/** @brief Mouse strategy - reset acceleration & accumulated values
+ * @see adcModeStrategy_t */
+static void halAdcMouseEnter(void)
+{
+    memset(&adcMouse,0,sizeof(adcMouse));
+}
+
+/** @brief Mouse strategy - process one sample
+ * 
+ * This strategy is used for the mouse moving mode of the moutpiece.
+ * X and y values are processed with acceleration and maximum speed.
+ * 
+ * The calculated mouse movements are sent to the corresponding
+ * mouse movement queues (either BLE, USB or BOTH).
+ * 
+ * @note This strategy is not available on a FABI device.
+ * @param D Currently measured ADC data.
+ * @see DEVICE_FABI
+ * @see DEVICE_FLIPMOUSE
+ * */
+static void halAdcMouseProcess(adcData_t *D)
+{
+    int32_t tempX,tempY;
+    //movement values in Q16
+    int32_t moveVal;
+    #if LOG_LEVEL_ADC >= ESP_LOG_DEBUG
+    static uint32_t debug_out_cnt = 0;
+    #endif
+    
+    //if you want to slow down, uncomment following two lines
+    //ESP_LOGD(LOG_TAG,"X/Y square, X/Y ellipse: %d/%d, %d/%d",tempX,tempY,D->x,D->y);
+    //vTaskDelay(10);
+    
+    //report raw values.
+    halAdcReportRaw(D->up, D->down, D->left, D->right, D->pressure, D->x, D->y);
+    
+    //if we are in a special strong mode, do NOT send accumulated data
+    //to USB/BLE. Instead, call halAdcProcessStrongMode
+    //if in normal mode, proceed with mouse
+    if(D->strongmode != STRONG_NORMAL)
+    {
+        //in special mode, process strong mdoe
+        halAdcProcessStrongMode(D);
+        return;
+    }
+    
+    //acceleration and speed are defined per reference period,
+    //scale them to the current sample period.
+    uint32_t accelStep = (adc_conf.acceleration * D->period * 256) / HAL_ADC_REF_PERIOD;
+    int32_t maxSpeed = halAdcKernelMaxSpeed(&adcKernel,D->period);
+    
+    //apply acceleration
+    if (D->x==0) adcMouse.accelTimeX=0;
+    else if (adcMouse.accelTimeX < (ACCELTIME_MAX << 8)) adcMouse.accelTimeX+=accelStep;
+    if (D->y==0) adcMouse.accelTimeY=0;
+    else if (adcMouse.accelTimeY < (ACCELTIME_MAX << 8)) adcMouse.accelTimeY+=accelStep;
+                    
+    //calculate the current X movement by using acceleration and
+    //the precomputed gain (accel factor and sensitivity), limited to max speed
+    moveVal = halAdcKernelMove(D->x,adcMouse.accelTimeX,adcKernel.gain_x,D->period,maxSpeed);
+    //add to accumulated movement value
+    adcMouse.accumXpos+=moveVal;
+    
+    //do the same calculations for Y axis
+    moveVal = halAdcKernelMove(D->y,adcMouse.accelTimeY,adcKernel.gain_y,D->period,maxSpeed);
+    adcMouse.accumYpos+=moveVal;
+    
+    //limit accumulated values (if max speed is above report limit)
+    if (adcMouse.accumXpos>HAL_ADC_ACCUM_MAX) adcMouse.accumXpos=HAL_ADC_ACCUM_MAX;
+    if (adcMouse.accumXpos< -HAL_ADC_ACCUM_MAX) adcMouse.accumXpos=-HAL_ADC_ACCUM_MAX;
+    if (adcMouse.accumYpos>HAL_ADC_ACCUM_MAX) adcMouse.accumYpos=HAL_ADC_ACCUM_MAX;
+    if (adcMouse.accumYpos< -HAL_ADC_ACCUM_MAX) adcMouse.accumYpos=-HAL_ADC_ACCUM_MAX;
+    
+    //Q16 -> int (truncated towards zero)
+    tempX = adcMouse.accumXpos / HAL_ADC_Q16_ONE;
+    tempY = adcMouse.accumYpos / HAL_ADC_Q16_ONE;
+    
+    #if LOG_LEVEL_ADC >= ESP_LOG_DEBUG
+    if(debug_out_cnt++%HAL_ADC_RAW_DIVIDER == 0)
+    {
+        ESP_LOGD(LOG_TAG,"mouse x/y %d/%d; ",tempX,tempY);
+    }
+    #endif
+
+    //pass movement to the coalescing stage, which merges it into
+    //a pending mouse report (one full X/Y report instead of one per axis).
+    //No movement is dropped if the HID queues are full.
+    if(tempX != 0 || tempY != 0)
+    {
+        adcMouse.accumXpos -= tempX * HAL_ADC_Q16_ONE;
+        adcMouse.accumYpos -= tempY * HAL_ADC_Q16_ONE;
+        
+        //post values to mouse queue (USB and/or BLE)
+        if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
+        { hidCoalesceMove(HID_COALESCE_USB,EVENT_QUEUE_HID_USB,tempX,tempY); }
+        
+        if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
+        { hidCoalesceMove(HID_COALESCE_BLE,EVENT_QUEUE_HID_BLE,tempX,tempY); }
+    }
+    
+    //pressure sensor is handled in another function
+    halAdcProcessPressure(D);
+}
+
+/** @brief Joystick HID commands for each axis assignment (adc_config_t.axis)
+ * 
+ * 0: X/Y axis, 1: Z/Z-rotate, 2: slider left/right
+ * @see HAL_ADC_JOYSTICK_AXIS_MAX */
+static const uint8_t adcJoystickCmds[HAL_ADC_JOYSTICK_AXIS_MAX+1][2] = {
+    {0x34, 0x35}, {0x36, 0x37}, {0x38, 0x39}
+};
+
+/** @brief State of the joystick strategy, reset on entering joystick mode
+ * @see halAdcJoystickEnter
+ * @see halAdcJoystickProcess */
+static struct {
+    /** @brief Last sent axis values [transport (0: USB, 1: BLE)][axis (0: X, 1: Y)],
+     * -1 if nothing was sent yet */
+    int16_t sent[2][2];
+    /** @brief Axis assignment of the sent values */
+    uint8_t axis;
+} adcJoystick;
+
+/** @brief Send one joystick axis value, if it differs from the last sent one
+ * 
+ * A value is sent if it differs more than epsilon from the last sent value.
+ * The center and both end positions are always sent if they are not reached
+ * exactly yet, so the axis does not get stuck near these positions.
+ * If the queue is full, the value is sent again on the next sample.
+ * 
+ * @param transport 0 for USB, 1 for BLE
+ * @param queue HID queue for this transport (EVENT_QUEUE_HID_USB or EVENT_QUEUE_HID_BLE)
+ * @param idx Axis index (0: X, 1: Y)
+ * @param value New axis value (0-HAL_ADC_JOYSTICK_MAX)
+ * @param epsilon Minimum change before a new value is sent
+ * */
+static void halAdcJoystickSend(uint8_t transport, event_queue_t queue,
+    uint8_t idx, int16_t value, uint8_t epsilon)
+{
+    int16_t last = adcJoystick.sent[transport][idx];
+    hid_report_t command;
+    
+    if(last == value) return;
+    if(last >= 0 && abs(value - last) <= epsilon && value != HAL_ADC_JOYSTICK_CENTER &&
+        value != 0 && value != HAL_ADC_JOYSTICK_MAX) return;
+    
+    memset(&command,0,sizeof(hid_report_t));
+    command.cmd[0] = adcJoystickCmds[adcJoystick.axis][idx];
+    command.cmd[1] = value & 0xFF;
+    command.cmd[2] = (value >> 8) & 0x03;
+    #if HID_REPORT_LATENCY
+    command.timestamp = command.queued = latencyNow();
+    #endif
+    if(eventQueueSend(queue,EVENT_SRC_ADC,&command,0) != 0) adcJoystick.sent[transport][idx] = value;
+}
+
+/** @brief Send joystick axis values to all connected transports
+ * @param x X value (0-HAL_ADC_JOYSTICK_MAX)
+ * @param y Y value (0-HAL_ADC_JOYSTICK_MAX)
+ * @param epsilon Minimum change before a new value is sent
+ * */
+static void halAdcJoystickUpdate(int16_t x, int16_t y, uint8_t epsilon)
+{
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
+    {
+        halAdcJoystickSend(0,EVENT_QUEUE_HID_USB,0,x,epsilon);
+        halAdcJoystickSend(0,EVENT_QUEUE_HID_USB,1,y,epsilon);
+    }
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
+    {
+        halAdcJoystickSend(1,EVENT_QUEUE_HID_BLE,0,x,epsilon);
+        halAdcJoystickSend(1,EVENT_QUEUE_HID_BLE,1,y,epsilon);
+    }
+}
+
+/** @brief Joystick strategy - reset the sent values & take the axis assignment
+ * @see adcModeStrategy_t */
+static void halAdcJoystickEnter(void)
+{
+    memset(adcJoystick.sent,0xFF,sizeof(adcJoystick.sent));
+    adcJoystick.axis = adc_conf.axis;
+    if(adcJoystick.axis > HAL_ADC_JOYSTICK_AXIS_MAX) adcJoystick.axis = 0;
+}
+
+/** @brief Joystick strategy - release the axes to their center position
+ * @see adcModeStrategy_t */
+static void halAdcJoystickLeave(void)
+{
+    halAdcJoystickUpdate(HAL_ADC_JOYSTICK_CENTER,HAL_ADC_JOYSTICK_CENTER,0);
+}
+
+/** @brief Map a mouthpiece deflection to an absolute joystick axis value
+ * @param v Deflection (deadzone is already subtracted)
+ * @param gain Joystick gain (Q16)
+ * @return Axis value, 0-HAL_ADC_JOYSTICK_MAX (HAL_ADC_JOYSTICK_CENTER at rest)
+ * */
+static int16_t halAdcJoystickMap(int32_t v, int32_t gain)
+{
+    int32_t val = HAL_ADC_JOYSTICK_CENTER + (int32_t)(((int64_t)v * gain) >> 16);
+    if(val < 0) val = 0;
+    if(val > HAL_ADC_JOYSTICK_MAX) val = HAL_ADC_JOYSTICK_MAX;
+    return (int16_t)val;
+}
+
+/** @brief Joystick strategy - process one sample
  * 
- * This task is used for threshold mode of the moutpiece.
- * It is invoked on config changes and reads out all 4 sensors,
- * calculates x and y values and compares it to thresholds.
+ * This strategy is used for the joystick mode of the moutpiece.
+ * It calculates 2 absolute axis values (depending on adc_config_t.axis
+ * either X/Y, Z/Z-rotate or both sliders) by applying the sensitivity to
+ * the deflection (outside of the deadzone).
+ * 
+ * An axis value is only sent to the corresponding HID queues (either BLE,
+ * USB or BOTH) if it changes more than adc_config_t.joystick_epsilon, so
+ * the report traffic depends on the movement and not on the sample rate.
+ * 
+ * @note This strategy is not available on a FABI device.
+ * @param D Currently measured ADC data.
+ * @see DEVICE_FABI
+ * @see DEVICE_FLIPMOUSE
+ * */
+static void halAdcJoystickProcess(adcData_t *D)
+{
+    halAdcReportRaw(D->up, D->down, D->left, D->right, D->pressure, D->x, D->y);
+    
+    //if we are in a special strong mode, do NOT send axis values
+    //to USB/BLE. Instead, call halAdcProcessStrongMode
+    //if in normal mode, proceed with joystick
+    if(D->strongmode != STRONG_NORMAL)
+    {
+        //in special mode, process strong mdoe
+        halAdcProcessStrongMode(D);
+        return;
+    }
+    
+    //axis assignment changed: release the previous axes
+    if(adc_conf.axis != adcJoystick.axis && adc_conf.axis <= HAL_ADC_JOYSTICK_AXIS_MAX)
+    {
+        halAdcJoystickLeave();
+        halAdcJoystickEnter();
+    }
+    
+    halAdcJoystickUpdate(halAdcJoystickMap(D->x,adcKernel.joy_gain_x),
+        halAdcJoystickMap(D->y,adcKernel.joy_gain_y),adc_conf.joystick_epsilon);
+    
+    //pressure sensor is handled in another function
+    halAdcProcessPressure(D);
+}
+#endif /* DEVICE_FLIPMOUSE */
+
+/** @brief Threshold strategy - currently pressed VBs
+ * 
+ * 1<<0: up, 1<<1: down, 1<<2: left, 1<<3: right; set if press event was sent.
+ * @see halAdcThresholdProcess */
+static uint8_t adcThresholdActive = 0;
+
+/** @brief Threshold strategy - release all VBs which are still pressed
+ * 
+ * Called when leaving threshold mode, otherwise a VB would stay pressed.
+ * @see adcModeStrategy_t */
+static void halAdcThresholdLeave(void)
+{
+    raw_action_t evt;
+    const uint32_t vbs[4] = {VB_UP, VB_DOWN, VB_LEFT, VB_RIGHT};
+    
+    evt.type = VB_RELEASE_EVENT;
+    evt.timestamp = latencyNow();
+    for(uint8_t i = 0; i<4; i++)
+    {
+        if(adcThresholdActive & (1<<i))
+        {
+            evt.vb = vbs[i];
+            halAdcSendEvent(&evt);
+        }
+    }
+    adcThresholdActive = 0;
+    //clear hysteresis state of all directions
+    adcHystActive &= ~((1<<ADC_HYST_UP) | (1<<ADC_HYST_DOWN) | (1<<ADC_HYST_LEFT) | (1<<ADC_HYST_RIGHT));
+    adcHystRaw &= ~((1<<ADC_HYST_UP) | (1<<ADC_HYST_DOWN) | (1<<ADC_HYST_LEFT) | (1<<ADC_HYST_RIGHT));
+}
+
+/** @brief Threshold strategy - process one sample
+ * 
+ * This strategy is used for threshold mode of the moutpiece.
+ * X and y values are compared to thresholds (deadzone), with a
+ * hysteresis band per direction (hyst_enter/hyst_exit).
  * 
  * If one value exceeds the threshold, the corresponding virtual button
  * flags are set or cleared.
+ * A press releases the opposite direction (its deflection is negative).
+ * Press events are only sent for VBs with a command assigned (vbUsageGet),
+ * or for all directions if button learning is enabled (VB_USAGE_LEARN).
  * 
+ * @param D Currently measured ADC data.
  * */
-void halAdcTaskThreshold(void * pvParameters)
+static void halAdcThresholdProcess(adcData_t *D)
 {
-    //analog values
-    adcData_t D;
+    //for a FABI device, we do not have 4 channels, so not UP/DOWN/LEFT/RIGHT
+    #ifdef DEVICE_FLIPMOUSE
     raw_action_t evt;
-    D.strongmode = STRONG_NORMAL;
-    TickType_t xLastWakeTime = xTaskGetTickCount();
-    //set adc data reference for timer
-    vTimerSetTimerID(adcStrongTimeoutTimerHandle,&D);
+    evt.timestamp = (uint32_t)D->now;
+    const uint32_t vbs[4] = {VB_UP, VB_DOWN, VB_LEFT, VB_RIGHT};
+    uint8_t activevbs = adcThresholdActive;
+    //VBs with at least one command assigned (1<<0: up, 1<<1: down, 1<<2: left, 1<<3: right),
+    //no events are sent for unused VBs.
+    uint32_t usage = vbUsageGet();
+    uint8_t usedvbs = ((usage & VB_USAGE_BIT(VB_UP)) ? (1<<0) : 0) | \
+        ((usage & VB_USAGE_BIT(VB_DOWN)) ? (1<<1) : 0) | \
+        ((usage & VB_USAGE_BIT(VB_LEFT)) ? (1<<2) : 0) | \
+        ((usage & VB_USAGE_BIT(VB_RIGHT)) ? (1<<3) : 0);
+    
+    //if we are in a special strong mode, do NOT send accumulated data
+    //to USB/BLE. Instead, call halAdcProcessStrongMode
+    //if in normal mode, proceed with mouse
+    if(D->strongmode == STRONG_NORMAL)
+    {
+        //deflection beyond the deadzone per direction (1<<0: up, 1<<1: down, 1<<2: left, 1<<3: right)
+        const int32_t depth[4] = {-D->y, D->y, -D->x, D->x};
+        
+        for(uint8_t i = 0; i<4; i++)
+        {
+            //value exceeds threshold (deadzone + hysteresis band)?
+            if(halAdcHysteresis(ADC_HYST_UP + i,depth[i]))
+            {
+                //if not already sent, send press action
+                if(!(activevbs & (1<<i)) && (usedvbs & (1<<i)))
+                {
+                    evt.type = VB_PRESS_EVENT;
+                    evt.vb = vbs[i];
+                    halAdcSendEvent(&evt);
+                    activevbs |= (1<<i);
+                }
+            } else {
+                //back in the deadzone or opposite direction -> release, if active
+                if(activevbs & (1<<i))
+                {
+                    evt.type = VB_RELEASE_EVENT;
+                    evt.vb = vbs[i];
+                    halAdcSendEvent(&evt);
+                    activevbs &= ~(1<<i);
+                }
+            }
+        }
+    } else {
+        //in special mode, process strong mdoe
+        halAdcProcessStrongMode(D);
+    }
     
+    //save pressed VBs for next sample
+    adcThresholdActive = activevbs;
+    
+    halAdcReportRaw(D->up, D->down, D->left, D->right, D->pressure, D->x, D->y);
+    
+    #endif
+    
+    //pressure sensor is handled in another function
+    halAdcProcessPressure(D);
+}
+
+/** @brief Strategy table, indexed by mouthpiece_mode_t
+ * @see adcModeStrategy_t
+ * @see mouthpiece_mode_t */
+static const adcModeStrategy_t halAdcModes[] = {
+    [NONE] = {"none", NULL, NULL, NULL},
     #ifdef DEVICE_FLIPMOUSE
-    //1<<0: up, 1<<1: down, 1<<2: left, 1<<3: right; set if press event was sent.
-    uint8_t activevbs = 0;
+    [MOUSE] = {"mouse", halAdcMouseEnter, NULL, halAdcMouseProcess},
+    [JOYSTICK] = {"joystick", halAdcJoystickEnter, halAdcJoystickLeave, halAdcJoystickProcess},
+    #endif
+    [THRESHOLD] = {"threshold", NULL, halAdcThresholdLeave, halAdcThresholdProcess},
+};
+
+/** @brief Get the strategy for a mouthpiece mode
+ * 
+ * @note On a FABI device, always the threshold strategy is used
+ * (other channels are masked out there).
+ * @param mode Mouthpiece mode
+ * @return Strategy for this mode, the NONE strategy for unknown modes
+ * */
+static const adcModeStrategy_t *halAdcGetStrategy(mouthpiece_mode_t mode)
+{
+    #ifdef DEVICE_FABI
+    return &halAdcModes[THRESHOLD];
     #endif
     
+    if((uint32_t)mode >= sizeof(halAdcModes)/sizeof(halAdcModes[0]) || \
+        halAdcModes[mode].name == NULL)
+    {
+        ESP_LOGE(LOG_TAG,"unknown mode %d, using none",mode);
+        return &halAdcModes[NONE];
+    }
+    return &halAdcModes[mode];
+}
+
+/** @brief Get the latency of mouthpiece mode switches
+ * 
+ * The latency is measured from the config update (halAdcUpdateConfig)
+ * until the first sample is processed by the new mode. It is bound by
+ * one sample period of the previous mode (plus the time for taking adcSem).
+ * 
+ * @param last Latency [us] of the last mode switch, might be NULL
+ * @param max Maximum latency [us] since startup, might be NULL
+ * */
+void halAdcGetModeSwitchLatency(uint32_t *last, uint32_t *max)
+{
+    if(last != NULL) *last = adcModeSwitchLatency;
+    if(max != NULL) *max = adcModeSwitchLatencyMax;
+}
+
+/** @brief Sampling engine state (only used by the ADC task)
+ * @see halAdcSetPeriod
+ * @see halAdcUpdateActivity */
+static struct {
+    /** @brief Periodic timer, notifies the ADC task for each sample */
+    esp_timer_handle_t timer;
+    /** @brief Currently active timer period [us], 0 if timer is stopped */
+    uint32_t period;
+    /** @brief Timestamp [us] of the last detected activity */
+    int64_t lastactive;
+    /** @brief Raw values (up,down,left,right,pressure) on the last detected activity */
+    uint32_t ref[5];
+} adcSampler;
+
+/** @brief Sample timer callback, wakes up the ADC task
+ * @param arg Task handle of the ADC task */
+static void halAdcSampleTimer(void *arg)
+{
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+/** @brief Convert a sample rate to a sample period
+ * @param rate Sample rate [Hz], HAL_ADC_RATE_IDLE is used if 0 (no config loaded yet)
+ * @return Sample period [us] */
+static uint32_t halAdcPeriod(uint32_t rate)
+{
+    if(rate == 0) rate = HAL_ADC_RATE_IDLE;
+    return 1000000 / rate;
+}
+
+/** @brief Change the sample period of the ADC task
+ * 
+ * The periodic sample timer is restarted, if the period is different
+ * to the currently used one.
+ * 
+ * @param period New sample period [us]
+ * */
+static void halAdcSetPeriod(uint32_t period)
+{
+    if(period == adcSampler.period) return;
+    if(adcSampler.period != 0) esp_timer_stop(adcSampler.timer);
+    if(esp_timer_start_periodic(adcSampler.timer,period) != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG,"Cannot start sample timer");
+        adcSampler.period = 0;
+        return;
+    }
+    ESP_LOGD(LOG_TAG,"sample period: %uus",period);
+    adcSampler.period = period;
+}
+
+/** @brief Detect if the mouthpiece is in use
+ * 
+ * The mouthpiece is active, if x/y is outside the deadzone, the pressure
+ * is outside the sip/puff thresholds, a strong mode is active or any
+ * raw value changed by more than otf_idle since the last activity.
+ * 
+ * @param D Currently measured ADC data.
+ * @return 1 if the mouthpiece is active (or was active during the
+ * last HAL_ADC_IDLE_TIMEOUT ms), 0 if idle.
+ * */
+static uint8_t halAdcUpdateActivity(adcData_t *D)
+{
+    uint32_t raw[5] = {D->up, D->down, D->left, D->right, D->pressure};
+    int64_t now = D->now;
+    uint8_t active = 0;
+    
+    if(D->x != 0 || D->y != 0 || D->strongmode != STRONG_NORMAL) active = 1;
+    if(D->pressure < adc_conf.threshold_sip || D->pressure > adc_conf.threshold_puff) active = 1;
+    for(uint8_t i = 0; i<5; i++)
+    {
+        if(abs((int32_t)raw[i] - (int32_t)adcSampler.ref[i]) > adc_conf.otf_idle) active = 1;
+    }
+    
+    if(active)
+    {
+        memcpy(adcSampler.ref,raw,sizeof(raw));
+        adcSampler.lastactive = now;
+        return 1;
+    }
+    
+    if((now - adcSampler.lastactive) < (HAL_ADC_IDLE_TIMEOUT * 1000)) return 1;
+    return 0;
+}
+
+/** @brief HAL TASK - ADC sampling task
+ * 
+ * This task is started once on init and is never deleted.
+ * On each sample, all sensors are read once (including deadzone) and
+ * the data is passed to the strategy of the current mouthpiece mode.
+ * 
+ * If the mode is changed by halAdcUpdateConfig, the strategy is switched
+ * on the next sample boundary, without deleting/creating any task.
+ * 
+ * Samples are triggered by a periodic esp_timer (not limited by the
+ * FreeRTOS tick rate). The sample rate is rate_active while the
+ * mouthpiece is in use and rate_idle if it is idle (or no sensors are
+ * used in the current mode).
+ * 
+ * @see adcModeStrategy_t
+ * @see halAdcModes
+ * @see halAdcUpdateActivity
+ * */
+void halAdcTask(void * pvParameters)
+{
+    //analog values
+    adcData_t D;
+    memset(&D,0,sizeof(adcData_t));
+    D.strongmode = STRONG_NORMAL;
+    //currently active strategy & corresponding mode
+    const adcModeStrategy_t *strategy = NULL;
+    mouthpiece_mode_t activemode = NONE;
+    //idle state of the mouthpiece
+    uint8_t active = 1;
+    
+    //create the sample timer, notifying this task
+    esp_timer_create_args_t timerargs = {
+        .callback = halAdcSampleTimer,
+        .arg = xTaskGetCurrentTaskHandle(),
+        .name = "adcsample"
+    };
+    if(esp_timer_create(&timerargs,&adcSampler.timer) != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG,"Cannot create sample timer, exiting");
+        adcHandle = NULL;
+        vTaskDelete(NULL);
+    }
+    
     while(1)
     {
         //get mutex
@@ -1036,174 +1441,92 @@ void halAdcTaskThreshold(void * pvParameters)
             continue;
         }
         
-        //read out the analog voltages from all 5 channels
-        uint8_t retry = 0;
-        while((halAdcReadData(&D) != 0) && (retry++ < 10));
-        if(retry == 10)
-        {
-			ESP_LOGE(LOG_TAG,"Cannot read ADC");
-			vTaskDelay(1000/portTICK_PERIOD_MS);
-			xSemaphoreGive(adcSem);
-		}
-        
-        //for a FABI device, we do not have 4 channels, so not UP/DOWN/LEFT/RIGHT
-        #ifdef DEVICE_FLIPMOUSE
-        
-        
+        //load the current config, without blocking on an update
+        uint32_t seq = halAdcLoadConfig();
         
-        //if we are in a special strong mode, do NOT send accumulated data
-        //to USB/BLE. Instead, call halAdcProcessStrongMode
-        //if in normal mode, proceed with mouse
-        if(D.strongmode == STRONG_NORMAL)
+        //switch the strategy on a mode change (on a sample boundary)
+        if(strategy == NULL || adc_conf.mode != activemode)
         {
-            //LEFT/RIGHT value exceeds threshold (deadzone) value?
-            if(D.x != 0)
-            {
-                if(D.x < 0)
-                {
-                    //if not already sent, send press action
-                    if(!(activevbs & (1<<2)))
-                    {
-                        evt.type = VB_PRESS_EVENT;
-                        evt.vb = VB_LEFT;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs |= (1<<2);
-                    }
-                    //if opposite was active, release it.
-                    if(activevbs & (1<<3))
-                    {
-                        evt.type = VB_RELEASE_EVENT;
-                        evt.vb = VB_RIGHT;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs &= ~(1<<3);
-                    }
-                }
-                if(D.x > 0)
-                {
-                    //if not already sent, send press action
-                    if(!(activevbs & (1<<3)))
-                    {
-                        evt.type = VB_PRESS_EVENT;
-                        evt.vb = VB_RIGHT;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs |= (1<<3);
-                    }
-                    //if opposite was active, release it.
-                    if(activevbs & (1<<2))
-                    {
-                        evt.type = VB_RELEASE_EVENT;
-                        evt.vb = VB_LEFT;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs &= ~(1<<2);
-                    }
-                }
-            } else {        
-                //value is 0 --> idle, release both directions
-                //if active
-                if(activevbs & (1<<3))
-                {
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_RIGHT;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    activevbs &= ~(1<<3);
-                }
-                if(activevbs & (1<<2))
-                {
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_LEFT;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    activevbs &= ~(1<<2);
-                }
-            }
+            if(strategy != NULL && strategy->leave != NULL) strategy->leave();
+            activemode = adc_conf.mode;
+            strategy = halAdcGetStrategy(activemode);
+            //don't take a pending strong mode to the new mode
+            D.strongmode = STRONG_NORMAL;
+            if(strategy->enter != NULL) strategy->enter();
             
-            //UP/DOWN value exceeds threshold (deadzone) value?
-            if(D.y != 0)
+            //measure latency from the config update until now
+            uint32_t request = __atomic_exchange_n(&adcModeSwitchRequest,0,__ATOMIC_RELAXED);
+            if(request != 0)
             {
-                if(D.y < 0)
-                {
-                    //if not already sent, send press action
-                    if(!(activevbs & (1<<0)))
-                    {
-                        evt.type = VB_PRESS_EVENT;
-                        evt.vb = VB_UP;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs |= (1<<0);
-                    }
-                    //if opposite was active, release it.
-                    if(activevbs & (1<<1))
-                    {
-                        evt.type = VB_RELEASE_EVENT;
-                        evt.vb = VB_DOWN;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs &= ~(1<<1);
-                    }
-                }
-                if(D.y > 0)
-                {
-                    //if not already sent, send press action
-                    if(!(activevbs & (1<<1)))
-                    {
-                        evt.type = VB_PRESS_EVENT;
-                        evt.vb = VB_DOWN;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs |= (1<<1);
-                    }
-                    //if opposite was active, release it.
-                    if(activevbs & (1<<0))
-                    {
-                        evt.type = VB_RELEASE_EVENT;
-                        evt.vb = VB_UP;
-                        xQueueSendToBack(debouncer_in,&evt,0);
-                        activevbs &= ~(1<<0);
-                    }
-                }
-            } else {        
-                //value is 0 --> idle, release both directions
-                //if active
-                if(activevbs & (1<<0))
-                {
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_UP;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    activevbs &= ~(1<<0);
-                }
-                if(activevbs & (1<<1))
-                {
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_DOWN;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    activevbs &= ~(1<<1);
-                }
+                adcModeSwitchLatency = latencyNow() - request;
+                if(adcModeSwitchLatency > adcModeSwitchLatencyMax) adcModeSwitchLatencyMax = adcModeSwitchLatency;
             }
-        } else {
-            //in special mode, process strong mdoe
-            halAdcProcessStrongMode(&D);
+            ESP_LOGI(LOG_TAG,"switched to mode %s, latency %uus (max %uus)", \
+                strategy->name,adcModeSwitchLatency,adcModeSwitchLatencyMax);
         }
         
-        halAdcReportRaw(D.up, D.down, D.left, D.right, D.pressure, D.x, D.y);
-        
-        #endif
+        if(strategy->process != NULL)
+        {
+            //read out the analog voltages from all 5 channels (including deadzone)
+            //& set calibrate request to 0 before
+            D.calibrate_request = 0;
+            //use the period of the timer which triggered this sample,
+            //the period is changed before waiting for the next sample.
+            //Timer is not started yet on the first sample.
+            if(adcSampler.period != 0) D.period = adcSampler.period;
+            else D.period = halAdcPeriod(adc_conf.rate_active);
+            D.now = esp_timer_get_time();
+            uint8_t retry = 0;
+            while(halAdcReadData(&D) != 0)
+            {
+                if(++retry == 10) break;
+            }
+            if(retry == 10)
+            {
+                ESP_LOGE(LOG_TAG,"Cannot read ADC");
+                xSemaphoreGive(adcSem);
+                vTaskDelay(1000/portTICK_PERIOD_MS);
+                continue;
+            }
+            
+            //process data according to current mode
+            strategy->process(&D);
+            
+            //queue pending mouse movements again, which could not be
+            //queued before (full HID queue), even if there is no movement now
+            hidCoalesceRetry(HID_COALESCE_USB,EVENT_QUEUE_HID_USB);
+            hidCoalesceRetry(HID_COALESCE_BLE,EVENT_QUEUE_HID_BLE);
+            
+            //check if we can use the idle sample rate
+            active = halAdcUpdateActivity(&D);
+        } else active = 0;
         
-        //pressure sensor is handled in another function
-        halAdcProcessPressure(&D);
+        //count if a new config was published during this sample
+        if((__atomic_load_n(&adcConfigSeq,__ATOMIC_ACQUIRE) >> 1) != (seq >> 1))
+        {
+            adcConfigChangedMidSample++;
+        }
         
         //give mutex
         xSemaphoreGive(adcSem);
         
-        //delay the task.
-        vTaskDelayUntil( &xLastWakeTime, 10/portTICK_PERIOD_MS);
-        //vTaskDelay(20/portTICK_PERIOD_MS);
+        //if OTF calibration is requested:
+        if(D.calibrate_request != 0) halAdcCalibrate();
+        
+        //adjust sample rate & wait for the next sample
+        if(active) halAdcSetPeriod(halAdcPeriod(adc_conf.rate_active));
+        else halAdcSetPeriod(halAdcPeriod(adc_conf.rate_idle));
+        ulTaskNotifyTake(pdTRUE, 1000/portTICK_PERIOD_MS);
     }
-    
 }
 
 
 /** @brief Reload ADC config
  * 
  * This method reloads the ADC config.
- * Depending on the configuration, a task switch might be initiated
- * to switch the mouthpiece mode from e.g., Joystick to Mouse to 
- * Alternative Mode (Threshold operated).
+ * Depending on the configuration, the ADC task switches the mouthpiece
+ * mode from e.g., Joystick to Mouse to Alternative Mode (Threshold operated)
+ * on the next sample.
  * @param params New ADC config
  * @return ESP_OK on success, ESP_FAIL otherwise (wrong config, out of memory)
  * */
@@ -1217,127 +1540,80 @@ esp_err_t halAdcUpdateConfig(adc_config_t* params)
     }
     
     //check for initialized mutex
-    if(adcSem == NULL)
+    if(adcConfigWriteSem == NULL)
     {
         ESP_LOGE(LOG_TAG,"Mutex not initialized");
         return ESP_FAIL;
     }
     
-    //acquire mutex
-    if(xSemaphoreTake(adcSem, (TickType_t) 30) != pdTRUE)
+    //check for a valid mode, the ADC task would fall back to NONE otherwise
+    if(params->mode != NONE && params->mode != MOUSE && \
+        params->mode != JOYSTICK && params->mode != THRESHOLD)
     {
-        ESP_LOGW(LOG_TAG,"Cannot obtain mutex for config update");
+        ESP_LOGE(LOG_TAG,"unknown mode (unconfigured), cannot update config.");
         return ESP_FAIL;
     }
     
-    #ifdef DEVICE_FLIPMOUSE
-    //if new mode is different, delete previous task
-    if(params->mode != adc_conf.mode)
+    //acquire writer mutex (the ADC task is not blocked by this mutex)
+    if(xSemaphoreTake(adcConfigWriteSem, (TickType_t) 30) != pdTRUE)
     {
-        if(adcHandle != NULL) 
-        {
-            ESP_LOGD(LOG_TAG, "mode change, deleting old task");
-            vTaskDelete(adcHandle);
-            adcHandle = NULL;
-        } else ESP_LOGW(LOG_TAG, "no valid task handle, no task deleted");
+        ESP_LOGW(LOG_TAG,"Cannot obtain mutex for config update");
+        return ESP_FAIL;
     }
-    #endif
     
     //check for invalid input
     #ifdef DEVICE_FLIPMOUSE
         params->otf_count = validate(params->otf_count,5,15,HAL_IO_ADC_OTF_COUNT);
         params->otf_idle = validate(params->otf_idle,0,15,HAL_IO_ADC_OTF_THRESHOLD);
+        params->strong_delay = validate(params->strong_delay,50,5000,HAL_ADC_DELAY_STRONGMODE);
+        params->strong_timeout = validate(params->strong_timeout,500,10000,HAL_ADC_TIMEOUT_STRONGMODE);
     #endif
+    params->rate_active = validate(params->rate_active,50,500,HAL_ADC_RATE_ACTIVE);
+    params->rate_idle = validate(params->rate_idle,5,100,HAL_ADC_RATE_IDLE);
+    params->axis = validate(params->axis,0,HAL_ADC_JOYSTICK_AXIS_MAX,0);
+    //exit threshold above the enter threshold would toggle on each sample
+    for(uint8_t i = 0; i<ADC_HYST_MAX; i++)
+    {
+        if(params->hyst_exit[i] > params->hyst_enter[i]) params->hyst_exit[i] = params->hyst_enter[i];
+    }
     
     //clear pending button flags
     //TBD...
     
-    //Just copy content
-    memcpy(&adc_conf,params,sizeof(adc_config_t));
+    //start writing: sequence number is odd, readers keep on using the active buffer
+    uint32_t seq = adcConfigSeq;
+    adcConfigSnapshot_t *active = &adcConfigBuffer[(seq >> 1) & 1];
+    adcConfigSnapshot_t *next = &adcConfigBuffer[((seq >> 1) + 1) & 1];
+    __atomic_store_n(&adcConfigSeq,seq+1,__ATOMIC_RELAXED);
+    //the odd sequence number must be visible before any write to the buffer
+    __atomic_thread_fence(__ATOMIC_RELEASE);
     
-    #ifdef DEVICE_FLIPMOUSE
-    //start task according to mode
-    if(adcHandle == NULL)
-    {
-        switch(adc_conf.mode)
-        {
-            case MOUSE:
-                xTaskCreate(halAdcTaskMouse,"ADC_TASK",4096,NULL,HAL_ADC_TASK_PRIORITY,&adcHandle);
-                ESP_LOGI(LOG_TAG,"created ADC task for mouse, handle %d",(uint32_t)adcHandle);
-                break;
-            case JOYSTICK:
-                xTaskCreate(halAdcTaskJoystick,"ADC_TASK",4096,NULL,HAL_ADC_TASK_PRIORITY,&adcHandle);
-                ESP_LOGI(LOG_TAG,"created ADC task for joystick, handle %d",(uint32_t)adcHandle);
-                break;
-            case THRESHOLD:
-                xTaskCreate(halAdcTaskThreshold,"ADC_TASK",4096,NULL,HAL_ADC_TASK_PRIORITY,&adcHandle);
-                ESP_LOGI(LOG_TAG,"created ADC task for threshold, handle %d",(uint32_t)adcHandle);
-                break;
-            case NONE:
-                ESP_LOGI(LOG_TAG,"no ADC task necessary");
-                break;
-            default:
-               ESP_LOGE(LOG_TAG,"unknown mode (unconfigured), cannot startup task.");
-               return ESP_FAIL;
-        }
-    } else {
-        ESP_LOGD(LOG_TAG,"ADC config reloaded without task switch");
-    }
-    #endif
+    //if new mode is different, the ADC task switches on the next sample.
+    //save the time to measure the latency.
+    if(params->mode != active->conf.mode) __atomic_store_n(&adcModeSwitchRequest,latencyNow(),__ATOMIC_RELAXED);
     
-    #ifdef DEVICE_FABI
-    //start task (independent of mode in FABI)
-    if(adcHandle == NULL)
-    {
-        //just use a threshold task, other channels are masked out in this task.
-        xTaskCreate(halAdcTaskThreshold,"ADC_TASK",4096,NULL,HAL_ADC_TASK_PRIORITY,&adcHandle);
-        ESP_LOGI(LOG_TAG,"created ADC task for threshold, handle %d",(uint32_t)adcHandle); 
-    }
-    #endif
+    //Just copy content to the inactive buffer
+    memcpy(&next->conf,params,sizeof(adc_config_t));
     
-    ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,&adc_conf,sizeof(adc_config_t),ESP_LOG_DEBUG);
-    //give mutex
-    xSemaphoreGive(adcSem);
-    return ESP_OK;
-}
-
-void halAdcStrongDelay( TimerHandle_t xTimer )
-{
-    xSemaphoreGive(adcStrongSem);
-}
-
-void halAdcStrongTimeout( TimerHandle_t xTimer )
-{
-    //get adc data reference
-    adcData_t *D = pvTimerGetTimerID(xTimer);
-    if(D == NULL)
-    {
-        ESP_LOGE(LOG_TAG,"Reference to adcData_t not set, but timeout occured");
-        return;
-    }
-    //set strong mode back to normal after timeout
-    if(D->strongmode == STRONG_PUFF)
-    {
-        ESP_LOGI(LOG_TAG,"Exit STRONG PUFF, timeout");
-        TONE(TONE_STRONGPUFF_EXIT_FREQ,TONE_STRONGPUFF_EXIT_DURATION);
-    }
-    if(D->strongmode == STRONG_SIP)
-    {
-        ESP_LOGI(LOG_TAG,"Exit STRONG SIP, timeout");
-        TONE(TONE_STRONGSIP_EXIT_FREQ,TONE_STRONGSIP_EXIT_DURATION);
-    }
+    //rebuild fixed point coefficients & deadzone table
+    halAdcKernelBuild(&next->kernel,next->conf.sensitivity_x,next->conf.sensitivity_y,
+        next->conf.max_speed,next->conf.deadzone_x,next->conf.deadzone_y);
     
-    D->strongmode = STRONG_NORMAL;
+    //publish: sequence number is even again, next buffer is the active one
+    __atomic_store_n(&adcConfigSeq,seq+2,__ATOMIC_RELEASE);
     
+    ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,&next->conf,sizeof(adc_config_t),ESP_LOG_DEBUG);
+    //give mutex
+    xSemaphoreGive(adcConfigWriteSem);
+    return ESP_OK;
 }
 
-
 /** @brief Init the ADC driver module
  * 
  * This method initializes the HAL ADC driver with the given config
- * Depending on the configuration, different tasks are initialized
- * to switch the mouthpiece mode from e.g., Joystick to Mouse to 
- * Alternative Mode (Threshold operated).
+ * and starts the ADC task. Depending on the configuration, this task
+ * processes the mouthpiece in different modes, e.g., Joystick, Mouse
+ * or Alternative Mode (Threshold operated).
  * @param params ADC config for intialization
  * @return ESP_OK on success, ESP_FAIL otherwise (wrong config, no memory, already initialized)
  * */
@@ -1356,18 +1632,23 @@ esp_err_t halAdcInit(adc_config_t* params)
     
     //initialize ADC semphore as mutex
     adcSem = xSemaphoreCreateMutex();
+    //initialize mutex for config updates
+    adcConfigWriteSem = xSemaphoreCreateMutex();
     
     //start first calibration
     //halAdcCalibrate();
     
-    //initialize SW timer for STRONG mode timeout
-    #ifdef DEVICE_FLIPMOUSE
-    adcStrongTimeoutTimerHandle = xTimerCreate("strongmode", HAL_ADC_TIMEOUT_STRONGMODE / portTICK_PERIOD_MS, \
-        pdFALSE,( void * ) 0,halAdcStrongTimeout);
-    adcStrongTimerHandle = xTimerCreate("strongmodedelay", HAL_ADC_DELAY_STRONGMODE / portTICK_PERIOD_MS, \
-        pdFALSE,( void * ) 0,halAdcStrongDelay);
-    adcStrongSem = xSemaphoreCreateBinary();
-    #endif
+    //start the ADC task once, the mode is switched by this task itself.
+    if(adcHandle == NULL)
+    {
+        if(xTaskCreate(halAdcTask,"ADC_TASK",HAL_ADC_TASK_STACKSIZE,NULL, \
+            HAL_ADC_TASK_PRIORITY,&adcHandle) != pdPASS)
+        {
+            ESP_LOGE(LOG_TAG,"Cannot create ADC task");
+            return ESP_FAIL;
+        }
+        ESP_LOGI(LOG_TAG,"created ADC task, handle %d",(uint32_t)adcHandle);
+    }
     
     //not initializing full config, only ADC
     if(params == NULL) return ESP_OK;
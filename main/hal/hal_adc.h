@@ -25,16 +25,17 @@
  * 
  * The hal_adc files are used to measure all ADC inputs (4 direction
  * sensors and 1 pressure sensor).
- * In addition, depending on the configuration, different ADC tasks are
- * loaded.
- * One of these tasks is loaded:<br>
- * * halAdcMouse - Use the ADC values as mouse input <br>
- * * halAdcThreshold - Use the ADC values to trigger virtual buttons 
+ * One ADC task (halAdcTask) is started, which reads all sensors and
+ * passes the data to one of these mode strategies, depending on the
+ * configuration:<br>
+ * * Mouse - Use the ADC values as mouse input <br>
+ * * Threshold - Use the ADC values to trigger virtual buttons 
  * (keyboard actions for example) <br>
- * * halAdcJoystick - Use the ADC input to control the HID joystick <br>
+ * * Joystick - Use the ADC input to control the HID joystick <br>
  * 
- * These tasks are HAL tasks, which means they might be reloaded/changed,
- * but they are not managed outside this module.<br>
+ * This task is a HAL task, which means it is not managed outside this
+ * module. A mode change is done on the next sample, without
+ * deleting/creating a task.<br>
  * In addition, the FUNCTIONAL task task_calibration can be used to
  * trigger a zero-point calibration of the mouthpiece.
  * 
@@ -47,28 +48,23 @@
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <driver/adc.h>
 #include "esp_adc_cal.h"
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "hal_serial.h"
+#include "hal_adc_filter.h"
+#include "hal_adc_kernel.h"
 #include "handler_hid.h"
 #include "handler_vb.h"
+#include "hid_coalesce.h"
+#include "latency.h"
 #include "math.h"
 
 
 #ifdef DEVICE_FLIPMOUSE
 
-/** @brief Use elliptic curve deadzone
- * 
- * If set to != 0, halAdcReadData will process the deadzone in
- * an elliptic curve instead of an rectangle.
- * 
- * @see halAdcReadData
- * @note Experimental feature!
- */
-#define HAL_IO_ADC_ELLIPTIC_DEADZONE  0
-
 /** @brief on-the-fly calibration - sliding window size
  * 
  * We do an on-the-fly calibration if the mouthpiece is assumed idle.
@@ -123,8 +119,6 @@
  * @see HAL_IO_ADC_CHANNEL_MIC */
 #define HAL_IO_PIN_ADC_MIC      33
 
-
-
 /** @brief ADC channel for FSR up
  * @note For adapting this channel, change HAL_IO_PIN_ADC_UP as well!
  * @see HAL_IO_PIN_ADC_UP */
@@ -152,10 +146,12 @@
  * @see HAL_IO_PIN_ADC_MIC */
 #define HAL_IO_ADC_CHANNEL_MIC      ADC1_CHANNEL_5
 
-/** @brief Timeout for strong sip/puff mode [ms] */
+/** @brief Default timeout for strong sip/puff mode [ms]
+ * @note This is the default value, can be changed with "AT ST" */
 #define HAL_ADC_TIMEOUT_STRONGMODE  2000
 
-/** @brief Time to wait until strong sip/puff + additional action is possible [ms] */
+/** @brief Default time to wait until strong sip/puff + additional action is possible [ms]
+ * @note This is the default value, can be changed with "AT SD" */
 #define HAL_ADC_DELAY_STRONGMODE  600
 
 #endif /* DEVICE_FLIPMOUSE */
@@ -174,8 +170,37 @@
 
 #endif /* DEVICE_FABI */
 
-/** @brief Parameter for mouse acceleration calculation */
-#define ACCELTIME_MAX 20000
+/** @brief Stack size for the ADC task
+ * @see halAdcTask */
+#define HAL_ADC_TASK_STACKSIZE 4096
+
+/** @brief Default sample rate [Hz] while the mouthpiece is in use
+ * @note This is the default value, can be changed with "AT SF"
+ * @see HAL_ADC_RATE_IDLE */
+#define HAL_ADC_RATE_ACTIVE 200
+
+/** @brief Default sample rate [Hz] while the mouthpiece is idle
+ * 
+ * If all channels change less than otf_idle for HAL_ADC_IDLE_TIMEOUT,
+ * and neither a movement nor sip/puff is detected, this sample rate is used.
+ * @note This is the default value, can be changed with "AT SI"
+ * @see HAL_ADC_RATE_ACTIVE */
+#define HAL_ADC_RATE_IDLE 20
+
+/** @brief Time [ms] without any activity, before switching to the idle sample rate
+ * @see HAL_ADC_RATE_IDLE */
+#define HAL_ADC_IDLE_TIMEOUT 1000
+
+/** @brief Joystick axis value at rest (10bit axis) */
+#define HAL_ADC_JOYSTICK_CENTER 512
+
+/** @brief Maximum joystick axis value (10bit axis) */
+#define HAL_ADC_JOYSTICK_MAX 1023
+
+/** @brief Highest valid joystick axis assignment (AT JA)
+ * 
+ * 0: X/Y, 1: Z/Z-rotate, 2: slider left/right */
+#define HAL_ADC_JOYSTICK_AXIS_MAX 2
 
 
 /** @brief Calibration function
@@ -192,21 +217,57 @@ void halAdcCalibrate(void);
 /** @brief Reload ADC config
  * 
  * This method reloads the ADC config.
- * Depending on the configuration, a task switch might be initiated
- * to switch the mouthpiece mode from e.g., Joystick to Mouse to 
- * Alternative Mode (Threshold operated).
+ * Depending on the configuration, the ADC task switches the mouthpiece
+ * mode from e.g., Joystick to Mouse to Alternative Mode (Threshold operated)
+ * on the next sample.
  * @param params New ADC config
  * @return ESP_OK on success, ESP_FAIL otherwise (wrong config, out of memory)
  * */
 esp_err_t halAdcUpdateConfig(adc_config_t* params);
 
 
+/** @brief Get the latency of mouthpiece mode switches
+ * 
+ * The latency is measured from the config update (halAdcUpdateConfig)
+ * until the first sample is processed by the new mode. It is bound by
+ * one sample period of the previous mode (plus the time for taking adcSem).
+ * 
+ * @param last Latency [us] of the last mode switch, might be NULL
+ * @param max Maximum latency [us] since startup, might be NULL
+ * */
+void halAdcGetModeSwitchLatency(uint32_t *last, uint32_t *max);
+
+/** @brief Get the number of samples which saw a config change mid-flight
+ * 
+ * Incremented by the ADC task if a new config was published while a
+ * sample was processed (this sample was processed with the previous config).
+ * 
+ * @return Count of samples since startup
+ * */
+uint32_t halAdcGetConfigChangeCount(void);
+
+/** @brief Get the count of emitted & suppressed VB events
+ * 
+ * Emitted are all VB events sent to debouncer_in by the ADC task,
+ * suppressed are crossings of a bare threshold (without hysteresis band)
+ * which did not change the VB state.
+ * 
+ * @param emitted Count of VB events sent to debouncer_in, might be NULL
+ * @param suppressed Count of threshold crossings held back by the hysteresis, might be NULL
+ * @see adc_hyst_channel_t
+ * */
+void halAdcGetHysteresisStats(uint32_t *emitted, uint32_t *suppressed);
+
+/** @brief Reset the counters of emitted & suppressed VB events
+ * @see halAdcGetHysteresisStats */
+void halAdcResetHysteresisStats(void);
+
 /** @brief Init the ADC driver module
  * 
  * This method initializes the HAL ADC driver with the given config
- * Depending on the configuration, different tasks are initialized
- * to switch the mouthpiece mode from e.g., Joystick to Mouse to 
- * Alternative Mode (Threshold operated).
+ * and starts the ADC task. Depending on the configuration, this task
+ * processes the mouthpiece in different modes, e.g., Joystick, Mouse
+ * or Alternative Mode (Threshold operated).
  * @param params ADC config for intialization
  * @return ESP_OK on success, ESP_FAIL otherwise (wrong config, no memory, already initialized)
  * */
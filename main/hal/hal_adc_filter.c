@@ -0,0 +1,289 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HAL helper - Filter pipeline for raw ADC sensor values.
+ *
+ * @see hal_adc_filter.h
+ * */
+
+#include "hal_adc_filter.h"
+#include <stdlib.h>
+#include <xtensa/hal.h>
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "hal_adc_flt"
+
+/** @brief State of the median filter for one channel */
+typedef struct adcFilterMedian {
+    /** @brief Ring buffer of the last raw values */
+    int32_t ring[HAL_ADC_FILTER_MEDIAN_MAX];
+    /** @brief Next write position in the ring buffer */
+    uint8_t pos;
+    /** @brief Count of valid values in the ring buffer */
+    uint8_t fill;
+} adcFilterMedian_t;
+
+/** @brief State of the 1€ filter for one channel */
+typedef struct adcFilterOneEuro {
+    /** @brief Last filtered value (Q8) */
+    int32_t x;
+    /** @brief Last filtered speed [counts/s] */
+    int32_t dx;
+} adcFilterOneEuro_t;
+
+/** @brief Filter state for all channels */
+static struct {
+    /** @brief Median filter state per channel */
+    adcFilterMedian_t median[HAL_ADC_FILTER_CHANNELS];
+    /** @brief IIR state per channel (Q8) */
+    int32_t iir[HAL_ADC_FILTER_CHANNELS];
+    /** @brief 1€ filter state per channel */
+    adcFilterOneEuro_t oe[HAL_ADC_FILTER_CHANNELS];
+    /** @brief Timestamp [us] of the last sample, 0 if the state is reset */
+    int64_t last;
+    /** @brief Filter parameters which were used for the last sample */
+    uint8_t median_n, iir_k, oe_mincutoff, oe_beta;
+} adcFilter;
+
+/** @brief Cost of each filter stage
+ * @see halAdcFilterGetCost */
+static adc_filter_cost_t adcFilterCost[FILTER_STAGE_MAX];
+
+/** @brief Names of the filter stages, used for reporting */
+static const char *adcFilterNames[FILTER_STAGE_MAX] = {"median","iir","oneeuro"};
+
+/** @brief Account the cycles of one filter stage
+ * @param stage Filter stage
+ * @param start Cycle counter value on start of this stage */
+static void halAdcFilterAccount(adc_filter_stage_t stage, uint32_t start)
+{
+    uint32_t cycles = xthal_get_ccount() - start;
+    adcFilterCost[stage].samples++;
+    adcFilterCost[stage].cycles += cycles;
+    if(cycles > adcFilterCost[stage].cycles_max) adcFilterCost[stage].cycles_max = cycles;
+}
+
+/** @brief Median of N, spike rejection
+ *
+ * The new value is put into the ring buffer, the median of the last
+ * n values is returned (sorted via insertion sort, n is small).
+ *
+ * @param m Median state for this channel
+ * @param x New raw value
+ * @param n Window size (odd, 3..HAL_ADC_FILTER_MEDIAN_MAX)
+ * @return Median of the last n values
+ * */
+static int32_t halAdcFilterMedian(adcFilterMedian_t *m, int32_t x, uint8_t n)
+{
+    int32_t sorted[HAL_ADC_FILTER_MEDIAN_MAX];
+
+    m->ring[m->pos] = x;
+    m->pos = (m->pos + 1) % n;
+    if(m->fill < n) m->fill++;
+
+    //insertion sort of all valid values
+    for(uint8_t i = 0; i<m->fill; i++)
+    {
+        int32_t v = m->ring[i];
+        int8_t j = i - 1;
+        while(j >= 0 && sorted[j] > v)
+        {
+            sorted[j+1] = sorted[j];
+            j--;
+        }
+        sorted[j+1] = v;
+    }
+    return sorted[m->fill / 2];
+}
+
+/** @brief Calculate the smoothing factor for the 1€ filter
+ *
+ * alpha = r / (r + 1), with r = 2 * pi * fc * Te
+ *
+ * @param fc Cutoff frequency [mHz]
+ * @param te Sample interval [us]
+ * @return alpha in Q16
+ * */
+static uint32_t halAdcFilterAlpha(uint32_t fc, uint32_t te)
+{
+    //r = 2*pi * fc[mHz] * te[us] / 1e9
+    uint64_t k = (uint64_t)fc * te * 6283 / 1000;
+    return (uint32_t)((k << 16) / (k + 1000000000ULL));
+}
+
+/** @brief 1€ filter, adaptive low pass
+ *
+ * Cutoff frequency is mincutoff + beta * |speed|, which means jitter
+ * is removed when the mouthpiece is (nearly) idle and only a small lag
+ * is added on fast movements.
+ *
+ * @see http://cristal.univ-lille.fr/~casiez/1euro/
+ * @param f 1€ state for this channel
+ * @param x New value
+ * @param te Sample interval [us]
+ * @param mincutoff Minimum cutoff frequency [0.1Hz]
+ * @param beta Speed coefficient [mHz per count/s]
+ * @return Filtered value
+ * */
+static int32_t halAdcFilterOneEuro(adcFilterOneEuro_t *f, int32_t x, uint32_t te, \
+    uint8_t mincutoff, uint8_t beta)
+{
+    int32_t xq = x << 8;
+
+    //estimate speed [counts/s] and filter it with a constant cutoff
+    int32_t dx = (int32_t)(((int64_t)(xq - f->x) * 1000000 / te) >> 8);
+    uint32_t alpha = halAdcFilterAlpha(HAL_ADC_FILTER_OE_DCUTOFF, te);
+    f->dx += (int32_t)(((int64_t)(dx - f->dx) * alpha) >> 16);
+
+    //adapt cutoff to speed and filter the value itself
+    uint32_t fc = mincutoff * 100 + beta * (uint32_t)abs(f->dx);
+    alpha = halAdcFilterAlpha(fc, te);
+    f->x += (int32_t)(((int64_t)(xq - f->x) * alpha) >> 16);
+
+    return (f->x + 128) >> 8;
+}
+
+/** @brief Apply the filter pipeline to one sample of raw values
+ *
+ * All enabled filter stages are applied to the first count channels.
+ * If the filter parameters changed since the last call, the filter
+ * state is reset (the first sample is passed unfiltered).
+ *
+ * @param conf ADC config containing the filter parameters
+ * @param values Raw values, replaced by the filtered values
+ * @param count Number of channels in values (max. HAL_ADC_FILTER_CHANNELS)
+ * */
+void halAdcFilterApply(const adc_config_t *conf, int32_t *values, uint8_t count)
+{
+    uint32_t start;
+    uint8_t n = conf->filter_median;
+
+    if(count > HAL_ADC_FILTER_CHANNELS) count = HAL_ADC_FILTER_CHANNELS;
+
+    //limit median window to an odd size, <3 means disabled
+    if(n > HAL_ADC_FILTER_MEDIAN_MAX) n = HAL_ADC_FILTER_MEDIAN_MAX;
+    if(n < 3) n = 0;
+    else n |= 1;
+
+    //reset all states if parameters are changed
+    if(n != adcFilter.median_n || conf->filter_iir != adcFilter.iir_k || \
+        conf->filter_oe_mincutoff != adcFilter.oe_mincutoff || \
+        conf->filter_oe_beta != adcFilter.oe_beta)
+    {
+        ESP_LOGI(LOG_TAG,"New filter params: median %d, IIR %d, 1e %d/%d",n, \
+            conf->filter_iir,conf->filter_oe_mincutoff,conf->filter_oe_beta);
+        halAdcFilterReset();
+        adcFilter.median_n = n;
+        adcFilter.iir_k = conf->filter_iir;
+        adcFilter.oe_mincutoff = conf->filter_oe_mincutoff;
+        adcFilter.oe_beta = conf->filter_oe_beta;
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    //first sample after a reset: initialize states with raw values
+    if(adcFilter.last == 0)
+    {
+        for(uint8_t i = 0; i<count; i++)
+        {
+            if(n != 0) halAdcFilterMedian(&adcFilter.median[i],values[i],n);
+            adcFilter.iir[i] = values[i] << 8;
+            adcFilter.oe[i].x = values[i] << 8;
+            adcFilter.oe[i].dx = 0;
+        }
+        adcFilter.last = now;
+        return;
+    }
+
+    //sample interval for 1€ filter
+    uint32_t te = (uint32_t)(now - adcFilter.last);
+    if(te == 0) te = 1;
+    if(te > HAL_ADC_FILTER_MAX_INTERVAL) te = HAL_ADC_FILTER_MAX_INTERVAL;
+    adcFilter.last = now;
+
+    //stage 1: median
+    if(n != 0)
+    {
+        start = xthal_get_ccount();
+        for(uint8_t i = 0; i<count; i++)
+        {
+            values[i] = halAdcFilterMedian(&adcFilter.median[i],values[i],n);
+        }
+        halAdcFilterAccount(FILTER_STAGE_MEDIAN,start);
+    }
+
+    //stage 2: IIR, y += (x-y) * (256-k) / 256
+    if(adcFilter.iir_k != 0)
+    {
+        start = xthal_get_ccount();
+        for(uint8_t i = 0; i<count; i++)
+        {
+            adcFilter.iir[i] += (int32_t)(((int64_t)((values[i] << 8) - adcFilter.iir[i]) * (256 - adcFilter.iir_k)) >> 8);
+            values[i] = (adcFilter.iir[i] + 128) >> 8;
+        }
+        halAdcFilterAccount(FILTER_STAGE_IIR,start);
+    }
+
+    //stage 3: 1€ filter
+    if(adcFilter.oe_mincutoff != 0)
+    {
+        start = xthal_get_ccount();
+        for(uint8_t i = 0; i<count; i++)
+        {
+            values[i] = halAdcFilterOneEuro(&adcFilter.oe[i],values[i],te, \
+                adcFilter.oe_mincutoff,adcFilter.oe_beta);
+        }
+        halAdcFilterAccount(FILTER_STAGE_ONEEURO,start);
+    }
+}
+
+/** @brief Reset the filter state of all channels
+ *
+ * The next sample will be passed unfiltered and is used as starting
+ * point for all filter stages.
+ * */
+void halAdcFilterReset(void)
+{
+    memset(adcFilter.median,0,sizeof(adcFilter.median));
+    adcFilter.last = 0;
+}
+
+/** @brief Get the cost of one filter stage
+ *
+ * @param stage Filter stage
+ * @param cost Pointer to a struct which will be filled with the current values
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t halAdcFilterGetCost(adc_filter_stage_t stage, adc_filter_cost_t *cost)
+{
+    if(stage >= FILTER_STAGE_MAX || cost == NULL) return ESP_FAIL;
+    memcpy(cost,&adcFilterCost[stage],sizeof(adc_filter_cost_t));
+    return ESP_OK;
+}
+
+/** @brief Get the name of one filter stage, used for reporting
+ * @param stage Filter stage
+ * @return Name of this stage ("?" for an invalid stage)
+ * */
+const char *halAdcFilterGetName(adc_filter_stage_t stage)
+{
+    if(stage >= FILTER_STAGE_MAX) return "?";
+    return adcFilterNames[stage];
+}
@@ -0,0 +1,121 @@
+#ifndef HAL_ADC_FILTER_H
+#define HAL_ADC_FILTER_H
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HAL helper - Filter pipeline for raw ADC sensor values.
+ *
+ * Each sensor channel (up, down, left, right, pressure) is passed
+ * through a chain of filter stages before any further processing is done
+ * in hal_adc:<br>
+ * * Median of N - spike rejection on a small ring buffer (AT FM) <br>
+ * * First order IIR - exponential smoothing (AT FI) <br>
+ * * 1€ filter - adaptive low pass, low jitter at rest and low lag
+ * on fast movements (AT FC & AT FS) <br>
+ *
+ * Each stage is disabled if its parameter is 0. All stages are done in
+ * fixed point, the cost of each stage is measured in CPU cycles and can
+ * be read via halAdcFilterGetCost (AT FT).
+ *
+ * @note These functions are not thread-safe, they are called by
+ * halAdcReadData with adcSem taken.
+ * @see adc_config_t
+ * */
+
+#include <stdint.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "common.h"
+
+/** @brief Number of filtered channels (up, down, left, right, pressure) */
+#define HAL_ADC_FILTER_CHANNELS 5
+
+/** @brief Maximum window size for the median filter
+ * @note Must be odd, larger values are limited to this size */
+#define HAL_ADC_FILTER_MEDIAN_MAX 7
+
+/** @brief Cutoff frequency [mHz] for the derivative in the 1€ filter
+ *
+ * The speed estimation of the 1€ filter is low pass filtered with
+ * a constant cutoff frequency (1Hz is recommended by the authors).
+ * */
+#define HAL_ADC_FILTER_OE_DCUTOFF 1000
+
+/** @brief Maximum sample interval [us] used for the 1€ filter
+ *
+ * If the time between two samples is longer (e.g., the ADC task was
+ * paused on a calibration), this value is used instead.
+ * */
+#define HAL_ADC_FILTER_MAX_INTERVAL 100000
+
+/** @brief Available filter stages, in order of processing */
+typedef enum {
+    FILTER_STAGE_MEDIAN = 0,
+    FILTER_STAGE_IIR,
+    FILTER_STAGE_ONEEURO,
+    FILTER_STAGE_MAX
+} adc_filter_stage_t;
+
+/** @brief Cost of one filter stage
+ * @see halAdcFilterGetCost */
+typedef struct adc_filter_cost {
+    /** @brief Count of processed samples (all channels of one sample count as one) */
+    uint32_t samples;
+    /** @brief Sum of CPU cycles for all processed samples */
+    uint64_t cycles;
+    /** @brief Maximum CPU cycles for one sample */
+    uint32_t cycles_max;
+} adc_filter_cost_t;
+
+/** @brief Apply the filter pipeline to one sample of raw values
+ *
+ * All enabled filter stages are applied to the first count channels.
+ * If the filter parameters changed since the last call, the filter
+ * state is reset (the first sample is passed unfiltered).
+ *
+ * @param conf ADC config containing the filter parameters
+ * @param values Raw values, replaced by the filtered values
+ * @param count Number of channels in values (max. HAL_ADC_FILTER_CHANNELS)
+ * */
+void halAdcFilterApply(const adc_config_t *conf, int32_t *values, uint8_t count);
+
+/** @brief Reset the filter state of all channels
+ *
+ * The next sample will be passed unfiltered and is used as starting
+ * point for all filter stages.
+ * */
+void halAdcFilterReset(void);
+
+/** @brief Get the cost of one filter stage
+ *
+ * @param stage Filter stage
+ * @param cost Pointer to a struct which will be filled with the current values
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t halAdcFilterGetCost(adc_filter_stage_t stage, adc_filter_cost_t *cost);
+
+/** @brief Get the name of one filter stage, used for reporting
+ * @param stage Filter stage
+ * @return Name of this stage ("?" for an invalid stage)
+ * */
+const char *halAdcFilterGetName(adc_filter_stage_t stage);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HAL helper - Fixed point sensor kernel for hal_adc.
+ *
+ * @see hal_adc_kernel.h
+ * */
+
+#include "hal_adc_kernel.h"
+#include <stdlib.h>
+#include <math.h>
+
+/** @brief Precompute the fixed point kernel coefficients
+ * 
+ * Converts the float based mouse gains to Q32, the joystick gains
+ * and max speed to Q16 and, if the elliptic deadzone is enabled,
+ * builds the ellipse border lookup table.
+ * 
+ * The elliptic deadzone table is indexed by a pseudo-angle
+ * t = |y| / (|x| + |y|), which needs only one integer division instead
+ * of atan/tan/sqrt. For each t, the intersection of the ray (1-t, t)
+ * and the deadzone ellipse is stored.
+ * 
+ * @note Float is used here, but only once per config update.
+ * @see hal_adc_kernel.h
+ * */
+void halAdcKernelBuild(adcKernel_t *kernel, uint32_t sensitivity_x,
+    uint32_t sensitivity_y, uint32_t max_speed, uint32_t deadzone_x,
+    uint32_t deadzone_y)
+{
+    //gain in Q32, multiplied with x * accelTime and shifted by 16 we get Q16
+    kernel->gain_x = (uint32_t)(sensitivity_x * HAL_ADC_ACCEL_FACTOR * 4294967296.0f + 0.5f);
+    kernel->gain_y = (uint32_t)(sensitivity_y * HAL_ADC_ACCEL_FACTOR * 4294967296.0f + 0.5f);
+    kernel->max_speed = max_speed * HAL_ADC_Q16_ONE;
+    kernel->joy_gain_x = (sensitivity_x * HAL_ADC_Q16_ONE) / HAL_ADC_JOYSTICK_DIVIDER;
+    kernel->joy_gain_y = (sensitivity_y * HAL_ADC_Q16_ONE) / HAL_ADC_JOYSTICK_DIVIDER;
+    
+    #if HAL_IO_ADC_ELLIPTIC_DEADZONE != 0
+    uint32_t a = deadzone_x;
+    uint32_t b = deadzone_y;
+    const uint32_t steps = 1<<HAL_ADC_DEADZONE_LUT_BITS;
+    
+    kernel->a2 = a*a;
+    kernel->b2 = b*b;
+    kernel->ab2 = (uint64_t)kernel->a2 * kernel->b2;
+    
+    for(uint32_t i = 0; i<=steps; i++)
+    {
+        //direction of this entry: (u,v) = (steps-i, i)
+        float u = steps - i;
+        float v = i;
+        float denom = sqrtf(kernel->b2*u*u + kernel->a2*v*v);
+        //no deadzone on at least one axis -> nothing to subtract
+        if(denom == 0.0f || a == 0 || b == 0)
+        {
+            kernel->dz_x[i] = 0;
+            kernel->dz_y[i] = 0;
+            continue;
+        }
+        //scale the ray to hit the ellipse border: s = a*b / sqrt(b²u² + a²v²)
+        float scale = (a*b) / denom;
+        kernel->dz_x[i] = (uint32_t)(scale * u * HAL_ADC_Q16_ONE + 0.5f);
+        kernel->dz_y[i] = (uint32_t)(scale * v * HAL_ADC_Q16_ONE + 0.5f);
+    }
+    #else
+    (void)deadzone_x;
+    (void)deadzone_y;
+    #endif
+}
+
+#if HAL_IO_ADC_ELLIPTIC_DEADZONE != 0
+/** @brief Apply the elliptic deadzone to one X/Y sample
+ * 
+ * @see hal_adc_kernel.h
+ * */
+void halAdcKernelDeadzone(const adcKernel_t *kernel, int32_t x, int32_t y,
+    int32_t *outx, int32_t *outy)
+{
+    //formula:
+    //https://sebadorn.de/2012/01/02/herausfinden-ob-ein-punkt-in-einer-ellipse-liegt
+    //A point in an elliptic curve (a/b are deadzone values):
+    //x² / a² + y² / b² <= 1  <=>  b²x² + a²y² <= a²b²
+    //done in integer, without any division.
+    uint32_t ax = abs(x);
+    uint32_t ay = abs(y);
+    if(ax > 0xFFFF) ax = 0xFFFF;
+    if(ay > 0xFFFF) ay = 0xFFFF;
+    
+    //check if point is inside deadzone
+    if((uint64_t)kernel->b2*ax*ax + (uint64_t)kernel->a2*ay*ay <= kernel->ab2)
+    {
+        *outx = 0;
+        *outy = 0;
+        return;
+    }
+    
+    //if outside deadzone, subtract ellipse itself to start with
+    //0 for a movement.
+    //The ellipse border on the ray to (x/y) is taken from the
+    //lookup table, indexed by the pseudo-angle |y|/(|x|+|y|) in Q16
+    //(0 is X axis, 1<<16 is Y axis)
+    const uint32_t fracbits = 16 - HAL_ADC_DEADZONE_LUT_BITS;
+    uint32_t t = (ay << 16) / (ax + ay);
+    uint32_t idx = t >> fracbits;
+    uint32_t frac = t & ((1<<fracbits)-1);
+    uint32_t deadzoneX = kernel->dz_x[idx];
+    uint32_t deadzoneY = kernel->dz_y[idx];
+    
+    //interpolate between two table entries
+    if(idx < (1<<HAL_ADC_DEADZONE_LUT_BITS))
+    {
+        deadzoneX -= (uint32_t)(((uint64_t)(kernel->dz_x[idx] - kernel->dz_x[idx+1]) * frac) >> fracbits);
+        deadzoneY += (uint32_t)(((uint64_t)(kernel->dz_y[idx+1] - kernel->dz_y[idx]) * frac) >> fracbits);
+    }
+    
+    //Q16 -> integer (rounded)
+    deadzoneX = (deadzoneX + HAL_ADC_Q16_ONE/2) >> 16;
+    deadzoneY = (deadzoneY + HAL_ADC_Q16_ONE/2) >> 16;
+    
+    //subtract calculated ellipse coordinates from output X/Y values,
+    //but do not cross zero
+    ax = (ax > deadzoneX) ? ax - deadzoneX : 0;
+    ay = (ay > deadzoneY) ? ay - deadzoneY : 0;
+    *outx = (x < 0) ? -(int32_t)ax : (int32_t)ax;
+    *outy = (y < 0) ? -(int32_t)ay : (int32_t)ay;
+}
+#endif
+
+/** @brief Calculate the mouse movement of one axis for one sample
+ * 
+ * @see hal_adc_kernel.h
+ * */
+int32_t halAdcKernelMove(int32_t value, uint32_t accelTime, uint32_t gain,
+    uint32_t period, int32_t maxSpeed)
+{
+    //acceleration and precomputed gain (accel factor and sensitivity):
+    //Q32 * Q8 -> Q16
+    int32_t moveVal = (int32_t)(((((int64_t)value * accelTime * gain) >> 24) \
+        * period) / HAL_ADC_REF_PERIOD);
+    //limit value
+    if (moveVal>maxSpeed) moveVal=maxSpeed;
+    if (moveVal< -maxSpeed) moveVal=-maxSpeed;
+    return moveVal;
+}
+
+/** @brief Scale the max speed of the kernel to the sample period
+ * 
+ * @see hal_adc_kernel.h
+ * */
+int32_t halAdcKernelMaxSpeed(const adcKernel_t *kernel, uint32_t period)
+{
+    return (int32_t)(((int64_t)kernel->max_speed * period) / HAL_ADC_REF_PERIOD);
+}
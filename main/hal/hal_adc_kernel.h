@@ -0,0 +1,200 @@
+#ifndef HAL_ADC_KERNEL_H
+#define HAL_ADC_KERNEL_H
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HAL helper - Fixed point sensor kernel for hal_adc.
+ *
+ * Deadzone and mouse movement calculation of the FLipMouse, done in
+ * integer only (Q16 / Q32). All coefficients which would need float or
+ * libm calls are precomputed once per config update (halAdcKernelBuild),
+ * the sample loop uses only the functions below.
+ *
+ * These functions have no dependency on FreeRTOS or ESP-IDF, they are
+ * also compiled on the host by tools/host_tests (comparison against the
+ * previous float implementation).
+ *
+ * @note These functions are not thread-safe, hal_adc uses its own copy
+ * of the kernel for each sample.
+ * @see adcKernel_t
+ * */
+
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Use elliptic curve deadzone
+ * 
+ * If set to != 0, halAdcReadData will process the deadzone in
+ * an elliptic curve instead of an rectangle.
+ * 
+ * @see halAdcReadData
+ * @see halAdcKernelDeadzone
+ * @note Experimental feature!
+ */
+#ifndef HAL_IO_ADC_ELLIPTIC_DEADZONE
+#define HAL_IO_ADC_ELLIPTIC_DEADZONE  0
+#endif
+
+/** @brief Size of the elliptic deadzone lookup table (in bits)
+ * 
+ * The elliptic deadzone is precomputed on each config update into a
+ * table with (1<<HAL_ADC_DEADZONE_LUT_BITS)+1 entries, covering one
+ * quadrant of the mouthpiece movement. Values between two entries are
+ * linearly interpolated.
+ * 
+ * @see HAL_IO_ADC_ELLIPTIC_DEADZONE
+ * @note Maximum is 16 (pseudo-angle is calculated in Q16).
+ */
+#define HAL_ADC_DEADZONE_LUT_BITS 6
+
+/** @brief Reference sample period [us] for mouse acceleration & maximum speed
+ * 
+ * Acceleration & maximum speed settings are defined per 10ms (which
+ * was the fixed sample period before). Mouse movements are scaled
+ * to the current sample period, so the cursor speed does not depend on
+ * the sample rate.
+ * */
+#define HAL_ADC_REF_PERIOD 10000
+
+/** @brief Divider for the joystick sensitivity
+ * 
+ * Axis value is: HAL_ADC_JOYSTICK_CENTER + x * sensitivity / HAL_ADC_JOYSTICK_DIVIDER
+ * (a sensitivity of 50 maps one sensor count to one axis step).
+ * */
+#define HAL_ADC_JOYSTICK_DIVIDER 50
+
+/** @brief Parameter for mouse acceleration calculation */
+#define ACCELTIME_MAX 20000
+
+/** @brief Factor for mouse acceleration calculation
+ * 
+ * Movement per sample is: x * sensitivity * HAL_ADC_ACCEL_FACTOR * accelTime
+ * @note This factor is only used for precomputing the fixed point gain,
+ * the sample loop does not use any float calculations.
+ * @see ACCELTIME_MAX */
+#define HAL_ADC_ACCEL_FACTOR (20 / 100000000.0f)
+
+/** @brief Fixed point 1.0 in Q16 format, used by the sensor kernel */
+#define HAL_ADC_Q16_ONE (1<<16)
+
+/** @brief Maximum accumulated mouse movement (Q16), avoids an overflow
+ * if max_speed is higher than the maximum report value.
+ * Only whole counts are passed on, the fractional part stays in the
+ * accumulator (no sub-count movement is lost). */
+#define HAL_ADC_ACCUM_MAX (16384 * HAL_ADC_Q16_ONE)
+
+/** @brief Precomputed fixed point coefficients for the sensor kernel
+ * 
+ * This struct is rebuilt on each config update (halAdcKernelBuild),
+ * the sample loop (halAdcReadData & halAdcMouseProcess) uses only integer
+ * operations on these values (no float, no libm calls).
+ * 
+ * @see halAdcKernelBuild
+ * @see halAdcUpdateConfig
+ * */
+typedef struct adcKernel {
+    /** @brief Mouse gain X axis (sensitivity_x * HAL_ADC_ACCEL_FACTOR) in Q32 */
+    uint32_t gain_x;
+    /** @brief Mouse gain Y axis (sensitivity_y * HAL_ADC_ACCEL_FACTOR) in Q32 */
+    uint32_t gain_y;
+    /** @brief Maximum movement per sample (max_speed) in Q16 */
+    int32_t max_speed;
+    /** @brief Joystick gain X axis (sensitivity_x / HAL_ADC_JOYSTICK_DIVIDER) in Q16 */
+    int32_t joy_gain_x;
+    /** @brief Joystick gain Y axis (sensitivity_y / HAL_ADC_JOYSTICK_DIVIDER) in Q16 */
+    int32_t joy_gain_y;
+    #if HAL_IO_ADC_ELLIPTIC_DEADZONE != 0
+    /** @brief Squared deadzone values (a², b²) for the ellipse check */
+    uint32_t a2;
+    uint32_t b2;
+    /** @brief a²*b², right side of the ellipse check */
+    uint64_t ab2;
+    /** @brief X coordinate (Q16) of the ellipse border, indexed by pseudo-angle */
+    uint32_t dz_x[(1<<HAL_ADC_DEADZONE_LUT_BITS)+1];
+    /** @brief Y coordinate (Q16) of the ellipse border, indexed by pseudo-angle */
+    uint32_t dz_y[(1<<HAL_ADC_DEADZONE_LUT_BITS)+1];
+    #endif
+} adcKernel_t;
+
+/** @brief Precompute the fixed point kernel coefficients
+ * 
+ * Converts the float based mouse gains to Q32, the joystick gains
+ * and max speed to Q16 and, if the elliptic deadzone is enabled,
+ * builds the ellipse border lookup table.
+ * 
+ * The elliptic deadzone table is indexed by a pseudo-angle
+ * t = |y| / (|x| + |y|), which needs only one integer division instead
+ * of atan/tan/sqrt. For each t, the intersection of the ray (1-t, t)
+ * and the deadzone ellipse is stored.
+ * 
+ * @note Float is used here, but only once per config update.
+ * @param kernel Kernel struct to be filled
+ * @param sensitivity_x Sensitivity X axis (AT AX)
+ * @param sensitivity_y Sensitivity Y axis (AT AY)
+ * @param max_speed Maximum movement per reference period (AT MS)
+ * @param deadzone_x Deadzone X axis (AT DX)
+ * @param deadzone_y Deadzone Y axis (AT DY)
+ * */
+void halAdcKernelBuild(adcKernel_t *kernel, uint32_t sensitivity_x,
+    uint32_t sensitivity_y, uint32_t max_speed, uint32_t deadzone_x,
+    uint32_t deadzone_y);
+
+#if HAL_IO_ADC_ELLIPTIC_DEADZONE != 0
+/** @brief Apply the elliptic deadzone to one X/Y sample
+ * 
+ * If the point is inside the ellipse (a = deadzone X, b = deadzone Y),
+ * x & y are set to 0. Otherwise the ellipse border on the ray to (x/y)
+ * is subtracted, without crossing zero.
+ * 
+ * @param kernel Precomputed kernel
+ * @param x Input value X axis (offset already subtracted)
+ * @param y Input value Y axis (offset already subtracted)
+ * @param outx Output value X axis
+ * @param outy Output value Y axis
+ * */
+void halAdcKernelDeadzone(const adcKernel_t *kernel, int32_t x, int32_t y,
+    int32_t *outx, int32_t *outy);
+#endif
+
+/** @brief Calculate the mouse movement of one axis for one sample
+ * 
+ * Movement is: value * accelTime * gain, scaled to the sample period
+ * and limited to +/- maxSpeed.
+ * 
+ * @param value Sensor value after deadzone
+ * @param accelTime Acceleration time of this axis in Q8
+ * @param gain Gain of this axis (adcKernel_t gain_x or gain_y) in Q32
+ * @param period Current sample period [us]
+ * @param maxSpeed Maximum movement for this period in Q16
+ * @return Movement in Q16
+ * @see halAdcKernelMaxSpeed
+ * */
+int32_t halAdcKernelMove(int32_t value, uint32_t accelTime, uint32_t gain,
+    uint32_t period, int32_t maxSpeed);
+
+/** @brief Scale the max speed of the kernel to the sample period
+ * 
+ * @param kernel Precomputed kernel
+ * @param period Current sample period [us]
+ * @return Maximum movement for this period in Q16
+ * */
+int32_t halAdcKernelMaxSpeed(const adcKernel_t *kernel, uint32_t period);
+
+#endif
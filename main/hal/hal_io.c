@@ -145,8 +145,9 @@ static void gpio_isr_handler(void* arg)
     default: return;
   }
   
-  //set VB number to event.
+  //set VB number & origin timestamp (latency measurement) to event.
   evt.vb = vb;
+  evt.timestamp = latencyNow();
   if(debouncer_in == NULL) return;
 
   //press or release?
@@ -155,7 +156,7 @@ static void gpio_isr_handler(void* arg)
     //set an press event
     evt.type = VB_PRESS_EVENT;
     //send event
-    xQueueSendToBackFromISR(debouncer_in,&evt,&xHigherPriorityTaskWoken);
+    eventQueueSendFromISR(EVENT_QUEUE_DEBOUNCER,EVENT_SRC_GPIO,&evt,&xHigherPriorityTaskWoken);
     //extra handling for long press
     if(pin == HAL_IO_PIN_LONGACTION)
     {
@@ -170,7 +171,7 @@ static void gpio_isr_handler(void* arg)
     //set an press event
     evt.type = VB_RELEASE_EVENT;
     //send event
-    xQueueSendToBackFromISR(debouncer_in,&evt,&xHigherPriorityTaskWoken);
+    eventQueueSendFromISR(EVENT_QUEUE_DEBOUNCER,EVENT_SRC_GPIO,&evt,&xHigherPriorityTaskWoken);
     //extra handling for long press
     if(pin == HAL_IO_PIN_LONGACTION)
     {
@@ -58,6 +58,7 @@
 #include "led_strip/led_strip.h"
 //common definitions & data for all of these functional tasks
 #include "common.h"
+#include "latency.h"
 #include "../config_switcher.h"
 
 /** @brief Macro to easily create a tone
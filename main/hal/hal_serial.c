@@ -74,6 +74,22 @@
  * @see halSerialReceiveI2CADC */
 #define HAL_SERIAL_I2C_TIMEOUT_MS 100
 
+/** @brief Count of consecutive I2C errors in fast mode, before falling back to standard mode
+ * @see HAL_SERIAL_I2C_CLK_FAST
+ * @see HAL_SERIAL_I2C_CLK_STD */
+#define HAL_SERIAL_I2C_FALLBACK_ERRORS 5
+
+/** @brief Currently used I2C clock speed [Hz]
+ * 
+ * Starts with HAL_SERIAL_I2C_CLK_FAST, is set to HAL_SERIAL_I2C_CLK_STD
+ * if the bus is not working reliably in fast mode.
+ * @see halSerialInitI2C */
+static uint32_t i2cClkSpeed = HAL_SERIAL_I2C_CLK_FAST;
+
+/** @brief Count of consecutive I2C errors
+ * @see HAL_SERIAL_I2C_FALLBACK_ERRORS */
+static uint8_t i2cErrors = 0;
+
 static const int BUF_SIZE_RX = 512;
 
 /** @brief Output callback
@@ -210,6 +226,8 @@ void halSerialRXTask(void *pvParameters)
 /** @brief Initialize I2C for reading ADC values from LPC
  * 
  * This function initializes the I2C, according to the pin settings.
+ * The bus is clocked in fast mode (HAL_SERIAL_I2C_CLK_FAST), on repeated
+ * errors it falls back to standard mode (HAL_SERIAL_I2C_CLK_STD).
  * 
  * @see HAL_IO_PIN_SDA
  * @see HAL_IO_PIN_SCL
@@ -225,6 +243,13 @@ esp_err_t halSerialInitI2C(bool deinit)
   {
     ESP_LOGW(LOG_TAG,"I2C error, re-init");
     i2c_driver_delete(i2c_master_port);
+    
+    //fall back to standard mode if fast mode does not work on this bus
+    if(++i2cErrors >= HAL_SERIAL_I2C_FALLBACK_ERRORS && i2cClkSpeed != HAL_SERIAL_I2C_CLK_STD)
+    {
+      ESP_LOGE(LOG_TAG,"I2C errors in fast mode, using %dHz",HAL_SERIAL_I2C_CLK_STD);
+      i2cClkSpeed = HAL_SERIAL_I2C_CLK_STD;
+    }
   }
 
   //initialize I2C according to esp-idf example.
@@ -234,7 +259,7 @@ esp_err_t halSerialInitI2C(bool deinit)
   conf.sda_pullup_en = GPIO_PULLUP_DISABLE;
   conf.scl_io_num = HAL_IO_PIN_SCL;
   conf.scl_pullup_en = GPIO_PULLUP_DISABLE;
-  conf.master.clk_speed = 100000;
+  conf.master.clk_speed = i2cClkSpeed;
   i2c_param_config(i2c_master_port, &conf);
   if(i2c_driver_install(i2c_master_port, conf.mode,0,0,0) != ESP_OK) 
   {
@@ -244,6 +269,36 @@ esp_err_t halSerialInitI2C(bool deinit)
   return ESP_OK;
 }
 
+/** @brief Send one HID command via I2C to the LPC
+ * @param rx HID command to be sent */
+static void halSerialSendHID(hid_report_t *rx)
+{
+  //output if debug
+  #if LOG_LEVEL_SERIAL >= ESP_LOG_DEBUG
+    ESP_LOGD(LOG_TAG,"HID: %02X:%02X:%02X",rx->cmd[0],rx->cmd[1],rx->cmd[2]);
+  #endif
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (HAL_SERIAL_I2C_ADDR_LPC << 1) | WRITE_BIT, ACK_CHECK_EN);
+  i2c_master_write(cmd, rx->cmd, 3, ACK_CHECK_EN);
+  i2c_master_stop(cmd);
+  esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
+  i2c_cmd_link_delete(cmd);
+  //we don't care about return code.
+  //I2C driver sometimes return TIMEOUT...
+  (void) ret;
+  
+  if(ret != ESP_OK)
+  {
+    ESP_LOGW(LOG_TAG,"I2C didn't succeed: 0x%X",ret);
+    halSerialInitI2C(true);
+  } else {
+    #if LOG_LEVEL_SERIAL >= ESP_LOG_DEBUG
+    ESP_LOGD(LOG_TAG,"I2C succeed");
+    #endif
+  }
+}
+
 /** @brief CONTINOUS TASK - Process HID commands & send via HID wire to LPC
  * 
  * This task is used to receive a byte buffer, which contains a HID command
@@ -278,39 +333,26 @@ esp_err_t halSerialInitI2C(bool deinit)
  * */
 void halSerialHIDTask(void *param)
 {
-  hid_cmd_t rx;
+  hid_report_t rx;
   while(1)
   {
     //check if queue is initialized
     if(hid_usb != NULL)
     {
       //pend on MQ, if timeout triggers, just wait again.
-      if(xQueueReceive(hid_usb,&rx,portMAX_DELAY))
+      if(eventQueueReceive(EVENT_QUEUE_HID_USB,&rx,portMAX_DELAY))
       {
-        //output if debug
-        #if LOG_LEVEL_SERIAL >= ESP_LOG_DEBUG
-          ESP_LOGD(LOG_TAG,"HID: %02X:%02X:%02X",rx.cmd[0],rx.cmd[1],rx.cmd[2]);
-        #endif
-        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, (HAL_SERIAL_I2C_ADDR_LPC << 1) | WRITE_BIT, ACK_CHECK_EN);
-        i2c_master_write(cmd, rx.cmd, 3, ACK_CHECK_EN);
-        i2c_master_stop(cmd);
-        esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
-        i2c_cmd_link_delete(cmd);
-        //we don't care about return code.
-        //I2C driver sometimes return TIMEOUT...
-        (void) ret;
-        
-        if(ret != ESP_OK)
+        //coalesced mouse movement: send all pending movement
+        //(merged until now) in full X/Y reports
+        if(rx.cmd[0] == HID_COALESCE_CMD)
         {
-          ESP_LOGW(LOG_TAG,"I2C didn't succeed: 0x%X",ret);
-          halSerialInitI2C(true);
-        } else {
-          #if LOG_LEVEL_SERIAL >= ESP_LOG_DEBUG
-          ESP_LOGD(LOG_TAG,"I2C succeed");
-          #endif
-        }
+          while(hidCoalesceFetch(HID_COALESCE_USB,&rx)) halSerialSendHID(&rx);
+        } else halSerialSendHID(&rx);
+        #if HID_REPORT_LATENCY
+        //latency: queue & transmit, complete path from the origin
+        latencyRecord(LATENCY_STAGE_USB,rx.queued);
+        latencyRecord(LATENCY_STAGE_TOTAL,rx.timestamp);
+        #endif
       }
     } else {
       ESP_LOGW(LOG_TAG,"usb hid queue not initialized, retry in 1s");
@@ -340,10 +382,13 @@ int halSerialReceiveI2CADC(uint8_t **data)
   }
   i2c_master_read_byte(cmd, *data + size - 1, NACK_VAL);
   i2c_master_stop(cmd);
-  esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
+  esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, HAL_SERIAL_I2C_TIMEOUT_MS / portTICK_RATE_MS);
   i2c_cmd_link_delete(cmd);
-  if(ret == ESP_OK) return size;
-  else 
+  if(ret == ESP_OK)
+  {
+    i2cErrors = 0;
+    return size;
+  } else 
   {
     //try to re-initialize for next call.
     halSerialInitI2C(true);
@@ -355,7 +400,8 @@ int halSerialReceiveI2CADC(uint8_t **data)
  * 
  * This method reads full AT commands from the halSerialATCmds queue.
  * 
- * @return -1 on error, number of read bytes otherwise
+ * @return -1 on error, number of read bytes otherwise (0 and data set to
+ * NULL for the end marker of a slot, see HAL_SERIAL_ATCMD_END)
  * @param data Double pointer to save the new allocated buffer to.
  * @warning Free the data pointer after use!
  * @note In timeout, debug information is print. Please uncomment if wanted:
@@ -370,6 +416,12 @@ int halSerialReceiveUSBSerial(uint8_t **data)
   atcmd_t recv;
   if(xQueueReceive(halSerialATCmds,&recv,HAL_SERIAL_UART_TIMEOUT_MS / portTICK_PERIOD_MS))
   {
+    //end marker of a loaded slot, no buffer
+    if(recv.buf == NULL && recv.len == HAL_SERIAL_ATCMD_END)
+    {
+      *data = NULL;
+      return 0;
+    }
     //test for valid buffer
     if(recv.buf == NULL)
     {
@@ -460,36 +512,40 @@ void halSerialReset(uint8_t exceptDevice)
   //send global reset command (don't send 3 different commands)
   if(exceptDevice == 0)
   {
-    hid_cmd_t m;
+    hid_report_t m;
+    memset(&m,0,sizeof(hid_report_t));
     m.cmd[0] = 0x00;
     //send to queue
-    xQueueSend(hid_usb, &m, 0);
+    eventQueueSend(EVENT_QUEUE_HID_USB,EVENT_SRC_SERIAL,&m,0);
     return;
   }
   
   //reset mouse
   if(!(exceptDevice & (1<<2))) 
   {
-    hid_cmd_t m;
+    hid_report_t m;
+    memset(&m,0,sizeof(hid_report_t));
     m.cmd[0] = 0x1F;
     //send to queue
-    xQueueSend(hid_usb, &m, 0);
+    eventQueueSend(EVENT_QUEUE_HID_USB,EVENT_SRC_SERIAL,&m,0);
   }
   //reset keyboard
   if(!(exceptDevice & (1<<0)))
   {
-    hid_cmd_t k;
+    hid_report_t k;
+    memset(&k,0,sizeof(hid_report_t));
     k.cmd[0] = 0x2F;
     //send to queue
-    xQueueSend(hid_usb, &k, 0);
+    eventQueueSend(EVENT_QUEUE_HID_USB,EVENT_SRC_SERIAL,&k,0);
   }
   //reset joystick
   if(!(exceptDevice & (1<<1)))
   {
-    hid_cmd_t j;
+    hid_report_t j;
+    memset(&j,0,sizeof(hid_report_t));
     j.cmd[0] = 0x3F;
     //send to queue
-    xQueueSend(hid_usb, &j, 0);
+    eventQueueSend(EVENT_QUEUE_HID_USB,EVENT_SRC_SERIAL,&j,0);
   }
 }
 
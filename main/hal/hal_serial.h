@@ -57,6 +57,7 @@
 #include "common.h"
 //used for add/remove keycodes from a HID report
 #include "keyboard.h"
+#include "hid_coalesce.h"
 //used to get current locale information
 #include "../config_switcher.h"
 
@@ -84,6 +85,12 @@
 /** @brief I2C Address for LPC chip */
 #define HAL_SERIAL_I2C_ADDR_LPC 0x05
 
+/** @brief I2C clock speed [Hz] for reading ADC data (fast mode, default) */
+#define HAL_SERIAL_I2C_CLK_FAST 400000
+
+/** @brief I2C clock speed [Hz] for reading ADC data (standard mode, fallback) */
+#define HAL_SERIAL_I2C_CLK_STD 100000
+
 /** @brief Queue for parsed AT commands
  * 
  * This queue is read by halSerialReceiveUSBSerial (which receives
@@ -118,10 +125,16 @@ void halSerialAddOutputStream(serialoutput_h cb);
 */
 void halSerialRemoveOutputStream(void);
 
+/** @brief Length of the end marker of a slot in halSerialATCmds (buf is NULL)
+ * @see SYSTEM_SLOT_CMDS_DONE */
+#define HAL_SERIAL_ATCMD_END 0
+
 /** @brief AT command type for halSerialATCmds queue
  * 
  * This type of data is used to pass one AT command (in format
  * of "AT MX 100") to any pending task.
+ * If buf is NULL and len is HAL_SERIAL_ATCMD_END, this is the end
+ * marker of a loaded slot.
  * @see halSerialATCmds
  * */
 typedef struct atcmd {
@@ -177,7 +190,8 @@ void halSerialFlushRX(void);
  * 
  * This method reads full AT commands from the halSerialATCmds queue.
  * 
- * @return -1 on error, number of read bytes otherwise
+ * @return -1 on error, number of read bytes otherwise (0 and data set to
+ * NULL for the end marker of a slot, see HAL_SERIAL_ATCMD_END)
  * @param data Double pointer to save the new allocated buffer to.
  * @warning Free the data pointer after use!
  * @see HAL_SERIAL_UART_TIMEOUT_MS
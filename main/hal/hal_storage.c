@@ -46,7 +46,11 @@
  * 
  * Slots are stored in following naming convention (8.3 rule applies here):
  * general slot config:
- * xxx.set (slot number, e.g., 000.set for slot 1)
+ * xxx.set (file id, e.g., 000.set; the slot order is kept in the index)
+ * precompiled image of a slot config (see slot_image.h):
+ * xxx.bin (created on storing, loaded instead of xxx.set if valid)
+ * name index of all slots & IR commands, loaded on mounting (see storage_index.h):
+ * index.idx (index.tmp while saving)
  * infrared commands
  * xxx_IR.set
  * 
@@ -70,6 +74,17 @@ SemaphoreHandle_t halStorageMutex = NULL;
 static uint32_t storageCurrentTID = 0;
 /** @brief Currently activated slot number */
 static uint8_t storageCurrentSlotNumber = 0;
+/** @brief Source of the last loaded slot: 1 for the binary image, 0 for the AT text
+ * @see halStorageLoadedImage */
+static uint8_t storageLoadedImage = 0;
+/** @brief Set if the name index was changed within the current transaction
+ * @see halStorageIndexSave */
+static uint8_t storageIndexDirty = 0;
+/** @brief Item count of an IR command file which marks an encoded command
+ * (followed by the length & the command encoded by ir_codec.h).
+ * Older files contain the count & the RMT items instead.
+ * @see halStorageStoreIR */
+#define IR_FILE_ENCODED 0xFFFF
 /** @brief File handle currently used by store slot
  * To append AT commands to a slot, multiple calls of
  * halStorageStore are required. Consequently, this module needs to know
@@ -185,6 +200,217 @@ esp_err_t halStorageGetFree(uint32_t *total, uint32_t *free)
 }
 
 
+/** @brief Create the file name of an indexed slot or IR command
+ * @param t Table (slots or IR commands)
+ * @param number Number of the slot/IR command
+ * @param file Buffer for the file name (sizeof(base_path)+32)
+ * */
+static void halStorageIndexFile(storage_index_t t, uint8_t number, char *file)
+{
+  if(t == STORAGE_INDEX_IR) sprintf(file,"%s/IR_%03d.set",base_path,number);
+  else sprintf(file,"%s/%03d.set",base_path,number);
+}
+
+/** @brief Read the name of a slot or IR command from its file
+ * 
+ * Used to build the name index, all other lookups use the index.
+ * @param t Table (slots or IR commands)
+ * @param number Number of the slot/IR command
+ * @param name Buffer for the name, minimum length: SLOTNAME_LENGTH+1
+ * @return ESP_OK on success, ESP_FAIL otherwise (no file, invalid content)
+ * */
+static esp_err_t halStorageReadName(storage_index_t t, uint8_t number, char *name)
+{
+  char file[sizeof(base_path)+32];
+  char buf[SLOTNAME_LENGTH+10];
+  esp_err_t ret = ESP_FAIL;
+  
+  halStorageIndexFile(t,number,file);
+  FILE *f = fopen(file, "rb");
+  if(f == NULL) return ESP_FAIL;
+  
+  if(t == STORAGE_INDEX_IR)
+  {
+    //IR: length of name (uint32_t), name & \0
+    uint32_t namelen = 0;
+    if(fread(&namelen,sizeof(uint32_t),1,f) == 1 && namelen < SLOTNAME_LENGTH && \
+      fread(name,sizeof(char),namelen,f) == namelen)
+    {
+      name[namelen] = '\0';
+      ret = ESP_OK;
+    }
+  } else {
+    //slot: first line "Slot XXX:<name>"
+    if(fgets(buf,SLOTNAME_LENGTH+10,f) != NULL && \
+      strncmp(buf,"Slot",strlen("Slot")) == 0 && strpbrk(buf,":") != NULL)
+    {
+      char *begin = strpbrk(buf,":");
+      strip(begin);
+      strncpy(name,begin+1,SLOTNAME_LENGTH);
+      name[SLOTNAME_LENGTH] = '\0';
+      ret = ESP_OK;
+    } else {
+      ESP_LOGE(LOG_TAG,"Missing \"Slot XXX:\" tag in %s!",file);
+    }
+  }
+  fclose(f);
+  return ret;
+}
+
+/** @brief Get the file id of a slot
+ * 
+ * Slot files are named by a stable file id, the order of the slots
+ * is kept in the index. Deleting or moving a slot does not rename files.
+ * @param slotnumber Number of the slot (position, 0-249)
+ * @return File id, -1 if there is no slot with this number
+ * */
+static int16_t halStorageSlotFile(uint8_t slotnumber)
+{
+  return storageIndexAt(STORAGE_INDEX_SLOT,slotnumber);
+}
+
+/** @brief Rebuild one table of the name index by reading all files
+ * 
+ * IR command files are numbered without gaps, reading stops at the first
+ * missing one. Slot files may have gaps, all file ids are read. The
+ * slot order is lost, slots are sorted by their file id.
+ * @param t Table (slots or IR commands)
+ * */
+static void halStorageIndexRebuild(storage_index_t t)
+{
+  char name[SLOTNAME_LENGTH+1];
+  storageIndexClear(t);
+  for(uint8_t i = 0; i<250; i++)
+  {
+    if(halStorageReadName(t,i,name) != ESP_OK)
+    {
+      if(t == STORAGE_INDEX_IR) break;
+      else continue;
+    }
+    storageIndexSet(t,i,name);
+  }
+  storageIndexDirty = 1;
+  ESP_LOGI(LOG_TAG,"Rebuilt index %d: %d entries",t,storageIndexCount(t));
+}
+
+/** @brief Check one table of the loaded index against the files
+ * 
+ * Detects an index which was not saved after a file operation (e.g.,
+ * power loss): the files of all entries must exist, the file of the
+ * next free id (used by the next new entry) must not.
+ * @note Only called on mounting, each indexed file is checked once.
+ * @param t Table (slots or IR commands)
+ * @return ESP_OK if the index matches, ESP_FAIL otherwise
+ * */
+static esp_err_t halStorageIndexCheck(storage_index_t t)
+{
+  char file[sizeof(base_path)+32];
+  struct stat st;
+  uint8_t count = storageIndexCount(t);
+  int16_t id;
+  
+  for(uint8_t i = 0; i<count; i++)
+  {
+    id = storageIndexAt(t,i);
+    if(id < 0) return ESP_FAIL;
+    halStorageIndexFile(t,id,file);
+    if(stat(file, &st) != 0) return ESP_FAIL;
+  }
+  id = storageIndexFree(t);
+  if(id >= 0)
+  {
+    halStorageIndexFile(t,id,file);
+    if(stat(file, &st) == 0) return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Save the name index, if changed
+ * 
+ * The index is written to a temporary file, which replaces the
+ * index file afterwards. An interrupted save leaves either the old
+ * or the new index (see halStorageIndexLoad).
+ * @return ESP_OK on success (or unchanged), ESP_FAIL otherwise
+ * */
+static esp_err_t halStorageIndexSave(void)
+{
+  char file[sizeof(base_path)+32];
+  char filetmp[sizeof(base_path)+32];
+  uint8_t *buf = NULL;
+  uint32_t len = 0;
+  
+  if(storageIndexDirty == 0) return ESP_OK;
+  if(storageIndexSerialize(&buf,&len) != ESP_OK) return ESP_FAIL;
+  
+  sprintf(file,"%s/index.idx",base_path);
+  sprintf(filetmp,"%s/index.tmp",base_path);
+  FILE *f = fopen(filetmp, "wb");
+  if(f == NULL)
+  {
+    free(buf);
+    ESP_LOGE(LOG_TAG,"cannot open file for writing: %s",filetmp);
+    return ESP_FAIL;
+  }
+  size_t written = fwrite(buf,1,len,f);
+  fclose(f);
+  free(buf);
+  if(written != len)
+  {
+    unlink(filetmp);
+    ESP_LOGE(LOG_TAG,"Error writing index");
+    return ESP_FAIL;
+  }
+  //SPIFFS cannot rename onto an existing file
+  unlink(file);
+  if(rename(filetmp,file) != 0)
+  {
+    ESP_LOGE(LOG_TAG,"Error renaming index");
+    return ESP_FAIL;
+  }
+  storageIndexDirty = 0;
+  return ESP_OK;
+}
+
+/** @brief Load the name index on mounting
+ * 
+ * A complete temporary file is newer than the index file (the save was
+ * interrupted before replacing the index file), so it is preferred.
+ * An incomplete temporary file is rejected by storageIndexDeserialize
+ * (length in the header), the index file is used then.
+ * Each table is checked against the files (halStorageIndexCheck) and
+ * rebuilt if necessary.
+ * */
+static void halStorageIndexLoad(void)
+{
+  char file[sizeof(base_path)+32];
+  const char *names[] = {"index.tmp", "index.idx"};
+  struct stat st;
+  esp_err_t ret = ESP_FAIL;
+  
+  for(uint8_t i = 0; i<2 && ret != ESP_OK; i++)
+  {
+    sprintf(file,"%s/%s",base_path,names[i]);
+    if(stat(file, &st) != 0 || st.st_size <= 0) continue;
+    uint8_t *buf = malloc(st.st_size);
+    if(buf == NULL) break;
+    FILE *f = fopen(file, "rb");
+    if(f != NULL)
+    {
+      if(fread(buf,1,st.st_size,f) == st.st_size) ret = storageIndexDeserialize(buf,st.st_size);
+      fclose(f);
+    }
+    free(buf);
+    //the temporary file is valid, finish the interrupted save
+    if(ret == ESP_OK && i == 0) storageIndexDirty = 1;
+  }
+  
+  for(uint8_t t = 0; t<STORAGE_INDEX_MAX; t++)
+  {
+    if(ret != ESP_OK || halStorageIndexCheck(t) != ESP_OK) halStorageIndexRebuild(t);
+  }
+  halStorageIndexSave();
+}
+
 /** @brief internal function to init the filesystem if handle is invalid 
  * @return ESP_OK on success, ESP_FAIL otherwise*/
 esp_err_t halStorageInit(void)
@@ -209,6 +435,9 @@ esp_err_t halStorageInit(void)
   //return on an error
   if(ret != ESP_OK) { ESP_LOGE(LOG_TAG,"Error mounting SPIFFS"); return ret; }
   
+  //load the slot & IR name index
+  halStorageIndexLoad();
+  
   //initialize nvs
   ret = nvs_flash_init();
   
@@ -327,6 +556,8 @@ void halStorageCreateDefault(uint32_t tid)
   free(buffer);
   fclose(source);
   fclose(target);
+  //names of all slots are changed
+  halStorageIndexRebuild(STORAGE_INDEX_SLOT);
 }
 
 /** @brief Get number of currently loaded slot (0-x)
@@ -356,34 +587,9 @@ uint8_t halStorageGetCurrentSlotNumber(void)
  * */
 esp_err_t halStorageGetNumberOfSlots(uint32_t tid, uint8_t *slotsavailable)
 {
-  uint8_t currentSlot = 0;
-  char file[sizeof(base_path)+32];
-  struct stat st;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
-  
-  do {
-    //create filename string to search if this slot is available
-    sprintf(file,"%s/%03d.set",base_path,currentSlot);
-    
-    //open file for reading
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Opening file %s",file);
-    #endif
-    
-    if (stat(file, &st) == 0) {
-      //check next slot if file exists
-      currentSlot++;
-    } else {
-      //if file doesn't exist, exit:
-      ESP_LOGI(LOG_TAG,"Available slots: %u",currentSlot);
-      *slotsavailable = currentSlot;
-      return ESP_OK;
-    }
-    if(currentSlot == 250) break;
-  } while(1);
-  
-  return ESP_FAIL;
+  *slotsavailable = storageIndexCount(STORAGE_INDEX_SLOT);
+  return ESP_OK;
 }
 
 
@@ -402,52 +608,15 @@ esp_err_t halStorageGetNumberOfSlots(uint32_t tid, uint8_t *slotsavailable)
  * */
 esp_err_t halStorageGetNameForNumberIR(uint32_t tid, uint8_t slotnumber, char *cmdName)
 {
-  uint32_t slotnamelen = 0;
-  char file[sizeof(base_path)+32];
-  FILE *f;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  //check for slot number
-  if(slotnumber >= 250)
+  const char *name = storageIndexName(STORAGE_INDEX_IR,slotnumber);
+  if(name == NULL)
   {
-    ESP_LOGE(LOG_TAG,"IR commands maximum: 250");
+    ESP_LOGW(LOG_TAG,"Invalid IR cmd number %d",slotnumber);
     return ESP_FAIL;
   }
-  
-  //create filename string to search if this slot is available
-  sprintf(file,"%s/IR_%03d.set",base_path,slotnumber);
-  
-  //open file for reading
-  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"Opening file %s",file);
-  #endif
-  f = fopen(file, "rb");
-  
-  if(f == NULL)
-  {
-    ESP_LOGW(LOG_TAG,"Invalid slot number %d, cannot load file",slotnumber);
-    return ESP_FAIL;
-  }
-  
-  fseek(f,0,SEEK_SET);
-
-  //read slot name
-  fread(&slotnamelen,sizeof(uint32_t),1,f);
-  if(slotnamelen > SLOTNAME_LENGTH + 1)
-  {
-    ESP_LOGE(LOG_TAG,"IR name too long: %u",slotnamelen);
-    fclose(f);
-    return ESP_FAIL;
-  }
-  fread(cmdName,sizeof(char),slotnamelen+1,f);
-  cmdName[slotnamelen] = '\0';
-  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"IR name: %s, length %d",cmdName,slotnamelen);
-  #endif
-  
-  //clean up & return
-  if(f!=NULL) fclose(f);
+  strncpy(cmdName,name,SLOTNAME_LENGTH);
   return ESP_OK;
 }
 /** @brief Delete one or all IR commands
@@ -492,6 +661,19 @@ esp_err_t halStorageDeleteIRCmd(int16_t slotnr, uint32_t tid)
   //check for valid storage handle
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
+  //drop the deleted command(s) from the IR cache
+  if(slotnr == -1) irCacheInvalidate(NULL);
+  else if(storageIndexName(STORAGE_INDEX_IR,slotnr) != NULL) \
+    irCacheInvalidate(storageIndexName(STORAGE_INDEX_IR,slotnr));
+  
+  //update & save the index before removing any file, following numbers
+  //are renamed below. An interrupted delete leaves files which are
+  //not indexed (instead of indexed entries without a file).
+  if(slotnr == -1) storageIndexClear(STORAGE_INDEX_IR);
+  else storageIndexRemove(STORAGE_INDEX_IR,slotnr,1);
+  storageIndexDirty = 1;
+  if(halStorageIndexSave() != ESP_OK) ESP_LOGE(LOG_TAG,"Cannot save index before deleting");
+  
   //delete one or all slots
   struct stat st;
   for(uint8_t i = from; i<=to; i++)
@@ -543,32 +725,9 @@ esp_err_t halStorageDeleteIRCmd(int16_t slotnr, uint32_t tid)
  * */
 esp_err_t halStorageGetNumberOfIRCmds(uint32_t tid, uint8_t *slotsavailable)
 {
-  uint8_t count = 0;
-  char file[sizeof(base_path)+32];
-  struct stat st;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
-  
-  do {
-    //create filename string to search if this slot is available
-    sprintf(file,"%s/IR_%03d.set",base_path,count);
-    
-    //open file for reading
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Opening file %s",file);
-    #endif
-    
-    if (stat(file, &st) == 0) {
-      //check next slot if file exists
-      count++;
-    } else {
-      ESP_LOGI(LOG_TAG,"Available IR cmds: %u",count);
-      *slotsavailable = count;
-      return ESP_OK;
-    }
-    if(count == 250) break;
-  } while(1);
-  return ESP_FAIL;
+  *slotsavailable = storageIndexCount(STORAGE_INDEX_IR);
+  return ESP_OK;
 }
 
 /** @brief Get the number of first available slot for an IR command
@@ -584,25 +743,16 @@ esp_err_t halStorageGetNumberOfIRCmds(uint32_t tid, uint8_t *slotsavailable)
  * */
 esp_err_t halStorageGetFreeIRCmdSlot(uint32_t tid, uint8_t *slotavailable)
 {
-  uint8_t current = 0;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  if(halStorageGetNumberOfIRCmds(tid,&current) != ESP_OK)
-  {
-    ESP_LOGE(LOG_TAG,"Cannot get number of active IR cmds");
-    return ESP_FAIL;
-  }
-  
-  if(current == 250)
+  int16_t nr = storageIndexFree(STORAGE_INDEX_IR);
+  if(nr < 0)
   {
     ESP_LOGW(LOG_TAG,"No free IR slot");
     *slotavailable = 250;
     return ESP_FAIL;
-  } else {
-    *slotavailable = current;
   }
-  
+  *slotavailable = nr;
   return ESP_OK;
 }
 
@@ -635,66 +785,16 @@ void strip(char *s) {
  * */
 esp_err_t halStorageGetNameForNumber(uint32_t tid, uint8_t slotnumber, char *slotname)
 {
-  //file name buffer
-  char file[sizeof(base_path)+32];
-  //malloc a buffer for SLOTNAME_LENGTH + strlen("Slot XXX:")
-  char *slotnamebuf = malloc(SLOTNAME_LENGTH+10);
-  FILE *f;
-  
-  if(slotnamebuf == NULL)
-  {
-    ESP_LOGE(LOG_TAG,"Cannot alloc buffer for slotname");
-    return ESP_FAIL;
-  }
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  //create filename string to search if this slot is available
-  sprintf(file,"%s/%03d.set",base_path,slotnumber);
-  
-  //open file for reading
-  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"Opening file %s",file);
-  #endif
-  f = fopen(file, "rb");
-  
-  if(f == NULL)
+  int16_t id = halStorageSlotFile(slotnumber);
+  const char *name = (id < 0) ? NULL : storageIndexName(STORAGE_INDEX_SLOT,id);
+  if(name == NULL)
   {
-    ESP_LOGW(LOG_TAG,"Invalid file");
-    free(slotnamebuf);
+    ESP_LOGW(LOG_TAG,"Invalid slot number %d",slotnumber);
     return ESP_FAIL;
   }
-  
-  fseek(f,0,SEEK_SET);
-
-  //read slot name
-  fgets(slotnamebuf,SLOTNAME_LENGTH+10,f);
-  //check if we have "Slot XXX:"
-  if((strncmp(slotnamebuf,"Slot",strlen("Slot")) == 0) && (strpbrk(slotnamebuf,":") != NULL))
-  {
-    //if yes, strip "Slot..." & save to caller
-    char *begin = strpbrk(slotnamebuf,":");
-    //remove \n \r
-    strip(begin);
-    strncpy(slotname,begin+1,SLOTNAME_LENGTH);
-  } else {
-    //if no, config is invalid
-    ESP_LOGE(LOG_TAG,"Missing \"Slot XXX:\" tag (%s)!",slotnamebuf);
-    
-    
-    
-    free(slotnamebuf);
-    fclose(f);
-    return ESP_FAIL;
-  }
-  
-  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"Read slotname: %s",slotname);
-  #endif
-  
-  //clean up & return
-  if(f!=NULL) fclose(f);
-  free(slotnamebuf);
+  strncpy(slotname,name,SLOTNAME_LENGTH);
   return ESP_OK;
 }
 
@@ -712,36 +812,20 @@ esp_err_t halStorageGetNameForNumber(uint32_t tid, uint8_t slotnumber, char *slo
  * */
 esp_err_t halStorageGetNumberForName(uint32_t tid, uint8_t *slotnumber, char *slotname)
 {
-  uint8_t currentSlot = 0;
-  char fileSlotName[SLOTNAME_LENGTH+4];
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  do {
-    //get name for slot number
-    if(halStorageGetNameForNumber(tid,currentSlot,fileSlotName) != ESP_OK)
-    {
-      *slotnumber = 0;
-      ESP_LOGI(LOG_TAG,"Cannot find slot %s",slotname);
-      return ESP_FAIL;
-    }
-    
-    //compare parameter & file slotname
-    if(strcmp(slotname, fileSlotName) == 0)
-    {
-      //found a slot
-      *slotnumber = currentSlot;
-      #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-      ESP_LOGD(LOG_TAG,"Found slot \"%s\" @%u",slotname,currentSlot);
-      #endif
-      return ESP_OK;
-    }
-    
-    //go to next possible slot & clean up
-    currentSlot++;
-  } while(1);
-
-  //we should never be here...
+  int16_t nr = storageIndexFind(STORAGE_INDEX_SLOT,slotname);
+  if(nr >= 0) nr = storageIndexPosition(STORAGE_INDEX_SLOT,nr);
+  if(nr < 0)
+  {
+    *slotnumber = 0;
+    ESP_LOGI(LOG_TAG,"Cannot find slot %s",slotname);
+    return ESP_FAIL;
+  }
+  *slotnumber = nr;
+  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Found slot \"%s\" @%u",slotname,nr);
+  #endif
   return ESP_OK;
 }
 
@@ -759,37 +843,20 @@ esp_err_t halStorageGetNumberForName(uint32_t tid, uint8_t *slotnumber, char *sl
  * */
 esp_err_t halStorageGetNumberForNameIR(uint32_t tid, uint8_t *slotnumber, char *cmdName)
 {
-  uint8_t currentSlot = 0;
-  char fileSlotName[SLOTNAME_LENGTH+4];
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  do {
-    //get name for slot number
-    if(halStorageGetNameForNumberIR(tid,currentSlot,fileSlotName) != ESP_OK)
-    {
-      *slotnumber = 0;
-      ESP_LOGI(LOG_TAG,"Cannot find IR cmd %s",cmdName);
-      return ESP_FAIL;
-    }
-    
-    //compare parameter & file slotname
-    if(strcmp(cmdName, fileSlotName) == 0)
-    {
-      //found a slot
-      *slotnumber = currentSlot;
-      #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-      ESP_LOGD(LOG_TAG,"Found IR slot \"%s\" @%u",cmdName,currentSlot);
-      #endif
-      return ESP_OK;
-    }
-    
-    //go to next possible slot & clean up
-    currentSlot++;
-  } while(1);
-
-  //we should never be here...
-  return ESP_FAIL;
+  int16_t nr = storageIndexFind(STORAGE_INDEX_IR,cmdName);
+  if(nr < 0)
+  {
+    *slotnumber = 0;
+    ESP_LOGI(LOG_TAG,"Cannot find IR cmd %s",cmdName);
+    return ESP_FAIL;
+  }
+  *slotnumber = nr;
+  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Found IR slot \"%s\" @%u",cmdName,nr);
+  #endif
+  return ESP_OK;
 }
 
 /** @brief Load a slot by an action
@@ -873,6 +940,89 @@ esp_err_t halStorageLoad(hal_storage_load_action navigate, uint32_t tid)
   return ESP_OK;
 }
 
+/** @brief Load & install the binary image of a slot
+ * 
+ * The image file is read at once and installed via slotImageInstall.
+ * @param id File id of the slot
+ * @return ESP_OK if installed, ESP_FAIL if there is no valid image
+ * (the AT text needs to be loaded)
+ * */
+static esp_err_t halStorageLoadImage(uint8_t id)
+{
+  char file[sizeof(base_path)+32];
+  struct stat st;
+  esp_err_t ret = ESP_FAIL;
+  
+  sprintf(file,"%s/%03d.bin",base_path,id);
+  if(stat(file, &st) != 0 || st.st_size <= 0) return ESP_FAIL;
+  
+  uint8_t *image = malloc(st.st_size);
+  if(image == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot malloc %d bytes for slot image",(int)st.st_size);
+    return ESP_FAIL;
+  }
+  FILE *f = fopen(file, "rb");
+  if(f != NULL)
+  {
+    if(fread(image,1,st.st_size,f) == st.st_size) ret = slotImageInstall(image,st.st_size);
+    fclose(f);
+  }
+  free(image);
+  
+  if(ret != ESP_OK) ESP_LOGW(LOG_TAG,"Cannot use image %s, loading AT text",file);
+  return ret;
+}
+
+/** @brief Check the source of the last loaded slot
+ * 
+ * Slots are loaded from the binary image (if valid) or from the AT text.
+ * After loading from the AT text, the caller should rebuild the image
+ * (halStorageStoreImage) as soon as all AT commands are processed.
+ * @return 1 if the last slot was installed from its binary image, 0 otherwise
+ * */
+uint8_t halStorageLoadedImage(void)
+{
+  return storageLoadedImage;
+}
+
+/** @brief Store the binary image of a slot
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot, the AT text (xxx.set) must exist
+ * @param image Image, built by slotImageBuild
+ * @param len Length of the image [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * @see slotImageBuild
+ * */
+esp_err_t halStorageStoreImage(uint32_t tid, uint8_t slotnumber, uint8_t *image, uint32_t len)
+{
+  char file[sizeof(base_path)+32];
+  
+  if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  int16_t id = halStorageSlotFile(slotnumber);
+  if(id < 0 || image == NULL) return ESP_FAIL;
+  
+  sprintf(file,"%s/%03d.bin",base_path,id);
+  FILE *f = fopen(file, "wb");
+  if(f == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"cannot open file for writing: %s",file);
+    return ESP_FAIL;
+  }
+  size_t written = fwrite(image,1,len,f);
+  fclose(f);
+  //never leave a partial image
+  if(written != len)
+  {
+    ESP_LOGE(LOG_TAG,"Error writing image %s",file);
+    unlink(file);
+    return ESP_FAIL;
+  }
+  ESP_LOGI(LOG_TAG,"Stored image %s, %d bytes",file,len);
+  return ESP_OK;
+}
+
 /** @brief Load a slot by a slot number (starting with 0)
  * 
  * This method loads a slot & saves the general config to the given
@@ -894,6 +1044,8 @@ esp_err_t halStorageLoad(hal_storage_load_action navigate, uint32_t tid)
  * @param slotnumber Number of the slot to be loaded
  * @param tid Transaction ID, which must match the one given by halStorageStartTransaction
  * @param outputSerial Either the loaded AT commands are sent to the command parser (== 0) or sent to the serial output
+ * @note If loading for the command parser, the binary image of this slot is installed
+ * directly if it is valid (see halStorageLoadedImage).
  * @note If sending to serial port, the slot name is printed as well ("Slot <number>:<name>).
  * @note If param outputserial is set to 1, the full config is printed. If set to 2, only slotnames are printed (used for "AT LI").
  * In addition, for compatibility reasons, AT LI outputs e.g. "Slot 1:mouse", AT LA outputs "Slot:mouse".
@@ -911,10 +1063,40 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
     ESP_LOGE(LOG_TAG,"Slotnumber too high: %d (0-249)",slotnumber);
     return ESP_FAIL;
   }
+  int16_t id = halStorageSlotFile(slotnumber);
+  if(id < 0)
+  {
+    ESP_LOGE(LOG_TAG,"cannot load requested slot number %u",slotnumber);
+    return ESP_FAIL;
+  }
+  
+  //load the precompiled image, if available
+  if(outputSerial == 0)
+  {
+    storageLoadedImage = 0;
+    if(halStorageLoadImage(id) == ESP_OK)
+    {
+      ESP_LOGI(LOG_TAG,"Loaded slot nr %d from image",slotnumber);
+      storageLoadedImage = 1;
+      storageCurrentSlotNumber = slotnumber;
+      return ESP_OK;
+    }
+  }
+  
+  //slot names are printed from the index ("AT LI")
+  if(outputSerial == 2)
+  {
+    sprintf(slotname,"Slot %d:%s",slotnumber+1,storageIndexName(STORAGE_INDEX_SLOT,id));
+    if(halSerialSendUSBSerial(slotname,strnlen(slotname,SLOTNAME_LENGTH+10),10) == -1)
+    {
+      ESP_LOGE(LOG_TAG,"Buffer overflow on serial");
+    }
+    return ESP_OK;
+  }
   
   //file naming convention for general config: xxx.set
-  //create filename from slotnumber
-  sprintf(file,"%s/%03d.set",base_path,slotnumber);
+  //create filename from file id
+  sprintf(file,"%s/%03d.set",base_path,id);
   
   //open file for reading
   #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
@@ -1110,6 +1292,16 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
     } else ESP_LOGE(LOG_TAG,"Error allocating memory for NVS output!");
   }
 
+  //all commands are queued, signal the end of this slot to task_commands
+  if(outputSerial == 0)
+  {
+    atcmd_t end = {.buf = NULL, .len = HAL_SERIAL_ATCMD_END};
+    if(halSerialATCmds == NULL || xQueueSend(halSerialATCmds,(void*)&end,10) != pdTRUE)
+    {
+      ESP_LOGE(LOG_TAG,"AT cmd queue is full, cannot send end marker");
+    }
+  }
+  
   ESP_LOGI(LOG_TAG,"Loaded slot %s,nr: %d, %u commands",slotname,slotnumber,cmdcount);
   
   //save current slot number, if processed by parser
@@ -1160,6 +1352,9 @@ esp_err_t halStorageLoadName(char *slotname, uint32_t tid)
  * This function is used to delete one slot or all slots (depending on
  * parameter slotnr)
  * 
+ * Only the files of the deleted slot are removed, the following slots
+ * are shifted in the index (no files are renamed).
+ * 
  * @param slotnr Number of slot to be deleted. Use -1 to delete all slots
  * @param tid Transaction id
  * @warning Deleting all slots, means that a complete factory reset is done. Maybe we change this in release versions.
@@ -1168,8 +1363,6 @@ esp_err_t halStorageLoadName(char *slotname, uint32_t tid)
 esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
 {
   char file[sizeof(base_path)+32];
-  char filenew[sizeof(base_path)+32];
-  int ret;
   //delete by starting & ending at given slotnumber 
   uint8_t from;
   uint8_t to;
@@ -1183,7 +1376,9 @@ esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
       ESP_LOGE(LOG_TAG,"Cannot get number of slots, cannot delete all");
       return ESP_FAIL;
     }
-    //if we have 2 slots, we need to delete 000.set & 001.set -> decrement here
+    //nothing to delete
+    if(to == 0) return ESP_OK;
+    //if we have 2 slots, we need to delete slot 0 & 1 -> decrement here
     to--;
   } else if(slotnr <= 250 && slotnr >= 0) {
     from = slotnr;
@@ -1196,43 +1391,80 @@ esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
   //check for valid storage handle
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  //delete one or all slots
+  //collect the file ids of one or all slots
+  uint8_t ids[250];
+  for(uint16_t i = from; i<=to; i++)
+  {
+    int16_t id = halStorageSlotFile(i);
+    if(id < 0)
+    {
+      ESP_LOGW(LOG_TAG,"Slot %d does not exist, cannot delete",i);
+      return ESP_FAIL;
+    }
+    ids[i] = id;
+  }
+  
+  //update the index, following slots are shifted by one
+  if(slotnr == -1)
+  {
+    storageIndexClear(STORAGE_INDEX_SLOT);
+    storageCurrentSlotNumber = 0;
+  } else {
+    storageIndexRemove(STORAGE_INDEX_SLOT,ids[slotnr],0);
+    //keep the number of the active slot (a following slot was shifted)
+    if(storageCurrentSlotNumber > slotnr) storageCurrentSlotNumber--;
+  }
+  storageIndexDirty = 1;
+  //save the index before removing any file: an interrupted delete
+  //leaves files which are not indexed (instead of an indexed slot
+  //without a file in the middle of the order).
+  if(halStorageIndexSave() != ESP_OK) ESP_LOGE(LOG_TAG,"Cannot save index before deleting");
+  
+  //delete the files of one or all slots
   struct stat st;
-  for(uint8_t i = from; i<=to; i++)
+  for(uint16_t i = from; i<=to; i++)
   {
-    sprintf(file,"%s/%03d.set",base_path,i);
+    sprintf(file,"%s/%03d.set",base_path,ids[i]);
     if (stat(file, &st) == 0) {
         // Delete it if it exists
         unlink(file);
     }
-    //not necessary, ESP32 uses preemption
-    //taskYIELD();
+    sprintf(file,"%s/%03d.bin",base_path,ids[i]);
+    if (stat(file, &st) == 0) unlink(file);
   }
   
-  //re-arrange all following slots (of course, only if not deleting all)
-  if(slotnr != -1)
-  {
-    
-    for(uint8_t i = to+1; i<=250; i++)
-    {
-      sprintf(file,"%s/%03d.set",base_path,i);
-      sprintf(filenew,"%s/%03d.set",base_path,i-1);
-      ret = rename(file,filenew);
-      if(ret != 0)
-      {
-        ESP_LOGI(LOG_TAG,"Stopped renaming @ slot %d",i);
-        break;
-      }
-      //not necessary, ESP32 uses preemption
-      //taskYIELD();
-    }
-  }
-  if(slotnr == -1)
+  if(slotnr == -1) ESP_LOGI(LOG_TAG,"Deleted all slots");
+  else ESP_LOGI(LOG_TAG,"Deleted slot %d",slotnr);
+  return ESP_OK;
+}
+
+/** @brief Move a slot to another position
+ * 
+ * All slots between both positions are shifted by one. Only the index
+ * is changed (saved on halStorageFinishTransaction), no files are renamed.
+ * 
+ * @param tid Transaction id
+ * @param from Current number of the slot (0-249)
+ * @param to New number of the slot (0-249)
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid numbers)
+ * */
+esp_err_t halStorageMoveSlot(uint32_t tid, uint8_t from, uint8_t to)
+{
+  if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  
+  //the active slot keeps its file id, but its number changes
+  int16_t current = halStorageSlotFile(storageCurrentSlotNumber);
+  
+  if(storageIndexMove(STORAGE_INDEX_SLOT,from,to) != ESP_OK)
   {
-    ESP_LOGI(LOG_TAG,"Deleted all slots");
-  } else {
-    ESP_LOGI(LOG_TAG,"Deleted slot %d, renamed remaining",slotnr);
+    ESP_LOGE(LOG_TAG,"Cannot move slot %d to %d, %d slots available",from,to, \
+      storageIndexCount(STORAGE_INDEX_SLOT));
+    return ESP_FAIL;
   }
+  storageIndexDirty = 1;
+  
+  if(current >= 0) storageCurrentSlotNumber = storageIndexPosition(STORAGE_INDEX_SLOT,current);
+  ESP_LOGI(LOG_TAG,"Moved slot %d to %d",from,to);
   return ESP_OK;
 }
 
@@ -1272,9 +1504,22 @@ esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
   //open file for writing, only if not already opened
   if(storeHandle == NULL)
   {
+    //an existing slot is overwritten, a new slot gets a free file id
+    //and is appended to the slot order
+    int16_t id = halStorageSlotFile(slotnumber);
+    if(id < 0)
+    {
+      id = storageIndexFree(STORAGE_INDEX_SLOT);
+      if(id < 0)
+      {
+        ESP_LOGE(LOG_TAG,"No free slot available");
+        return ESP_FAIL;
+      }
+      slotnumber = storageIndexCount(STORAGE_INDEX_SLOT);
+    }
     //file naming convention for general config: xxx.set
-    //create filename from slotnumber
-    sprintf(file,"%s/%03d.set",base_path,slotnumber);
+    //create filename from file id
+    sprintf(file,"%s/%03d.set",base_path,id);
     
     #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
     ESP_LOGD(LOG_TAG,"Opening file %s",file);
@@ -1285,12 +1530,17 @@ esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
       ESP_LOGE(LOG_TAG,"cannot open file for writing: %s",file);
       return ESP_FAIL;
     }
+    //the image of the previous content is outdated now
+    sprintf(file,"%s/%03d.bin",base_path,id);
+    unlink(file);
     
     //write slot name if freshly opened file
     char slotname[SLOTNAME_LENGTH+11];
     //we start numbering IN the config file with "1" -> increment given slot number
     sprintf(slotname,"Slot %d:%s",slotnumber+1,cfgstring);
     fputs(slotname,storeHandle);
+    storageIndexSet(STORAGE_INDEX_SLOT,id,cfgstring);
+    storageIndexDirty = 1;
     
     ///@todo not necessary anymore?
     //save current slot number to access the VB configs
@@ -1307,6 +1557,8 @@ esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
  * This method stores a set of IR edges with a given length and a given
  * command name. 
  * If there is already a cmd with this given name, it is overwritten!
+ * The edges are encoded by irCodecEncode (known protocol, RLE or unchanged),
+ * halStorageLoadIR decodes them again.
  * 
  * @param tid Transaction id
  * @param cfg Pointer to a IR config, can be freed after this call
@@ -1344,6 +1596,18 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
   } else {
     ESP_LOGI(LOG_TAG,"Overwriting @%d",cmdnumber);
   }
+  //a cached previous version is outdated
+  irCacheInvalidate(cmdName);
+  
+  //encode the recorded items (known protocol, RLE or unchanged)
+  uint16_t enclen = 0;
+  uint8_t *encoded = malloc(IR_CODEC_MAX_LENGTH(cfg->count));
+  if(encoded == NULL || irCodecEncode(cfg->buffer,cfg->count,encoded,&enclen) != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot encode IR cmd");
+    if(encoded != NULL) free(encoded);
+    return ESP_FAIL;
+  }
   
   //create filename from slotnumber
   sprintf(file,"%s/IR_%03d.set",base_path,cmdnumber);
@@ -1356,6 +1620,7 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
   if(f == NULL)
   {
     ESP_LOGE(LOG_TAG,"cannot open file for writing: %s",file);
+    free(encoded);
     return ESP_FAIL;
   }
   
@@ -1367,26 +1632,32 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
   fwrite(cmdName,sizeof(char),namelen, f);
   fwrite(&nullterm,sizeof(char),1, f);
   
-  //write length of IR commands.
-  fwrite(&cfg->count,sizeof(uint16_t),1, f);
+  //write marker for an encoded command & its length
+  uint16_t marker = IR_FILE_ENCODED;
+  fwrite(&marker,sizeof(uint16_t),1, f);
+  fwrite(&enclen,sizeof(uint16_t),1, f);
   
   //write remaining IR command
-  if(fwrite(cfg->buffer,sizeof(rmt_item32_t),cfg->count,f) != cfg->count)
+  if(fwrite(encoded,sizeof(uint8_t),enclen,f) != enclen)
   {
     //did not write a full config
     ESP_LOGE(LOG_TAG,"Error writing IR cmd");
+    free(encoded);
     fclose(f);
     return ESP_FAIL;
   } else {
-    ESP_LOGI(LOG_TAG,"Stored IR cmd %u (%s) with %u bytes payload (length %d)", \
-      cmdnumber, cmdName, sizeof(rmt_item32_t)*cfg->count, cfg->count);
+    ESP_LOGI(LOG_TAG,"Stored IR cmd %u (%s) as %s, %u bytes payload (recorded: %u)", \
+      cmdnumber, cmdName, irCodecName(encoded[0]), enclen, sizeof(rmt_item32_t)*cfg->count);
     #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,cfg->buffer,sizeof(rmt_item32_t)*cfg->count,ESP_LOG_VERBOSE);
+    ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,encoded,enclen,ESP_LOG_VERBOSE);
     #endif
   }
+  free(encoded);
   
   //clean up
   fclose(f);
+  storageIndexSet(STORAGE_INDEX_IR,cmdnumber,cmdName);
+  storageIndexDirty = 1;
   return ESP_OK;
 }
 
@@ -1409,10 +1680,8 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
  * */
 esp_err_t halStorageLoadIR(char *cmdName, halIOIR_t *cfg, uint32_t tid)
 {
-  uint8_t currentSlot = 0;
   uint32_t slotnamelen = 0;
   char file[sizeof(base_path)+32];
-  char fileSlotName[SLOTNAME_LENGTH+4];
   FILE *f;
   
   //do some checks for file system
@@ -1424,86 +1693,89 @@ esp_err_t halStorageLoadIR(char *cmdName, halIOIR_t *cfg, uint32_t tid)
     return ESP_FAIL;
   }
   
-  do {
-    //create filename string to search if this slot is available
-    sprintf(file,"%s/IR_%03d.set",base_path,currentSlot);
-    
-    //open file for reading
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Opening file %s",file);
-    #endif
-    f = fopen(file, "rb");
-
-    //Currently: return ESP_FAIL for first not found file
-    if(f == NULL)
-    {
-      ESP_LOGI(LOG_TAG,"Stopped at IR cmd number %u, didn't found the given name",currentSlot);
-      return ESP_FAIL;
-    }
-    
-    fseek(f,0,SEEK_SET);
+  //get the number via the index
+  int16_t nr = storageIndexFind(STORAGE_INDEX_IR,cmdName);
+  if(nr < 0)
+  {
+    ESP_LOGI(LOG_TAG,"Didn't find IR cmd %s",cmdName);
+    return ESP_FAIL;
+  }
+  sprintf(file,"%s/IR_%03d.set",base_path,nr);
   
-    //read slot name
-    fread(&slotnamelen,sizeof(uint32_t),1,f);
-    if(slotnamelen > SLOTNAME_LENGTH + 1)
+  //open file for reading
+  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Opening file %s",file);
+  #endif
+  f = fopen(file, "rb");
+  if(f == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot open IR cmd %s (%s)",cmdName,file);
+    return ESP_FAIL;
+  }
+  
+  //skip the name
+  fread(&slotnamelen,sizeof(uint32_t),1,f);
+  if(slotnamelen > SLOTNAME_LENGTH + 1)
+  {
+    ESP_LOGE(LOG_TAG,"CMD name too long: %u",slotnamelen);
+    fclose(f);
+    return ESP_FAIL;
+  }
+  fseek(f,slotnamelen+1,SEEK_CUR);
+  ESP_LOGI(LOG_TAG,"Found IR slot \"%s\" @%u",cmdName,nr);
+  
+  //read length of recorded items
+  uint16_t irlength = 0;
+  fread(&irlength,sizeof(uint16_t),1,f);
+  
+  //encoded command (see ir_codec.h), decoded to a new buffer
+  if(irlength == IR_FILE_ENCODED)
+  {
+    uint16_t enclen = 0;
+    fread(&enclen,sizeof(uint16_t),1,f);
+    uint8_t *encoded = malloc(enclen);
+    if(encoded == NULL || fread(encoded,sizeof(uint8_t),enclen,f) != enclen || \
+      irCodecDecode(encoded,enclen,&cfg->buffer,&cfg->count) != ESP_OK)
     {
-      ESP_LOGE(LOG_TAG,"CMD name too long: %u",slotnamelen);
+      ESP_LOGE(LOG_TAG,"Cannot read/decode IR cmd %s",cmdName);
+      if(encoded != NULL) free(encoded);
       fclose(f);
       return ESP_FAIL;
     }
-    fread(fileSlotName,sizeof(char),slotnamelen+1,f);
-    fileSlotName[slotnamelen] = '\0';
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Read cmdname: %s, length %d",fileSlotName,slotnamelen);
-    #endif
-      
-    //compare parameter & file slotname
-    if(strcmp(cmdName, fileSlotName) == 0)
-    {
-      //found a slot
-      ESP_LOGI(LOG_TAG,"Found IR slot \"%s\" @%u",cmdName,currentSlot);
-      //read length of recorded items
-      uint16_t irlength = 0;
-      fread(&irlength,sizeof(uint16_t),1,f);
-      
-      //allocate amount of IR edges.
-      cfg->buffer = malloc(sizeof(rmt_item32_t)*irlength);
-      
-      if(cfg->buffer != NULL)
+    ESP_LOGD(LOG_TAG,"Decoded IR cmd (%s, %u bytes) to %u items",irCodecName(encoded[0]),enclen,cfg->count);
+    free(encoded);
+    fclose(f);
+    return ESP_OK;
+  }
+  
+  //allocate amount of IR edges.
+  cfg->buffer = malloc(sizeof(rmt_item32_t)*irlength);
+  
+  if(cfg->buffer != NULL)
+  {
+      //read from file to buffer
+      if(fread(cfg->buffer,sizeof(rmt_item32_t),irlength,f) != irlength)
       {
-          //read from file to buffer
-          if(fread(cfg->buffer,sizeof(rmt_item32_t),irlength,f) != irlength)
-          {
-            //maybe EOF, didn't read as many bytes as requested
-            ESP_LOGE(LOG_TAG,"Cannot read data from file");
-            fclose(f);
-            free(cfg->buffer);
-            return ESP_FAIL;
-          }
-          //save length to struct as well
-          cfg->count = irlength;
-          
-          //debug output
-          ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,cfg->buffer,sizeof(rmt_item32_t)*cfg->count,ESP_LOG_VERBOSE);
-      } else {
-        //didn't get a buffer pointer
-        ESP_LOGE(LOG_TAG,"No memory for IR command");
+        //maybe EOF, didn't read as many bytes as requested
+        ESP_LOGE(LOG_TAG,"Cannot read data from file");
         fclose(f);
+        free(cfg->buffer);
         return ESP_FAIL;
       }
+      //save length to struct as well
+      cfg->count = irlength;
       
-      //clean up / return
-      fclose(f);
-      return ESP_OK;
-    }
-    
-    //go to next possible slot & clean up
-    currentSlot++;
+      //debug output
+      ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,cfg->buffer,sizeof(rmt_item32_t)*cfg->count,ESP_LOG_VERBOSE);
+  } else {
+    //didn't get a buffer pointer
+    ESP_LOGE(LOG_TAG,"No memory for IR command");
     fclose(f);
-  } while(1);
-
-  //we should never be here...
-  if(f!=NULL) fclose(f);
+    return ESP_FAIL;
+  }
+  
+  //clean up / return
+  fclose(f);
   return ESP_OK;
 }
 
@@ -1602,6 +1874,9 @@ esp_err_t halStorageFinishTransaction(uint32_t tid)
     storeHandle = NULL;
   }
   
+  //save the name index once for all changes of this transaction
+  if(halStorageIndexSave() != ESP_OK) ESP_LOGE(LOG_TAG,"Cannot save index");
+  
   //reset caller & id
   storageCurrentTID = 0;
   strncpy(storageCurrentTIDHolder,"",2);
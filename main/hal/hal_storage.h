@@ -59,6 +59,13 @@
  * xxx.fms (slot number, e.g., 001.fms for slot 1)
  * virtual button config for slot xxx
  * xxx_VB.fms
+ * precompiled image of a slot config (see slot_image.h):
+ * xxx.bin
+ * name index & order of all slots & IR commands (see storage_index.h):
+ * index.idx (index.tmp while saving)
+ * 
+ * The number in a slot file name is a stable file id, the index maps
+ * the slot numbers to these ids. Deleting & moving slots does not rename files.
  * 
  * @note Maximum number of slots: 250! (e.g. 250.fms)
  * @note Maximum number of IR commands: 100 (0-100, e.g. IR_99.fms)
@@ -87,6 +94,10 @@
 #include "../config_switcher.h"
 #include "task_debouncer.h"
 #include "hal_adc.h"
+#include "slot_image.h"
+#include "storage_index.h"
+#include "ir_cache.h"
+#include "ir_codec.h"
 
 
 //for IR stuff
@@ -260,11 +271,22 @@ esp_err_t halStorageLoad(hal_storage_load_action navigate, uint32_t tid);
  * @param slotnumber Number of the slot to be loaded
  * @param tid Transaction ID, which must match the one given by halStorageStartTransaction
  * @param outputSerial Either the loaded AT commands are sent to the command parser (== 0) or sent to the serial output
+ * @note If loading for the command parser, the binary image of this slot is installed
+ * directly if it is valid (see halStorageLoadedImage).
  * @note If sending to serial port, the slot name is printed as well ("Slot <number>:<name>).
  * @return ESP_OK if everything is fine, ESP_FAIL if the command was not successful (slot number not found)
  * */
 esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputSerial);
 
+/** @brief Check the source of the last loaded slot
+ * 
+ * Slots are loaded from the binary image (if valid) or from the AT text.
+ * After loading from the AT text, the caller should rebuild the image
+ * (halStorageStoreImage) as soon as all AT commands are processed.
+ * @return 1 if the last slot was installed from its binary image, 0 otherwise
+ * */
+uint8_t halStorageLoadedImage(void);
+
 
 /** @brief Load a slot by a slot name
  * 
@@ -342,6 +364,8 @@ esp_err_t halStorageGetNameForNumberIR(uint32_t tid, uint8_t slotnumber, char *c
  * This method stores a set of IR edges with a given length and a given
  * command name. 
  * If there is already a cmd with this given name, it is overwritten!
+ * The edges are encoded by irCodecEncode (known protocol, RLE or unchanged),
+ * halStorageLoadIR decodes them again.
  * 
  * @param tid Transaction id
  * @param cfg Pointer to a IR config, can be freed after this call
@@ -448,6 +472,17 @@ esp_err_t halStorageFinishTransaction(uint32_t tid);
  * */
 esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber);
 
+/** @brief Store the binary image of a slot
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot, the AT text (xxx.set) must exist
+ * @param image Image, built by slotImageBuild
+ * @param len Length of the image [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * @see slotImageBuild
+ * */
+esp_err_t halStorageStoreImage(uint32_t tid, uint8_t slotnumber, uint8_t *image, uint32_t len);
+
 /** @brief Store a virtual button config struct
  * 
  * This method stores the config structs for virtual buttons.
@@ -485,10 +520,25 @@ void halStorageCreateDefault(uint32_t tid);
  * This function is used to delete one slot or all slots (depending on
  * parameter slotnumber)
  * 
+ * Only the files of the deleted slot are removed, the following slots
+ * are shifted in the index (no files are renamed).
+ * 
  * @param slotnr Number of slot to be deleted. Use -1 to delete all slots
  * @param tid Transaction id
  * @return ESP_OK if everything is fine, ESP_FAIL otherwise
  * */
 esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid);
 
+/** @brief Move a slot to another position
+ * 
+ * All slots between both positions are shifted by one. Only the index
+ * is changed (saved on halStorageFinishTransaction), no files are renamed.
+ * 
+ * @param tid Transaction id
+ * @param from Current number of the slot (0-249)
+ * @param to New number of the slot (0-249)
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid numbers)
+ * */
+esp_err_t halStorageMoveSlot(uint32_t tid, uint8_t from, uint8_t to);
+
 #endif /*_HAL_STORAGE_H*/
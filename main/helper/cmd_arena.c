@@ -0,0 +1,105 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Arena storage for command chains
+ *
+ * @see cmd_arena.h
+ * */
+#include "cmd_arena.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "cmd_arena"
+
+/** @brief Allocate memory in the arena
+ * @param a Arena
+ * @param len Length [bytes]
+ * @return Pointer to the memory (aligned to CMD_ARENA_ALIGN), NULL if out of memory
+ * */
+void *cmdArenaAlloc(cmd_arena_t *a, uint32_t len)
+{
+  if(a == NULL || len == 0) return NULL;
+  len = CMD_ARENA_ALIGNED(len);
+
+  cmd_arena_block_t *b = a->blocks;
+  //no block or not enough space left: allocate a new one
+  if(b == NULL || (b->size - b->used) < len)
+  {
+    uint32_t size = (len > CMD_ARENA_BLOCK_SIZE) ? len : CMD_ARENA_BLOCK_SIZE;
+    b = malloc(sizeof(cmd_arena_block_t) + size);
+    if(b == NULL)
+    {
+      ESP_LOGE(LOG_TAG,"No memory for new block (%d bytes)",size);
+      return NULL;
+    }
+    b->used = 0;
+    b->size = size;
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+
+  void *ret = &b->data[b->used];
+  b->used += len;
+  a->used += len;
+  return ret;
+}
+
+/** @brief Copy a string into the arena
+ * @param a Arena
+ * @param str String to copy, might be NULL
+ * @return Copy of the string, NULL if str is NULL or out of memory
+ * */
+char *cmdArenaStrdup(cmd_arena_t *a, const char *str)
+{
+  if(str == NULL) return NULL;
+  uint32_t len = strlen(str) + 1;
+  char *ret = cmdArenaAlloc(a,len);
+  if(ret != NULL) memcpy(ret,str,len);
+  return ret;
+}
+
+/** @brief Mark an allocation as dead
+ *
+ * The memory is not reused, only counted for deciding about compaction.
+ * @param a Arena
+ * @param len Length of the allocation [bytes], as given to cmdArenaAlloc
+ * */
+void cmdArenaRelease(cmd_arena_t *a, uint32_t len)
+{
+  if(a == NULL || len == 0) return;
+  a->dead += CMD_ARENA_ALIGNED(len);
+}
+
+/** @brief Free all blocks of an arena
+ * @param a Arena, empty afterwards
+ * */
+void cmdArenaReset(cmd_arena_t *a)
+{
+  if(a == NULL) return;
+  cmd_arena_block_t *b = a->blocks;
+  while(b != NULL)
+  {
+    cmd_arena_block_t *next = b->next;
+    free(b);
+    b = next;
+  }
+  a->blocks = NULL;
+  a->used = 0;
+  a->dead = 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Arena storage for command chains
+ *
+ * Command chain elements and their AT strings are not allocated one by
+ * one. They are placed into a per-slot arena (a list of larger blocks),
+ * which is freed at once if the slot is cleared (cmdArenaReset).
+ *
+ * Single elements cannot be freed. Memory of removed elements is
+ * only counted as dead (cmdArenaRelease), the owner of the arena can
+ * compact it by copying the live elements into a new arena.
+ *
+ * @note The arena is not locked, all calls have to be done with the
+ * owner's mutex held.
+ * @see cmdArenaAlloc
+ * @see cmdArenaReset
+ * */
+#ifndef _CMD_ARENA_H_
+#define _CMD_ARENA_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+
+/** @brief Default size of one arena block [bytes]
+ * @note Larger allocations get their own block */
+#define CMD_ARENA_BLOCK_SIZE 1024
+
+/** @brief Alignment of each allocation [bytes]
+ * @note Pointer size (4 on the ESP32), elements contain pointers */
+#define CMD_ARENA_ALIGN sizeof(void *)
+
+/** @brief Round a length up to the arena alignment */
+#define CMD_ARENA_ALIGNED(len) (((len) + CMD_ARENA_ALIGN - 1) & ~(CMD_ARENA_ALIGN - 1))
+
+/** @brief One block of an arena */
+typedef struct cmd_arena_block {
+  /** @brief Next block, NULL for the last one */
+  struct cmd_arena_block *next;
+  /** @brief Used bytes of data */
+  uint32_t used;
+  /** @brief Size of data [bytes] */
+  uint32_t size;
+  /** @brief Storage of this block */
+  uint8_t data[];
+} cmd_arena_block_t;
+
+/** @brief One arena */
+typedef struct cmd_arena {
+  /** @brief List of blocks, the first one is used for new allocations */
+  cmd_arena_block_t *blocks;
+  /** @brief Allocated bytes (aligned) */
+  uint32_t used;
+  /** @brief Bytes of released (dead) allocations */
+  uint32_t dead;
+} cmd_arena_t;
+
+/** @brief Initializer for cmd_arena_t */
+#define CMD_ARENA_INITIALIZER {NULL, 0, 0}
+
+/** @brief Allocate memory in the arena
+ * @param a Arena
+ * @param len Length [bytes]
+ * @return Pointer to the memory (aligned to CMD_ARENA_ALIGN), NULL if out of memory
+ * */
+void *cmdArenaAlloc(cmd_arena_t *a, uint32_t len);
+
+/** @brief Copy a string into the arena
+ * @param a Arena
+ * @param str String to copy, might be NULL
+ * @return Copy of the string, NULL if str is NULL or out of memory
+ * */
+char *cmdArenaStrdup(cmd_arena_t *a, const char *str);
+
+/** @brief Mark an allocation as dead
+ *
+ * The memory is not reused, only counted for deciding about compaction.
+ * @param a Arena
+ * @param len Length of the allocation [bytes], as given to cmdArenaAlloc
+ * */
+void cmdArenaRelease(cmd_arena_t *a, uint32_t len);
+
+/** @brief Free all blocks of an arena
+ * @param a Arena, empty afterwards
+ * */
+void cmdArenaReset(cmd_arena_t *a);
+
+#endif /* _CMD_ARENA_H_ */
@@ -0,0 +1,108 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Lock-free reading of command chains (RCU style)
+ *
+ * @see cmd_rcu.h
+ * */
+#include "cmd_rcu.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "cmd_rcu"
+
+/** @brief Check if the grace period of a retired object has elapsed
+ *
+ * If the reader was outside of a read section while retiring (even sequence),
+ * it cannot reach the unlinked object. Otherwise, the object is safe as soon
+ * as the reader left this read section (sequence changed).
+ * @param r RCU state of this chain
+ * @param seq Read sequence while retiring
+ * @return 1 if the object can be freed */
+static uint8_t cmdRcuGraceElapsed(cmd_rcu_t *r, uint32_t seq)
+{
+  if((seq & 0x01) == 0) return 1;
+  return (__atomic_load_n(&r->readseq,__ATOMIC_SEQ_CST) != seq) ? 1 : 0;
+}
+
+/** @brief Retire an unlinked element or chain
+ *
+ * The object is freed after its grace period via cmdRcuReclaim.
+ * If no memory is available for tracking, this call waits for the grace
+ * period (max. CMD_RCU_RETIRE_WAIT ticks) & frees the object immediately.
+ * If the grace period does not elapse (e.g., the reader task itself
+ * modifies the chain within a macro), the object is leaked.
+ * @note Writer only (call with the writer mutex held), obj must be unlinked before.
+ * @param r RCU state of this chain
+ * @param obj Element or chain
+ * @param reclaim Function to free obj
+ * */
+void cmdRcuRetire(cmd_rcu_t *r, void *obj, cmd_rcu_reclaim_h reclaim)
+{
+  if(r == NULL || obj == NULL || reclaim == NULL) return;
+  uint32_t seq = __atomic_load_n(&r->readseq,__ATOMIC_SEQ_CST);
+
+  cmd_rcu_retired_t *ret = malloc(sizeof(cmd_rcu_retired_t));
+  if(ret == NULL)
+  {
+    ESP_LOGW(LOG_TAG,"No memory for retiring, waiting for reader");
+    for(uint32_t i = 0; i<CMD_RCU_RETIRE_WAIT; i++)
+    {
+      if(cmdRcuGraceElapsed(r,seq))
+      {
+        reclaim(obj);
+        return;
+      }
+      vTaskDelay(1);
+    }
+    ESP_LOGE(LOG_TAG,"Reader did not leave read section, object leaked");
+    return;
+  }
+  ret->obj = obj;
+  ret->reclaim = reclaim;
+  ret->seq = seq;
+  ret->next = r->retired;
+  r->retired = ret;
+}
+
+/** @brief Free all retired objects whose grace period has elapsed
+ * @note Writer only (call with the writer mutex held)
+ * @param r RCU state of this chain
+ * @return Count of objects, which are still waiting */
+uint32_t cmdRcuReclaim(cmd_rcu_t *r)
+{
+  uint32_t waiting = 0;
+  if(r == NULL) return 0;
+  cmd_rcu_retired_t **pp = &r->retired;
+
+  while(*pp != NULL)
+  {
+    cmd_rcu_retired_t *ret = *pp;
+    if(cmdRcuGraceElapsed(r,ret->seq))
+    {
+      *pp = ret->next;
+      ret->reclaim(ret->obj);
+      free(ret);
+    } else {
+      waiting++;
+      pp = &ret->next;
+    }
+  }
+  return waiting;
+}
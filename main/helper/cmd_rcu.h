@@ -0,0 +1,119 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Lock-free reading of command chains (RCU style)
+ *
+ * The command chain of handler_vb and the dispatch table of handler_hid
+ * are read on each VB event by the handler's task, without taking any mutex:<br>
+ * * The reader marks its read section via cmdRcuReadLock/Unlock.<br>
+ * * Writers (serialized by the handler's mutex) never modify an element
+ * which is visible to the reader: new elements are completely initialized
+ * before they are linked (one atomic pointer store), a new chain is
+ * published by one atomic store of the head pointer.<br>
+ * * Unlinked elements/chains are retired. They are freed after a grace
+ * period (the reader left the read section it was in while unlinking),
+ * on the next call to cmdRcuReclaim (by any writer).
+ *
+ * @note Exactly one reader task per chain is supported (the vb_dispatch
+ * sink task of the handler). Any other access must hold the writer mutex.
+ * @see cmdRcuRetire
+ * @see cmdRcuReclaim
+ * */
+#ifndef _CMD_RCU_H_
+#define _CMD_RCU_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+
+/** @brief Reclaim function, frees one retired element or chain */
+typedef void (*cmd_rcu_reclaim_h)(void *obj);
+
+/** @brief One retired element or chain, waiting for its grace period */
+typedef struct cmd_rcu_retired {
+  /** @brief Retired element or chain */
+  void *obj;
+  /** @brief Function to free obj */
+  cmd_rcu_reclaim_h reclaim;
+  /** @brief Read sequence of the reader while retiring */
+  uint32_t seq;
+  /** @brief Next retired element */
+  struct cmd_rcu_retired *next;
+} cmd_rcu_retired_t;
+
+/** @brief RCU state of one command chain */
+typedef struct cmd_rcu {
+  /** @brief Read sequence, odd while the reader is in a read section */
+  uint32_t readseq;
+  /** @brief List of retired elements (writer only) */
+  cmd_rcu_retired_t *retired;
+} cmd_rcu_t;
+
+/** @brief Maximum time [ticks] to wait for a grace period if no memory
+ * is available to retire an object
+ * @see cmdRcuRetire */
+#define CMD_RCU_RETIRE_WAIT 100
+
+/** @brief Initializer for cmd_rcu_t */
+#define CMD_RCU_INITIALIZER {0, NULL}
+
+/** @brief Load a chain pointer (head or next) in a read section */
+#define CMD_RCU_LOAD(p) __atomic_load_n(&(p),__ATOMIC_ACQUIRE)
+
+/** @brief Publish a chain pointer (head or next), writer only */
+#define CMD_RCU_STORE(p,v) __atomic_store_n(&(p),(v),__ATOMIC_SEQ_CST)
+
+/** @brief Enter a read section, chain elements are valid until cmdRcuReadUnlock
+ * @param r RCU state of this chain */
+static inline void cmdRcuReadLock(cmd_rcu_t *r)
+{
+  __atomic_fetch_add(&r->readseq,1,__ATOMIC_SEQ_CST);
+}
+
+/** @brief Leave a read section
+ * @param r RCU state of this chain */
+static inline void cmdRcuReadUnlock(cmd_rcu_t *r)
+{
+  __atomic_fetch_add(&r->readseq,1,__ATOMIC_SEQ_CST);
+}
+
+/** @brief Retire an unlinked element or chain
+ *
+ * The object is freed after its grace period via cmdRcuReclaim.
+ * If no memory is available for tracking, this call waits for the grace
+ * period (max. CMD_RCU_RETIRE_WAIT ticks) & frees the object immediately.
+ * If the grace period does not elapse (e.g., the reader task itself
+ * modifies the chain within a macro), the object is leaked.
+ * @note Writer only (call with the writer mutex held), obj must be unlinked before.
+ * @param r RCU state of this chain
+ * @param obj Element or chain
+ * @param reclaim Function to free obj
+ * */
+void cmdRcuRetire(cmd_rcu_t *r, void *obj, cmd_rcu_reclaim_h reclaim);
+
+/** @brief Free all retired objects whose grace period has elapsed
+ * @note Writer only (call with the writer mutex held)
+ * @param r RCU state of this chain
+ * @return Count of objects, which are still waiting */
+uint32_t cmdRcuReclaim(cmd_rcu_t *r);
+
+#endif /* _CMD_RCU_H_ */
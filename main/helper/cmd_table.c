@@ -0,0 +1,55 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Index of a command dispatch table
+ *
+ * @see cmd_table.h
+ * */
+#include "cmd_table.h"
+
+/** @brief Reset an index before counting
+ * @param start Index with slots+1 entries
+ * @param slots Count of table indices
+ * */
+void cmdTableInit(uint16_t *start, uint32_t slots)
+{
+  memset(start,0,(slots+1)*sizeof(uint16_t));
+}
+
+/** @brief Sum up all counts to the first element of each table index
+ * @param start Index
+ * @param slots Count of table indices
+ * */
+void cmdTablePrefix(uint16_t *start, uint32_t slots)
+{
+  for(uint32_t i = 1; i<=slots; i++) start[i] += start[i-1];
+}
+
+/** @brief Finish the index after placing all elements
+ * 
+ * Placing moved each start to the next table index, move back.
+ * @param start Index
+ * @param slots Count of table indices
+ * */
+void cmdTableFinish(uint16_t *start, uint32_t slots)
+{
+  for(uint32_t i = slots; i>0; i--) start[i] = start[i-1];
+  start[0] = 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Index of a command dispatch table
+ *
+ * Command handlers compile their command chain into one contiguous array,
+ * sorted by a table index (e.g., VB & press/release). This index stores
+ * the first element of each table index, so dispatching is one lookup
+ * instead of walking the whole chain.
+ *
+ * The index is built by a counting sort, which keeps the order of the
+ * chain for the commands of one table index:<br>
+ * * cmdTableInit, then cmdTableCount for each element<br>
+ * * cmdTablePrefix<br>
+ * * cmdTablePlace for each element (in chain order), returning the
+ * array position of this element<br>
+ * * cmdTableFinish<br>
+ * Afterwards, cmdTableLookup returns the range of one table index.
+ *
+ * @note The index is not locked, the owner publishes it after building.
+ * @see handler_hid_compile
+ * */
+#ifndef _CMD_TABLE_H_
+#define _CMD_TABLE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Reset an index before counting
+ * @param start Index with slots+1 entries
+ * @param slots Count of table indices
+ * */
+void cmdTableInit(uint16_t *start, uint32_t slots);
+
+/** @brief Count one element of a table index
+ * @param start Index
+ * @param idx Table index of this element (< slots)
+ * */
+static inline void cmdTableCount(uint16_t *start, uint32_t idx)
+{
+  start[idx+1]++;
+}
+
+/** @brief Sum up all counts to the first element of each table index
+ * @param start Index
+ * @param slots Count of table indices
+ * */
+void cmdTablePrefix(uint16_t *start, uint32_t slots);
+
+/** @brief Get the array position of the next element of a table index
+ * @note Call in chain order, each element exactly once.
+ * @param start Index
+ * @param idx Table index of this element
+ * @return Array position of this element
+ * */
+static inline uint16_t cmdTablePlace(uint16_t *start, uint32_t idx)
+{
+  return start[idx]++;
+}
+
+/** @brief Finish the index after placing all elements
+ * @param start Index
+ * @param slots Count of table indices
+ * */
+void cmdTableFinish(uint16_t *start, uint32_t slots);
+
+/** @brief Get the elements of one table index
+ * @param start Finished index
+ * @param idx Table index
+ * @param first Array position of the first element
+ * @return Count of elements, which are stored contiguous from first on
+ * */
+static inline uint32_t cmdTableLookup(const uint16_t *start, uint32_t idx, uint32_t *first)
+{
+  *first = start[idx];
+  return start[idx+1] - start[idx];
+}
+
+#endif /* _CMD_TABLE_H_ */
@@ -0,0 +1,237 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Debouncing state machine for VBs
+ *
+ * @see debounce_core.h
+ * */
+#include "debounce_core.h"
+
+/** @brief Get a configured debounce time
+ * @param d Debouncer
+ * @param vb VB number
+ * @param which Type of the requested time
+ * @return Configured time [ms], 0 if not set */
+static inline uint16_t debounceTime(debounce_core_t *d, uint32_t vb, debounce_time_t which)
+{
+  if(d->time == NULL) return 0;
+  return d->time(d->ctx,vb,which);
+}
+
+/** @brief Send an event to the sink
+ * @param d Debouncer
+ * @param vb VB number
+ * @param press 1 for press, 0 for release
+ * @param origin Origin timestamp
+ * @param start Receive timestamp
+ * @param debounced 1 if sent after an expired debounce time */
+static inline void debounceSend(debounce_core_t *d, uint32_t vb, uint8_t press, \
+  uint32_t origin, uint32_t start, uint8_t debounced)
+{
+  if(d->sink != NULL) d->sink(d->ctx,vb,press,origin,start,debounced);
+}
+
+/** @brief Stop the running deadline of one VB
+ * @param d Debouncer
+ * @param s State of this VB
+ * @note If this was the earliest deadline, it is searched again on the next request. */
+static inline void debounceStop(debounce_core_t *d, debounce_vb_t *s)
+{
+  if(s->dir != DEBOUNCE_IDLE && s->deadline == d->next) d->nextValid = 0;
+  s->dir = DEBOUNCE_IDLE;
+}
+
+/** @brief Start a deadline for one VB
+ * @param d Debouncer
+ * @param s State of this VB
+ * @param dir New state
+ * @param deadline Expiry time [us] */
+static inline void debounceStart(debounce_core_t *d, debounce_vb_t *s, \
+  debounce_dir_t dir, int64_t deadline)
+{
+  s->dir = dir;
+  s->deadline = deadline;
+  if(deadline < d->next) d->next = deadline;
+}
+
+/** @brief Initialize a debouncer, all VBs are idle
+ * @param d Debouncer
+ * @param count Count of VBs (max. DEBOUNCE_VB_MAX)
+ * @param deftime Default press/release time [ms]
+ * @param mintime Minimum time [ms], events with a time up to this value are sent directly
+ * @param time Lookup function for debounce times
+ * @param sink Sink for debounced events
+ * @param ctx Context for the lookup & sink functions
+ * */
+void debounceInit(debounce_core_t *d, uint32_t count, uint16_t deftime, uint16_t mintime, \
+  debounce_time_h time, debounce_sink_h sink, void *ctx)
+{
+  if(d == NULL) return;
+  memset(d,0,sizeof(debounce_core_t));
+  d->count = (count > DEBOUNCE_VB_MAX) ? DEBOUNCE_VB_MAX : count;
+  d->deftime = deftime;
+  d->mintime = mintime;
+  d->time = time;
+  d->sink = sink;
+  d->ctx = ctx;
+  d->next = INT64_MAX;
+  d->nextValid = 1;
+}
+
+/** @brief Process one input (raw) event
+ * @param d Debouncer
+ * @param vb VB number
+ * @param press 1 for press, 0 for release
+ * @param now Current time [us]
+ * @param origin Origin timestamp of this event, passed to the sink
+ * @param start Receive timestamp of this event, passed to the sink
+ * @return 0 on success, -1 if vb is out of range
+ * */
+int debounceInput(debounce_core_t *d, uint32_t vb, uint8_t press, int64_t now, \
+  uint32_t origin, uint32_t start)
+{
+  if(d == NULL || vb >= d->count) return -1;
+  debounce_vb_t *s = &d->vb[vb];
+  uint16_t time;
+
+  switch(s->dir)
+  {
+    case DEBOUNCE_IDLE:
+      //use the VB or global value, or the default value
+      time = debounceTime(d,vb,press ? DEBOUNCE_TIME_PRESS : DEBOUNCE_TIME_RELEASE);
+      if(time == 0) time = d->deftime;
+      if(time > d->mintime)
+      {
+        s->origin = origin;
+        s->start = start;
+        debounceStart(d,s,press ? DEBOUNCE_PRESS : DEBOUNCE_RELEASE,now + (int64_t)time * 1000);
+      } else {
+        //no debounce time is used, map directly
+        debounceSend(d,vb,press,origin,start,0);
+      }
+      break;
+    case DEBOUNCE_PRESS:
+      //release while press is debounced: cancel & send the release
+      //anyway, just to be sure to release any actions (avoiding sticky keys)
+      if(press == 0)
+      {
+        debounceStop(d,s);
+        debounceSend(d,vb,0,origin,start,0);
+      }
+      break;
+    case DEBOUNCE_RELEASE:
+      //press while release is debounced: cancel only if an anti-tremor
+      //time is set. Otherwise we might loose release events (sticky keys).
+      time = debounceTime(d,vb,DEBOUNCE_TIME_RELEASE);
+      if(press && time != 0) debounceStop(d,s);
+      break;
+    case DEBOUNCE_DEADTIME:
+    default:
+      break;
+  }
+  return 0;
+}
+
+/** @brief Process all expired deadlines
+ * @param d Debouncer
+ * @param now Current time [us]
+ * */
+void debounceProcess(debounce_core_t *d, int64_t now)
+{
+  if(d == NULL) return;
+  //nothing expired yet, no need to look at each VB
+  if(d->nextValid && d->next > now) return;
+
+  //the earliest deadline is searched again while processing
+  d->next = INT64_MAX;
+  d->nextValid = 1;
+  for(uint32_t i = 0; i<d->count; i++)
+  {
+    debounce_vb_t *s = &d->vb[i];
+    if(s->dir == DEBOUNCE_IDLE) continue;
+    if(s->deadline > now)
+    {
+      if(s->deadline < d->next) d->next = s->deadline;
+      continue;
+    }
+
+    debounce_dir_t dir = s->dir;
+    s->dir = DEBOUNCE_IDLE;
+    //deadtime finished, ready for the next event
+    if(dir == DEBOUNCE_DEADTIME) continue;
+
+    //start deadtime before sending (the sink might feed new events)
+    uint16_t deadtime = debounceTime(d,i,DEBOUNCE_TIME_IDLE);
+    if(deadtime != 0) debounceStart(d,s,DEBOUNCE_DEADTIME,now + (int64_t)deadtime * 1000);
+    debounceSend(d,i,(dir == DEBOUNCE_PRESS) ? 1 : 0,s->origin,s->start,1);
+  }
+}
+
+/** @brief Get the earliest running deadline
+ * @param d Debouncer
+ * @param deadline Earliest deadline [us], only set if a deadline is running
+ * @return 1 if a deadline is running, 0 otherwise
+ * */
+uint8_t debounceNextDeadline(debounce_core_t *d, int64_t *deadline)
+{
+  if(d == NULL || deadline == NULL) return 0;
+  //earliest deadline was cancelled, search again
+  if(d->nextValid == 0)
+  {
+    d->next = INT64_MAX;
+    for(uint32_t i = 0; i<d->count; i++)
+    {
+      if(d->vb[i].dir == DEBOUNCE_IDLE) continue;
+      if(d->vb[i].deadline < d->next) d->next = d->vb[i].deadline;
+    }
+    d->nextValid = 1;
+  }
+  if(d->next == INT64_MAX) return 0;
+  *deadline = d->next;
+  return 1;
+}
+
+/** @brief Cancel a running deadline (nothing is sent)
+ * @param d Debouncer
+ * @param vb VB number, use any number >= count to cancel all deadlines
+ * */
+void debounceCancel(debounce_core_t *d, uint32_t vb)
+{
+  if(d == NULL) return;
+  if(vb >= d->count)
+  {
+    for(uint32_t i = 0; i<d->count; i++) d->vb[i].dir = DEBOUNCE_IDLE;
+    d->next = INT64_MAX;
+    d->nextValid = 1;
+    return;
+  }
+  debounceStop(d,&d->vb[vb]);
+}
+
+/** @brief Get the state of one VB
+ * @param d Debouncer
+ * @param vb VB number
+ * @return Current state, DEBOUNCE_IDLE if vb is out of range
+ * */
+debounce_dir_t debounceGetState(debounce_core_t *d, uint32_t vb)
+{
+  if(d == NULL || vb >= d->count) return DEBOUNCE_IDLE;
+  return d->vb[vb].dir;
+}
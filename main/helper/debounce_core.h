@@ -0,0 +1,178 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Debouncing state machine for VBs
+ *
+ * This module contains the debouncing logic of task_debouncer, without
+ * any FreeRTOS/ESP-IDF dependency: the current time is given with each
+ * call, debounce times are requested via a lookup function and finished
+ * events are sent to a sink function. So the same state machine can be
+ * driven by task_debouncer (esp_timer, debouncer_in queue) or on a host
+ * with a virtual clock & recorded/generated event streams.
+ *
+ * Each VB is in one of these states:<br>
+ * * DEBOUNCE_IDLE: an input event starts the press/release debouncing
+ * (or is sent directly, if the debounce time is not above mintime).<br>
+ * * DEBOUNCE_PRESS: a release cancels the press debouncing & is sent
+ * directly (avoiding sticky keys). On expiry, the press is sent.<br>
+ * * DEBOUNCE_RELEASE: a press cancels the release debouncing, if a release
+ * time is configured (anti-tremor). On expiry, the release is sent.<br>
+ * * DEBOUNCE_DEADTIME: all input events are ignored until expiry.<br>
+ * After a press/release is sent, the deadtime is started (if configured).
+ *
+ * @note Not locked, all calls have to be done by one task.
+ * @see debounceInput
+ * @see debounceProcess
+ * */
+#ifndef _DEBOUNCE_CORE_H_
+#define _DEBOUNCE_CORE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Maximum count of VBs */
+#define DEBOUNCE_VB_MAX 32
+
+/** @brief State of one VB */
+typedef enum debounce_dir {
+  /** @brief No deadline is running */
+  DEBOUNCE_IDLE = 0,
+  /** @brief Deadline is running for a press event */
+  DEBOUNCE_PRESS,
+  /** @brief Deadline is running for a release event */
+  DEBOUNCE_RELEASE,
+  /** @brief Deadline is running for the deadtime between two events (lock-out) */
+  DEBOUNCE_DEADTIME
+} debounce_dir_t;
+
+/** @brief Type of a debounce time, requested via debounce_time_h */
+typedef enum debounce_time {
+  /** @brief Debounce time for press events */
+  DEBOUNCE_TIME_PRESS = 0,
+  /** @brief Debounce time for release events */
+  DEBOUNCE_TIME_RELEASE,
+  /** @brief Deadtime after an event */
+  DEBOUNCE_TIME_IDLE
+} debounce_time_t;
+
+/** @brief Lookup function for debounce times
+ * @param ctx Context, as given to debounceInit
+ * @param vb VB number
+ * @param which Type of the requested time
+ * @return Configured time [ms] (VB or global value), 0 if not set
+ * */
+typedef uint16_t (*debounce_time_h)(void *ctx, uint32_t vb, debounce_time_t which);
+
+/** @brief Sink for debounced events
+ * @param ctx Context, as given to debounceInit
+ * @param vb VB number
+ * @param press 1 for press, 0 for release
+ * @param origin Origin timestamp of the input event
+ * @param start Timestamp of receiving the input event (as given to debounceInput)
+ * @param debounced 1 if sent after an expired debounce time, 0 if sent directly
+ * */
+typedef void (*debounce_sink_h)(void *ctx, uint32_t vb, uint8_t press, \
+  uint32_t origin, uint32_t start, uint8_t debounced);
+
+/** @brief Debouncing state of one VB */
+typedef struct debounce_vb {
+  /** @brief Current state */
+  debounce_dir_t dir;
+  /** @brief Expiry time [us] of the running deadline, valid if dir != DEBOUNCE_IDLE */
+  int64_t deadline;
+  /** @brief Origin timestamp of the input event which started this deadline */
+  uint32_t origin;
+  /** @brief Receive timestamp of the input event which started this deadline */
+  uint32_t start;
+} debounce_vb_t;
+
+/** @brief Debouncer state machine */
+typedef struct debounce_core {
+  /** @brief State of each VB */
+  debounce_vb_t vb[DEBOUNCE_VB_MAX];
+  /** @brief Count of VBs (all inputs must be smaller) */
+  uint32_t count;
+  /** @brief Default press/release time [ms], if none is configured */
+  uint16_t deftime;
+  /** @brief Minimum time [ms], events with a time up to this value are sent directly */
+  uint16_t mintime;
+  /** @brief Lookup function for debounce times */
+  debounce_time_h time;
+  /** @brief Sink for debounced events */
+  debounce_sink_h sink;
+  /** @brief Context for the lookup & sink functions */
+  void *ctx;
+  /** @brief Earliest running deadline [us], INT64_MAX if none is running */
+  int64_t next;
+  /** @brief Set if next is up to date, cleared if the earliest deadline was cancelled */
+  uint8_t nextValid;
+} debounce_core_t;
+
+/** @brief Initialize a debouncer, all VBs are idle
+ * @param d Debouncer
+ * @param count Count of VBs (max. DEBOUNCE_VB_MAX)
+ * @param deftime Default press/release time [ms]
+ * @param mintime Minimum time [ms], events with a time up to this value are sent directly
+ * @param time Lookup function for debounce times
+ * @param sink Sink for debounced events
+ * @param ctx Context for the lookup & sink functions
+ * */
+void debounceInit(debounce_core_t *d, uint32_t count, uint16_t deftime, uint16_t mintime, \
+  debounce_time_h time, debounce_sink_h sink, void *ctx);
+
+/** @brief Process one input (raw) event
+ * @param d Debouncer
+ * @param vb VB number
+ * @param press 1 for press, 0 for release
+ * @param now Current time [us]
+ * @param origin Origin timestamp of this event, passed to the sink
+ * @param start Receive timestamp of this event, passed to the sink
+ * @return 0 on success, -1 if vb is out of range
+ * */
+int debounceInput(debounce_core_t *d, uint32_t vb, uint8_t press, int64_t now, \
+  uint32_t origin, uint32_t start);
+
+/** @brief Process all expired deadlines
+ * @param d Debouncer
+ * @param now Current time [us]
+ * */
+void debounceProcess(debounce_core_t *d, int64_t now);
+
+/** @brief Get the earliest running deadline
+ * @param d Debouncer
+ * @param deadline Earliest deadline [us], only set if a deadline is running
+ * @return 1 if a deadline is running, 0 otherwise
+ * */
+uint8_t debounceNextDeadline(debounce_core_t *d, int64_t *deadline);
+
+/** @brief Cancel a running deadline (nothing is sent)
+ * @param d Debouncer
+ * @param vb VB number, use any number >= count to cancel all deadlines
+ * */
+void debounceCancel(debounce_core_t *d, uint32_t vb);
+
+/** @brief Get the state of one VB
+ * @param d Debouncer
+ * @param vb VB number
+ * @return Current state, DEBOUNCE_IDLE if vb is out of range
+ * */
+debounce_dir_t debounceGetState(debounce_core_t *d, uint32_t vb);
+
+#endif /* _DEBOUNCE_CORE_H_ */
@@ -0,0 +1,368 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Instrumented event queues (debouncer_in, hid_usb, hid_ble)
+ *
+ * @see event_queue.h
+ * */
+#include "event_queue.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "event_queue"
+
+/** @brief One instrumented queue */
+typedef struct eventQueue {
+  /** @brief Queue handle, NULL if not created */
+  QueueHandle_t handle;
+  /** @brief Free elements within the depth limit (one token per element) */
+  SemaphoreHandle_t slots;
+  /** @brief Count of queued events without a token (markers, eventQueueSendToFront) */
+  uint32_t unlimited;
+  /** @brief Count of tokens, which are not returned (depth was decreased) */
+  uint32_t debt;
+  /** @brief Position of the last send (incremented on each try to send)
+   * @see eventQueueIsLast */
+  volatile uint32_t position;
+  /** @brief Statistics (waiting is read on request) */
+  event_queue_stats_t stats;
+  /** @brief Sequence numbers & drops per source */
+  event_queue_src_stats_t src[EVENT_SRC_MAX];
+} eventQueue_t;
+
+/** @brief Names of all queues, indexed by event_queue_t */
+static const char *eventQueueNames[EVENT_QUEUE_MAX] = {"debouncer_in","hid_usb","hid_ble"};
+
+/** @brief Names of all sources, indexed by event_queue_src_t */
+static const char *eventQueueSrcNames[EVENT_SRC_MAX] = {"gpio","adc","marker","hid","serial","commands"};
+
+/** @brief All instrumented queues */
+static eventQueue_t eventQueues[EVENT_QUEUE_MAX];
+
+/** @brief Spinlock for statistics, updated by tasks & ISRs */
+static portMUX_TYPE eventQueueLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Count one event (sent or dropped)
+ * @note Must be called within a critical section (eventQueueLock).
+ * @param q Queue
+ * @param src Producer of this event
+ * @param ret Return value of the FreeRTOS send function
+ * @return Sequence number of this event, 0 if it was dropped
+ * */
+static uint32_t eventQueueCount(eventQueue_t *q, event_queue_src_t src, BaseType_t ret)
+{
+  uint32_t seq = ++q->src[src].seq;
+  //0 is reserved for a dropped event
+  if(seq == 0) seq = ++q->src[src].seq;
+  //markers are only counted per source, they are no input events
+  uint8_t event = (src != EVENT_SRC_MARKER);
+  if(ret != pdTRUE)
+  {
+    if(event) q->stats.dropped++;
+    q->src[src].dropped++;
+    q->src[src].lastdrop = seq;
+    return 0;
+  }
+  if(event) q->stats.sent++;
+  UBaseType_t waiting = uxQueueMessagesWaitingFromISR(q->handle);
+  if(waiting > q->stats.highwater) q->stats.highwater = waiting;
+  return seq;
+}
+
+/** @brief Return the token of one event, which was removed from the queue
+ *
+ * Called for each received or flushed event. The consumer does not know
+ * if the event holds a token (markers don't), only the counts are kept
+ * consistent: a marker might be received after another event, the token
+ * is returned one event later.
+ * @param q Queue
+ * */
+static void eventQueueRelease(eventQueue_t *q)
+{
+  uint8_t give = 1;
+  portENTER_CRITICAL(&eventQueueLock);
+  if(q->unlimited > 0)
+  {
+    q->unlimited--;
+    give = 0;
+  } else if(q->debt > 0) {
+    //depth was decreased, swallow this token
+    q->debt--;
+    give = 0;
+  }
+  portEXIT_CRITICAL(&eventQueueLock);
+  if(give) xSemaphoreGive(q->slots);
+}
+
+/** @brief Create an instrumented queue
+ *
+ * @note Called once in app_main, might be called with suspended scheduler.
+ * @param queue Queue to be created
+ * @param capacity Allocated element count (maximum depth)
+ * @param depth Default depth (1 to capacity)
+ * @param itemsize Size of one element (up to EVENT_QUEUE_ITEM_MAX)
+ * @return Queue handle, NULL on an error
+ * */
+QueueHandle_t eventQueueCreate(event_queue_t queue, UBaseType_t capacity, UBaseType_t depth, UBaseType_t itemsize)
+{
+  if(queue >= EVENT_QUEUE_MAX || itemsize > EVENT_QUEUE_ITEM_MAX) return NULL;
+  eventQueue_t *q = &eventQueues[queue];
+  memset(q,0,sizeof(eventQueue_t));
+  q->stats.name = eventQueueNames[queue];
+  q->stats.capacity = capacity;
+  q->stats.depth = (depth == 0 || depth > capacity) ? capacity : depth;
+  for(uint8_t i = 0; i<EVENT_SRC_MAX; i++) q->src[i].name = eventQueueSrcNames[i];
+  q->handle = xQueueCreate(capacity,itemsize);
+  if(q->handle == NULL) return NULL;
+  q->slots = xSemaphoreCreateCounting(capacity,q->stats.depth);
+  if(q->slots == NULL)
+  {
+    vQueueDelete(q->handle);
+    q->handle = NULL;
+  }
+  return q->handle;
+}
+
+uint32_t eventQueueSend(event_queue_t queue, event_queue_src_t src, const void *item, TickType_t wait)
+{
+  return eventQueueSendTracked(queue,src,item,wait,NULL);
+}
+
+uint32_t eventQueueSendTracked(event_queue_t queue, event_queue_src_t src, const void *item, TickType_t wait, uint32_t *position)
+{
+  if(queue >= EVENT_QUEUE_MAX || src >= EVENT_SRC_MAX || item == NULL) return 0;
+  eventQueue_t *q = &eventQueues[queue];
+  BaseType_t ret = pdFALSE;
+  uint32_t seq, pos;
+  if(q->handle == NULL) return 0;
+
+  //block until a free element within the depth limit is available
+  if(xSemaphoreTake(q->slots,wait) == pdTRUE)
+  {
+    //moved before sending: a concurrent eventQueueIsLast fails as
+    //soon as this event might be in the queue
+    portENTER_CRITICAL(&eventQueueLock);
+    pos = ++q->position;
+    portEXIT_CRITICAL(&eventQueueLock);
+    if(position != NULL) *position = pos;
+    ret = xQueueSendToBack(q->handle,item,0);
+    //capacity is used up by markers, return the token
+    if(ret != pdTRUE) xSemaphoreGive(q->slots);
+  }
+
+  portENTER_CRITICAL(&eventQueueLock);
+  seq = eventQueueCount(q,src,ret);
+  portEXIT_CRITICAL(&eventQueueLock);
+  if(seq == 0) ESP_LOGW(LOG_TAG,"%s: dropped event from %s",q->stats.name,q->src[src].name);
+  return seq;
+}
+
+uint32_t eventQueueSendToFront(event_queue_t queue, event_queue_src_t src, const void *item)
+{
+  if(queue >= EVENT_QUEUE_MAX || src >= EVENT_SRC_MAX || item == NULL) return 0;
+  eventQueue_t *q = &eventQueues[queue];
+  BaseType_t ret = pdFALSE;
+  uint32_t seq;
+  if(q->handle == NULL) return 0;
+
+  //markers may use the full capacity, they are never limited by the depth.
+  //Counted before sending, the consumer might receive it immediately.
+  portENTER_CRITICAL(&eventQueueLock);
+  q->unlimited++;
+  q->position++;
+  portEXIT_CRITICAL(&eventQueueLock);
+  ret = xQueueSendToFront(q->handle,item,0);
+  if(ret != pdTRUE)
+  {
+    portENTER_CRITICAL(&eventQueueLock);
+    q->unlimited--;
+    portEXIT_CRITICAL(&eventQueueLock);
+  }
+
+  portENTER_CRITICAL(&eventQueueLock);
+  seq = eventQueueCount(q,src,ret);
+  portEXIT_CRITICAL(&eventQueueLock);
+  return seq;
+}
+
+uint32_t eventQueueSendFromISR(event_queue_t queue, event_queue_src_t src, const void *item, BaseType_t *woken)
+{
+  if(queue >= EVENT_QUEUE_MAX || src >= EVENT_SRC_MAX || item == NULL) return 0;
+  eventQueue_t *q = &eventQueues[queue];
+  BaseType_t ret = pdFALSE;
+  uint32_t seq;
+  if(q->handle == NULL) return 0;
+
+  if(xSemaphoreTakeFromISR(q->slots,woken) == pdTRUE)
+  {
+    portENTER_CRITICAL_ISR(&eventQueueLock);
+    q->position++;
+    portEXIT_CRITICAL_ISR(&eventQueueLock);
+    ret = xQueueSendToBackFromISR(q->handle,item,woken);
+    if(ret != pdTRUE) xSemaphoreGiveFromISR(q->slots,woken);
+  }
+
+  //no logging in an ISR, drops are visible via AT QS
+  portENTER_CRITICAL_ISR(&eventQueueLock);
+  seq = eventQueueCount(q,src,ret);
+  portEXIT_CRITICAL_ISR(&eventQueueLock);
+  return seq;
+}
+
+/** @brief Check if an event is still the last one sent to a queue
+ *
+ * Each send (successful or not) moves the position, an event is the
+ * last one if no other producer tried to send afterwards.
+ * @param queue Queue
+ * @param position Position of the event (see eventQueueSendTracked)
+ * @return 1 if no other event was sent after this one, 0 otherwise
+ * */
+uint8_t eventQueueIsLast(event_queue_t queue, uint32_t position)
+{
+  if(queue >= EVENT_QUEUE_MAX) return 0;
+  //aligned 32bit read, no lock necessary
+  return (eventQueues[queue].position == position) ? 1 : 0;
+}
+
+/** @brief Receive an event from a queue (consumer)
+ * Same as xQueueReceive, the element is returned to the depth limit.
+ * @param queue Queue
+ * @param item Buffer for the event (size of one element)
+ * @param wait Maximum time to wait [ticks]
+ * @return pdTRUE if an event was received, pdFALSE otherwise
+ * */
+BaseType_t eventQueueReceive(event_queue_t queue, void *item, TickType_t wait)
+{
+  if(queue >= EVENT_QUEUE_MAX || item == NULL) return pdFALSE;
+  eventQueue_t *q = &eventQueues[queue];
+  if(q->handle == NULL) return pdFALSE;
+  if(xQueueReceive(q->handle,item,wait) != pdTRUE) return pdFALSE;
+  eventQueueRelease(q);
+  return pdTRUE;
+}
+
+/** @brief Discard all events of a queue (counted as flushed)
+ * 
+ * The queue is drained (instead of xQueueReset), each event returns
+ * its token to the depth limit.
+ * @param queue Queue */
+void eventQueueReset(event_queue_t queue)
+{
+  uint8_t item[EVENT_QUEUE_ITEM_MAX];
+  uint32_t flushed = 0;
+  if(queue >= EVENT_QUEUE_MAX) return;
+  eventQueue_t *q = &eventQueues[queue];
+  if(q->handle == NULL) return;
+  while(xQueueReceive(q->handle,item,0) == pdTRUE)
+  {
+    eventQueueRelease(q);
+    flushed++;
+  }
+  portENTER_CRITICAL(&eventQueueLock);
+  q->stats.flushed += flushed;
+  portEXIT_CRITICAL(&eventQueueLock);
+}
+
+/** @brief Set the depth limit of a queue
+ * @param queue Queue
+ * @param depth New depth (1 to the capacity of this queue)
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t eventQueueSetDepth(event_queue_t queue, uint32_t depth)
+{
+  uint32_t old;
+  if(queue >= EVENT_QUEUE_MAX) return ESP_FAIL;
+  eventQueue_t *q = &eventQueues[queue];
+  if(q->slots == NULL) return ESP_FAIL;
+  if(depth == 0 || depth > q->stats.capacity) return ESP_FAIL;
+  
+  portENTER_CRITICAL(&eventQueueLock);
+  old = q->stats.depth;
+  q->stats.depth = depth;
+  portEXIT_CRITICAL(&eventQueueLock);
+  
+  if(depth > old)
+  {
+    uint32_t add = depth - old;
+    //cancel tokens which are not returned yet, add the remaining ones
+    portENTER_CRITICAL(&eventQueueLock);
+    while(add > 0 && q->debt > 0) { add--; q->debt--; }
+    portEXIT_CRITICAL(&eventQueueLock);
+    while(add-- > 0) xSemaphoreGive(q->slots);
+  } else {
+    uint32_t remove = old - depth;
+    //remove free tokens now, all others when their event is received
+    while(remove > 0 && xSemaphoreTake(q->slots,0) == pdTRUE) remove--;
+    portENTER_CRITICAL(&eventQueueLock);
+    q->debt += remove;
+    portEXIT_CRITICAL(&eventQueueLock);
+  }
+  ESP_LOGI(LOG_TAG,"%s: depth %d",q->stats.name,depth);
+  return ESP_OK;
+}
+
+/** @brief Get the statistics of one queue
+ * @param queue Queue
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t eventQueueGetStats(event_queue_t queue, event_queue_stats_t *stats)
+{
+  if(queue >= EVENT_QUEUE_MAX || stats == NULL) return ESP_FAIL;
+  eventQueue_t *q = &eventQueues[queue];
+  portENTER_CRITICAL(&eventQueueLock);
+  memcpy(stats,&q->stats,sizeof(event_queue_stats_t));
+  portEXIT_CRITICAL(&eventQueueLock);
+  stats->waiting = (q->handle != NULL) ? uxQueueMessagesWaiting(q->handle) : 0;
+  return ESP_OK;
+}
+
+/** @brief Get the statistics of one source on one queue
+ * @param queue Queue
+ * @param src Source
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t eventQueueGetSourceStats(event_queue_t queue, event_queue_src_t src, event_queue_src_stats_t *stats)
+{
+  if(queue >= EVENT_QUEUE_MAX || src >= EVENT_SRC_MAX || stats == NULL) return ESP_FAIL;
+  portENTER_CRITICAL(&eventQueueLock);
+  memcpy(stats,&eventQueues[queue].src[src],sizeof(event_queue_src_stats_t));
+  portEXIT_CRITICAL(&eventQueueLock);
+  return ESP_OK;
+}
+
+/** @brief Clear all counters & high-water marks (sequence numbers are kept) */
+void eventQueueResetStats(void)
+{
+  portENTER_CRITICAL(&eventQueueLock);
+  for(uint8_t i = 0; i<EVENT_QUEUE_MAX; i++)
+  {
+    eventQueues[i].stats.sent = 0;
+    eventQueues[i].stats.dropped = 0;
+    eventQueues[i].stats.flushed = 0;
+    eventQueues[i].stats.highwater = 0;
+    for(uint8_t j = 0; j<EVENT_SRC_MAX; j++)
+    {
+      eventQueues[i].src[j].dropped = 0;
+      eventQueues[i].src[j].lastdrop = 0;
+    }
+  }
+  portEXIT_CRITICAL(&eventQueueLock);
+}
@@ -0,0 +1,231 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Instrumented event queues (debouncer_in, hid_usb, hid_ble)
+ *
+ * Input events pass up to three queues until a report is sent. Most
+ * producers send with a timeout of 0-2 ticks, a full queue must not
+ * block an ISR or the ADC task. To see where an event was lost, all
+ * producers send via this wrapper instead of xQueueSend:
+ *
+ * * Each event gets a sequence number per queue & source (event_queue_src_t),
+ *   the sequence number of the last dropped event is saved.
+ * * Drops (queue full), flushed events (eventQueueReset) and the
+ *   high-water mark are counted per queue.
+ * * Each queue is allocated with its own capacity, the usable
+ *   depth is limited at runtime (eventQueueSetDepth, AT QD). This way,
+ *   depths can be tuned from the statistics without reallocating a queue
+ *   while its consumer is waiting on it.
+ *   The depth is a counting semaphore with one token per free element,
+ *   producers block on this semaphore (instead of polling the queue).
+ * * Each send moves the position of a queue, a producer can check
+ *   if its event is still the last one (eventQueueIsLast).
+ *
+ * Consumers receive via eventQueueReceive, which returns the token.
+ * Statistics are reported via AT QS (serial & websocket).
+ *
+ * @see eventQueueSend
+ * @see eventQueueGetStats
+ * */
+#ifndef _EVENT_QUEUE_H_
+#define _EVENT_QUEUE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+
+/** @brief Allocated element count of debouncer_in (maximum depth) */
+#define EVENT_QUEUE_CAPACITY 64
+
+/** @brief Default depth of debouncer_in */
+#define EVENT_QUEUE_DEPTH_DEFAULT 32
+
+/** @brief Maximum element size of an instrumented queue (used for flushing) */
+#define EVENT_QUEUE_ITEM_MAX 16
+
+/** @brief Instrumented queues */
+typedef enum {
+  /** @brief debouncer_in, raw_action_t */
+  EVENT_QUEUE_DEBOUNCER = 0,
+  /** @brief hid_usb, hid_report_t */
+  EVENT_QUEUE_HID_USB,
+  /** @brief hid_ble, hid_report_t */
+  EVENT_QUEUE_HID_BLE,
+  /** @brief Count of queues, no valid queue */
+  EVENT_QUEUE_MAX
+} event_queue_t;
+
+/** @brief Producers of events */
+typedef enum {
+  /** @brief GPIO ISR (hal_io) */
+  EVENT_SRC_GPIO = 0,
+  /** @brief ADC task (hal_adc) */
+  EVENT_SRC_ADC,
+  /** @brief Internal markers of the debouncer (timer & gestures),
+   * not counted in the queue statistics (sent/dropped) */
+  EVENT_SRC_MARKER,
+  /** @brief HID handler (VB commands) */
+  EVENT_SRC_HID,
+  /** @brief Serial HAL (e.g., halSerialReset) */
+  EVENT_SRC_SERIAL,
+  /** @brief Command parser (direct commands) */
+  EVENT_SRC_COMMANDS,
+  /** @brief Count of sources, no valid source */
+  EVENT_SRC_MAX
+} event_queue_src_t;
+
+/** @brief Statistics of one queue
+ * @see eventQueueGetStats */
+typedef struct event_queue_stats {
+  /** @brief Name of this queue */
+  const char *name;
+  /** @brief Count of events sent to this queue (without markers) */
+  uint32_t sent;
+  /** @brief Count of events which could not be queued (depth reached, without markers) */
+  uint32_t dropped;
+  /** @brief Count of queued events discarded by eventQueueReset */
+  uint32_t flushed;
+  /** @brief Current count of events in the queue */
+  uint32_t waiting;
+  /** @brief Maximum count of events in the queue */
+  uint32_t highwater;
+  /** @brief Current depth limit */
+  uint32_t depth;
+  /** @brief Allocated element count (maximum depth) */
+  uint32_t capacity;
+} event_queue_stats_t;
+
+/** @brief Statistics of one source on one queue
+ * @see eventQueueGetSourceStats */
+typedef struct event_queue_src_stats {
+  /** @brief Name of this source */
+  const char *name;
+  /** @brief Sequence number of the last event (count of events of this source) */
+  uint32_t seq;
+  /** @brief Count of dropped events of this source */
+  uint32_t dropped;
+  /** @brief Sequence number of the last dropped event, 0 if none */
+  uint32_t lastdrop;
+} event_queue_src_stats_t;
+
+/** @brief Create an instrumented queue
+ *
+ * @note Called once in app_main, might be called with suspended scheduler.
+ * @param queue Queue to be created
+ * @param capacity Allocated element count (maximum depth)
+ * @param depth Default depth (1 to capacity)
+ * @param itemsize Size of one element (up to EVENT_QUEUE_ITEM_MAX)
+ * @return Queue handle, NULL on an error
+ * */
+QueueHandle_t eventQueueCreate(event_queue_t queue, UBaseType_t capacity, UBaseType_t depth, UBaseType_t itemsize);
+
+/** @brief Send an event to the back of a queue (task context)
+ *
+ * If the depth limit is reached, the producer waits up to "wait" ticks
+ * for a free element, the event is dropped (and counted) afterwards.
+ * @param queue Queue
+ * @param src Producer of this event
+ * @param item Event, copied into the queue
+ * @param wait Maximum time to wait [ticks]
+ * @return Sequence number of this event (per queue & source), 0 if it was dropped
+ * */
+uint32_t eventQueueSend(event_queue_t queue, event_queue_src_t src, const void *item, TickType_t wait);
+
+/** @brief Send an event to the back of a queue & get its position (task context)
+ *
+ * Same as eventQueueSend, position is set to the position of this event
+ * in the queue. It can be used with eventQueueIsLast to check if any other
+ * event was queued afterwards.
+ * @see eventQueueSend
+ * @see eventQueueIsLast
+ * @param position Pointer to the position, set if the event was queued
+ * */
+uint32_t eventQueueSendTracked(event_queue_t queue, event_queue_src_t src, const void *item, TickType_t wait, uint32_t *position);
+
+/** @brief Check if an event is still the last one sent to a queue
+ *
+ * Each send (successful or not) moves the position, an event is the
+ * last one if no other producer tried to send afterwards.
+ * @param queue Queue
+ * @param position Position of the event (see eventQueueSendTracked)
+ * @return 1 if no other event was sent after this one, 0 otherwise
+ * */
+uint8_t eventQueueIsLast(event_queue_t queue, uint32_t position);
+
+/** @brief Send an event to the front of a queue (task context, no waiting)
+ *
+ * Used for internal markers, which must be handled before any other event.
+ * @see eventQueueSend
+ * */
+uint32_t eventQueueSendToFront(event_queue_t queue, event_queue_src_t src, const void *item);
+
+/** @brief Send an event to the back of a queue (ISR context)
+ * @see eventQueueSend
+ * @param queue Queue
+ * @param src Producer of this event
+ * @param item Event, copied into the queue
+ * @param woken Set to pdTRUE if a higher priority task was woken
+ * @return Sequence number of this event (per queue & source), 0 if it was dropped
+ * */
+uint32_t eventQueueSendFromISR(event_queue_t queue, event_queue_src_t src, const void *item, BaseType_t *woken);
+
+/** @brief Receive an event from a queue (consumer)
+ * Same as xQueueReceive, the element is returned to the depth limit.
+ * @param queue Queue
+ * @param item Buffer for the event (size of one element)
+ * @param wait Maximum time to wait [ticks]
+ * @return pdTRUE if an event was received, pdFALSE otherwise
+ * */
+BaseType_t eventQueueReceive(event_queue_t queue, void *item, TickType_t wait);
+
+/** @brief Discard all events of a queue (counted as flushed)
+ * @param queue Queue */
+void eventQueueReset(event_queue_t queue);
+
+/** @brief Set the depth limit of a queue
+ * @param queue Queue
+ * @param depth New depth (1 to the capacity of this queue)
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t eventQueueSetDepth(event_queue_t queue, uint32_t depth);
+
+/** @brief Get the statistics of one queue
+ * @param queue Queue
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t eventQueueGetStats(event_queue_t queue, event_queue_stats_t *stats);
+
+/** @brief Get the statistics of one source on one queue
+ * @param queue Queue
+ * @param src Source
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t eventQueueGetSourceStats(event_queue_t queue, event_queue_src_t src, event_queue_src_stats_t *stats);
+
+/** @brief Clear all counters & high-water marks (sequence numbers are kept) */
+void eventQueueResetStats(void);
+
+#endif /* _EVENT_QUEUE_H_ */
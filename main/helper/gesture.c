@@ -0,0 +1,251 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Gesture recognizer on debounced VB events
+ *
+ * @see gesture.h
+ * */
+#include "gesture.h"
+
+/** @brief Check if a timestamp is reached (valid across a wrap of the 32bit time)
+ * @param now Current time [ms]
+ * @param t Timestamp [ms]
+ * @return 1 if now is equal or after t */
+static inline uint8_t gestureReached(uint32_t now, uint32_t t)
+{
+  return ((int32_t)(now - t) >= 0) ? 1 : 0;
+}
+
+/** @brief Signal a gesture VB to the sink
+ * @param e Engine
+ * @param s Gesture
+ * @param press 1 for press, 0 for release
+ * @param origin Origin timestamp of the triggering event */
+static void gestureEmit(gesture_engine_t *e, gesture_state_t *s, uint8_t press, uint32_t origin)
+{
+  if(e->sink != NULL) e->sink(e->ctx,s->outvb,press,origin);
+}
+
+/** @brief Process one edge for a tap gesture (double/triple)
+ * @param e Engine
+ * @param s Gesture
+ * @param press 1 for press, 0 for release
+ * @param now Current time [ms]
+ * @param origin Origin timestamp of this event */
+static void gestureTap(gesture_engine_t *e, gesture_state_t *s, uint8_t press, uint32_t now, uint32_t origin)
+{
+  uint8_t taps = (s->cfg.type == GESTURE_TRIPLE) ? 3 : 2;
+  //pause (on press) or press (on release) too long: start again
+  if(s->taps != 0 || press == 0)
+  {
+    if((now - s->last) > s->cfg.time) s->taps = 0;
+  }
+  s->last = now;
+  if(press) return;
+  //a release within time of its press is a tap
+  if((now - s->pressed[0]) > s->cfg.time) return;
+  s->taps++;
+  if(s->taps >= taps)
+  {
+    s->taps = 0;
+    gestureEmit(e,s,1,origin);
+    gestureEmit(e,s,0,origin);
+  }
+}
+
+/** @brief Compile gesture definitions
+ *
+ * Invalid definitions (unknown type, time 0, input VB out of range,
+ * chord with the same VB twice) are ignored. All recognizer states are reset.
+ * @param e Engine
+ * @param cfg Array of gesture definitions, gesture n is signalled as VB firstvb+n
+ * @param count Count of definitions (max. GESTURE_MAX)
+ * @param inputs Count of input VBs (max. GESTURE_INPUT_MAX)
+ * @param firstvb VB of the first gesture
+ * @param sink Sink for recognized gestures
+ * @param ctx Context for the sink
+ * @return Count of compiled (valid) gestures
+ * */
+uint8_t gestureCompile(gesture_engine_t *e, const gesture_cfg_t *cfg, uint8_t count, \
+  uint32_t inputs, uint32_t firstvb, gesture_sink_h sink, void *ctx)
+{
+  uint8_t compiled = 0;
+  if(e == NULL) return 0;
+  memset(e,0,sizeof(gesture_engine_t));
+  if(inputs > GESTURE_INPUT_MAX) inputs = GESTURE_INPUT_MAX;
+  if(count > GESTURE_MAX) count = GESTURE_MAX;
+  e->inputs = inputs;
+  e->sink = sink;
+  e->ctx = ctx;
+  if(cfg == NULL) return 0;
+
+  for(uint8_t i = 0; i<count; i++)
+  {
+    const gesture_cfg_t *c = &cfg[i];
+    e->g[i].outvb = firstvb + i;
+    if(c->type == GESTURE_NONE || c->type >= GESTURE_TYPE_MAX) continue;
+    if(c->time == 0 || c->vb >= inputs) continue;
+    if(c->type == GESTURE_CHORD && (c->vb2 >= inputs || c->vb2 == c->vb)) continue;
+
+    memcpy(&e->g[i].cfg,c,sizeof(gesture_cfg_t));
+    e->map[c->vb] |= (1 << i);
+    e->used |= (1UL << c->vb);
+    if(c->type == GESTURE_CHORD)
+    {
+      e->map[c->vb2] |= (1 << i);
+      e->used |= (1UL << c->vb2);
+    }
+    compiled++;
+  }
+  return compiled;
+}
+
+/** @brief Reset all recognizer states (gestures stay compiled)
+ * @note No release is signalled for an active gesture VB.
+ * @param e Engine
+ * */
+void gestureReset(gesture_engine_t *e)
+{
+  if(e == NULL) return;
+  for(uint8_t i = 0; i<GESTURE_MAX; i++)
+  {
+    gesture_state_t *s = &e->g[i];
+    s->taps = 0;
+    s->held = 0;
+    s->armed = 0;
+    s->active = 0;
+  }
+}
+
+/** @brief Process one debounced VB event
+ * @param e Engine
+ * @param vb VB of this event, VBs not used for gestures are ignored
+ * @param press 1 for press, 0 for release
+ * @param now Current time [ms]
+ * @param origin Origin timestamp of this event, passed to the sink
+ * */
+void gestureInput(gesture_engine_t *e, uint32_t vb, uint8_t press, uint32_t now, uint32_t origin)
+{
+  if(e == NULL || vb >= e->inputs) return;
+  uint32_t m = e->map[vb];
+
+  //only gestures using this VB are processed (at most GESTURE_MAX)
+  while(m != 0)
+  {
+    gesture_state_t *s = &e->g[__builtin_ctz(m)];
+    m &= m - 1;
+    switch(s->cfg.type)
+    {
+      case GESTURE_DOUBLE:
+      case GESTURE_TRIPLE:
+        if(press) s->pressed[0] = now;
+        gestureTap(e,s,press,now,origin);
+        break;
+      case GESTURE_LONG:
+        if(press)
+        {
+          s->armed = 1;
+          s->deadline = now + s->cfg.time;
+        } else {
+          s->armed = 0;
+          if(s->active)
+          {
+            s->active = 0;
+            gestureEmit(e,s,0,origin);
+          }
+        }
+        break;
+      case GESTURE_CHORD:
+      {
+        uint8_t idx = (vb == s->cfg.vb) ? 0 : 1;
+        if(press)
+        {
+          s->held |= (1 << idx);
+          s->pressed[idx] = now;
+          //both pressed, second one within time after the first one
+          if(s->held == 0x03 && s->active == 0 && \
+            (now - s->pressed[idx ^ 1]) <= s->cfg.time)
+          {
+            s->active = 1;
+            gestureEmit(e,s,1,origin);
+          }
+        } else {
+          s->held &= ~(1 << idx);
+          if(s->active)
+          {
+            s->active = 0;
+            gestureEmit(e,s,0,origin);
+          }
+        }
+        break;
+      }
+      default: break;
+    }
+  }
+}
+
+/** @brief Get the earliest running deadline (long hold)
+ * @param e Engine
+ * @param deadline Earliest deadline [ms], only set if a deadline is running
+ * @return 1 if a deadline is running, 0 otherwise
+ * */
+uint8_t gestureNextDeadline(gesture_engine_t *e, uint32_t *deadline)
+{
+  uint8_t found = 0;
+  uint32_t next = 0;
+  if(e == NULL || deadline == NULL) return 0;
+  for(uint8_t i = 0; i<GESTURE_MAX; i++)
+  {
+    if(e->g[i].armed == 0) continue;
+    if(found == 0 || (int32_t)(e->g[i].deadline - next) < 0) next = e->g[i].deadline;
+    found = 1;
+  }
+  if(found) *deadline = next;
+  return found;
+}
+
+/** @brief Process all expired deadlines (long hold)
+ * @param e Engine
+ * @param now Current time [ms]
+ * */
+void gestureProcess(gesture_engine_t *e, uint32_t now)
+{
+  if(e == NULL) return;
+  for(uint8_t i = 0; i<GESTURE_MAX; i++)
+  {
+    gesture_state_t *s = &e->g[i];
+    if(s->armed && gestureReached(now,s->deadline))
+    {
+      s->armed = 0;
+      s->active = 1;
+      gestureEmit(e,s,1,0);
+    }
+  }
+}
+
+/** @brief Get the bitmap of all input VBs used by any gesture
+ * @param e Engine
+ * @return Bitmap of input VBs (bit n: VB n)
+ * */
+uint32_t gestureGetUsed(gesture_engine_t *e)
+{
+  if(e == NULL) return 0;
+  return e->used;
+}
@@ -0,0 +1,188 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Gesture recognizer on debounced VB events
+ *
+ * The gesture engine is fed with all debounced VB events (see
+ * task_debouncer). Each recognized gesture is signalled as press/release
+ * of an own, virtual VB (firstvb + number of the gesture):<br>
+ * * GESTURE_DOUBLE/GESTURE_TRIPLE: 2/3 taps of one VB, each press and
+ * each pause shorter than the gesture time. A press & release of the
+ * gesture VB is signalled after the last tap.<br>
+ * * GESTURE_LONG: one VB is held for at least the gesture time. The
+ * gesture VB is pressed when this time elapses & released with the VB.<br>
+ * * GESTURE_CHORD: two VBs are pressed within the gesture time. The
+ * gesture VB is pressed with the second VB & released with the first
+ * released one.
+ *
+ * The underlying VB events are not suppressed (no added latency), assign
+ * no command to a VB if it should be used for gestures only.
+ *
+ * Gesture definitions are compiled once (on slot load) into a table,
+ * mapping each input VB to its gestures. Each event is processed with a
+ * constant amount of work (at most GESTURE_MAX gestures per VB), no
+ * timer is used: the caller checks gestureNextDeadline and calls
+ * gestureProcess if a long hold might be due.
+ *
+ * @note This module has no FreeRTOS/ESP-IDF dependency. The clock (each
+ * call gets the current time) & the sink are given by the caller, so it
+ * can be used on a host with a virtual clock as well.
+ * @note Not locked, all calls have to be done by one task (task_debouncer).
+ * @see gestureCompile
+ * @see gestureInput
+ * */
+#ifndef _GESTURE_H_
+#define _GESTURE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Maximum count of gestures (per slot) */
+#define GESTURE_MAX 8
+
+/** @brief Maximum count of input VBs (size of the compiled VB map) */
+#define GESTURE_INPUT_MAX 32
+
+/** @brief Type of a gesture */
+typedef enum gesture_type {
+  /** @brief Unused gesture */
+  GESTURE_NONE = 0,
+  /** @brief Two taps of vb */
+  GESTURE_DOUBLE,
+  /** @brief Three taps of vb */
+  GESTURE_TRIPLE,
+  /** @brief vb is held for a long time */
+  GESTURE_LONG,
+  /** @brief vb & vb2 are pressed together */
+  GESTURE_CHORD,
+  /** @brief Count of gesture types */
+  GESTURE_TYPE_MAX
+} gesture_type_t;
+
+/** @brief Definition of one gesture, stored in the slot (see AT GE) */
+typedef struct gesture_cfg {
+  /** @brief Type of this gesture, see gesture_type_t */
+  uint8_t type;
+  /** @brief Input VB */
+  uint8_t vb;
+  /** @brief Second input VB, only used for GESTURE_CHORD */
+  uint8_t vb2;
+  /** @brief Gesture time [ms]: maximum tap/pause, minimum hold or maximum chord delay */
+  uint16_t time;
+} gesture_cfg_t;
+
+/** @brief Sink for recognized gestures
+ * @param ctx Context, as given to gestureCompile
+ * @param vb Gesture VB (firstvb + number of the gesture)
+ * @param press 1 for press, 0 for release
+ * @param origin Origin timestamp of the input event, which triggered this gesture
+ * (0 if triggered by a deadline, the hold time is no latency)
+ * */
+typedef void (*gesture_sink_h)(void *ctx, uint32_t vb, uint8_t press, uint32_t origin);
+
+/** @brief Compiled gesture & its recognizer state */
+typedef struct gesture_state {
+  /** @brief Definition of this gesture */
+  gesture_cfg_t cfg;
+  /** @brief Output VB of this gesture */
+  uint32_t outvb;
+  /** @brief Timestamp [ms] of the last input edge (tap gestures) */
+  uint32_t last;
+  /** @brief Timestamp [ms] of the press of each input (chord: vb, vb2) */
+  uint32_t pressed[2];
+  /** @brief Deadline [ms] of a long hold, valid if armed is set */
+  uint32_t deadline;
+  /** @brief Count of taps so far */
+  uint8_t taps;
+  /** @brief Bitmap of pressed inputs (bit 0: vb, bit 1: vb2) */
+  uint8_t held;
+  /** @brief Set if a long hold deadline is running */
+  uint8_t armed;
+  /** @brief Set if the output VB is pressed */
+  uint8_t active;
+} gesture_state_t;
+
+/** @brief Gesture engine, compiled gesture table & all recognizer states */
+typedef struct gesture_engine {
+  /** @brief Compiled gestures */
+  gesture_state_t g[GESTURE_MAX];
+  /** @brief Map of input VBs to gestures (bit n: gesture n uses this VB) */
+  uint8_t map[GESTURE_INPUT_MAX];
+  /** @brief Count of input VBs (all inputs must be smaller) */
+  uint32_t inputs;
+  /** @brief Bitmap of input VBs used by any gesture */
+  uint32_t used;
+  /** @brief Sink for recognized gestures */
+  gesture_sink_h sink;
+  /** @brief Context for the sink */
+  void *ctx;
+} gesture_engine_t;
+
+/** @brief Compile gesture definitions
+ *
+ * Invalid definitions (unknown type, time 0, input VB out of range,
+ * chord with the same VB twice) are ignored. All recognizer states are reset.
+ * @param e Engine
+ * @param cfg Array of gesture definitions, gesture n is signalled as VB firstvb+n
+ * @param count Count of definitions (max. GESTURE_MAX)
+ * @param inputs Count of input VBs (max. GESTURE_INPUT_MAX)
+ * @param firstvb VB of the first gesture
+ * @param sink Sink for recognized gestures
+ * @param ctx Context for the sink
+ * @return Count of compiled (valid) gestures
+ * */
+uint8_t gestureCompile(gesture_engine_t *e, const gesture_cfg_t *cfg, uint8_t count, \
+  uint32_t inputs, uint32_t firstvb, gesture_sink_h sink, void *ctx);
+
+/** @brief Reset all recognizer states (gestures stay compiled)
+ * @note No release is signalled for an active gesture VB.
+ * @param e Engine
+ * */
+void gestureReset(gesture_engine_t *e);
+
+/** @brief Process one debounced VB event
+ * @param e Engine
+ * @param vb VB of this event, VBs not used for gestures are ignored
+ * @param press 1 for press, 0 for release
+ * @param now Current time [ms]
+ * @param origin Origin timestamp of this event, passed to the sink
+ * */
+void gestureInput(gesture_engine_t *e, uint32_t vb, uint8_t press, uint32_t now, uint32_t origin);
+
+/** @brief Get the earliest running deadline (long hold)
+ * @param e Engine
+ * @param deadline Earliest deadline [ms], only set if a deadline is running
+ * @return 1 if a deadline is running, 0 otherwise
+ * */
+uint8_t gestureNextDeadline(gesture_engine_t *e, uint32_t *deadline);
+
+/** @brief Process all expired deadlines (long hold)
+ * @param e Engine
+ * @param now Current time [ms]
+ * */
+void gestureProcess(gesture_engine_t *e, uint32_t now);
+
+/** @brief Get the bitmap of all input VBs used by any gesture
+ * @param e Engine
+ * @return Bitmap of input VBs (bit n: VB n)
+ * */
+uint32_t gestureGetUsed(gesture_engine_t *e);
+
+#endif /* _GESTURE_H_ */
@@ -0,0 +1,302 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Coalescing of relative mouse movements
+ *
+ * @see hid_coalesce.h
+ * */
+#include "hid_coalesce.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "coalesce"
+
+/** @brief One pending report, fetched by the consumer on receiving its marker */
+typedef struct hidCoalesceReport {
+  /** @brief Pending movement, not yet fetched */
+  int32_t x, y;
+  /** @brief Position of the marker in the HID queue (eventQueueSendTracked) */
+  uint32_t position;
+  /** @brief Set if the marker is queued, movement might be merged */
+  uint8_t open;
+} hidCoalesceReport_t;
+
+/** @brief Pending movement of one transport */
+typedef struct hidCoalesceState {
+  /** @brief Pending reports, in the same order as their markers in the HID queue */
+  hidCoalesceReport_t reports[HID_COALESCE_REPORTS];
+  /** @brief Number of the oldest pending report (next one fetched by the consumer) */
+  uint32_t head;
+  /** @brief Number of the next pending report (producer) */
+  uint32_t tail;
+  /** @brief Movement without a queued marker (HID queue was full) */
+  int32_t x, y;
+  /** @brief Statistics */
+  hid_coalesce_stats_t stats;
+} hidCoalesceState_t;
+
+/** @brief State of all transports
+ * @see hidCoalesceLock */
+static hidCoalesceState_t hidCoalesce[HID_COALESCE_MAX];
+
+/** @brief Spinlock for hidCoalesce, producer & consumer might run on different cores */
+static portMUX_TYPE hidCoalesceLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Limit a value to +-limit
+ * @param v Value
+ * @param limit Maximum absolute value
+ * @return Limited value */
+static int32_t hidCoalesceClamp(int32_t v, int32_t limit)
+{
+  if(v > limit) return limit;
+  if(v < -limit) return -limit;
+  return v;
+}
+
+/** @brief Check if a pending report is still in use
+ * @note Must be called within a critical section (hidCoalesceLock).
+ * @param s Transport state
+ * @param nr Number of the report
+ * @return 1 if the report was not fetched completely & not reset */
+static uint8_t hidCoalesceIsPending(hidCoalesceState_t *s, uint32_t nr)
+{
+  return ((int32_t)(nr - s->head) >= 0 && (int32_t)(s->tail - nr) > 0) ? 1 : 0;
+}
+
+/** @brief Queue markers for all movement without a marker
+ *
+ * Called by the producer outside of the critical section (no queue calls
+ * are allowed within). The movement is moved to new pending reports (up to
+ * HID_COALESCE_MAX_PENDING per axis each), before its marker is sent.
+ * If the queue is full, the movement is kept & sent again by hidCoalesceRetry.
+ * @param t Transport
+ * @param queue HID queue for this transport
+ * */
+static void hidCoalesceQueueMarkers(hid_coalesce_t t, event_queue_t queue)
+{
+  hidCoalesceState_t *s = &hidCoalesce[t];
+  hid_report_t cmd;
+  memset(&cmd,0,sizeof(hid_report_t));
+  cmd.cmd[0] = HID_COALESCE_CMD;
+
+  while(1)
+  {
+    uint32_t nr, position = 0;
+    hidCoalesceReport_t *r;
+
+    //move the movement into a new report, before the consumer might see its marker
+    portENTER_CRITICAL(&hidCoalesceLock);
+    if((s->x == 0 && s->y == 0) || s->tail - s->head >= HID_COALESCE_REPORTS)
+    {
+      portEXIT_CRITICAL(&hidCoalesceLock);
+      return;
+    }
+    nr = s->tail++;
+    r = &s->reports[nr % HID_COALESCE_REPORTS];
+    r->x = hidCoalesceClamp(s->x,HID_COALESCE_MAX_PENDING);
+    r->y = hidCoalesceClamp(s->y,HID_COALESCE_MAX_PENDING);
+    r->open = 0;
+    s->x -= r->x;
+    s->y -= r->y;
+    portEXIT_CRITICAL(&hidCoalesceLock);
+
+    #if HID_REPORT_LATENCY
+    cmd.timestamp = cmd.queued = latencyNow();
+    #endif
+    uint32_t seq = eventQueueSendTracked(queue,EVENT_SRC_ADC,&cmd,0,&position);
+
+    portENTER_CRITICAL(&hidCoalesceLock);
+    if(seq == 0)
+    {
+      //queue is full: keep movement, try again on next sample (hidCoalesceRetry).
+      //The report is the newest one, there is no marker for it.
+      if(hidCoalesceIsPending(s,nr))
+      {
+        s->x += r->x;
+        s->y += r->y;
+        s->tail--;
+      }
+      s->stats.dropped++;
+      portEXIT_CRITICAL(&hidCoalesceLock);
+      return;
+    }
+    //merging is possible until another event is queued
+    if(hidCoalesceIsPending(s,nr))
+    {
+      r->position = position;
+      r->open = 1;
+    }
+    portEXIT_CRITICAL(&hidCoalesceLock);
+  }
+}
+
+/** @brief Add a relative mouse movement
+ *
+ * The movement is merged into the newest pending report of this transport,
+ * if its marker is still the last event of the HID queue. Otherwise, a new
+ * pending report is started and its marker is sent to the given queue.
+ *
+ * @param t Transport
+ * @param queue HID queue for this transport (EVENT_QUEUE_HID_USB or EVENT_QUEUE_HID_BLE)
+ * @param x Relative X movement
+ * @param y Relative Y movement
+ * */
+void hidCoalesceMove(hid_coalesce_t t, event_queue_t queue, int32_t x, int32_t y)
+{
+  if(t >= HID_COALESCE_MAX || queue >= EVENT_QUEUE_MAX) return;
+  hidCoalesceState_t *s = &hidCoalesce[t];
+
+  portENTER_CRITICAL(&hidCoalesceLock);
+  //merge into the newest report, if nothing is queued after its marker,
+  //no older movement is waiting & it does not exceed the limit
+  if(s->tail != s->head && s->x == 0 && s->y == 0)
+  {
+    hidCoalesceReport_t *r = &s->reports[(s->tail - 1) % HID_COALESCE_REPORTS];
+    if(r->open && eventQueueIsLast(queue,r->position) &&
+      hidCoalesceClamp(r->x + x,HID_COALESCE_MAX_PENDING) == r->x + x &&
+      hidCoalesceClamp(r->y + y,HID_COALESCE_MAX_PENDING) == r->y + y)
+    {
+      r->x += x;
+      r->y += y;
+      s->stats.merged++;
+      portEXIT_CRITICAL(&hidCoalesceLock);
+      return;
+    }
+  }
+  //otherwise: new report (without a marker yet). Limited only to avoid
+  //an overflow, if the consumer stalls for hours.
+  s->x = hidCoalesceClamp(s->x + hidCoalesceClamp(x,HID_COALESCE_MAX_PENDING),INT32_MAX/2);
+  s->y = hidCoalesceClamp(s->y + hidCoalesceClamp(y,HID_COALESCE_MAX_PENDING),INT32_MAX/2);
+  portEXIT_CRITICAL(&hidCoalesceLock);
+
+  hidCoalesceQueueMarkers(t,queue);
+}
+
+/** @brief Queue a marker again, if a pending movement could not be queued before
+ *
+ * If the HID queue was full on the last movement, the pending movement
+ * stays without a marker. If the user stops moving, no further call to
+ * hidCoalesceMove would queue it. This function is called on each sample
+ * (even without any movement) to retry sending the marker.
+ *
+ * @param t Transport
+ * @param queue HID queue for this transport (EVENT_QUEUE_HID_USB or EVENT_QUEUE_HID_BLE)
+ * */
+void hidCoalesceRetry(hid_coalesce_t t, event_queue_t queue)
+{
+  if(t >= HID_COALESCE_MAX || queue >= EVENT_QUEUE_MAX) return;
+  hidCoalesceQueueMarkers(t,queue);
+}
+
+/** @brief Fetch a part of the pending movement, limited per axis
+ *
+ * Same as hidCoalesceFetch, but the movement is returned as plain values.
+ * Used by consumers with wider reports (e.g., 16bit BLE mouse report).
+ *
+ * @param t Transport
+ * @param limit Maximum absolute value per axis (e.g., 127 for 8bit reports)
+ * @param x Pointer to X movement, will be filled
+ * @param y Pointer to Y movement, will be filled
+ * @return 1 if x/y contain movement, 0 if there is no pending movement
+ * */
+uint8_t hidCoalesceFetchMove(hid_coalesce_t t, int32_t limit, int32_t *x, int32_t *y)
+{
+  if(t >= HID_COALESCE_MAX || x == NULL || y == NULL || limit <= 0) return 0;
+  hidCoalesceState_t *s = &hidCoalesce[t];
+
+  portENTER_CRITICAL(&hidCoalesceLock);
+  //no report (e.g., marker was queued before a reset)
+  if(s->head == s->tail)
+  {
+    portEXIT_CRITICAL(&hidCoalesceLock);
+    return 0;
+  }
+  hidCoalesceReport_t *r = &s->reports[s->head % HID_COALESCE_REPORTS];
+  //nothing left: this report is finished, the next movement starts a new one
+  if(r->x == 0 && r->y == 0)
+  {
+    r->open = 0;
+    s->head++;
+    portEXIT_CRITICAL(&hidCoalesceLock);
+    return 0;
+  }
+  //take as much as fits into one report
+  *x = hidCoalesceClamp(r->x,limit);
+  *y = hidCoalesceClamp(r->y,limit);
+  r->x -= *x;
+  r->y -= *y;
+  s->stats.reports++;
+  portEXIT_CRITICAL(&hidCoalesceLock);
+  return 1;
+}
+
+/** @brief Fetch one mouse report from the pending movement
+ *
+ * Called by the consumer task on receiving a HID_COALESCE_CMD.
+ * cmd is filled with a mouse X/Y report (0x01) from the oldest pending
+ * report, limited to +-127 per axis. Call this function until it
+ * returns 0, the pending report of this marker is then finished.
+ *
+ * @param t Transport
+ * @param cmd Command, which will be filled with the mouse report
+ * @return 1 if cmd contains a report, 0 if there is no pending movement
+ * */
+uint8_t hidCoalesceFetch(hid_coalesce_t t, hid_report_t *cmd)
+{
+  int32_t x,y;
+  if(cmd == NULL) return 0;
+  if(hidCoalesceFetchMove(t,127,&x,&y) == 0) return 0;
+
+  cmd->cmd[0] = 0x01;
+  cmd->cmd[1] = (int8_t)x;
+  cmd->cmd[2] = (int8_t)y;
+  return 1;
+}
+
+/** @brief Discard any pending movement of one transport
+ *
+ * Used if the HID queue is reset. If the consumer cannot send
+ * (e.g., no BLE connection), it has to fetch & discard the
+ * pending report of each marker instead.
+ * @param t Transport
+ * */
+void hidCoalesceReset(hid_coalesce_t t)
+{
+  if(t >= HID_COALESCE_MAX) return;
+  portENTER_CRITICAL(&hidCoalesceLock);
+  hidCoalesce[t].x = 0;
+  hidCoalesce[t].y = 0;
+  //markers still in the queue find no report
+  hidCoalesce[t].head = hidCoalesce[t].tail;
+  portEXIT_CRITICAL(&hidCoalesceLock);
+}
+
+/** @brief Get statistics of one transport
+ * @param t Transport
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t hidCoalesceGetStats(hid_coalesce_t t, hid_coalesce_stats_t *stats)
+{
+  if(t >= HID_COALESCE_MAX || stats == NULL) return ESP_FAIL;
+  portENTER_CRITICAL(&hidCoalesceLock);
+  memcpy(stats,&hidCoalesce[t].stats,sizeof(hid_coalesce_stats_t));
+  portEXIT_CRITICAL(&hidCoalesceLock);
+  return ESP_OK;
+}
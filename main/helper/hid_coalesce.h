@@ -0,0 +1,159 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Coalescing of relative mouse movements
+ *
+ * Relative mouse movements (from the mouthpiece) are not sent as
+ * individual HID commands. Instead, they are accumulated per transport
+ * (USB/BLE) into a pending report and one marker command (HID_COALESCE_CMD)
+ * is queued to hid_usb/hid_ble for each pending report. Any further
+ * movement is merged into the newest pending report until the consumer
+ * task (halSerialHIDTask/halBLETask) fetches it via hidCoalesceFetch.
+ *
+ * Movement is merged only as long as the marker is the last event in
+ * the HID queue (eventQueueIsLast). If any other report (e.g., a click)
+ * was queued after the marker, a new pending report with its own marker
+ * is started, movement is never sent before a report which was queued
+ * earlier.
+ *
+ * If the HID queue is full, the movement is kept and the marker is queued
+ * again on the next sample (hidCoalesceRetry); no displacement is lost.
+ *
+ * @see hidCoalesceMove
+ * @see hidCoalesceFetch
+ * */
+#ifndef _HID_COALESCE_H_
+#define _HID_COALESCE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <esp_log.h>
+#include "common.h"
+#include "latency.h"
+
+/** @brief Marker command in hid_report_t.cmd[0] for a coalesced mouse movement
+ *
+ * This command is never sent to the LPC or to a BLE host, consumers need to
+ * replace it by fetching the pending movement via hidCoalesceFetch.
+ * */
+#define HID_COALESCE_CMD 0x0E
+
+/** @brief Maximum movement per axis of one pending report
+ *
+ * If a pending report would exceed this value, the remaining movement is
+ * put into a new pending report with its own marker (nothing is truncated).
+ * */
+#define HID_COALESCE_MAX_PENDING 32767
+
+/** @brief Maximum count of pending reports (queued markers) per transport
+ *
+ * If all are in use, movement is kept and queued as soon as the consumer
+ * has fetched a report (hidCoalesceRetry).
+ * */
+#define HID_COALESCE_REPORTS 16
+
+/** @brief Available transports for coalescing */
+typedef enum {
+  HID_COALESCE_USB = 0,
+  HID_COALESCE_BLE,
+  HID_COALESCE_MAX
+} hid_coalesce_t;
+
+/** @brief Statistics of one transport
+ * @see hidCoalesceGetStats */
+typedef struct hid_coalesce_stats {
+  /** @brief Count of mouse reports fetched by the consumer */
+  uint32_t reports;
+  /** @brief Count of movements merged into an already queued report */
+  uint32_t merged;
+  /** @brief Count of failed sends to the HID queue (movement is kept) */
+  uint32_t dropped;
+} hid_coalesce_stats_t;
+
+/** @brief Add a relative mouse movement
+ *
+ * The movement is merged into the newest pending report of this transport,
+ * if its marker is still the last event of the HID queue. Otherwise, a new
+ * pending report is started and its marker is sent to the given queue.
+ *
+ * @param t Transport
+ * @param queue HID queue for this transport (EVENT_QUEUE_HID_USB or EVENT_QUEUE_HID_BLE)
+ * @param x Relative X movement
+ * @param y Relative Y movement
+ * */
+void hidCoalesceMove(hid_coalesce_t t, event_queue_t queue, int32_t x, int32_t y);
+
+/** @brief Queue a marker again, if a pending movement could not be queued before
+ *
+ * If the HID queue was full on the last movement, the pending movement
+ * stays without a marker. If the user stops moving, no further call to
+ * hidCoalesceMove would queue it. This function is called on each sample
+ * (even without any movement) to retry sending the marker.
+ *
+ * @param t Transport
+ * @param queue HID queue for this transport (EVENT_QUEUE_HID_USB or EVENT_QUEUE_HID_BLE)
+ * */
+void hidCoalesceRetry(hid_coalesce_t t, event_queue_t queue);
+
+/** @brief Fetch one mouse report from the pending movement
+ *
+ * Called by the consumer task on receiving a HID_COALESCE_CMD.
+ * cmd is filled with a mouse X/Y report (0x01) from the oldest pending
+ * report, limited to +-127 per axis. Call this function until it
+ * returns 0, the pending report of this marker is then finished.
+ *
+ * @param t Transport
+ * @param cmd Command, which will be filled with the mouse report
+ * @return 1 if cmd contains a report, 0 if there is no pending movement
+ * */
+uint8_t hidCoalesceFetch(hid_coalesce_t t, hid_report_t *cmd);
+
+/** @brief Fetch a part of the pending movement, limited per axis
+ *
+ * Same as hidCoalesceFetch, but the movement is returned as plain values.
+ * Used by consumers with wider reports (e.g., 16bit BLE mouse report).
+ *
+ * @param t Transport
+ * @param limit Maximum absolute value per axis (e.g., 127 for 8bit reports)
+ * @param x Pointer to X movement, will be filled
+ * @param y Pointer to Y movement, will be filled
+ * @return 1 if x/y contain movement, 0 if there is no pending movement
+ * */
+uint8_t hidCoalesceFetchMove(hid_coalesce_t t, int32_t limit, int32_t *x, int32_t *y);
+
+/** @brief Discard any pending movement of one transport
+ *
+ * Used if the HID queue is reset. If the consumer cannot send
+ * (e.g., no BLE connection), it has to fetch & discard the
+ * pending report of each marker instead.
+ * @param t Transport
+ * */
+void hidCoalesceReset(hid_coalesce_t t);
+
+/** @brief Get statistics of one transport
+ * @param t Transport
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t hidCoalesceGetStats(hid_coalesce_t t, hid_coalesce_stats_t *stats);
+
+#endif /* _HID_COALESCE_H_ */
@@ -0,0 +1,251 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - LRU cache of ready-to-send IR commands
+ *
+ * @see ir_cache.h
+ * */
+#include "ir_cache.h"
+
+#define LOG_TAG "ircache"
+
+/** @brief One cached IR command */
+typedef struct ir_cache_entry {
+  /** @brief Name of the IR command, empty if this entry is not used */
+  char name[SLOTNAME_LENGTH+1];
+  /** @brief RMT items */
+  rmt_item32_t *items;
+  /** @brief Count of RMT items */
+  uint16_t count;
+  /** @brief Value of irCacheTick on last use (LRU) */
+  uint32_t lastused;
+} ir_cache_entry_t;
+
+/** @brief All cache entries */
+static ir_cache_entry_t irCache[IR_CACHE_ENTRIES];
+/** @brief Size of all cached RMT items [bytes] */
+static uint32_t irCacheBytes = 0;
+/** @brief Counter for LRU ordering, incremented on each access */
+static uint32_t irCacheTick = 0;
+/** @brief Mutex for all cache data (no critical section, copies can be large)
+ * @see irCacheInit */
+static SemaphoreHandle_t irCacheSem = NULL;
+
+/** @brief Maximum time to wait for irCacheSem [ticks] */
+#define IR_CACHE_WAIT 20
+
+/** @brief Take irCacheSem
+ * @return 1 if taken, 0 otherwise (not initialized or timeout) */
+static uint8_t irCacheLock(void)
+{
+  if(irCacheSem == NULL) return 0;
+  if(xSemaphoreTake(irCacheSem,IR_CACHE_WAIT) != pdTRUE)
+  {
+    ESP_LOGW(LOG_TAG,"IR cache mutex not free");
+    return 0;
+  }
+  return 1;
+}
+
+/** @brief Initialize the IR cache (create the mutex)
+ * @note Called once in app_main, before any other function of this cache.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t irCacheInit(void)
+{
+  if(irCacheSem != NULL) return ESP_OK;
+  irCacheSem = xSemaphoreCreateMutex();
+  if(irCacheSem == NULL) return ESP_FAIL;
+  return ESP_OK;
+}
+
+/** @brief Find the entry of a name
+ * @note Must be called with irCacheSem taken.
+ * @param name Name of the IR command
+ * @return Index of the entry, -1 if not cached
+ * */
+static int8_t irCacheFind(const char *name)
+{
+  for(uint8_t i = 0; i<IR_CACHE_ENTRIES; i++)
+  {
+    if(irCache[i].items != NULL && strcmp(irCache[i].name,name) == 0) return i;
+  }
+  return -1;
+}
+
+/** @brief Detach the items of an entry & mark the entry as unused
+ * @note Must be called with irCacheSem taken.
+ * @param i Index of the entry
+ * @return RMT items, which need to be freed by the caller
+ * */
+static rmt_item32_t *irCacheDetach(uint8_t i)
+{
+  rmt_item32_t *items = irCache[i].items;
+  irCacheBytes -= irCache[i].count * sizeof(rmt_item32_t);
+  irCache[i].items = NULL;
+  irCache[i].count = 0;
+  irCache[i].name[0] = '\0';
+  return items;
+}
+
+/** @brief Get a cached IR command
+ * 
+ * A buffer with the size of the cached command is allocated & the
+ * RMT items are copied into it. The command is marked as most
+ * recently used.
+ * @param name Name of the IR command
+ * @param buffer Pointer to the new buffer, must be freed by the caller
+ * (e.g., by sending it via SENDIRSTRUCT)
+ * @param count Count of copied items
+ * @return ESP_OK on a hit, ESP_FAIL if not cached (or no memory)
+ * */
+esp_err_t irCacheGet(const char *name, rmt_item32_t **buffer, uint16_t *count)
+{
+  esp_err_t ret = ESP_FAIL;
+  if(name == NULL || buffer == NULL || count == NULL) return ESP_FAIL;
+  *buffer = NULL;
+  
+  if(irCacheLock() == 0) return ESP_FAIL;
+  int8_t i = irCacheFind(name);
+  if(i >= 0)
+  {
+    *buffer = malloc(irCache[i].count * sizeof(rmt_item32_t));
+    if(*buffer != NULL)
+    {
+      memcpy(*buffer,irCache[i].items,irCache[i].count * sizeof(rmt_item32_t));
+      *count = irCache[i].count;
+      irCache[i].lastused = ++irCacheTick;
+      ret = ESP_OK;
+    } else ESP_LOGE(LOG_TAG,"Cannot malloc for cached IR cmd %s",name);
+  }
+  xSemaphoreGive(irCacheSem);
+  return ret;
+}
+
+/** @brief Add (or replace) an IR command
+ * 
+ * The RMT items are copied, least recently used commands are evicted
+ * until the command fits into IR_CACHE_BYTES.
+ * @param name Name of the IR command
+ * @param buffer RMT items
+ * @param count Count of items
+ * @return ESP_OK if cached, ESP_FAIL otherwise (too large, no memory)
+ * */
+esp_err_t irCachePut(const char *name, const rmt_item32_t *buffer, uint16_t count)
+{
+  rmt_item32_t *evicted[IR_CACHE_ENTRIES+1];
+  uint8_t evictedcount = 0;
+  uint32_t size = count * sizeof(rmt_item32_t);
+  
+  if(name == NULL || buffer == NULL || count == 0) return ESP_FAIL;
+  if(strnlen(name,SLOTNAME_LENGTH+1) > SLOTNAME_LENGTH) return ESP_FAIL;
+  if(size > IR_CACHE_BYTES)
+  {
+    ESP_LOGW(LOG_TAG,"IR cmd %s too large for cache (%u bytes)",name,size);
+    return ESP_FAIL;
+  }
+  
+  rmt_item32_t *items = malloc(size);
+  if(items == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot malloc %u bytes for IR cmd %s",size,name);
+    return ESP_FAIL;
+  }
+  memcpy(items,buffer,size);
+  
+  if(irCacheLock() == 0)
+  {
+    free(items);
+    return ESP_FAIL;
+  }
+  //replace a previous version
+  int8_t i = irCacheFind(name);
+  if(i >= 0) evicted[evictedcount++] = irCacheDetach(i);
+  
+  //evict LRU entries until the new one fits & one entry is free
+  while(1)
+  {
+    int8_t unused = -1;
+    int8_t lru = -1;
+    for(uint8_t e = 0; e<IR_CACHE_ENTRIES; e++)
+    {
+      if(irCache[e].items == NULL)
+      {
+        if(unused < 0) unused = e;
+      } else if(lru < 0 || (int32_t)(irCache[e].lastused - irCache[lru].lastused) < 0) {
+        lru = e;
+      }
+    }
+    if(unused >= 0 && irCacheBytes + size <= IR_CACHE_BYTES)
+    {
+      i = unused;
+      break;
+    }
+    evicted[evictedcount++] = irCacheDetach(lru);
+  }
+  
+  strcpy(irCache[i].name,name);
+  irCache[i].items = items;
+  irCache[i].count = count;
+  irCache[i].lastused = ++irCacheTick;
+  irCacheBytes += size;
+  xSemaphoreGive(irCacheSem);
+  
+  for(uint8_t e = 0; e<evictedcount; e++) free(evicted[e]);
+  ESP_LOGD(LOG_TAG,"Cached IR cmd %s, %u bytes (evicted %d)",name,size,evictedcount);
+  return ESP_OK;
+}
+
+/** @brief Check if an IR command is cached (without marking it as used)
+ * @param name Name of the IR command
+ * @return 1 if cached, 0 otherwise
+ * */
+uint8_t irCacheContains(const char *name)
+{
+  if(name == NULL || irCacheLock() == 0) return 0;
+  int8_t i = irCacheFind(name);
+  xSemaphoreGive(irCacheSem);
+  return (i >= 0) ? 1 : 0;
+}
+
+/** @brief Remove one or all IR commands from the cache
+ * 
+ * Must be called whenever a stored IR command is changed or deleted.
+ * @param name Name of the IR command, NULL to clear the cache
+ * */
+void irCacheInvalidate(const char *name)
+{
+  rmt_item32_t *evicted[IR_CACHE_ENTRIES];
+  uint8_t evictedcount = 0;
+  
+  //a stale command must not stay cached, wait for the mutex
+  if(irCacheSem == NULL || xSemaphoreTake(irCacheSem,portMAX_DELAY) != pdTRUE) return;
+  for(uint8_t i = 0; i<IR_CACHE_ENTRIES; i++)
+  {
+    if(irCache[i].items == NULL) continue;
+    if(name == NULL || strcmp(irCache[i].name,name) == 0)
+    {
+      evicted[evictedcount++] = irCacheDetach(i);
+    }
+  }
+  xSemaphoreGive(irCacheSem);
+  
+  for(uint8_t e = 0; e<evictedcount; e++) free(evicted[e]);
+}
@@ -0,0 +1,94 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - LRU cache of ready-to-send IR commands
+ *
+ * Sending an IR command (T_SENDIR, AT IP) would need a storage transaction
+ * and a file read for each button press. This cache holds the RMT items
+ * of recently used IR commands in RAM, keyed by the command name.
+ *
+ * * Bounded by IR_CACHE_BYTES (size of all RMT items) & IR_CACHE_ENTRIES,
+ *   the least recently used command is evicted first.
+ * * fct_infrared warms the cache on each slot load for all IR commands
+ *   of this slot (fct_infrared_warm).
+ * * hal_storage invalidates a command if it is stored or deleted.
+ *
+ * @note All functions are thread-safe (mutex, call irCacheInit once).
+ * Only copies are handed in/out, a hit allocates exactly the size of
+ * the cached command.
+ * @see irCacheGet
+ * @see irCachePut
+ * */
+#ifndef _IR_CACHE_H_
+#define _IR_CACHE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include "driver/rmt.h"
+#include "common.h"
+
+/** @brief Initialize the IR cache (create the mutex)
+ * @note Called once in app_main, before any other function of this cache.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t irCacheInit(void);
+
+/** @brief Get a cached IR command
+ * 
+ * A buffer with the size of the cached command is allocated & the
+ * RMT items are copied into it. The command is marked as most
+ * recently used.
+ * @param name Name of the IR command
+ * @param buffer Pointer to the new buffer, must be freed by the caller
+ * (e.g., by sending it via SENDIRSTRUCT)
+ * @param count Count of copied items
+ * @return ESP_OK on a hit, ESP_FAIL if not cached (or no memory)
+ * */
+esp_err_t irCacheGet(const char *name, rmt_item32_t **buffer, uint16_t *count);
+
+/** @brief Add (or replace) an IR command
+ * 
+ * The RMT items are copied, least recently used commands are evicted
+ * until the command fits into IR_CACHE_BYTES.
+ * @param name Name of the IR command
+ * @param buffer RMT items
+ * @param count Count of items
+ * @return ESP_OK if cached, ESP_FAIL otherwise (too large, no memory)
+ * */
+esp_err_t irCachePut(const char *name, const rmt_item32_t *buffer, uint16_t count);
+
+/** @brief Check if an IR command is cached (without marking it as used)
+ * @param name Name of the IR command
+ * @return 1 if cached, 0 otherwise
+ * */
+uint8_t irCacheContains(const char *name);
+
+/** @brief Remove one or all IR commands from the cache
+ * 
+ * Must be called whenever a stored IR command is changed or deleted.
+ * @param name Name of the IR command, NULL to clear the cache
+ * */
+void irCacheInvalidate(const char *name);
+
+#endif /* _IR_CACHE_H_ */
@@ -0,0 +1,632 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Compact encoding of recorded IR commands
+ *
+ * @see ir_codec.h
+ * */
+#include "ir_codec.h"
+
+#define LOG_TAG "ircodec"
+
+/** @brief Maximum count of marks/spaces of a command (2 per RMT item) */
+#define IR_CODEC_MAX_SEGMENTS 512
+
+/** @brief RC5 half bit [RMT ticks] */
+#define IR_CODEC_RC5_T IR_CODEC_US(889)
+/** @brief RC6 half bit [RMT ticks] */
+#define IR_CODEC_RC6_T IR_CODEC_US(444)
+
+/** @brief List of marks (> 0) & spaces (< 0) [RMT ticks]
+ * 
+ * Adjacent marks or spaces are merged, a leading space is dropped.
+ * */
+typedef struct ir_codec_segments {
+  /** @brief Durations, mark positive & space negative */
+  int32_t *seg;
+  /** @brief Count of durations */
+  uint16_t n;
+  /** @brief Size of seg */
+  uint16_t max;
+  /** @brief Set if seg was too small */
+  uint8_t overflow;
+} ir_codec_segments_t;
+
+/** @brief One known protocol */
+typedef struct ir_codec_proto {
+  /** @brief Name for logging */
+  const char *name;
+  /** @brief Length of the payload [bytes] */
+  uint8_t payloadlen;
+  /** @brief Decode recorded segments to the payload, ESP_FAIL if not matching */
+  esp_err_t (*match)(const ir_codec_segments_t *s, uint8_t *payload);
+  /** @brief Generate the segments of a payload */
+  esp_err_t (*generate)(const uint8_t *payload, ir_codec_segments_t *s);
+} ir_codec_proto_t;
+
+/** @brief Append a mark (> 0) or space (< 0) */
+static void irCodecAdd(ir_codec_segments_t *s, int32_t v)
+{
+  if(v == 0) return;
+  //the transmission starts with the first mark
+  if(s->n == 0 && v < 0) return;
+  if(s->n != 0 && (s->seg[s->n-1] > 0) == (v > 0))
+  {
+    s->seg[s->n-1] += v;
+    return;
+  }
+  if(s->n >= s->max)
+  {
+    s->overflow = 1;
+    return;
+  }
+  s->seg[s->n++] = v;
+}
+
+/** @brief Remove trailing spaces (no carrier until the end anyway) */
+static void irCodecFinish(ir_codec_segments_t *s)
+{
+  while(s->n != 0 && s->seg[s->n-1] < 0) s->n--;
+}
+
+/** @brief Check a recorded duration against a nominal one (IR_CODEC_TOLERANCE)
+ * @param d Recorded duration, a space must be negated before
+ * @param expected Nominal duration [RMT ticks] */
+static bool irCodecNear(int32_t d, uint32_t expected)
+{
+  if(d <= 0) return false;
+  return (uint32_t)abs(d - (int32_t)expected) <= expected / IR_CODEC_TOLERANCE;
+}
+
+/** @brief Get the count of bi-phase units of a duration
+ * @param d Duration (mark or space)
+ * @param unit Length of one unit [RMT ticks]
+ * @param max Maximum count of units
+ * @return Count of units, 0 if not a multiple of unit */
+static uint8_t irCodecUnits(int32_t d, uint32_t unit, uint8_t max)
+{
+  d = abs(d);
+  for(uint8_t u = 1; u<=max; u++)
+  {
+    if((uint32_t)abs(d - (int32_t)(u*unit)) <= unit/3) return u;
+  }
+  return 0;
+}
+
+/** @brief Convert bi-phase segments to a level per unit
+ * @param s Segments, starting at seg[first]
+ * @param first Index of the first segment
+ * @param unit Length of one unit [RMT ticks]
+ * @param maxunits Maximum count of units per segment
+ * @param lv Levels, lv[0]..lv[*nlv-1] are already set
+ * @param nlv Count of levels
+ * @param size Size of lv
+ * @return ESP_OK on success, ESP_FAIL if the timing does not match */
+static esp_err_t irCodecLevels(const ir_codec_segments_t *s, uint16_t first, \
+  uint32_t unit, uint8_t maxunits, uint8_t *lv, uint16_t *nlv, uint16_t size)
+{
+  for(uint16_t i = first; i<s->n; i++)
+  {
+    uint8_t u = irCodecUnits(s->seg[i],unit,maxunits);
+    if(u == 0) return ESP_FAIL;
+    while(u--)
+    {
+      if(*nlv >= size) return ESP_FAIL;
+      lv[(*nlv)++] = (s->seg[i] > 0) ? 1 : 0;
+    }
+  }
+  //a trailing space is not recorded
+  if(*nlv % 2)
+  {
+    if(*nlv >= size) return ESP_FAIL;
+    lv[(*nlv)++] = 0;
+  }
+  return ESP_OK;
+}
+
+/** @brief NEC: 9ms mark, 4.5ms space, 32 bits LSB first, stop mark */
+static esp_err_t irCodecMatchNEC(const ir_codec_segments_t *s, uint8_t *payload)
+{
+  uint32_t data = 0;
+  if(s->n != 67) return ESP_FAIL;
+  if(!irCodecNear(s->seg[0],IR_CODEC_US(9000)) || \
+    !irCodecNear(-s->seg[1],IR_CODEC_US(4500))) return ESP_FAIL;
+  for(uint8_t i = 0; i<32; i++)
+  {
+    if(!irCodecNear(s->seg[2+2*i],IR_CODEC_US(560))) return ESP_FAIL;
+    if(irCodecNear(-s->seg[3+2*i],IR_CODEC_US(1690))) data |= (1UL << i);
+    else if(!irCodecNear(-s->seg[3+2*i],IR_CODEC_US(560))) return ESP_FAIL;
+  }
+  if(!irCodecNear(s->seg[66],IR_CODEC_US(560))) return ESP_FAIL;
+  for(uint8_t i = 0; i<4; i++) payload[i] = (data >> (8*i)) & 0xFF;
+  return ESP_OK;
+}
+
+/** @brief Generate a NEC frame */
+static esp_err_t irCodecGenerateNEC(const uint8_t *payload, ir_codec_segments_t *s)
+{
+  irCodecAdd(s,IR_CODEC_US(9000));
+  irCodecAdd(s,-IR_CODEC_US(4500));
+  for(uint8_t i = 0; i<32; i++)
+  {
+    irCodecAdd(s,IR_CODEC_US(560));
+    if(payload[i/8] & (1 << (i%8))) irCodecAdd(s,-IR_CODEC_US(1690));
+    else irCodecAdd(s,-IR_CODEC_US(560));
+  }
+  irCodecAdd(s,IR_CODEC_US(560));
+  return ESP_OK;
+}
+
+/** @brief Sony SIRC: 2.4ms mark, bits LSB first (1.2ms/0.6ms mark, 0.6ms space) */
+static esp_err_t irCodecMatchSony(const ir_codec_segments_t *s, uint8_t *payload)
+{
+  uint32_t data = 0;
+  uint8_t bits = (s->n - 1) / 2;
+  if(s->n % 2 == 0 || (bits != 12 && bits != 15 && bits != 20)) return ESP_FAIL;
+  if(!irCodecNear(s->seg[0],IR_CODEC_US(2400)) || \
+    !irCodecNear(-s->seg[1],IR_CODEC_US(600))) return ESP_FAIL;
+  for(uint8_t i = 0; i<bits; i++)
+  {
+    if(irCodecNear(s->seg[2+2*i],IR_CODEC_US(1200))) data |= (1UL << i);
+    else if(!irCodecNear(s->seg[2+2*i],IR_CODEC_US(600))) return ESP_FAIL;
+    if(i != bits-1 && !irCodecNear(-s->seg[3+2*i],IR_CODEC_US(600))) return ESP_FAIL;
+  }
+  payload[0] = bits;
+  for(uint8_t i = 0; i<3; i++) payload[1+i] = (data >> (8*i)) & 0xFF;
+  return ESP_OK;
+}
+
+/** @brief Generate a Sony SIRC frame */
+static esp_err_t irCodecGenerateSony(const uint8_t *payload, ir_codec_segments_t *s)
+{
+  uint8_t bits = payload[0];
+  if(bits != 12 && bits != 15 && bits != 20) return ESP_FAIL;
+  irCodecAdd(s,IR_CODEC_US(2400));
+  irCodecAdd(s,-IR_CODEC_US(600));
+  for(uint8_t i = 0; i<bits; i++)
+  {
+    if(payload[1+i/8] & (1 << (i%8))) irCodecAdd(s,IR_CODEC_US(1200));
+    else irCodecAdd(s,IR_CODEC_US(600));
+    irCodecAdd(s,-IR_CODEC_US(600));
+  }
+  return ESP_OK;
+}
+
+/** @brief RC5: 14 bi-phase bits MSB first (1: space-mark, 0: mark-space) */
+static esp_err_t irCodecMatchRC5(const ir_codec_segments_t *s, uint8_t *payload)
+{
+  uint8_t lv[28];
+  uint16_t nlv = 0;
+  uint16_t data = 0;
+  
+  //first half of the first start bit is a space (not recorded)
+  lv[nlv++] = 0;
+  if(irCodecLevels(s,0,IR_CODEC_RC5_T,2,lv,&nlv,sizeof(lv)) != ESP_OK) return ESP_FAIL;
+  if(nlv != 28) return ESP_FAIL;
+  for(uint8_t i = 0; i<14; i++)
+  {
+    if(lv[2*i] == lv[2*i+1]) return ESP_FAIL;
+    data = (data << 1) | lv[2*i+1];
+  }
+  //first start bit is always 1
+  if((data & (1 << 13)) == 0) return ESP_FAIL;
+  payload[0] = data & 0xFF;
+  payload[1] = data >> 8;
+  return ESP_OK;
+}
+
+/** @brief Generate a RC5 frame */
+static esp_err_t irCodecGenerateRC5(const uint8_t *payload, ir_codec_segments_t *s)
+{
+  uint16_t data = payload[0] | (payload[1] << 8);
+  for(int8_t i = 13; i>=0; i--)
+  {
+    int32_t half = (data & (1 << i)) ? IR_CODEC_RC5_T : -IR_CODEC_RC5_T;
+    irCodecAdd(s,-half);
+    irCodecAdd(s,half);
+  }
+  return ESP_OK;
+}
+
+/** @brief RC6: 2.67ms mark, 0.89ms space, start bit, 3 mode bits, double length
+ * toggle bit & 8-32 data bits, MSB first (1: mark-space, 0: space-mark) */
+static esp_err_t irCodecMatchRC6(const ir_codec_segments_t *s, uint8_t *payload)
+{
+  uint8_t lv[12+64];
+  uint16_t nlv = 0;
+  uint32_t data = 0;
+  uint8_t mode = 0;
+  
+  if(s->n < 4) return ESP_FAIL;
+  if(!irCodecNear(s->seg[0],6*IR_CODEC_RC6_T) || \
+    !irCodecNear(-s->seg[1],2*IR_CODEC_RC6_T)) return ESP_FAIL;
+  if(irCodecLevels(s,2,IR_CODEC_RC6_T,3,lv,&nlv,sizeof(lv)) != ESP_OK) return ESP_FAIL;
+  if(nlv < 12+16) return ESP_FAIL;
+  
+  //start bit (1), mode bits
+  if(lv[0] != 1 || lv[1] != 0) return ESP_FAIL;
+  for(uint8_t i = 1; i<4; i++)
+  {
+    if(lv[2*i] == lv[2*i+1]) return ESP_FAIL;
+    mode = (mode << 1) | lv[2*i];
+  }
+  //toggle bit: 2 units per half
+  if(lv[8] != lv[9] || lv[10] != lv[11] || lv[8] == lv[10]) return ESP_FAIL;
+  uint8_t bits = (nlv - 12) / 2;
+  for(uint8_t i = 0; i<bits; i++)
+  {
+    if(lv[12+2*i] == lv[12+2*i+1]) return ESP_FAIL;
+    data = (data << 1) | lv[12+2*i];
+  }
+  payload[0] = mode | (lv[8] << 3);
+  payload[1] = bits;
+  for(uint8_t i = 0; i<4; i++) payload[2+i] = (data >> (8*i)) & 0xFF;
+  return ESP_OK;
+}
+
+/** @brief Generate a RC6 frame */
+static esp_err_t irCodecGenerateRC6(const uint8_t *payload, ir_codec_segments_t *s)
+{
+  uint8_t bits = payload[1];
+  uint32_t data = 0;
+  if(bits < 8 || bits > 32) return ESP_FAIL;
+  for(uint8_t i = 0; i<4; i++) data |= (uint32_t)payload[2+i] << (8*i);
+  
+  irCodecAdd(s,6*IR_CODEC_RC6_T);
+  irCodecAdd(s,-2*IR_CODEC_RC6_T);
+  //start bit & mode bits
+  uint8_t header = 0x08 | (payload[0] & 0x07);
+  for(int8_t i = 3; i>=0; i--)
+  {
+    int32_t half = (header & (1 << i)) ? IR_CODEC_RC6_T : -IR_CODEC_RC6_T;
+    irCodecAdd(s,half);
+    irCodecAdd(s,-half);
+  }
+  //toggle bit
+  int32_t half = (payload[0] & 0x08) ? 2*IR_CODEC_RC6_T : -2*IR_CODEC_RC6_T;
+  irCodecAdd(s,half);
+  irCodecAdd(s,-half);
+  for(int8_t i = bits-1; i>=0; i--)
+  {
+    half = (data & (1UL << i)) ? IR_CODEC_RC6_T : -IR_CODEC_RC6_T;
+    irCodecAdd(s,half);
+    irCodecAdd(s,-half);
+  }
+  return ESP_OK;
+}
+
+/** @brief Known protocols, indexed by ir_codec_protocol_t - IR_CODEC_NEC */
+static const ir_codec_proto_t irCodecProtocols[] = {
+  {"NEC", 4, irCodecMatchNEC, irCodecGenerateNEC},
+  {"Sony", 4, irCodecMatchSony, irCodecGenerateSony},
+  {"RC5", 2, irCodecMatchRC5, irCodecGenerateRC5},
+  {"RC6", 6, irCodecMatchRC6, irCodecGenerateRC6},
+};
+
+/** @brief Check if generated segments match the recorded ones (IR_CODEC_TOLERANCE) */
+static bool irCodecVerify(const ir_codec_segments_t *recorded, const ir_codec_segments_t *generated)
+{
+  if(recorded->n != generated->n || generated->overflow) return false;
+  for(uint16_t i = 0; i<recorded->n; i++)
+  {
+    if((recorded->seg[i] > 0) != (generated->seg[i] > 0)) return false;
+    if(!irCodecNear(abs(recorded->seg[i]),abs(generated->seg[i]))) return false;
+  }
+  return true;
+}
+
+/** @brief Encode segments as quantised durations with run-length encoded pairs
+ * @param s Segments
+ * @param out Buffer, minimum IR_CODEC_MAX_LENGTH(s->n/2)
+ * @param max Size of out
+ * @param len Length of the encoded command
+ * @return ESP_OK on success, ESP_FAIL if not possible (too many durations, too long) */
+static esp_err_t irCodecEncodeRLE(const ir_codec_segments_t *s, uint8_t *out, uint16_t max, uint16_t *len)
+{
+  uint32_t first[IR_CODEC_RLE_SYMBOLS];
+  uint32_t sum[IR_CODEC_RLE_SYMBOLS];
+  uint16_t members[IR_CODEC_RLE_SYMBOLS];
+  uint8_t k = 0;
+  uint16_t pos;
+  
+  uint8_t *sym = malloc(s->n);
+  if(sym == NULL) return ESP_FAIL;
+  
+  //quantise: each duration is assigned to the first similar one
+  for(uint16_t i = 0; i<s->n; i++)
+  {
+    uint32_t d = abs(s->seg[i]);
+    uint8_t c;
+    for(c = 0; c<k; c++)
+    {
+      if((uint32_t)abs((int32_t)d - (int32_t)first[c]) <= first[c]/8 + IR_CODEC_QUANTUM) break;
+    }
+    if(c == k)
+    {
+      if(k == IR_CODEC_RLE_SYMBOLS || d > UINT16_MAX)
+      {
+        free(sym);
+        return ESP_FAIL;
+      }
+      first[k] = d;
+      sum[k] = 0;
+      members[k] = 0;
+      k++;
+    }
+    sum[c] += d;
+    members[c]++;
+    sym[i] = c;
+  }
+  
+  //header & table (mean of each duration)
+  if(max < 4 + 2*k)
+  {
+    free(sym);
+    return ESP_FAIL;
+  }
+  out[0] = IR_CODEC_RLE;
+  out[1] = s->n & 0xFF;
+  out[2] = s->n >> 8;
+  out[3] = k;
+  pos = 4;
+  for(uint8_t c = 0; c<k; c++)
+  {
+    uint16_t mean = (sum[c] + members[c]/2) / members[c];
+    out[pos++] = mean & 0xFF;
+    out[pos++] = mean >> 8;
+  }
+  
+  //mark/space pairs, repeated pairs as runs
+  uint16_t prev = 0xFFFF;
+  uint8_t run = 0;
+  for(uint16_t i = 0; i<s->n; i += 2)
+  {
+    uint8_t pair = (sym[i] << 4) | ((i+1 < s->n) ? sym[i+1] : 0);
+    if(pair == prev && run < 16)
+    {
+      run++;
+      if(run == 1)
+      {
+        if(pos >= max) break;
+        pos++;
+      }
+      out[pos-1] = 0xF0 | (run-1);
+      continue;
+    }
+    if(pos >= max) break;
+    out[pos++] = pair;
+    prev = pair;
+    run = 0;
+  }
+  free(sym);
+  if(pos >= max) return ESP_FAIL;
+  *len = pos;
+  return ESP_OK;
+}
+
+/** @brief Decode run-length encoded pairs to segments */
+static esp_err_t irCodecDecodeRLE(const uint8_t *in, uint16_t len, ir_codec_segments_t *s)
+{
+  uint16_t table[IR_CODEC_RLE_SYMBOLS];
+  if(len < 4) return ESP_FAIL;
+  uint16_t n = in[1] | (in[2] << 8);
+  uint8_t k = in[3];
+  uint16_t pos = 4;
+  uint8_t prev = 0xFF;
+  uint16_t done = 0;
+  
+  if(k > IR_CODEC_RLE_SYMBOLS || n > s->max || len < pos + 2*k) return ESP_FAIL;
+  for(uint8_t c = 0; c<k; c++, pos += 2)
+  {
+    table[c] = in[pos] | (in[pos+1] << 8);
+    if(table[c] == 0) return ESP_FAIL;
+  }
+  
+  while(done < n)
+  {
+    if(pos >= len) return ESP_FAIL;
+    uint8_t b = in[pos++];
+    uint8_t repeat = 1;
+    if((b >> 4) == 0xF)
+    {
+      if(prev == 0xFF) return ESP_FAIL;
+      repeat = (b & 0x0F) + 1;
+      b = prev;
+    }
+    if((b >> 4) >= k || (b & 0x0F) >= k) return ESP_FAIL;
+    while(repeat-- && done < n)
+    {
+      irCodecAdd(s,table[b >> 4]);
+      done++;
+      if(done < n)
+      {
+        irCodecAdd(s,-(int32_t)table[b & 0x0F]);
+        done++;
+      }
+    }
+    prev = b;
+  }
+  return ESP_OK;
+}
+
+/** @brief Convert segments to RMT items (mark: level 1), ending with a 0 duration */
+static esp_err_t irCodecItems(const ir_codec_segments_t *s, rmt_item32_t **items, uint16_t *count)
+{
+  //durations are 15 bits, longer ones are split
+  uint16_t halves = 0;
+  for(uint16_t i = 0; i<s->n; i++) halves += (abs(s->seg[i]) + 32766) / 32767;
+  uint16_t c = halves/2 + 1;
+  rmt_item32_t *it = calloc(c,sizeof(rmt_item32_t));
+  if(it == NULL) return ESP_FAIL;
+  
+  uint16_t h = 0;
+  for(uint16_t i = 0; i<s->n; i++)
+  {
+    uint32_t d = abs(s->seg[i]);
+    uint8_t level = (s->seg[i] > 0) ? 1 : 0;
+    while(d != 0)
+    {
+      uint16_t part = (d > 32767) ? 32767 : d;
+      if(h % 2 == 0)
+      {
+        it[h/2].duration0 = part;
+        it[h/2].level0 = level;
+      } else {
+        it[h/2].duration1 = part;
+        it[h/2].level1 = level;
+      }
+      d -= part;
+      h++;
+    }
+  }
+  *items = it;
+  *count = c;
+  return ESP_OK;
+}
+
+/** @brief Encode a recorded IR command
+ * 
+ * @param items Recorded RMT items (mark: level 1)
+ * @param count Count of items
+ * @param out Buffer for the encoded command, minimum IR_CODEC_MAX_LENGTH(count)
+ * @param len Length of the encoded command [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid parameters, no memory)
+ * */
+esp_err_t irCodecEncode(const rmt_item32_t *items, uint16_t count, uint8_t *out, uint16_t *len)
+{
+  uint8_t payload[8];
+  if(items == NULL || out == NULL || len == NULL || count == 0) return ESP_FAIL;
+  
+  ir_codec_segments_t rec = {NULL, 0, 2*count, 0};
+  ir_codec_segments_t gen = {NULL, 0, IR_CODEC_MAX_SEGMENTS, 0};
+  rec.seg = malloc(rec.max * sizeof(int32_t));
+  gen.seg = malloc(gen.max * sizeof(int32_t));
+  if(rec.seg == NULL || gen.seg == NULL)
+  {
+    free(rec.seg);
+    free(gen.seg);
+    return ESP_FAIL;
+  }
+  
+  //flatten the items, a zero duration ends the command
+  for(uint16_t i = 0; i<count; i++)
+  {
+    if(items[i].duration0 == 0) break;
+    irCodecAdd(&rec,items[i].level0 ? items[i].duration0 : -(int32_t)items[i].duration0);
+    if(items[i].duration1 == 0) break;
+    irCodecAdd(&rec,items[i].level1 ? items[i].duration1 : -(int32_t)items[i].duration1);
+  }
+  irCodecFinish(&rec);
+  if(rec.n == 0)
+  {
+    free(rec.seg);
+    free(gen.seg);
+    return ESP_FAIL;
+  }
+  
+  //known protocol: only if the generated frame matches the recording
+  for(uint8_t p = 0; p<sizeof(irCodecProtocols)/sizeof(irCodecProtocols[0]); p++)
+  {
+    const ir_codec_proto_t *proto = &irCodecProtocols[p];
+    if(proto->match(&rec,payload) != ESP_OK) continue;
+    gen.n = 0;
+    gen.overflow = 0;
+    if(proto->generate(payload,&gen) != ESP_OK) continue;
+    irCodecFinish(&gen);
+    if(!irCodecVerify(&rec,&gen)) continue;
+    out[0] = IR_CODEC_NEC + p;
+    memcpy(&out[1],payload,proto->payloadlen);
+    *len = 1 + proto->payloadlen;
+    free(rec.seg);
+    free(gen.seg);
+    return ESP_OK;
+  }
+  
+  //quantised durations, if smaller than the items
+  esp_err_t ret = irCodecEncodeRLE(&rec,out,IR_CODEC_MAX_LENGTH(count),len);
+  free(rec.seg);
+  free(gen.seg);
+  if(ret == ESP_OK) return ESP_OK;
+  
+  //unchanged items
+  out[0] = IR_CODEC_RAW;
+  out[1] = count & 0xFF;
+  out[2] = count >> 8;
+  memcpy(&out[3],items,sizeof(rmt_item32_t)*count);
+  *len = IR_CODEC_MAX_LENGTH(count);
+  return ESP_OK;
+}
+
+/** @brief Decode an IR command to RMT items
+ * 
+ * @param in Encoded command
+ * @param len Length of the encoded command [bytes]
+ * @param items Decoded RMT items, allocated by this function (free after use)
+ * @param count Count of decoded items
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid data, no memory)
+ * */
+esp_err_t irCodecDecode(const uint8_t *in, uint16_t len, rmt_item32_t **items, uint16_t *count)
+{
+  esp_err_t ret = ESP_FAIL;
+  if(in == NULL || items == NULL || count == NULL || len == 0) return ESP_FAIL;
+  
+  if(in[0] == IR_CODEC_RAW)
+  {
+    if(len < 3) return ESP_FAIL;
+    uint16_t c = in[1] | (in[2] << 8);
+    if(c == 0 || len != IR_CODEC_MAX_LENGTH(c)) return ESP_FAIL;
+    *items = malloc(sizeof(rmt_item32_t)*c);
+    if(*items == NULL) return ESP_FAIL;
+    memcpy(*items,&in[3],sizeof(rmt_item32_t)*c);
+    *count = c;
+    return ESP_OK;
+  }
+  
+  ir_codec_segments_t s = {NULL, 0, IR_CODEC_MAX_SEGMENTS, 0};
+  s.seg = malloc(s.max * sizeof(int32_t));
+  if(s.seg == NULL) return ESP_FAIL;
+  
+  if(in[0] == IR_CODEC_RLE)
+  {
+    ret = irCodecDecodeRLE(in,len,&s);
+  } else if(in[0] < IR_CODEC_MAX) {
+    const ir_codec_proto_t *proto = &irCodecProtocols[in[0] - IR_CODEC_NEC];
+    if(len == 1 + proto->payloadlen) ret = proto->generate(&in[1],&s);
+  }
+  irCodecFinish(&s);
+  if(ret == ESP_OK && s.n != 0 && s.overflow == 0) ret = irCodecItems(&s,items,count);
+  else ret = ESP_FAIL;
+  free(s.seg);
+  
+  if(ret != ESP_OK) ESP_LOGE(LOG_TAG,"Invalid IR command (%s, %u bytes)",irCodecName(in[0]),len);
+  return ret;
+}
+
+/** @brief Get the name of an encoding (e.g., for logging)
+ * @param id First byte of an encoded command
+ * @return Name, "invalid" for unknown ids
+ * */
+const char *irCodecName(uint8_t id)
+{
+  if(id == IR_CODEC_RAW) return "raw";
+  if(id == IR_CODEC_RLE) return "RLE";
+  if(id < IR_CODEC_MAX) return irCodecProtocols[id - IR_CODEC_NEC].name;
+  return "invalid";
+}
@@ -0,0 +1,117 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Compact encoding of recorded IR commands
+ *
+ * A recorded IR command is a list of RMT items (4 bytes each, up to
+ * TASK_HAL_IR_RECV_MAXIMUM_EDGES). This codec stores it as:
+ * * a protocol id & a few bytes, if the command is a single frame of a
+ *   known protocol (NEC, Sony SIRC, RC5, RC6). On sending, the frame is
+ *   generated with the nominal timing of the protocol.
+ * * a table of quantised durations & one byte per mark/space pair
+ *   (repeated pairs are run-length encoded) for any other command.
+ * * the RMT items unchanged, if none of the above is possible or smaller.
+ *
+ * A protocol is only used if the generated frame matches each recorded
+ * duration within IR_CODEC_TOLERANCE, otherwise the next encoding is tried.
+ *
+ * Layout of an encoded command (multi-byte values little endian):
+ * * IR_CODEC_RAW: id, count (uint16_t), count x rmt_item32_t
+ * * IR_CODEC_RLE: id, segments (uint16_t), table size k, k x duration
+ *   (uint16_t, RMT ticks), pairs: mark index << 4 | space index or
+ *   0xF0 | (n-1) to repeat the previous pair n times
+ * * protocols: id, payload (see ir_codec_protocol_t)
+ *
+ * @note Decoding is done on loading a command into the IR cache.
+ * @see irCodecEncode
+ * @see irCodecDecode
+ * */
+#ifndef _IR_CODEC_H_
+#define _IR_CODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include "driver/rmt.h"
+
+/** @brief RMT ticks per 10us, must match RMT_CLK_DIV in hal_io.c (80MHz / 100) */
+#define IR_CODEC_TICKS_PER_10US 8
+
+/** @brief Convert a duration in [us] to RMT ticks */
+#define IR_CODEC_US(us) (((us) * IR_CODEC_TICKS_PER_10US) / 10)
+
+/** @brief Allowed deviation of a recorded duration from the nominal one [1/x] (25%) */
+#define IR_CODEC_TOLERANCE 4
+
+/** @brief Quantisation step of RLE durations [RMT ticks] */
+#define IR_CODEC_QUANTUM IR_CODEC_US(20)
+
+/** @brief Maximum count of distinct durations of an RLE encoded command */
+#define IR_CODEC_RLE_SYMBOLS 15
+
+/** @brief Maximum length of an encoded command of count RMT items [bytes] */
+#define IR_CODEC_MAX_LENGTH(count) (3 + sizeof(rmt_item32_t) * (count))
+
+/** @brief Encodings of an IR command, first byte of an encoded command */
+typedef enum {
+  /** @brief Unchanged RMT items */
+  IR_CODEC_RAW = 0,
+  /** @brief Quantised durations, run-length encoded */
+  IR_CODEC_RLE,
+  /** @brief NEC, payload: 32 bits (address, ~address, command, ~command) */
+  IR_CODEC_NEC,
+  /** @brief Sony SIRC, payload: bit count (12, 15, 20) & 3 bytes data */
+  IR_CODEC_SONY,
+  /** @brief Philips RC5, payload: 14 bits (start, field, toggle, address, command) */
+  IR_CODEC_RC5,
+  /** @brief Philips RC6, payload: mode | toggle << 3, bit count (8-32) & 4 bytes data */
+  IR_CODEC_RC6,
+  IR_CODEC_MAX
+} ir_codec_protocol_t;
+
+/** @brief Encode a recorded IR command
+ * 
+ * @param items Recorded RMT items (mark: level 1)
+ * @param count Count of items
+ * @param out Buffer for the encoded command, minimum IR_CODEC_MAX_LENGTH(count)
+ * @param len Length of the encoded command [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid parameters, no memory)
+ * */
+esp_err_t irCodecEncode(const rmt_item32_t *items, uint16_t count, uint8_t *out, uint16_t *len);
+
+/** @brief Decode an IR command to RMT items
+ * 
+ * @param in Encoded command
+ * @param len Length of the encoded command [bytes]
+ * @param items Decoded RMT items, allocated by this function (free after use)
+ * @param count Count of decoded items
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid data, no memory)
+ * */
+esp_err_t irCodecDecode(const uint8_t *in, uint16_t len, rmt_item32_t **items, uint16_t *count);
+
+/** @brief Get the name of an encoding (e.g., for logging)
+ * @param id First byte of an encoded command
+ * @return Name, "invalid" for unknown ids
+ * */
+const char *irCodecName(uint8_t id);
+
+#endif /* _IR_CODEC_H_ */
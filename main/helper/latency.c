@@ -0,0 +1,161 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Input latency measurement
+ *
+ * @see latency.h
+ * */
+#include "latency.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "latency"
+
+/** @brief Histogram of one stage */
+typedef struct latencyHist {
+  /** @brief Count of durations per bucket */
+  uint32_t bucket[LATENCY_BUCKETS];
+  /** @brief Count of all durations */
+  uint32_t count;
+  /** @brief Maximum duration [us] */
+  uint32_t max;
+} latencyHist_t;
+
+/** @brief Histograms of all stages
+ * @see latencyLock */
+static latencyHist_t latencyHist[LATENCY_STAGE_MAX];
+
+/** @brief Spinlock for latencyHist, stages are recorded by different tasks */
+static portMUX_TYPE latencyLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Names of the stages, used for reporting */
+static const char *latencyNames[LATENCY_STAGE_MAX] = {"input","debounce","dispatch","usb","ble","total","slottext","slotimage"};
+
+/** @brief Get the histogram bucket for a duration
+ * @param us Duration [us]
+ * @return Bucket index (0 to LATENCY_BUCKETS-1) */
+static uint8_t latencyBucket(uint32_t us)
+{
+  if(us < 8) return us;
+  uint8_t msb = 31 - __builtin_clz(us);
+  uint32_t idx = 8 + (msb-3)*4 + ((us >> (msb-2)) & 0x03);
+  if(idx >= LATENCY_BUCKETS) idx = LATENCY_BUCKETS - 1;
+  return idx;
+}
+
+/** @brief Get the upper bound of a histogram bucket
+ * @param idx Bucket index
+ * @return Largest duration [us] counted in this bucket */
+static uint32_t latencyBucketMax(uint8_t idx)
+{
+  if(idx < 8) return idx;
+  uint8_t msb = (idx-8)/4 + 3;
+  uint32_t low = (4 + ((idx-8) & 0x03)) << (msb-2);
+  return low + (1 << (msb-2)) - 1;
+}
+
+/** @brief Calculate one percentile of a histogram
+ * @param h Histogram (copy, not locked)
+ * @param p Percentile (1-100)
+ * @return Upper bound of the bucket containing this percentile, limited to h->max */
+static uint32_t latencyPercentile(latencyHist_t *h, uint8_t p)
+{
+  uint32_t target = ((uint64_t)h->count * p + 99) / 100;
+  uint32_t sum = 0;
+  if(h->count == 0) return 0;
+  if(target == 0) target = 1;
+  for(uint8_t i = 0; i<LATENCY_BUCKETS; i++)
+  {
+    sum += h->bucket[i];
+    if(sum >= target)
+    {
+      uint32_t v = latencyBucketMax(i);
+      return (v > h->max) ? h->max : v;
+    }
+  }
+  return h->max;
+}
+
+/** @brief Record the duration of one stage
+ *
+ * The duration is the time between the given timestamp and now.
+ * Nothing is recorded if the timestamp is 0.
+ *
+ * @param stage Measured stage
+ * @param since Timestamp of the beginning of this stage (see latencyNow)
+ * @return Timestamp of now, can be used as beginning of the next stage
+ * */
+uint32_t latencyRecord(latency_stage_t stage, uint32_t since)
+{
+  uint32_t now = latencyNow();
+  if(stage >= LATENCY_STAGE_MAX || since == 0) return now;
+  //unsigned difference, valid across a wrap of the 32bit timestamp
+  uint32_t us = now - since;
+  uint8_t idx = latencyBucket(us);
+
+  portENTER_CRITICAL(&latencyLock);
+  latencyHist[stage].bucket[idx]++;
+  latencyHist[stage].count++;
+  if(us > latencyHist[stage].max) latencyHist[stage].max = us;
+  portEXIT_CRITICAL(&latencyLock);
+  return now;
+}
+
+/** @brief Get the statistics of one stage
+ * @param stage Stage
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t latencyGetStats(latency_stage_t stage, latency_stats_t *stats)
+{
+  //static: avoids ~400 bytes on the caller's stack (only used by AT LT)
+  static latencyHist_t h;
+  if(stage >= LATENCY_STAGE_MAX || stats == NULL) return ESP_FAIL;
+
+  //copy the histogram, percentiles are calculated without the lock held
+  portENTER_CRITICAL(&latencyLock);
+  memcpy(&h,&latencyHist[stage],sizeof(latencyHist_t));
+  portEXIT_CRITICAL(&latencyLock);
+
+  stats->count = h.count;
+  stats->max = h.max;
+  stats->p50 = latencyPercentile(&h,50);
+  stats->p95 = latencyPercentile(&h,95);
+  stats->p99 = latencyPercentile(&h,99);
+  return ESP_OK;
+}
+
+/** @brief Get the name of one stage, used for reporting
+ * @param stage Stage
+ * @return Name of this stage ("?" for an invalid stage)
+ * */
+const char *latencyGetName(latency_stage_t stage)
+{
+  if(stage >= LATENCY_STAGE_MAX) return "?";
+  return latencyNames[stage];
+}
+
+/** @brief Clear all histograms */
+void latencyReset(void)
+{
+  portENTER_CRITICAL(&latencyLock);
+  memset(latencyHist,0,sizeof(latencyHist));
+  portEXIT_CRITICAL(&latencyLock);
+  ESP_LOGI(LOG_TAG,"Histograms cleared");
+}
@@ -0,0 +1,128 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Input latency measurement
+ *
+ * Each input event is stamped at its origin (GPIO ISR or ADC sample,
+ * see raw_action_t.timestamp). This timestamp is carried through the
+ * debouncer, the VB event loop (vb_event_data_t) and the HID queues
+ * (hid_report_t.timestamp) until the report is sent via USB or BLE.
+ * The HID queues carry timestamps only if HID_REPORT_LATENCY is set,
+ * otherwise the usb/ble/total stages are not recorded.
+ *
+ * Each stage records its duration in a histogram (latency_stage_t),
+ * percentiles are calculated on request (AT LT).
+ *
+ * Histogram buckets are logarithmic: values below 8us are exact,
+ * above each power of 2 is split into 4 buckets. Percentiles are
+ * reported as upper bound of the bucket, which is at most 25% above
+ * the real value. The maximum is exact.
+ *
+ * @note All timestamps are the lower 32bit of esp_timer_get_time [us],
+ * 0 is used for "no timestamp". Durations are valid up to ~71min.
+ * @see latencyRecord
+ * @see latencyGetStats
+ * */
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/** @brief Count of histogram buckets per stage
+ *
+ * 8 linear buckets (0-7us) and 4 buckets per power of 2 up to 2^24us (~16s).
+ * Longer durations are counted in the last bucket. */
+#define LATENCY_BUCKETS (8 + 21*4)
+
+/** @brief Measured stages of one input event */
+typedef enum {
+  /** @brief Origin (ISR/ADC sample) until received by the debouncer */
+  LATENCY_STAGE_INPUT = 0,
+  /** @brief Received by the debouncer until posted to the VB event loop
+   * (contains the debounce time) */
+  LATENCY_STAGE_DEBOUNCE,
+  /** @brief Posted to the VB event loop until queued by handler_hid */
+  LATENCY_STAGE_DISPATCH,
+  /** @brief Queued to hid_usb until sent to the USB chip */
+  LATENCY_STAGE_USB,
+  /** @brief Queued to hid_ble until sent to the BLE stack */
+  LATENCY_STAGE_BLE,
+  /** @brief Origin until sent (USB or BLE) */
+  LATENCY_STAGE_TOTAL,
+  /** @brief Slot switch, loaded from the AT text (config_switcher, not an input event) */
+  LATENCY_STAGE_SLOT_TEXT,
+  /** @brief Slot switch, installed from the binary image (config_switcher, not an input event) */
+  LATENCY_STAGE_SLOT_IMAGE,
+  LATENCY_STAGE_MAX
+} latency_stage_t;
+
+/** @brief Statistics of one stage, all durations in [us]
+ * @see latencyGetStats */
+typedef struct latency_stats {
+  /** @brief Count of recorded durations */
+  uint32_t count;
+  /** @brief Percentiles 50/95/99 */
+  uint32_t p50, p95, p99;
+  /** @brief Maximum duration */
+  uint32_t max;
+} latency_stats_t;
+
+/** @brief Get a timestamp for latency measurement
+ *
+ * Can be used in ISRs.
+ * @return Lower 32bit of esp_timer_get_time [us], never 0 */
+static inline uint32_t latencyNow(void)
+{
+  uint32_t t = (uint32_t)esp_timer_get_time();
+  return (t == 0) ? 1 : t;
+}
+
+/** @brief Record the duration of one stage
+ *
+ * The duration is the time between the given timestamp and now.
+ * Nothing is recorded if the timestamp is 0.
+ *
+ * @param stage Measured stage
+ * @param since Timestamp of the beginning of this stage (see latencyNow)
+ * @return Timestamp of now, can be used as beginning of the next stage
+ * */
+uint32_t latencyRecord(latency_stage_t stage, uint32_t since);
+
+/** @brief Get the statistics of one stage
+ * @param stage Stage
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t latencyGetStats(latency_stage_t stage, latency_stats_t *stats);
+
+/** @brief Get the name of one stage, used for reporting
+ * @param stage Stage
+ * @return Name of this stage ("?" for an invalid stage)
+ * */
+const char *latencyGetName(latency_stage_t stage);
+
+/** @brief Clear all histograms */
+void latencyReset(void);
+
+#endif /* _LATENCY_H_ */
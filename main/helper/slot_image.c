@@ -0,0 +1,337 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Precompiled binary slot images
+ *
+ * @see slot_image.h
+ * */
+#include "slot_image.h"
+#include "../config_switcher.h"
+#include "handler_hid.h"
+#include "handler_vb.h"
+#include "task_debouncer.h"
+
+#define LOG_TAG "slotimage"
+
+/** @brief Checksum (FNV-1a, 32bit) of a buffer
+ * @param data Buffer
+ * @param len Length [bytes]
+ * @return Checksum */
+static uint32_t slotImageChecksum(const uint8_t *data, uint32_t len)
+{
+  uint32_t hash = 0x811C9DC5;
+  for(uint32_t i = 0; i<len; i++)
+  {
+    hash ^= data[i];
+    hash *= 0x01000193;
+  }
+  return hash;
+}
+
+/** @brief Length of a string in an image, incl. \0 (0 for NULL) */
+static uint16_t slotImageStrlen(const char *s)
+{
+  if(s == NULL) return 0;
+  return strnlen(s,ATCMD_LENGTH) + 1;
+}
+
+/** @brief Append a string to an image (incl. \0, nothing for NULL)
+ * @return Position after this string */
+static uint8_t *slotImagePutString(uint8_t *pos, const char *s, uint16_t len)
+{
+  if(len == 0) return pos;
+  memcpy(pos,s,len-1);
+  pos[len-1] = 0;
+  return pos + len;
+}
+
+/** @brief Build the image of the current slot
+ *
+ * Contains the current config (configGetCurrent) and the command chains
+ * of handler_hid & handler_vb. Both chains are locked while the image is
+ * built (AT commands might still be processed by task_commands).
+ * @note Call with a storage transaction held.
+ * @param slotname Name of this slot, saved in generalConfig_t.slotName
+ * @param image Pointer to the image buffer, allocated here. Free it after use.
+ * @param len Length of the image [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (no memory)
+ * */
+esp_err_t slotImageBuild(const char *slotname, uint8_t **image, uint32_t *len)
+{
+  slot_image_header_t header = {SLOT_IMAGE_MAGIC, SLOT_IMAGE_VERSION, sizeof(generalConfig_t), 0, 0, 0, 0};
+  generalConfig_t *cfg = configGetCurrent();
+  
+  if(image == NULL || len == NULL || cfg == NULL) return ESP_FAIL;
+  
+  //0.) lock both chains, they must not change between sizing & filling
+  if(handler_hid_lockCmdChain() != ESP_OK) return ESP_FAIL;
+  if(handler_vb_lockCmdChain() != ESP_OK)
+  {
+    handler_hid_unlockCmdChain();
+    return ESP_FAIL;
+  }
+  
+  //1.) get the size of the image
+  uint32_t size = sizeof(slot_image_header_t) + sizeof(generalConfig_t);
+  for(hid_cmd_t *h = handler_hid_getCmdChain(); h != NULL; h = h->next)
+  {
+    size += sizeof(slot_image_hid_t) + slotImageStrlen(h->atoriginal);
+    header.hidcount++;
+  }
+  for(vb_cmd_t *v = handler_vb_getCmdChain(); v != NULL; v = v->next)
+  {
+    size += sizeof(slot_image_vb_t) + slotImageStrlen(v->atoriginal) + slotImageStrlen(v->cmdparam);
+    header.vbcount++;
+  }
+  
+  uint8_t *buf = malloc(size);
+  if(buf == NULL)
+  {
+    handler_vb_unlockCmdChain();
+    handler_hid_unlockCmdChain();
+    ESP_LOGE(LOG_TAG,"No memory for slot image (%d bytes)",size);
+    return ESP_FAIL;
+  }
+  
+  //2.) config, with slot name & version of this image
+  uint8_t *pos = buf + sizeof(slot_image_header_t);
+  generalConfig_t *imgcfg = (generalConfig_t *)pos;
+  memcpy(imgcfg,cfg,sizeof(generalConfig_t));
+  imgcfg->slotversion = SLOT_IMAGE_VERSION;
+  if(slotname != NULL)
+  {
+    strncpy(imgcfg->slotName,slotname,SLOTNAME_LENGTH-1);
+    imgcfg->slotName[SLOTNAME_LENGTH-1] = 0;
+  }
+  pos += sizeof(generalConfig_t);
+  
+  //3.) HID commands
+  for(hid_cmd_t *h = handler_hid_getCmdChain(); h != NULL; h = h->next)
+  {
+    slot_image_hid_t rec = {h->vb, {h->cmd[0], h->cmd[1], h->cmd[2]}, slotImageStrlen(h->atoriginal)};
+    memcpy(pos,&rec,sizeof(slot_image_hid_t));
+    pos = slotImagePutString(pos + sizeof(slot_image_hid_t),h->atoriginal,rec.atlen);
+  }
+  
+  //4.) VB commands
+  for(vb_cmd_t *v = handler_vb_getCmdChain(); v != NULL; v = v->next)
+  {
+    slot_image_vb_t rec = {v->vb, v->cmd, slotImageStrlen(v->atoriginal), slotImageStrlen(v->cmdparam)};
+    memcpy(pos,&rec,sizeof(slot_image_vb_t));
+    pos = slotImagePutString(pos + sizeof(slot_image_vb_t),v->atoriginal,rec.atlen);
+    pos = slotImagePutString(pos,v->cmdparam,rec.paramlen);
+  }
+  handler_vb_unlockCmdChain();
+  handler_hid_unlockCmdChain();
+  
+  //5.) header, checksum over all data
+  header.length = size;
+  header.checksum = slotImageChecksum(buf + sizeof(slot_image_header_t),size - sizeof(slot_image_header_t));
+  memcpy(buf,&header,sizeof(slot_image_header_t));
+  
+  ESP_LOGI(LOG_TAG,"Built image: %d bytes, %d HID, %d VB cmds",size,header.hidcount,header.vbcount);
+  *image = buf;
+  *len = size;
+  return ESP_OK;
+}
+
+/** @brief Validate a slot image
+ * @param image Image buffer
+ * @param len Length of the image buffer [bytes]
+ * @return ESP_OK if the image can be installed, ESP_FAIL otherwise
+ * (damaged, other version or generalConfig_t layout)
+ * */
+esp_err_t slotImageCheck(const uint8_t *image, uint32_t len)
+{
+  slot_image_header_t header;
+  
+  if(image == NULL || len < sizeof(slot_image_header_t) + sizeof(generalConfig_t)) return ESP_FAIL;
+  memcpy(&header,image,sizeof(slot_image_header_t));
+  
+  if(header.magic != SLOT_IMAGE_MAGIC || header.length != len)
+  {
+    ESP_LOGE(LOG_TAG,"Invalid image header");
+    return ESP_FAIL;
+  }
+  if(header.version != SLOT_IMAGE_VERSION || header.cfgsize != sizeof(generalConfig_t))
+  {
+    ESP_LOGW(LOG_TAG,"Image version %d/%d, need %d/%d",header.version,header.cfgsize, \
+      SLOT_IMAGE_VERSION,sizeof(generalConfig_t));
+    return ESP_FAIL;
+  }
+  if(header.checksum != slotImageChecksum(image + sizeof(slot_image_header_t),len - sizeof(slot_image_header_t)))
+  {
+    ESP_LOGE(LOG_TAG,"Image checksum error");
+    return ESP_FAIL;
+  }
+  
+  //check if all records fit into the image
+  const uint8_t *pos = image + sizeof(slot_image_header_t) + sizeof(generalConfig_t);
+  const uint8_t *end = image + len;
+  for(uint16_t i = 0; i<header.hidcount; i++)
+  {
+    slot_image_hid_t rec;
+    if(pos + sizeof(slot_image_hid_t) > end) return ESP_FAIL;
+    memcpy(&rec,pos,sizeof(slot_image_hid_t));
+    pos += sizeof(slot_image_hid_t) + rec.atlen;
+    if(pos > end || (rec.vb & 0x7F) >= VB_MAX_ALL) return ESP_FAIL;
+  }
+  for(uint16_t i = 0; i<header.vbcount; i++)
+  {
+    slot_image_vb_t rec;
+    if(pos + sizeof(slot_image_vb_t) > end) return ESP_FAIL;
+    memcpy(&rec,pos,sizeof(slot_image_vb_t));
+    pos += sizeof(slot_image_vb_t) + rec.atlen + rec.paramlen;
+    if(pos > end || (rec.vb & 0x7F) >= VB_MAX_ALL) return ESP_FAIL;
+  }
+  if(pos != end) return ESP_FAIL;
+  return ESP_OK;
+}
+
+/** @brief Copy a string of an image to a new buffer
+ * @return New buffer, NULL if not used (len 0) or no memory */
+static char *slotImageGetString(const uint8_t *pos, uint16_t len)
+{
+  if(len == 0) return NULL;
+  char *s = malloc(len);
+  if(s == NULL) return NULL;
+  memcpy(s,pos,len);
+  s[len-1] = 0;
+  return s;
+}
+
+/** @brief Free a VB chain, which was not handed over to handler_vb */
+static void slotImageFreeVB(vb_cmd_t *chain)
+{
+  while(chain != NULL)
+  {
+    vb_cmd_t *next = chain->next;
+    if(chain->atoriginal != NULL) free(chain->atoriginal);
+    if(chain->cmdparam != NULL) free(chain->cmdparam);
+    free(chain);
+    chain = next;
+  }
+}
+
+/** @brief Install a slot image
+ *
+ * The image is validated (slotImageCheck), the config is copied into the
+ * current config and the command chains are replaced. Fields which are not
+ * part of a slot's AT text (e.g., debounce times, locale) keep their values.
+ * @param image Image buffer, can be freed after this call
+ * @param len Length of the image buffer [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (nothing is changed if the image is invalid)
+ * */
+esp_err_t slotImageInstall(const uint8_t *image, uint32_t len)
+{
+  slot_image_header_t header;
+  generalConfig_t *cfg = configGetCurrent();
+  hid_cmd_t *hid = NULL;
+  vb_cmd_t *vb = NULL;
+  vb_cmd_t **vblink = &vb;
+  esp_err_t ret = ESP_OK;
+  
+  if(cfg == NULL || slotImageCheck(image,len) != ESP_OK) return ESP_FAIL;
+  memcpy(&header,image,sizeof(slot_image_header_t));
+  const uint8_t *pos = image + sizeof(slot_image_header_t) + sizeof(generalConfig_t);
+  
+  //1.) HID chain, AT strings are used from the image (handler_hid copies everything)
+  if(header.hidcount != 0)
+  {
+    hid = calloc(header.hidcount,sizeof(hid_cmd_t));
+    if(hid == NULL) return ESP_FAIL;
+  }
+  for(uint16_t i = 0; i<header.hidcount; i++)
+  {
+    slot_image_hid_t rec;
+    memcpy(&rec,pos,sizeof(slot_image_hid_t));
+    pos += sizeof(slot_image_hid_t);
+    hid[i].vb = rec.vb;
+    memcpy(hid[i].cmd,rec.cmd,3);
+    hid[i].atoriginal = (rec.atlen != 0) ? (char *)pos : NULL;
+    hid[i].next = (i+1 < header.hidcount) ? &hid[i+1] : NULL;
+    pos += rec.atlen;
+  }
+  
+  //2.) VB chain, handler_vb takes the ownership of each element
+  for(uint16_t i = 0; i<header.vbcount; i++)
+  {
+    slot_image_vb_t rec;
+    memcpy(&rec,pos,sizeof(slot_image_vb_t));
+    pos += sizeof(slot_image_vb_t);
+    vb_cmd_t *new = calloc(1,sizeof(vb_cmd_t));
+    if(new == NULL) { ret = ESP_FAIL; break; }
+    *vblink = new;
+    vblink = &new->next;
+    new->vb = rec.vb;
+    new->cmd = rec.cmd;
+    new->atoriginal = slotImageGetString(pos,rec.atlen);
+    new->cmdparam = slotImageGetString(pos+rec.atlen,rec.paramlen);
+    if((rec.atlen != 0 && new->atoriginal == NULL) || (rec.paramlen != 0 && new->cmdparam == NULL))
+    {
+      ret = ESP_FAIL;
+      break;
+    }
+    pos += rec.atlen + rec.paramlen;
+  }
+  if(ret != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for VB cmds");
+    slotImageFreeVB(vb);
+    if(hid != NULL) free(hid);
+    return ESP_FAIL;
+  }
+  
+  //3.) config, settings which are not stored in a slot are kept
+  generalConfig_t *imgcfg = malloc(sizeof(generalConfig_t));
+  if(imgcfg == NULL)
+  {
+    slotImageFreeVB(vb);
+    if(hid != NULL) free(hid);
+    return ESP_FAIL;
+  }
+  memcpy(imgcfg,image + sizeof(slot_image_header_t),sizeof(generalConfig_t));
+  imgcfg->adc.reportraw = cfg->adc.reportraw;
+  imgcfg->locale = cfg->locale;
+  imgcfg->irtimeout = cfg->irtimeout;
+  imgcfg->button_learn = cfg->button_learn;
+  imgcfg->debounce_press = cfg->debounce_press;
+  imgcfg->debounce_release = cfg->debounce_release;
+  imgcfg->debounce_idle = cfg->debounce_idle;
+  memcpy(imgcfg->debounce_press_vb,cfg->debounce_press_vb,sizeof(cfg->debounce_press_vb));
+  memcpy(imgcfg->debounce_release_vb,cfg->debounce_release_vb,sizeof(cfg->debounce_release_vb));
+  memcpy(imgcfg->debounce_idle_vb,cfg->debounce_idle_vb,sizeof(cfg->debounce_idle_vb));
+  memcpy(cfg,imgcfg,sizeof(generalConfig_t));
+  free(imgcfg);
+  
+  //4.) replace both chains & compile the gestures
+  if(handler_hid_setCmdChain(hid) != ESP_OK) ret = ESP_FAIL;
+  if(hid != NULL) free(hid);
+  if(handler_vb_setCmdChain(vb) != ESP_OK)
+  {
+    slotImageFreeVB(vb);
+    ret = ESP_FAIL;
+  }
+  if(debouncerGesturesChanged() != ESP_OK) ret = ESP_FAIL;
+  
+  ESP_LOGI(LOG_TAG,"Installed image %s: %d bytes, %d HID, %d VB cmds",cfg->slotName, \
+    len,header.hidcount,header.vbcount);
+  return ret;
+}
@@ -0,0 +1,134 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Precompiled binary slot images
+ *
+ * Loading a slot from its AT text (xxx.set) sends each line to
+ * task_commands, where it is parsed again and the config & command
+ * chains are rebuilt command by command. To speed up slot switching,
+ * each slot is additionally compiled into a binary image (xxx.bin)
+ * when it is stored:
+ *
+ * * slot_image_header_t (magic, version, sizes, checksum)
+ * * generalConfig_t (slotversion is set to SLOT_IMAGE_VERSION)
+ * * HID commands: slot_image_hid_t, followed by the AT string
+ * * VB commands: slot_image_vb_t, followed by the AT string & parameter
+ *
+ * Loading an image is one read and a direct install (slotImageInstall).
+ * If an image is missing, damaged or built by a firmware with a different
+ * image version (or generalConfig_t layout), the AT text is loaded and
+ * the image is rebuilt afterwards. The AT text stays the export format
+ * (AT LA, web download).
+ *
+ * @warning Increment SLOT_IMAGE_VERSION on each change of generalConfig_t,
+ * hid_cmd_t or vb_cmd_t (the size check cannot detect all changes).
+ * @see slotImageBuild
+ * @see slotImageInstall
+ * */
+#ifndef _SLOT_IMAGE_H_
+#define _SLOT_IMAGE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include "common.h"
+
+/** @brief Magic of a slot image ("FMSI") */
+#define SLOT_IMAGE_MAGIC 0x49534D46
+
+/** @brief Version of the image format & generalConfig_t layout
+ * @see generalConfig_t.slotversion */
+#define SLOT_IMAGE_VERSION 1
+
+/** @brief Header of a slot image */
+typedef struct slot_image_header {
+  /** @brief SLOT_IMAGE_MAGIC */
+  uint32_t magic;
+  /** @brief SLOT_IMAGE_VERSION of the building firmware */
+  uint32_t version;
+  /** @brief sizeof(generalConfig_t) of the building firmware */
+  uint32_t cfgsize;
+  /** @brief Total length of the image, including this header [bytes] */
+  uint32_t length;
+  /** @brief Count of HID commands */
+  uint16_t hidcount;
+  /** @brief Count of VB commands */
+  uint16_t vbcount;
+  /** @brief Checksum (FNV-1a) of everything after this header */
+  uint32_t checksum;
+} slot_image_header_t;
+
+/** @brief One HID command in a slot image, followed by atlen bytes of AT string */
+typedef struct slot_image_hid {
+  /** @brief VB number & press flag, see hid_cmd_t.vb */
+  uint8_t vb;
+  /** @brief Command, see hid_cmd_t.cmd */
+  uint8_t cmd[3];
+  /** @brief Length of the AT string incl. \0, 0 if not used */
+  uint16_t atlen;
+} slot_image_hid_t;
+
+/** @brief One VB command in a slot image, followed by atlen bytes of
+ * AT string and paramlen bytes of parameter */
+typedef struct slot_image_vb {
+  /** @brief VB number & press flag, see vb_cmd_t.vb */
+  uint8_t vb;
+  /** @brief Type of command, see vb_cmd_t.cmd */
+  uint8_t cmd;
+  /** @brief Length of the AT string incl. \0, 0 if not used */
+  uint16_t atlen;
+  /** @brief Length of the parameter incl. \0, 0 if not used */
+  uint16_t paramlen;
+} slot_image_vb_t;
+
+/** @brief Build the image of the current slot
+ *
+ * Contains the current config (configGetCurrent) and the command chains
+ * of handler_hid & handler_vb.
+ * @note Call with a storage transaction held, the chains are modified
+ * by loading a slot only.
+ * @param slotname Name of this slot, saved in generalConfig_t.slotName
+ * @param image Pointer to the image buffer, allocated here. Free it after use.
+ * @param len Length of the image [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (no memory)
+ * */
+esp_err_t slotImageBuild(const char *slotname, uint8_t **image, uint32_t *len);
+
+/** @brief Validate a slot image
+ * @param image Image buffer
+ * @param len Length of the image buffer [bytes]
+ * @return ESP_OK if the image can be installed, ESP_FAIL otherwise
+ * (damaged, other version or generalConfig_t layout)
+ * */
+esp_err_t slotImageCheck(const uint8_t *image, uint32_t len);
+
+/** @brief Install a slot image
+ *
+ * The image is validated (slotImageCheck), the config is copied into the
+ * current config and the command chains are replaced. Fields which are not
+ * part of a slot's AT text (e.g., debounce times, locale) keep their values.
+ * @param image Image buffer, can be freed after this call
+ * @param len Length of the image buffer [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (nothing is changed if the image is invalid)
+ * */
+esp_err_t slotImageInstall(const uint8_t *image, uint32_t len);
+
+#endif /* _SLOT_IMAGE_H_ */
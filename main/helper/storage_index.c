@@ -0,0 +1,413 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - In-RAM name index of stored slots & IR commands
+ *
+ * @see storage_index.h
+ * */
+#include "storage_index.h"
+
+#define LOG_TAG "storageidx"
+
+/** @brief Empty hash bucket */
+#define STORAGE_INDEX_EMPTY 0xFF
+
+/** @brief One indexed table */
+typedef struct storage_index_table {
+  /** @brief Name of each number, NULL if not used */
+  char *names[STORAGE_INDEX_ENTRIES];
+  /** @brief Hash table, number of the name or STORAGE_INDEX_EMPTY */
+  uint8_t bucket[STORAGE_INDEX_BUCKETS];
+  /** @brief Bitmap of used numbers */
+  uint32_t used[(STORAGE_INDEX_ENTRIES+31)/32];
+  /** @brief Order: number at each position (0 to count-1) */
+  uint8_t order[STORAGE_INDEX_ENTRIES];
+  /** @brief Position of each number, STORAGE_INDEX_EMPTY if not used */
+  uint8_t position[STORAGE_INDEX_ENTRIES];
+  /** @brief Count of used numbers */
+  uint8_t count;
+} storage_index_table_t;
+
+/** @brief Header of a serialized index, followed by the entries
+ * (table, number, length of name & the name without \0) in the
+ * order of their positions */
+typedef struct storage_index_header {
+  /** @brief STORAGE_INDEX_MAGIC */
+  uint32_t magic;
+  /** @brief STORAGE_INDEX_VERSION */
+  uint32_t version;
+  /** @brief Total length, including this header [bytes] */
+  uint32_t length;
+  /** @brief Count of entries (all tables) */
+  uint32_t entries;
+} storage_index_header_t;
+
+/** @brief All tables, empty buckets are initialized on first use */
+static storage_index_table_t storageIndex[STORAGE_INDEX_MAX];
+
+/** @brief Set if the buckets are initialized */
+static uint8_t storageIndexReady = 0;
+
+/** @brief Hash (FNV-1a) of a name, index of the first bucket */
+static uint32_t storageIndexHash(const char *name)
+{
+  uint32_t hash = 0x811C9DC5;
+  while(*name != 0)
+  {
+    hash ^= (uint8_t)*name++;
+    hash *= 0x01000193;
+  }
+  return hash & (STORAGE_INDEX_BUCKETS - 1);
+}
+
+/** @brief Initialize the buckets of all tables, if not done yet */
+static void storageIndexInit(void)
+{
+  if(storageIndexReady) return;
+  memset(storageIndex,0,sizeof(storageIndex));
+  for(uint8_t t = 0; t<STORAGE_INDEX_MAX; t++)
+  {
+    memset(storageIndex[t].bucket,STORAGE_INDEX_EMPTY,STORAGE_INDEX_BUCKETS);
+    memset(storageIndex[t].position,STORAGE_INDEX_EMPTY,STORAGE_INDEX_ENTRIES);
+  }
+  storageIndexReady = 1;
+}
+
+/** @brief Insert a used number into the hash table */
+static void storageIndexInsert(storage_index_table_t *tab, uint8_t number)
+{
+  uint32_t b = storageIndexHash(tab->names[number]);
+  while(tab->bucket[b] != STORAGE_INDEX_EMPTY) b = (b + 1) & (STORAGE_INDEX_BUCKETS - 1);
+  tab->bucket[b] = number;
+}
+
+/** @brief Rebuild hash table & bitmap of a table (after removing/renaming) */
+static void storageIndexRehash(storage_index_table_t *tab)
+{
+  memset(tab->bucket,STORAGE_INDEX_EMPTY,STORAGE_INDEX_BUCKETS);
+  memset(tab->used,0,sizeof(tab->used));
+  for(uint16_t i = 0; i<STORAGE_INDEX_ENTRIES; i++)
+  {
+    if(tab->names[i] == NULL) continue;
+    tab->used[i/32] |= (1UL << (i%32));
+    storageIndexInsert(tab,i);
+  }
+}
+
+/** @brief Rebuild the positions of all numbers from the order */
+static void storageIndexReposition(storage_index_table_t *tab)
+{
+  memset(tab->position,STORAGE_INDEX_EMPTY,STORAGE_INDEX_ENTRIES);
+  for(uint16_t p = 0; p<tab->count; p++) tab->position[tab->order[p]] = p;
+}
+
+/** @brief Clear one table
+ * @param t Table
+ * */
+void storageIndexClear(storage_index_t t)
+{
+  if(t >= STORAGE_INDEX_MAX) return;
+  storageIndexInit();
+  storage_index_table_t *tab = &storageIndex[t];
+  for(uint16_t i = 0; i<STORAGE_INDEX_ENTRIES; i++)
+  {
+    if(tab->names[i] != NULL) free(tab->names[i]);
+    tab->names[i] = NULL;
+  }
+  tab->count = 0;
+  storageIndexRehash(tab);
+  storageIndexReposition(tab);
+}
+
+/** @brief Set the name of a number (add or rename)
+ * 
+ * A new number is appended to the order (position count-1).
+ * @param t Table
+ * @param number Number (0 to STORAGE_INDEX_ENTRIES-1)
+ * @param name Name (max. SLOTNAME_LENGTH-1 characters)
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid parameters, no memory)
+ * */
+esp_err_t storageIndexSet(storage_index_t t, uint8_t number, const char *name)
+{
+  if(t >= STORAGE_INDEX_MAX || number >= STORAGE_INDEX_ENTRIES || name == NULL) return ESP_FAIL;
+  storageIndexInit();
+  storage_index_table_t *tab = &storageIndex[t];
+  
+  //unchanged
+  if(tab->names[number] != NULL && strcmp(tab->names[number],name) == 0) return ESP_OK;
+  
+  char *copy = malloc(strnlen(name,SLOTNAME_LENGTH) + 1);
+  if(copy == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for name %s",name);
+    return ESP_FAIL;
+  }
+  strncpy(copy,name,strnlen(name,SLOTNAME_LENGTH));
+  copy[strnlen(name,SLOTNAME_LENGTH)] = 0;
+  
+  if(tab->names[number] != NULL)
+  {
+    //renamed: the old name might be in any bucket
+    free(tab->names[number]);
+    tab->names[number] = copy;
+    storageIndexRehash(tab);
+  } else {
+    tab->names[number] = copy;
+    tab->used[number/32] |= (1UL << (number%32));
+    tab->order[tab->count] = number;
+    tab->position[number] = tab->count;
+    tab->count++;
+    storageIndexInsert(tab,number);
+  }
+  return ESP_OK;
+}
+
+/** @brief Remove a number
+ * 
+ * The number is removed from the order, all following positions are decremented.
+ * @param t Table
+ * @param number Number to be removed
+ * @param compact If != 0, all following numbers are decremented (the
+ * files were renamed to close the gap)
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t storageIndexRemove(storage_index_t t, uint8_t number, uint8_t compact)
+{
+  if(t >= STORAGE_INDEX_MAX || number >= STORAGE_INDEX_ENTRIES) return ESP_FAIL;
+  storageIndexInit();
+  storage_index_table_t *tab = &storageIndex[t];
+  
+  if(tab->names[number] == NULL) return ESP_OK;
+  free(tab->names[number]);
+  tab->names[number] = NULL;
+  
+  //remove from the order
+  uint8_t pos = tab->position[number];
+  memmove(&tab->order[pos],&tab->order[pos+1],tab->count - pos - 1);
+  tab->count--;
+  
+  if(compact)
+  {
+    memmove(&tab->names[number],&tab->names[number+1], \
+      (STORAGE_INDEX_ENTRIES - number - 1) * sizeof(char *));
+    tab->names[STORAGE_INDEX_ENTRIES - 1] = NULL;
+    for(uint16_t p = 0; p<tab->count; p++) if(tab->order[p] > number) tab->order[p]--;
+  }
+  storageIndexRehash(tab);
+  storageIndexReposition(tab);
+  return ESP_OK;
+}
+
+/** @brief Move a number to another position
+ * 
+ * All numbers between both positions are shifted by one.
+ * @param t Table
+ * @param from Current position (0 to count-1)
+ * @param to New position (0 to count-1)
+ * @return ESP_OK on success, ESP_FAIL on invalid positions
+ * */
+esp_err_t storageIndexMove(storage_index_t t, uint8_t from, uint8_t to)
+{
+  if(t >= STORAGE_INDEX_MAX) return ESP_FAIL;
+  storageIndexInit();
+  storage_index_table_t *tab = &storageIndex[t];
+  if(from >= tab->count || to >= tab->count) return ESP_FAIL;
+  
+  uint8_t number = tab->order[from];
+  if(from < to) memmove(&tab->order[from],&tab->order[from+1],to - from);
+  else memmove(&tab->order[to+1],&tab->order[to],from - to);
+  tab->order[to] = number;
+  storageIndexReposition(tab);
+  return ESP_OK;
+}
+
+/** @brief Get the number at a position
+ * @param t Table
+ * @param position Position (0 to count-1)
+ * @return Number, -1 if the position is not used
+ * */
+int16_t storageIndexAt(storage_index_t t, uint8_t position)
+{
+  if(t >= STORAGE_INDEX_MAX) return -1;
+  storageIndexInit();
+  if(position >= storageIndex[t].count) return -1;
+  return storageIndex[t].order[position];
+}
+
+/** @brief Get the position of a number
+ * @param t Table
+ * @param number Number
+ * @return Position, -1 if the number is not used
+ * */
+int16_t storageIndexPosition(storage_index_t t, uint8_t number)
+{
+  if(t >= STORAGE_INDEX_MAX || number >= STORAGE_INDEX_ENTRIES) return -1;
+  storageIndexInit();
+  if(storageIndex[t].position[number] == STORAGE_INDEX_EMPTY) return -1;
+  return storageIndex[t].position[number];
+}
+
+/** @brief Find the number of a name
+ * @param t Table
+ * @param name Name to look for
+ * @return Number, -1 if not found
+ * */
+int16_t storageIndexFind(storage_index_t t, const char *name)
+{
+  if(t >= STORAGE_INDEX_MAX || name == NULL) return -1;
+  storageIndexInit();
+  storage_index_table_t *tab = &storageIndex[t];
+  
+  uint32_t b = storageIndexHash(name);
+  while(tab->bucket[b] != STORAGE_INDEX_EMPTY)
+  {
+    if(strcmp(tab->names[tab->bucket[b]],name) == 0) return tab->bucket[b];
+    b = (b + 1) & (STORAGE_INDEX_BUCKETS - 1);
+  }
+  return -1;
+}
+
+/** @brief Get the name of a number
+ * @param t Table
+ * @param number Number
+ * @return Name, NULL if this number is not used
+ * */
+const char *storageIndexName(storage_index_t t, uint8_t number)
+{
+  if(t >= STORAGE_INDEX_MAX || number >= STORAGE_INDEX_ENTRIES) return NULL;
+  storageIndexInit();
+  return storageIndex[t].names[number];
+}
+
+/** @brief Get the count of used numbers
+ * @param t Table
+ * @return Count of used numbers
+ * */
+uint8_t storageIndexCount(storage_index_t t)
+{
+  if(t >= STORAGE_INDEX_MAX) return 0;
+  storageIndexInit();
+  return storageIndex[t].count;
+}
+
+/** @brief Get the first free number
+ * @param t Table
+ * @return First free number, -1 if the table is full
+ * */
+int16_t storageIndexFree(storage_index_t t)
+{
+  if(t >= STORAGE_INDEX_MAX) return -1;
+  storageIndexInit();
+  storage_index_table_t *tab = &storageIndex[t];
+  for(uint16_t w = 0; w<sizeof(tab->used)/sizeof(uint32_t); w++)
+  {
+    if(tab->used[w] == 0xFFFFFFFF) continue;
+    //first cleared bit of this word
+    uint16_t i = w*32 + __builtin_ctz(~tab->used[w]);
+    return (i < STORAGE_INDEX_ENTRIES) ? i : -1;
+  }
+  return -1;
+}
+
+/** @brief Serialize all tables
+ * @param buf Pointer to a buffer, allocated here. Free it after use.
+ * @param len Length of the buffer [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (no memory)
+ * */
+esp_err_t storageIndexSerialize(uint8_t **buf, uint32_t *len)
+{
+  storage_index_header_t header = {STORAGE_INDEX_MAGIC, STORAGE_INDEX_VERSION, sizeof(storage_index_header_t), 0};
+  if(buf == NULL || len == NULL) return ESP_FAIL;
+  storageIndexInit();
+  
+  for(uint8_t t = 0; t<STORAGE_INDEX_MAX; t++)
+  {
+    for(uint16_t p = 0; p<storageIndex[t].count; p++)
+    {
+      header.length += 3 + strlen(storageIndex[t].names[storageIndex[t].order[p]]);
+      header.entries++;
+    }
+  }
+  
+  uint8_t *out = malloc(header.length);
+  if(out == NULL) return ESP_FAIL;
+  memcpy(out,&header,sizeof(storage_index_header_t));
+  uint8_t *pos = out + sizeof(storage_index_header_t);
+  //entries are written in the order of their positions, storageIndexSet
+  //appends them in the same order on loading.
+  for(uint8_t t = 0; t<STORAGE_INDEX_MAX; t++)
+  {
+    for(uint16_t p = 0; p<storageIndex[t].count; p++)
+    {
+      uint8_t i = storageIndex[t].order[p];
+      uint8_t namelen = strlen(storageIndex[t].names[i]);
+      *pos++ = t;
+      *pos++ = i;
+      *pos++ = namelen;
+      memcpy(pos,storageIndex[t].names[i],namelen);
+      pos += namelen;
+    }
+  }
+  *buf = out;
+  *len = header.length;
+  return ESP_OK;
+}
+
+/** @brief Load all tables from a serialized index
+ * @param buf Buffer, built by storageIndexSerialize
+ * @param len Length of the buffer [bytes]
+ * @return ESP_OK on success, ESP_FAIL if the buffer is invalid (all tables are cleared)
+ * */
+esp_err_t storageIndexDeserialize(const uint8_t *buf, uint32_t len)
+{
+  storage_index_header_t header;
+  char name[SLOTNAME_LENGTH];
+  
+  for(uint8_t t = 0; t<STORAGE_INDEX_MAX; t++) storageIndexClear(t);
+  if(buf == NULL || len < sizeof(storage_index_header_t)) return ESP_FAIL;
+  memcpy(&header,buf,sizeof(storage_index_header_t));
+  if(header.magic != STORAGE_INDEX_MAGIC || header.version != STORAGE_INDEX_VERSION || \
+    header.length != len)
+  {
+    ESP_LOGW(LOG_TAG,"Invalid index header");
+    return ESP_FAIL;
+  }
+  
+  const uint8_t *pos = buf + sizeof(storage_index_header_t);
+  const uint8_t *end = buf + len;
+  for(uint32_t e = 0; e<header.entries; e++)
+  {
+    if(pos + 3 > end || pos[0] >= STORAGE_INDEX_MAX || pos[1] >= STORAGE_INDEX_ENTRIES || \
+      pos[2] >= SLOTNAME_LENGTH || pos + 3 + pos[2] > end) break;
+    memcpy(name,&pos[3],pos[2]);
+    name[pos[2]] = 0;
+    if(storageIndexSet(pos[0],pos[1],name) != ESP_OK) break;
+    pos += 3 + pos[2];
+  }
+  if(pos != end)
+  {
+    ESP_LOGW(LOG_TAG,"Invalid index entries");
+    for(uint8_t t = 0; t<STORAGE_INDEX_MAX; t++) storageIndexClear(t);
+    return ESP_FAIL;
+  }
+  ESP_LOGI(LOG_TAG,"Loaded index: %d slots, %d IR cmds",storageIndexCount(STORAGE_INDEX_SLOT), \
+    storageIndexCount(STORAGE_INDEX_IR));
+  return ESP_OK;
+}
@@ -0,0 +1,166 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - In-RAM name index of stored slots & IR commands
+ *
+ * Slot and IR command names are stored inside their files (xxx.set,
+ * IR_xxx.set). Without an index, each lookup by name opens the files
+ * one by one (up to 250 per table), counting calls stat() on each file until
+ * one is missing.
+ *
+ * This index holds, per table (storage_index_table_t):
+ * * the name of each used number,
+ * * a hash table (open addressing) name -> number for O(1) lookups,
+ * * a bitmap of used numbers (count & first free number),
+ * * the order of the numbers (position -> number & number -> position).
+ *
+ * Numbers are stable ids of the files. The order maps the positions,
+ * which are visible to the user (e.g., slot 1, 2, 3), to these ids.
+ * Deleting or moving an entry changes the order only, no file is renamed.
+ *
+ * hal_storage keeps the index in sync with the files and saves it
+ * (storageIndexSerialize) to a file, which is loaded on mounting.
+ *
+ * @note The index is not locked, it is accessed by hal_storage within a
+ * storage transaction only.
+ * @see storageIndexFind
+ * */
+#ifndef _STORAGE_INDEX_H_
+#define _STORAGE_INDEX_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include "common.h"
+
+/** @brief Count of numbers per table (0-249) */
+#define STORAGE_INDEX_ENTRIES 250
+
+/** @brief Count of hash buckets per table (power of 2, > STORAGE_INDEX_ENTRIES) */
+#define STORAGE_INDEX_BUCKETS 512
+
+/** @brief Magic of a serialized index ("FMIX") */
+#define STORAGE_INDEX_MAGIC 0x58494D46
+
+/** @brief Version of the serialized index */
+#define STORAGE_INDEX_VERSION 2
+
+/** @brief Indexed tables */
+typedef enum {
+  /** @brief Slots, xxx.set */
+  STORAGE_INDEX_SLOT = 0,
+  /** @brief IR commands, IR_xxx.set */
+  STORAGE_INDEX_IR,
+  /** @brief Count of tables, no valid table */
+  STORAGE_INDEX_MAX
+} storage_index_t;
+
+/** @brief Clear one table
+ * @param t Table
+ * */
+void storageIndexClear(storage_index_t t);
+
+/** @brief Set the name of a number (add or rename)
+ * 
+ * A new number is appended to the order (position count-1).
+ * @param t Table
+ * @param number Number (0 to STORAGE_INDEX_ENTRIES-1)
+ * @param name Name (max. SLOTNAME_LENGTH-1 characters)
+ * @return ESP_OK on success, ESP_FAIL otherwise (invalid parameters, no memory)
+ * */
+esp_err_t storageIndexSet(storage_index_t t, uint8_t number, const char *name);
+
+/** @brief Remove a number
+ * 
+ * The number is removed from the order, all following positions are decremented.
+ * @param t Table
+ * @param number Number to be removed
+ * @param compact If != 0, all following numbers are decremented (the
+ * files were renamed to close the gap)
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t storageIndexRemove(storage_index_t t, uint8_t number, uint8_t compact);
+
+/** @brief Move a number to another position
+ * 
+ * All numbers between both positions are shifted by one.
+ * @param t Table
+ * @param from Current position (0 to count-1)
+ * @param to New position (0 to count-1)
+ * @return ESP_OK on success, ESP_FAIL on invalid positions
+ * */
+esp_err_t storageIndexMove(storage_index_t t, uint8_t from, uint8_t to);
+
+/** @brief Get the number at a position
+ * @param t Table
+ * @param position Position (0 to count-1)
+ * @return Number, -1 if the position is not used
+ * */
+int16_t storageIndexAt(storage_index_t t, uint8_t position);
+
+/** @brief Get the position of a number
+ * @param t Table
+ * @param number Number
+ * @return Position, -1 if the number is not used
+ * */
+int16_t storageIndexPosition(storage_index_t t, uint8_t number);
+
+/** @brief Find the number of a name
+ * @param t Table
+ * @param name Name to look for
+ * @return Number, -1 if not found
+ * */
+int16_t storageIndexFind(storage_index_t t, const char *name);
+
+/** @brief Get the name of a number
+ * @param t Table
+ * @param number Number
+ * @return Name, NULL if this number is not used
+ * */
+const char *storageIndexName(storage_index_t t, uint8_t number);
+
+/** @brief Get the count of used numbers
+ * @param t Table
+ * @return Count of used numbers
+ * */
+uint8_t storageIndexCount(storage_index_t t);
+
+/** @brief Get the first free number
+ * @param t Table
+ * @return First free number, -1 if the table is full
+ * */
+int16_t storageIndexFree(storage_index_t t);
+
+/** @brief Serialize all tables
+ * @param buf Pointer to a buffer, allocated here. Free it after use.
+ * @param len Length of the buffer [bytes]
+ * @return ESP_OK on success, ESP_FAIL otherwise (no memory)
+ * */
+esp_err_t storageIndexSerialize(uint8_t **buf, uint32_t *len);
+
+/** @brief Load all tables from a serialized index
+ * @param buf Buffer, built by storageIndexSerialize
+ * @param len Length of the buffer [bytes]
+ * @return ESP_OK on success, ESP_FAIL if the buffer is invalid (all tables are cleared)
+ * */
+esp_err_t storageIndexDeserialize(const uint8_t *buf, uint32_t len);
+
+#endif /* _STORAGE_INDEX_H_ */
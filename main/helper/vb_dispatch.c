@@ -0,0 +1,179 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Dispatcher for debounced VB events
+ *
+ * @see vb_dispatch.h
+ * */
+#include "vb_dispatch.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "vb_dispatch"
+
+/** @brief One event in a sink queue */
+typedef struct vbDispatchItem {
+  /** @brief Press or release */
+  vb_event_t type;
+  /** @brief VB number & timestamps */
+  vb_event_data_t data;
+} vbDispatchItem_t;
+
+/** @brief One registered sink */
+typedef struct vbDispatchSink {
+  /** @brief Sink function */
+  vb_sink_h sink;
+  /** @brief Queue of this sink */
+  QueueHandle_t queue;
+  /** @brief Statistics (depth is read on request) */
+  vb_dispatch_stats_t stats;
+} vbDispatchSink_t;
+
+/** @brief All registered sinks */
+static vbDispatchSink_t vbDispatchSinks[VB_DISPATCH_MAX_SINKS];
+
+/** @brief Count of registered sinks
+ * @note Incremented after a sink is completely initialized, the
+ * debouncer never sees a partly registered sink. */
+static volatile uint8_t vbDispatchCount = 0;
+
+/** @brief Spinlock for statistics, updated by the debouncer & sink tasks */
+static portMUX_TYPE vbDispatchLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Task of one sink, waits for events and calls the sink function
+ * @param param Pointer to vbDispatchSink_t of this sink */
+static void vbDispatchTask(void *param)
+{
+  vbDispatchSink_t *s = (vbDispatchSink_t *)param;
+  vbDispatchItem_t item;
+
+  while(1)
+  {
+    if(xQueueReceive(s->queue,&item,portMAX_DELAY) != pdTRUE) continue;
+    if(s->sink(item.type,&item.data) != ESP_OK)
+    {
+      portENTER_CRITICAL(&vbDispatchLock);
+      s->stats.failed++;
+      portEXIT_CRITICAL(&vbDispatchLock);
+      ESP_LOGW(LOG_TAG,"%s: VB%d not handled",s->stats.name,item.data.vb);
+    }
+  }
+}
+
+/** @brief Register a new sink
+ *
+ * A queue (VB_DISPATCH_QUEUE_LEN) and a task are created for this sink.
+ * @note Sinks are registered on startup (app_main), there is no unregister.
+ * @param name Name of this sink (used for the task & statistics)
+ * @param sink Sink function
+ * @param priority Task priority of this sink
+ * @param stacksize Task stack size of this sink
+ * @return ESP_OK on success, ESP_FAIL if no more sinks are available or
+ * the queue/task cannot be created
+ * */
+esp_err_t vbDispatchRegister(const char *name, vb_sink_h sink, UBaseType_t priority, uint32_t stacksize)
+{
+  if(sink == NULL || name == NULL) return ESP_FAIL;
+  if(vbDispatchCount >= VB_DISPATCH_MAX_SINKS)
+  {
+    ESP_LOGE(LOG_TAG,"No free sink for %s",name);
+    return ESP_FAIL;
+  }
+
+  vbDispatchSink_t *s = &vbDispatchSinks[vbDispatchCount];
+  memset(s,0,sizeof(vbDispatchSink_t));
+  s->sink = sink;
+  s->stats.name = name;
+  s->queue = xQueueCreate(VB_DISPATCH_QUEUE_LEN,sizeof(vbDispatchItem_t));
+  if(s->queue == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create queue for %s",name);
+    return ESP_FAIL;
+  }
+  if(xTaskCreate(vbDispatchTask,name,stacksize,s,priority,NULL) != pdPASS)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create task for %s",name);
+    vQueueDelete(s->queue);
+    s->queue = NULL;
+    return ESP_FAIL;
+  }
+
+  vbDispatchCount++;
+  ESP_LOGI(LOG_TAG,"Registered %s, priority %d",name,priority);
+  return ESP_OK;
+}
+
+/** @brief Post a VB event to all sinks
+ *
+ * Called by the debouncer.
+ * @param type Press or release
+ * @param data VB number & timestamps, copied to each sink queue
+ * @return ESP_OK if queued to all sinks, ESP_FAIL if at least one sink dropped this event
+ * */
+esp_err_t vbDispatchPost(vb_event_t type, const vb_event_data_t *data)
+{
+  vbDispatchItem_t item;
+  esp_err_t ret = ESP_OK;
+  if(data == NULL) return ESP_FAIL;
+
+  item.type = type;
+  memcpy(&item.data,data,sizeof(vb_event_data_t));
+
+  for(uint8_t i = 0; i<vbDispatchCount; i++)
+  {
+    vbDispatchSink_t *s = &vbDispatchSinks[i];
+    if(xQueueSend(s->queue,&item,VB_DISPATCH_POST_TIMEOUT) != pdTRUE)
+    {
+      portENTER_CRITICAL(&vbDispatchLock);
+      s->stats.dropped++;
+      portEXIT_CRITICAL(&vbDispatchLock);
+      ESP_LOGW(LOG_TAG,"%s: queue full, dropped VB%d",s->stats.name,data->vb);
+      ret = ESP_FAIL;
+      continue;
+    }
+    uint32_t depth = uxQueueMessagesWaiting(s->queue);
+    portENTER_CRITICAL(&vbDispatchLock);
+    s->stats.posted++;
+    if(depth > s->stats.highwater) s->stats.highwater = depth;
+    portEXIT_CRITICAL(&vbDispatchLock);
+  }
+  return ret;
+}
+
+/** @brief Get the count of registered sinks
+ * @return Count of sinks */
+uint8_t vbDispatchGetSinkCount(void)
+{
+  return vbDispatchCount;
+}
+
+/** @brief Get the statistics of one sink
+ * @param sink Sink number (0 to vbDispatchGetSinkCount()-1)
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t vbDispatchGetStats(uint8_t sink, vb_dispatch_stats_t *stats)
+{
+  if(sink >= vbDispatchCount || stats == NULL) return ESP_FAIL;
+  portENTER_CRITICAL(&vbDispatchLock);
+  memcpy(stats,&vbDispatchSinks[sink].stats,sizeof(vb_dispatch_stats_t));
+  portEXIT_CRITICAL(&vbDispatchLock);
+  stats->depth = uxQueueMessagesWaiting(vbDispatchSinks[sink].queue);
+  return ESP_OK;
+}
@@ -0,0 +1,116 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Dispatcher for debounced VB events
+ *
+ * Debounced VB events are not posted to the default event loop (which
+ * is shared with system events). Instead, each command handler
+ * (handler_hid, handler_vb) registers as a sink with its own queue and
+ * its own task & priority. vbDispatchPost copies the event directly to
+ * all sink queues, a slow sink (e.g., a macro in handler_vb) cannot
+ * delay any other sink.
+ *
+ * All queues & tasks are created once on registration, nothing is
+ * allocated per event. A full sink queue or a failed sink call is never
+ * dropped silently: it is logged and counted (see vbDispatchGetStats, AT VS).
+ *
+ * @see vbDispatchRegister
+ * @see vbDispatchPost
+ * */
+#ifndef _VB_DISPATCH_H_
+#define _VB_DISPATCH_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include "common.h"
+
+/** @brief Maximum count of registered sinks */
+#define VB_DISPATCH_MAX_SINKS 4
+
+/** @brief Queue length (events) of each sink */
+#define VB_DISPATCH_QUEUE_LEN 16
+
+/** @brief Maximum time [ticks] to wait for a free slot in a sink queue,
+ * the event is dropped (and counted) afterwards. */
+#define VB_DISPATCH_POST_TIMEOUT 2
+
+/** @brief Sink for VB events, called in the sink's task
+ * @param type Press or release
+ * @param data VB number & timestamps
+ * @return ESP_OK if the event was handled (or ignored on purpose), any
+ * other value is counted as failed event
+ * */
+typedef esp_err_t (*vb_sink_h)(vb_event_t type, const vb_event_data_t *data);
+
+/** @brief Statistics of one sink
+ * @see vbDispatchGetStats */
+typedef struct vb_dispatch_stats {
+  /** @brief Name of this sink */
+  const char *name;
+  /** @brief Count of events queued to this sink */
+  uint32_t posted;
+  /** @brief Count of events which could not be queued (queue full) */
+  uint32_t dropped;
+  /** @brief Count of events where the sink returned an error */
+  uint32_t failed;
+  /** @brief Current count of events in the queue */
+  uint32_t depth;
+  /** @brief Maximum count of events in the queue */
+  uint32_t highwater;
+} vb_dispatch_stats_t;
+
+/** @brief Register a new sink
+ *
+ * A queue (VB_DISPATCH_QUEUE_LEN) and a task are created for this sink.
+ * @note Sinks are registered on startup (app_main), there is no unregister.
+ * @param name Name of this sink (used for the task & statistics)
+ * @param sink Sink function
+ * @param priority Task priority of this sink
+ * @param stacksize Task stack size of this sink
+ * @return ESP_OK on success, ESP_FAIL if no more sinks are available or
+ * the queue/task cannot be created
+ * */
+esp_err_t vbDispatchRegister(const char *name, vb_sink_h sink, UBaseType_t priority, uint32_t stacksize);
+
+/** @brief Post a VB event to all sinks
+ *
+ * Called by the debouncer.
+ * @param type Press or release
+ * @param data VB number & timestamps, copied to each sink queue
+ * @return ESP_OK if queued to all sinks, ESP_FAIL if at least one sink dropped this event
+ * */
+esp_err_t vbDispatchPost(vb_event_t type, const vb_event_data_t *data);
+
+/** @brief Get the count of registered sinks
+ * @return Count of sinks */
+uint8_t vbDispatchGetSinkCount(void);
+
+/** @brief Get the statistics of one sink
+ * @param sink Sink number (0 to vbDispatchGetSinkCount()-1)
+ * @param stats Pointer to a struct, which will be filled
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t vbDispatchGetStats(uint8_t sink, vb_dispatch_stats_t *stats);
+
+#endif /* _VB_DISPATCH_H_ */
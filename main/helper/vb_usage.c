@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Combined VB usage bitmap
+ *
+ * @see vb_usage.h
+ * */
+#include "vb_usage.h"
+
+/** @brief Tag for ESP_LOG logging */
+#define LOG_TAG "vb_usage"
+
+/** @brief Published bitmap per command handler */
+static uint32_t vbUsageSrc[VB_USAGE_SRC_MAX];
+
+/** @brief Combined bitmap of all command handlers, read via atomic load */
+static uint32_t vbUsage = 0;
+
+/** @brief Spinlock for publishing, serializes updates of different handlers */
+static portMUX_TYPE vbUsageLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Publish the VB usage of one command handler
+ *
+ * Called by a command handler whenever its command chain changes.
+ * The combined bitmap is updated immediately.
+ *
+ * @param src Command handler
+ * @param bitmap Bitmap of used VBs (VB_USAGE_BIT), press & release are not distinguished
+ * */
+void vbUsagePublish(vb_usage_src_t src, uint32_t bitmap)
+{
+  uint32_t combined = 0;
+  if(src >= VB_USAGE_SRC_MAX) return;
+
+  portENTER_CRITICAL(&vbUsageLock);
+  vbUsageSrc[src] = bitmap;
+  for(uint8_t i = 0; i<VB_USAGE_SRC_MAX; i++) combined |= vbUsageSrc[i];
+  __atomic_store_n(&vbUsage,combined,__ATOMIC_RELEASE);
+  portEXIT_CRITICAL(&vbUsageLock);
+
+  ESP_LOGD(LOG_TAG,"src %d: 0x%08X, combined 0x%08X",src,bitmap,combined);
+}
+
+/** @brief Get the combined VB usage bitmap of all command handlers
+ * @note Lock-free, can be called in any task on each sample
+ * @return Bitmap of used VBs (VB_USAGE_BIT)
+ * */
+uint32_t vbUsageGet(void)
+{
+  return __atomic_load_n(&vbUsage,__ATOMIC_ACQUIRE);
+}
+
+/** @brief Check if a VB has any command assigned (in any command handler)
+ * @param vb VB number (press/release flag is ignored)
+ * @return true if used (or not tracked), false if no command is assigned
+ * */
+bool vbUsageActive(uint8_t vb)
+{
+  vb &= 0x7F;
+  if(vb >= VB_USAGE_MAX) return true;
+  return (vbUsageGet() & VB_USAGE_BIT(vb)) != 0;
+}
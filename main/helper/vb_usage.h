@@ -0,0 +1,83 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HELPER - Combined VB usage bitmap
+ *
+ * Each command handler (handler_hid, handler_vb) publishes a bitmap of
+ * all VBs which have at least one command assigned, whenever its command
+ * chain changes. task_debouncer publishes all input VBs of gestures, these
+ * must send events even without an assigned command.
+ * If button learning is enabled (AT BL 1), config_switcher publishes
+ * the mouthpiece directions, the host must receive their events.
+ * These bitmaps are combined into one word, which can be
+ * read lock-free (one atomic load) by any other module, e.g., the ADC task
+ * can decide per sample if a strong sip/puff + direction is assigned or if
+ * an event for a VB is necessary at all.
+ *
+ * @note Only VBs 0-31 are tracked, any other VB is reported as used.
+ * @see vbUsagePublish
+ * @see vbUsageGet
+ * */
+#ifndef _VB_USAGE_H_
+#define _VB_USAGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+
+/** @brief Bit of one VB in the usage bitmap */
+#define VB_USAGE_BIT(vb) (1UL << (vb))
+
+/** @brief Count of VBs, which are tracked in the usage bitmap */
+#define VB_USAGE_MAX 32
+
+/** @brief Sources (command handlers) of the usage bitmap */
+typedef enum {
+  VB_USAGE_HID = 0,
+  VB_USAGE_VB,
+  VB_USAGE_GESTURE,
+  VB_USAGE_LEARN,
+  VB_USAGE_SRC_MAX
+} vb_usage_src_t;
+
+/** @brief Publish the VB usage of one command handler
+ *
+ * Called by a command handler whenever its command chain changes.
+ * The combined bitmap is updated immediately.
+ *
+ * @param src Command handler
+ * @param bitmap Bitmap of used VBs (VB_USAGE_BIT), press & release are not distinguished
+ * */
+void vbUsagePublish(vb_usage_src_t src, uint32_t bitmap);
+
+/** @brief Get the combined VB usage bitmap of all command handlers
+ * @note Lock-free, can be called in any task on each sample
+ * @return Bitmap of used VBs (VB_USAGE_BIT)
+ * */
+uint32_t vbUsageGet(void);
+
+/** @brief Check if a VB has any command assigned (in any command handler)
+ * @param vb VB number (press/release flag is ignored)
+ * @return true if used (or not tracked), false if no command is assigned
+ * */
+bool vbUsageActive(uint8_t vb);
+
+#endif /* _VB_USAGE_H_ */
@@ -0,0 +1,439 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief TOOL - Host simulation of the debouncer (debounce_core).
+ *
+ * Replays a recorded or fuzzed stream of raw VB press/release events
+ * through the same state machine as task_debouncer, on a virtual clock
+ * (each deadline is processed exactly on time). Debounce times are
+ * looked up like task_debouncer does: the VB value (AT AP/AR/AI with a
+ * VB selected, debounce_*_vb) or the global value (debounce_*), the
+ * default time if neither is set.
+ *
+ * Reported are:<br>
+ * * each output event with its added latency (-v)<br>
+ * * suppressed input events (bounces), by debouncer state on arrival<br>
+ * * added latency per VB & direction, and the worst case<br>
+ * * VBs whose output state differs from the input state at the end
+ * (stuck keys), in this case the exit code is 1.<br>
+ *
+ * Stream format (text, one event per line, sorted by time):<br>
+ * <time [us]> <vb> <1 for press | 0 for release><br>
+ * Empty lines & lines starting with '#' are ignored.
+ *
+ * Run without arguments for the usage.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "debounce_core.h"
+
+/** @brief Count of VBs of the FLipMouse (VB_MAX) */
+#define SIM_VB_DEFAULT 20
+
+/** @brief Default time [ms], same as DEBOUNCETIME_MS */
+#define SIM_DEFTIME 50
+
+/** @brief Minimum time [ms], same as DEBOUNCETIME_MIN_MS */
+#define SIM_MINTIME 10
+
+/** @brief One input event of the stream */
+typedef struct simInput {
+  /** @brief Timestamp [us] */
+  int64_t time;
+  /** @brief VB number */
+  uint32_t vb;
+  /** @brief 1 for press, 0 for release */
+  uint8_t press;
+  /** @brief Debouncer state of this VB on arrival */
+  uint8_t state;
+  /** @brief Set if this input was sent by the debouncer */
+  uint8_t sent;
+} simInput_t;
+
+/** @brief Latency statistics of one VB & direction */
+typedef struct simLatency {
+  uint32_t count;
+  int64_t sum;
+  int64_t min;
+  int64_t max;
+  /** @brief Input which caused the maximum */
+  uint32_t worst;
+} simLatency_t;
+
+/** @brief Simulation state */
+typedef struct sim {
+  /** @brief Debounce times [ms] of each VB (0: use the global value) */
+  uint16_t press_vb[DEBOUNCE_VB_MAX];
+  uint16_t release_vb[DEBOUNCE_VB_MAX];
+  uint16_t idle_vb[DEBOUNCE_VB_MAX];
+  /** @brief Global debounce times [ms] */
+  uint16_t press;
+  uint16_t release;
+  uint16_t idle;
+  /** @brief Input stream */
+  simInput_t *in;
+  uint32_t count;
+  uint32_t capacity;
+  /** @brief Virtual clock [us] */
+  int64_t now;
+  /** @brief Output state of each VB (last sent event) */
+  uint8_t out[DEBOUNCE_VB_MAX];
+  /** @brief Latency per VB, [vb][press] */
+  simLatency_t lat[DEBOUNCE_VB_MAX][2];
+  /** @brief Count of output events */
+  uint32_t outputs;
+  /** @brief Count of releases sent for a VB which was not pressed */
+  uint32_t redundant;
+  /** @brief Print each output event */
+  uint8_t verbose;
+} sim_t;
+
+/** @brief Lookup function, same as debouncerTime of task_debouncer */
+static uint16_t simTime(void *ctx, uint32_t vb, debounce_time_t which)
+{
+  sim_t *s = ctx;
+  switch(which)
+  {
+    case DEBOUNCE_TIME_PRESS:
+      if(s->press_vb[vb] != 0) return s->press_vb[vb];
+      return s->press;
+    case DEBOUNCE_TIME_RELEASE:
+      if(s->release_vb[vb] != 0) return s->release_vb[vb];
+      return s->release;
+    case DEBOUNCE_TIME_IDLE:
+      if(s->idle_vb[vb] != 0) return s->idle_vb[vb];
+      return s->idle;
+    default: return 0;
+  }
+}
+
+/** @brief Sink, records each output event (origin is the input index) */
+static void simSink(void *ctx, uint32_t vb, uint8_t press, uint32_t origin, \
+  uint32_t start, uint8_t debounced)
+{
+  sim_t *s = ctx;
+  simInput_t *in = &s->in[origin];
+  int64_t latency = s->now - in->time;
+  simLatency_t *l = &s->lat[vb][press ? 1 : 0];
+  (void)start;
+
+  in->sent = 1;
+  s->outputs++;
+  if(press == 0 && s->out[vb] == 0) s->redundant++;
+  s->out[vb] = press;
+
+  if(l->count == 0 || latency < l->min) l->min = latency;
+  if(l->count == 0 || latency > l->max)
+  {
+    l->max = latency;
+    l->worst = origin;
+  }
+  l->sum += latency;
+  l->count++;
+
+  if(s->verbose)
+  {
+    printf("%12.3f ms  VB %2u %-7s +%8.3f ms%s\n", s->now / 1000.0, vb,
+      press ? "press" : "release", latency / 1000.0, debounced ? " (debounced)" : "");
+  }
+}
+
+/** @brief Append one input event to the stream */
+static void simAdd(sim_t *s, int64_t time, uint32_t vb, uint8_t press)
+{
+  if(s->count == s->capacity)
+  {
+    s->capacity = s->capacity ? s->capacity * 2 : 256;
+    s->in = realloc(s->in, s->capacity * sizeof(simInput_t));
+    if(s->in == NULL)
+    {
+      fprintf(stderr, "out of memory\n");
+      exit(2);
+    }
+  }
+  memset(&s->in[s->count], 0, sizeof(simInput_t));
+  s->in[s->count].time = time;
+  s->in[s->count].vb = vb;
+  s->in[s->count].press = press;
+  s->count++;
+}
+
+/** @brief Read a recorded stream
+ * @return 0 on success, -1 on an error (printed) */
+static int simRead(sim_t *s, const char *name, uint32_t vbs)
+{
+  char line[128];
+  uint32_t nr = 0;
+  FILE *f = strcmp(name, "-") ? fopen(name, "r") : stdin;
+  if(f == NULL)
+  {
+    perror(name);
+    return -1;
+  }
+  while(fgets(line, sizeof(line), f) != NULL)
+  {
+    long long t;
+    unsigned vb, press;
+    char *p = line;
+    nr++;
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p == '#' || *p == '\n' || *p == '\r' || *p == 0) continue;
+    if(sscanf(p, "%lld %u %u", &t, &vb, &press) != 3 || vb >= vbs || press > 1)
+    {
+      fprintf(stderr, "%s:%u: invalid event\n", name, nr);
+      return -1;
+    }
+    if(s->count != 0 && t < s->in[s->count-1].time)
+    {
+      fprintf(stderr, "%s:%u: events not sorted by time\n", name, nr);
+      return -1;
+    }
+    simAdd(s, t, vb, press);
+  }
+  if(f != stdin) fclose(f);
+  return 0;
+}
+
+/** @brief Compare function for sorting generated events by time */
+static int simCompare(const void *a, const void *b)
+{
+  const simInput_t *x = a, *y = b;
+  if(x->time != y->time) return (x->time < y->time) ? -1 : 1;
+  return (x->vb < y->vb) ? -1 : (x->vb > y->vb);
+}
+
+/** @brief Add one edge with up to 4 bounces within 'bounce' [us] before the stable level */
+static int64_t simFuzzEdge(sim_t *s, int64_t t, uint32_t vb, uint8_t press, uint32_t bounce)
+{
+  uint32_t toggles = (bounce != 0) ? (rand() % 3) * 2 : 0;
+  uint8_t level = press;
+  simAdd(s, t, vb, level);
+  for(uint32_t i = 0; i < toggles; i++)
+  {
+    t += 1 + rand() % (bounce / (toggles + 1) + 1);
+    level ^= 1;
+    simAdd(s, t, vb, level);
+  }
+  return t;
+}
+
+/** @brief Generate a fuzzed stream: press/release cycles with bounces on 'vbs' VBs */
+static void simFuzz(sim_t *s, uint32_t cycles, uint32_t vbs, uint32_t bounce)
+{
+  for(uint32_t vb = 0; vb < vbs; vb++)
+  {
+    int64_t t = (rand() % 1000) * 1000;
+    for(uint32_t c = vb; c < cycles; c += vbs)
+    {
+      t = simFuzzEdge(s, t, vb, 1, bounce);
+      t += (20 + rand() % 600) * 1000;
+      t = simFuzzEdge(s, t, vb, 0, bounce);
+      t += (30 + rand() % 800) * 1000;
+    }
+  }
+  qsort(s->in, s->count, sizeof(simInput_t), simCompare);
+}
+
+/** @brief Advance the virtual clock, processing each deadline on time */
+static void simAdvance(sim_t *s, debounce_core_t *d, int64_t to)
+{
+  int64_t next;
+  while(debounceNextDeadline(d, &next) && next <= to)
+  {
+    if(next > s->now) s->now = next;
+    debounceProcess(d, s->now);
+  }
+  if(to > s->now) s->now = to;
+}
+
+/** @brief Parse "vb=ms" for a per VB time */
+static int simParseVb(const char *arg, uint16_t *times, uint32_t vbs)
+{
+  unsigned vb, ms;
+  if(sscanf(arg, "%u=%u", &vb, &ms) != 2 || vb >= vbs || ms > 65535)
+  {
+    fprintf(stderr, "invalid VB time: %s (expected vb=ms)\n", arg);
+    return -1;
+  }
+  times[vb] = ms;
+  return 0;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [options] [stream|-]\n"
+    "  -p ms      global press time (AT AP)\n"
+    "  -r ms      global release time (AT AR)\n"
+    "  -i ms      global idle time (AT AI)\n"
+    "  -P vb=ms   press time of one VB (debounce_press_vb), repeatable\n"
+    "  -R vb=ms   release time of one VB (debounce_release_vb), repeatable\n"
+    "  -I vb=ms   idle time of one VB (debounce_idle_vb), repeatable\n"
+    "  -d ms      default time, if none is set (default %d)\n"
+    "  -m ms      minimum time, up to this value events are sent directly (default %d)\n"
+    "  -n count   count of VBs (default %d)\n"
+    "  -f cycles  fuzz: generate press/release cycles instead of reading a stream\n"
+    "  -V count   fuzz: count of VBs to use (default 4)\n"
+    "  -b ms      fuzz: bounce window after each edge (default 5, 0 for none)\n"
+    "  -s seed    fuzz: random seed (default 1)\n"
+    "  -o file    write the input stream (e.g. a fuzzed one) to file\n"
+    "  -v         print each output event\n",
+    name, SIM_DEFTIME, SIM_MINTIME, SIM_VB_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+  static sim_t s;
+  debounce_core_t d;
+  uint32_t vbs = SIM_VB_DEFAULT, fuzz = 0, fuzzVbs = 4, bounce = 5;
+  unsigned deftime = SIM_DEFTIME, mintime = SIM_MINTIME, seed = 1;
+  const char *outName = NULL;
+  int opt;
+
+  while((opt = getopt(argc, argv, "p:r:i:P:R:I:d:m:n:f:V:b:s:o:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'p': s.press = atoi(optarg); break;
+      case 'r': s.release = atoi(optarg); break;
+      case 'i': s.idle = atoi(optarg); break;
+      case 'P': if(simParseVb(optarg, s.press_vb, vbs)) return 2; break;
+      case 'R': if(simParseVb(optarg, s.release_vb, vbs)) return 2; break;
+      case 'I': if(simParseVb(optarg, s.idle_vb, vbs)) return 2; break;
+      case 'd': deftime = atoi(optarg); break;
+      case 'm': mintime = atoi(optarg); break;
+      case 'n':
+        vbs = atoi(optarg);
+        if(vbs == 0 || vbs > DEBOUNCE_VB_MAX)
+        {
+          fprintf(stderr, "VB count: 1-%d\n", DEBOUNCE_VB_MAX);
+          return 2;
+        }
+        break;
+      case 'f': fuzz = atoi(optarg); break;
+      case 'V': fuzzVbs = atoi(optarg); break;
+      case 'b': bounce = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'o': outName = optarg; break;
+      case 'v': s.verbose = 1; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if(fuzzVbs == 0 || fuzzVbs > vbs) fuzzVbs = vbs;
+
+  if(fuzz != 0)
+  {
+    srand(seed);
+    simFuzz(&s, fuzz, fuzzVbs, bounce * 1000);
+  } else if(optind < argc) {
+    if(simRead(&s, argv[optind], vbs)) return 2;
+  } else {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if(outName != NULL)
+  {
+    FILE *f = fopen(outName, "w");
+    if(f == NULL)
+    {
+      perror(outName);
+      return 2;
+    }
+    fprintf(f, "# <time [us]> <vb> <1 press | 0 release>\n");
+    for(uint32_t i = 0; i < s.count; i++)
+    {
+      fprintf(f, "%lld %u %u\n", (long long)s.in[i].time, s.in[i].vb, s.in[i].press);
+    }
+    fclose(f);
+  }
+
+  //replay
+  debounceInit(&d, vbs, deftime, mintime, simTime, simSink, &s);
+  for(uint32_t i = 0; i < s.count; i++)
+  {
+    simAdvance(&s, &d, s.in[i].time);
+    s.in[i].state = debounceGetState(&d, s.in[i].vb);
+    debounceInput(&d, s.in[i].vb, s.in[i].press, s.now, i, i);
+  }
+  //run all remaining deadlines
+  simAdvance(&s, &d, INT64_MAX);
+
+  //report
+  uint32_t suppressed[4] = {0}, total = 0, stuck = 0;
+  uint8_t last[DEBOUNCE_VB_MAX] = {0};
+  for(uint32_t i = 0; i < s.count; i++)
+  {
+    last[s.in[i].vb] = s.in[i].press;
+    if(s.in[i].sent) continue;
+    suppressed[s.in[i].state & 3]++;
+    total++;
+  }
+  for(uint32_t vb = 0; vb < vbs; vb++) if(last[vb] != s.out[vb]) stuck++;
+
+  printf("config: press %u ms, release %u ms, idle %u ms (global), default %u ms, min %u ms\n",
+    s.press, s.release, s.idle, deftime, mintime);
+  for(uint32_t vb = 0; vb < vbs; vb++)
+  {
+    if(s.press_vb[vb] || s.release_vb[vb] || s.idle_vb[vb])
+    {
+      printf("  VB %2u: press %u ms, release %u ms, idle %u ms (0: global)\n",
+        vb, s.press_vb[vb], s.release_vb[vb], s.idle_vb[vb]);
+    }
+  }
+  printf("inputs: %u, outputs: %u, suppressed: %u (arrived while idle %u, "
+    "press pending %u, release pending %u, deadtime %u)\n", s.count, s.outputs, total,
+    suppressed[DEBOUNCE_IDLE], suppressed[DEBOUNCE_PRESS], suppressed[DEBOUNCE_RELEASE],
+    suppressed[DEBOUNCE_DEADTIME]);
+  printf("redundant releases: %u, stuck VBs: %u\n", s.redundant, stuck);
+
+  printf("added latency [ms]  count      min      avg      max\n");
+  simLatency_t *worst = NULL;
+  uint32_t worstVb = 0;
+  int32_t worstPress = 0;
+  for(uint32_t vb = 0; vb < vbs; vb++)
+  {
+    for(int32_t p = 1; p >= 0; p--)
+    {
+      simLatency_t *l = &s.lat[vb][p];
+      if(l->count == 0) continue;
+      printf("  VB %2u %-7s %7u %8.3f %8.3f %8.3f\n", vb, p ? "press" : "release", l->count,
+        l->min / 1000.0, (double)l->sum / l->count / 1000.0, l->max / 1000.0);
+      if(worst == NULL || l->max > worst->max)
+      {
+        worst = l;
+        worstVb = vb;
+        worstPress = p;
+      }
+    }
+  }
+  if(worst != NULL)
+  {
+    printf("worst case added latency: %.3f ms (VB %u %s, input #%u at %.3f ms)\n",
+      worst->max / 1000.0, worstVb, worstPress ? "press" : "release", worst->worst,
+      s.in[worst->worst].time / 1000.0);
+  }
+  free(s.in);
+  return stuck ? 1 : 0;
+}
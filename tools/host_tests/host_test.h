@@ -0,0 +1,45 @@
+/* Minimal assertion & timing helpers for the host tests. */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/** @brief Number of failed checks, returned by HOST_TEST_RESULT */
+static int hostTestFailed = 0;
+
+/** @brief Check a condition, print file/line & message if it fails */
+#define CHECK(cond, ...) do { \
+    if(!(cond)) { \
+      hostTestFailed++; \
+      fprintf(stderr, "FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+    } \
+  } while(0)
+
+/** @brief Exit code for main, prints a summary */
+#define HOST_TEST_RESULT() \
+  (printf("%s\n", hostTestFailed ? "FAILED" : "OK"), hostTestFailed ? 1 : 0)
+
+/** @brief Monotonic time in ns, for the benchmarks */
+static inline uint64_t hostTestNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** @brief Simple deterministic PRNG (xorshift32) for test inputs */
+static inline uint32_t hostTestRand(uint32_t *state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+#endif
@@ -0,0 +1,19 @@
+/* Host stub for ESP-IDF driver/rmt.h, only the RMT item layout. */
+#ifndef DRIVER_RMT_H_HOST_STUB
+#define DRIVER_RMT_H_HOST_STUB
+
+#include <stdint.h>
+
+typedef struct {
+  union {
+    struct {
+      uint32_t duration0 :15;
+      uint32_t level0 :1;
+      uint32_t duration1 :15;
+      uint32_t level1 :1;
+    };
+    uint32_t val;
+  };
+} rmt_item32_t;
+
+#endif
@@ -0,0 +1,23 @@
+/* Host stub for ESP-IDF esp_log.h, logs go to stderr. */
+#ifndef ESP_LOG_H_HOST_STUB
+#define ESP_LOG_H_HOST_STUB
+
+#include <stdio.h>
+#include "esp_err.h"
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { (void)(tag); } while(0)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while(0)
+#define ESP_LOGV(tag, fmt, ...) do { (void)(tag); } while(0)
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host test - fixed point sensor kernel (hal_adc_kernel) vs. float.
+ *
+ * Compares the Q16 deadzone & mouse movement with:<br>
+ * * the exact result (double) <br>
+ * * the previous float implementation of hal_adc (copied below) <br>
+ * and measures the time per sample of both implementations.
+ *
+ * @note The previous elliptic deadzone used atan(y/x) with an integer
+ * division and did not subtract anything on the axes. The copy below
+ * uses a float division, otherwise its result would be far off.
+ * @note Timing is done on the host FPU. On the ESP32, double (libm)
+ * is emulated in software, so the gap is larger on the target.
+ * */
+
+#include <stdlib.h>
+#include <math.h>
+#include "host_test.h"
+#include "hal_adc_kernel.h"
+
+/** @brief Previous elliptic deadzone (float/double, libm) */
+static void floatDeadzone(int32_t x, int32_t y, uint8_t a, uint8_t b,
+  int32_t *outx, int32_t *outy)
+{
+  float status = pow(x,2) / pow(a,2) + pow(y,2) / pow(b,2);
+  if(status > 1.0)
+  {
+    float deadzoneX = 0;
+    float deadzoneY = 0;
+    if((x < 0 || x > 0) && (y < 0 || y > 0))
+    {
+      float angle = atan((float)y/x);
+      deadzoneX = fabs((a*b)/sqrt(pow(b,2)+pow(a,2)*pow(tan(angle),2)));
+      deadzoneY = fabs((a*b)/sqrt(pow(a,2)+ pow(b,2)/pow(tan(angle),2)));
+    }
+    *outx = (x > 0) ? x - (int)deadzoneX : x + (int)deadzoneX;
+    *outy = (y > 0) ? y - (int)deadzoneY : y + (int)deadzoneY;
+  } else {
+    *outx = 0;
+    *outy = 0;
+  }
+}
+
+/** @brief Exact elliptic deadzone (double), reference for both versions */
+static void exactDeadzone(int32_t x, int32_t y, uint32_t a, uint32_t b,
+  double *outx, double *outy)
+{
+  double bx = (double)b*x, ay = (double)a*y;
+  if(bx*bx + ay*ay <= (double)a*a*b*b)
+  {
+    *outx = 0;
+    *outy = 0;
+    return;
+  }
+  double d = sqrt(bx*bx + ay*ay);
+  double dzx = a*b*fabs((double)x)/d;
+  double dzy = a*b*fabs((double)y)/d;
+  *outx = copysign(fmax(fabs((double)x) - dzx, 0), x);
+  *outy = copysign(fmax(fabs((double)y) - dzy, 0), y);
+}
+
+static void testDeadzone(void)
+{
+  static const uint8_t dz[][2] = { {10,10}, {20,40}, {60,15}, {35,35}, {100,80} };
+  double maxErrQ16 = 0, maxErrFloat = 0;
+  adcKernel_t k;
+
+  for(unsigned i = 0; i < sizeof(dz)/sizeof(dz[0]); i++)
+  {
+    uint8_t a = dz[i][0], b = dz[i][1];
+    halAdcKernelBuild(&k, 50, 50, 15, a, b);
+    for(int32_t x = -400; x <= 400; x++)
+    {
+      for(int32_t y = -400; y <= 400; y += 3)
+      {
+        int32_t qx, qy, fx, fy;
+        double ex, ey;
+        halAdcKernelDeadzone(&k, x, y, &qx, &qy);
+        floatDeadzone(x, y, a, b, &fx, &fy);
+        exactDeadzone(x, y, a, b, &ex, &ey);
+        double eq = fmax(fabs(qx - ex), fabs(qy - ey));
+        if(eq > maxErrQ16) maxErrQ16 = eq;
+        CHECK(eq <= 1.0, "dz %u/%u x/y %d/%d: q16 %d/%d exact %.2f/%.2f",
+          a, b, x, y, qx, qy, ex, ey);
+        //no sign change by the deadzone
+        CHECK((qx == 0 || (qx > 0) == (x > 0)) && (qy == 0 || (qy > 0) == (y > 0)),
+          "sign flip at %d/%d", x, y);
+        if(x != 0 && y != 0)
+        {
+          double ef = fmax(fabs(fx - ex), fabs(fy - ey));
+          if(ef > maxErrFloat) maxErrFloat = ef;
+        }
+      }
+    }
+  }
+
+  //no deadzone on one axis -> values are passed unchanged
+  halAdcKernelBuild(&k, 50, 50, 15, 0, 30);
+  int32_t qx, qy;
+  halAdcKernelDeadzone(&k, 17, -50, &qx, &qy);
+  CHECK(qx == 17 && qy == -50, "deadzone 0/30: %d/%d", qx, qy);
+
+  printf("deadzone: max error vs exact: q16 %.3f, float %.3f (off-axis)\n",
+    maxErrQ16, maxErrFloat);
+}
+
+/** @brief Mouse movement simulation state for one axis */
+typedef struct {
+  double accumD;
+  float accumF;
+  int32_t accumQ;
+  uint32_t accelD, accelQ;
+  float accelF;
+  int64_t posD, posF, posQ;
+} axisSim_t;
+
+/** @brief Feed one sample into all three implementations (period = reference) */
+static void simStep(axisSim_t *s, int32_t x, uint32_t sens, uint32_t accel,
+  uint32_t maxSpeed, const adcKernel_t *k)
+{
+  const uint32_t period = HAL_ADC_REF_PERIOD;
+
+  //exact
+  if(x == 0) s->accelD = 0;
+  else if(s->accelD < ACCELTIME_MAX) s->accelD += accel;
+  double mD = x * (double)sens * (20 / 100000000.0) * s->accelD;
+  if(mD > maxSpeed) mD = maxSpeed;
+  if(mD < -(double)maxSpeed) mD = -(double)maxSpeed;
+  s->accumD += mD;
+  int32_t tD = (int32_t)s->accumD;
+  s->accumD -= tD;
+  s->posD += tD;
+
+  //previous float implementation
+  if(x == 0) s->accelF = 0;
+  else if(s->accelF < ACCELTIME_MAX) s->accelF += accel;
+  float mF = x * (int32_t)sens * HAL_ADC_ACCEL_FACTOR * s->accelF;
+  if(mF > maxSpeed) mF = maxSpeed;
+  if(mF < -(float)maxSpeed) mF = -(float)maxSpeed;
+  s->accumF += mF;
+  int32_t tF = (int32_t)s->accumF;
+  s->accumF -= tF;
+  s->posF += tF;
+
+  //fixed point kernel, same steps as halAdcMouseProcess
+  uint32_t accelStep = (accel * period * 256) / HAL_ADC_REF_PERIOD;
+  int32_t maxQ = halAdcKernelMaxSpeed(k, period);
+  if(x == 0) s->accelQ = 0;
+  else if(s->accelQ < (ACCELTIME_MAX << 8)) s->accelQ += accelStep;
+  s->accumQ += halAdcKernelMove(x, s->accelQ, k->gain_x, period, maxQ);
+  if(s->accumQ > HAL_ADC_ACCUM_MAX) s->accumQ = HAL_ADC_ACCUM_MAX;
+  if(s->accumQ < -HAL_ADC_ACCUM_MAX) s->accumQ = -HAL_ADC_ACCUM_MAX;
+  int32_t tQ = s->accumQ / HAL_ADC_Q16_ONE;
+  s->accumQ -= tQ * HAL_ADC_Q16_ONE;
+  s->posQ += tQ;
+}
+
+static void testMovement(void)
+{
+  static const uint32_t sens[] = { 10, 60, 200 };
+  static const uint32_t accel[] = { 5, 20, 50 };
+  static const uint32_t speed[] = { 4, 15, 30 };
+  uint32_t seed = 0x1234567;
+  int64_t maxDiffQ = 0, maxDiffF = 0;
+
+  for(unsigned i = 0; i < 3; i++)
+  {
+    for(unsigned j = 0; j < 3; j++)
+    {
+      for(unsigned m = 0; m < 3; m++)
+      {
+        adcKernel_t k;
+        axisSim_t s;
+        int32_t x = 0;
+        uint32_t hold = 0;
+
+        memset(&s, 0, sizeof(s));
+        halAdcKernelBuild(&k, sens[i], sens[i], speed[m], 0, 0);
+        for(uint32_t n = 0; n < 20000; n++)
+        {
+          //piecewise constant input, 1/4 of the time at rest
+          if(hold == 0)
+          {
+            hold = 20 + hostTestRand(&seed) % 200;
+            x = (hostTestRand(&seed) % 4 == 0) ? 0 :
+              (int32_t)(hostTestRand(&seed) % 601) - 300;
+          }
+          hold--;
+          simStep(&s, x, sens[i], accel[j], speed[m], &k);
+
+          int64_t dq = llabs(s.posQ - s.posD);
+          int64_t df = llabs(s.posF - s.posD);
+          if(dq > maxDiffQ) maxDiffQ = dq;
+          if(df > maxDiffF) maxDiffF = df;
+        }
+        //rounding of the Q32 gain is < 0.1%, plus one count of truncation
+        int64_t limit = 2 + llabs(s.posD) / 1000;
+        CHECK(llabs(s.posQ - s.posD) <= limit,
+          "sens %u accel %u speed %u: q16 %lld exact %lld",
+          sens[i], accel[j], speed[m], (long long)s.posQ, (long long)s.posD);
+      }
+    }
+  }
+  printf("movement: max position diff vs exact: q16 %lld, float %lld counts\n",
+    (long long)maxDiffQ, (long long)maxDiffF);
+}
+
+static void benchmark(void)
+{
+  enum { N = 2000000 };
+  adcKernel_t k;
+  volatile uint32_t sink = 0;
+  uint32_t seed = 42;
+  static int16_t in[4096][2];
+
+  for(unsigned i = 0; i < 4096; i++)
+  {
+    in[i][0] = (int16_t)(hostTestRand(&seed) % 801) - 400;
+    in[i][1] = (int16_t)(hostTestRand(&seed) % 801) - 400;
+  }
+  halAdcKernelBuild(&k, 60, 60, 15, 30, 20);
+
+  uint64_t t0 = hostTestNow();
+  for(unsigned i = 0; i < N; i++)
+  {
+    int32_t ox, oy;
+    floatDeadzone(in[i&4095][0], in[i&4095][1], 30, 20, &ox, &oy);
+    sink += ox + oy;
+  }
+  uint64_t t1 = hostTestNow();
+  for(unsigned i = 0; i < N; i++)
+  {
+    int32_t ox, oy;
+    halAdcKernelDeadzone(&k, in[i&4095][0], in[i&4095][1], &ox, &oy);
+    sink += ox + oy;
+  }
+  uint64_t t2 = hostTestNow();
+
+  float accelF = 0;
+  for(unsigned i = 0; i < N; i++)
+  {
+    accelF = (accelF < ACCELTIME_MAX) ? accelF + 20 : accelF;
+    float mF = in[i&4095][0] * 60 * HAL_ADC_ACCEL_FACTOR * accelF;
+    if(mF > 15) mF = 15;
+    if(mF < -15) mF = -15;
+    sink += (int32_t)(mF * 1000);
+  }
+  uint64_t t3 = hostTestNow();
+  uint32_t accelQ = 0;
+  int32_t maxQ = halAdcKernelMaxSpeed(&k, HAL_ADC_REF_PERIOD);
+  for(unsigned i = 0; i < N; i++)
+  {
+    accelQ = (accelQ < (ACCELTIME_MAX << 8)) ? accelQ + 20*256 : accelQ;
+    sink += halAdcKernelMove(in[i&4095][0], accelQ, k.gain_x, HAL_ADC_REF_PERIOD, maxQ);
+  }
+  uint64_t t4 = hostTestNow();
+
+  printf("bench deadzone: float %.1f ns, q16 %.1f ns per sample (%.1fx)\n",
+    (double)(t1-t0)/N, (double)(t2-t1)/N, (double)(t1-t0)/(t2-t1));
+  printf("bench movement: float %.1f ns, q16 %.1f ns per axis (%.1fx)\n",
+    (double)(t3-t2)/N, (double)(t4-t3)/N, (double)(t3-t2)/(t4-t3));
+  (void)sink;
+}
+
+int main(void)
+{
+  testDeadzone();
+  testMovement();
+  benchmark();
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,329 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host test - HID command dispatch (cmd_table & cmd_arena) vs. chain walk.
+ *
+ * A slot with 20 VBs and a few hundred commands is built twice:<br>
+ * * as before: one malloc per element & AT string, each press/release
+ * walks the whole chain<br>
+ * * as handler_hid does now: elements in a cmd_arena, compiled into a
+ * contiguous table via cmd_table, one lookup per press/release<br>
+ * Both have to send the same commands in the same order. Build,
+ * dispatch & teardown are timed.
+ *
+ * Loading a slot is timed as well: one handler_hid_addCmd per command,
+ * either walking to the tail & compiling after each command (as before)
+ * or appending via a tail link & compiling once (handler_hid_commit).
+ *
+ * @note benchCmd_t & benchReport_t have the same layout as hid_cmd_t &
+ * hid_report_t (without latency timestamps), common.h is not used here.
+ * */
+
+#include <stdlib.h>
+#include "host_test.h"
+#include "cmd_arena.h"
+#include "cmd_table.h"
+
+/** @brief VBs used by the slot */
+#define BENCH_VB 20
+/** @brief Commands of the slot */
+#define BENCH_CMDS 300
+/** @brief Table indices: press & release of each VB */
+#define BENCH_SLOTS (BENCH_VB*2)
+/** @brief Same mapping as HID_TABLE_IDX */
+#define BENCH_IDX(vb) (((uint32_t)((vb) & 0x7F) << 1) | (((vb) & 0x80) ? 1 : 0))
+
+/** @brief Chain element, same as hid_cmd_t */
+typedef struct benchCmd {
+  uint8_t vb;
+  uint8_t cmd[3];
+  char *atoriginal;
+  struct benchCmd *next;
+} benchCmd_t;
+
+/** @brief Compiled command, same as hid_report_t */
+typedef struct benchReport {
+  uint8_t cmd[3];
+  uint8_t flags;
+} benchReport_t;
+
+/** @brief Compiled table, same as hid_cmd_table_t */
+typedef struct benchTable {
+  uint16_t start[BENCH_SLOTS+1];
+  benchReport_t cmds[];
+} benchTable_t;
+
+/** @brief Input for both chains: VB & command of each element */
+static struct { uint8_t vb; uint8_t cmd[3]; char at[24]; } input[BENCH_CMDS];
+
+static const char *atNames[] = { "AT KP KEY_A", "AT CL", "AT KH KEY_SHIFT KEY_A", "AT MX 10", "AT NE" };
+
+/** @brief Old storage: one malloc per element & string, appended to the chain */
+static benchCmd_t *buildMalloc(void)
+{
+  benchCmd_t *head = NULL, **link = &head;
+  for(uint32_t i = 0; i < BENCH_CMDS; i++)
+  {
+    benchCmd_t *c = malloc(sizeof(benchCmd_t));
+    c->vb = input[i].vb;
+    memcpy(c->cmd, input[i].cmd, 3);
+    c->atoriginal = strdup(input[i].at);
+    c->next = NULL;
+    *link = c;
+    link = &c->next;
+  }
+  return head;
+}
+
+static void freeMalloc(benchCmd_t *c)
+{
+  while(c != NULL)
+  {
+    benchCmd_t *next = c->next;
+    free(c->atoriginal);
+    free(c);
+    c = next;
+  }
+}
+
+/** @brief New storage: elements & strings in an arena */
+static benchCmd_t *buildArena(cmd_arena_t *a)
+{
+  benchCmd_t *head = NULL, **link = &head;
+  for(uint32_t i = 0; i < BENCH_CMDS; i++)
+  {
+    benchCmd_t *c = cmdArenaAlloc(a, sizeof(benchCmd_t));
+    c->vb = input[i].vb;
+    memcpy(c->cmd, input[i].cmd, 3);
+    c->atoriginal = cmdArenaStrdup(a, input[i].at);
+    c->next = NULL;
+    *link = c;
+    link = &c->next;
+  }
+  return head;
+}
+
+/** @brief Same steps as handler_hid_compile */
+static benchTable_t *compile(benchCmd_t *chain)
+{
+  uint32_t count = 0;
+  benchCmd_t *c;
+  for(c = chain; c != NULL; c = c->next) count++;
+  benchTable_t *t = malloc(sizeof(benchTable_t) + count*sizeof(benchReport_t));
+  cmdTableInit(t->start, BENCH_SLOTS);
+  for(c = chain; c != NULL; c = c->next) cmdTableCount(t->start, BENCH_IDX(c->vb));
+  cmdTablePrefix(t->start, BENCH_SLOTS);
+  for(c = chain; c != NULL; c = c->next)
+  {
+    benchReport_t *dst = &t->cmds[cmdTablePlace(t->start, BENCH_IDX(c->vb))];
+    memcpy(dst->cmd, c->cmd, 3);
+    dst->flags = c->vb;
+  }
+  cmdTableFinish(t->start, BENCH_SLOTS);
+  return t;
+}
+
+/** @brief Old dispatch: walk the chain, send each matching element */
+static uint32_t dispatchChain(benchCmd_t *chain, uint8_t vb, uint32_t *hash)
+{
+  uint32_t n = 0;
+  for(benchCmd_t *c = chain; c != NULL; c = c->next)
+  {
+    if(c->vb != vb) continue;
+    *hash = *hash * 31 + (c->cmd[0] | c->cmd[1] << 8 | c->cmd[2] << 16);
+    n++;
+  }
+  return n;
+}
+
+/** @brief New dispatch: one lookup, contiguous commands */
+static uint32_t dispatchTable(const benchTable_t *t, uint8_t vb, uint32_t *hash)
+{
+  uint32_t first;
+  uint32_t n = cmdTableLookup(t->start, BENCH_IDX(vb), &first);
+  for(uint32_t i = 0; i < n; i++)
+  {
+    const benchReport_t *r = &t->cmds[first+i];
+    *hash = *hash * 31 + (r->cmd[0] | r->cmd[1] << 8 | r->cmd[2] << 16);
+  }
+  return n;
+}
+
+/** @brief Old slot load: walk to the tail & compile (incl. retiring the
+ * old table, a malloc in cmdRcuRetire) after each added command */
+static benchTable_t *loadPerCmd(cmd_arena_t *a)
+{
+  benchCmd_t *head = NULL;
+  benchTable_t *t = NULL;
+  for(uint32_t i = 0; i < BENCH_CMDS; i++)
+  {
+    benchCmd_t *c = cmdArenaAlloc(a, sizeof(benchCmd_t));
+    c->vb = input[i].vb;
+    memcpy(c->cmd, input[i].cmd, 3);
+    c->atoriginal = cmdArenaStrdup(a, input[i].at);
+    c->next = NULL;
+    benchCmd_t **link = &head;
+    while(*link != NULL) link = &(*link)->next;
+    *link = c;
+    benchTable_t *old = t;
+    t = compile(head);
+    void *retire = malloc(16);
+    free(retire);
+    free(old);
+  }
+  return t;
+}
+
+/** @brief New slot load: append via the tail link, compile once */
+static benchTable_t *loadBatch(cmd_arena_t *a)
+{
+  benchCmd_t *head = NULL, **tail = &head;
+  for(uint32_t i = 0; i < BENCH_CMDS; i++)
+  {
+    benchCmd_t *c = cmdArenaAlloc(a, sizeof(benchCmd_t));
+    c->vb = input[i].vb;
+    memcpy(c->cmd, input[i].cmd, 3);
+    c->atoriginal = cmdArenaStrdup(a, input[i].at);
+    c->next = NULL;
+    *tail = c;
+    tail = &c->next;
+  }
+  return compile(head);
+}
+
+static void testEquivalence(void)
+{
+  cmd_arena_t a = CMD_ARENA_INITIALIZER;
+  benchCmd_t *old = buildMalloc();
+  benchTable_t *t = compile(buildArena(&a));
+
+  CHECK(t->start[BENCH_SLOTS] == BENCH_CMDS, "table count %u", t->start[BENCH_SLOTS]);
+  for(uint32_t vb = 0; vb < BENCH_VB; vb++)
+  {
+    for(uint32_t press = 0; press < 2; press++)
+    {
+      uint8_t v = vb | (press ? 0x80 : 0);
+      uint32_t h1 = 0, h2 = 0;
+      uint32_t n1 = dispatchChain(old, v, &h1);
+      uint32_t n2 = dispatchTable(t, v, &h2);
+      //same commands in the same order
+      CHECK(n1 == n2 && h1 == h2, "vb 0x%02X: chain %u cmds, table %u cmds", v, n1, n2);
+      uint32_t first;
+      cmdTableLookup(t->start, BENCH_IDX(v), &first);
+      for(uint32_t i = 0; i < n2; i++) CHECK(t->cmds[first+i].flags == v, "wrong vb in range");
+    }
+  }
+  freeMalloc(old);
+  free(t);
+  cmdArenaReset(&a);
+  CHECK(a.blocks == NULL && a.used == 0, "arena not empty after reset");
+
+  //both slot loads compile the same table
+  cmd_arena_t a1 = CMD_ARENA_INITIALIZER, a2 = CMD_ARENA_INITIALIZER;
+  benchTable_t *t1 = loadPerCmd(&a1);
+  benchTable_t *t2 = loadBatch(&a2);
+  CHECK(memcmp(t1, t2, sizeof(benchTable_t) + BENCH_CMDS*sizeof(benchReport_t)) == 0,
+    "slot load: tables differ");
+  free(t1);
+  free(t2);
+  cmdArenaReset(&a1);
+  cmdArenaReset(&a2);
+}
+
+static void benchmark(void)
+{
+  enum { EVENTS = 1000000, SLOTS = 2000 };
+  uint32_t seed = 99, h1 = 0, h2 = 0, n1 = 0, n2 = 0;
+  static uint8_t events[4096];
+
+  for(uint32_t i = 0; i < 4096; i++)
+  {
+    events[i] = (hostTestRand(&seed) % BENCH_VB) | ((hostTestRand(&seed) & 1) ? 0x80 : 0);
+  }
+
+  //slot load & clear
+  uint64_t t0 = hostTestNow();
+  for(uint32_t i = 0; i < SLOTS; i++) freeMalloc(buildMalloc());
+  uint64_t t1 = hostTestNow();
+  for(uint32_t i = 0; i < SLOTS; i++)
+  {
+    cmd_arena_t a = CMD_ARENA_INITIALIZER;
+    free(compile(buildArena(&a)));
+    cmdArenaReset(&a);
+  }
+  uint64_t t2 = hostTestNow();
+
+  //slot load via addCmd (fewer runs, the old one is quadratic)
+  enum { LOADS = 200 };
+  uint64_t l0 = hostTestNow();
+  for(uint32_t i = 0; i < LOADS; i++)
+  {
+    cmd_arena_t a = CMD_ARENA_INITIALIZER;
+    free(loadPerCmd(&a));
+    cmdArenaReset(&a);
+  }
+  uint64_t l1 = hostTestNow();
+  for(uint32_t i = 0; i < LOADS; i++)
+  {
+    cmd_arena_t a = CMD_ARENA_INITIALIZER;
+    free(loadBatch(&a));
+    cmdArenaReset(&a);
+  }
+  uint64_t l2 = hostTestNow();
+
+  //dispatch
+  cmd_arena_t a = CMD_ARENA_INITIALIZER;
+  benchCmd_t *old = buildMalloc();
+  benchTable_t *t = compile(buildArena(&a));
+  uint64_t t3 = hostTestNow();
+  for(uint32_t i = 0; i < EVENTS; i++) n1 += dispatchChain(old, events[i&4095], &h1);
+  uint64_t t4 = hostTestNow();
+  for(uint32_t i = 0; i < EVENTS; i++) n2 += dispatchTable(t, events[i&4095], &h2);
+  uint64_t t5 = hostTestNow();
+  CHECK(n1 == n2 && h1 == h2, "dispatch differs: %u/%u cmds", n1, n2);
+
+  printf("bench slot load+clear (%d cmds): malloc chain %.1f us, arena+table %.1f us\n",
+    BENCH_CMDS, (double)(t1-t0)/SLOTS/1000, (double)(t2-t1)/SLOTS/1000);
+  printf("bench slot load via addCmd (%d cmds): compile per cmd %.1f us, tail + one compile %.1f us (%.1fx)\n",
+    BENCH_CMDS, (double)(l1-l0)/LOADS/1000, (double)(l2-l1)/LOADS/1000, (double)(l1-l0)/(l2-l1));
+  printf("bench dispatch (%d VBs): chain walk %.1f ns, table %.1f ns per event (%.1fx)\n",
+    BENCH_VB, (double)(t4-t3)/EVENTS, (double)(t5-t4)/EVENTS, (double)(t4-t3)/(t5-t4));
+  printf("arena: %u bytes for %d cmds\n", a.used, BENCH_CMDS);
+
+  freeMalloc(old);
+  free(t);
+  cmdArenaReset(&a);
+}
+
+int main(void)
+{
+  uint32_t seed = 12345;
+  for(uint32_t i = 0; i < BENCH_CMDS; i++)
+  {
+    input[i].vb = (hostTestRand(&seed) % BENCH_VB) | ((hostTestRand(&seed) & 1) ? 0x80 : 0);
+    input[i].cmd[0] = hostTestRand(&seed);
+    input[i].cmd[1] = hostTestRand(&seed);
+    input[i].cmd[2] = hostTestRand(&seed);
+    snprintf(input[i].at, sizeof(input[i].at), "%s", atNames[i % 5]);
+  }
+  testEquivalence();
+  benchmark();
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,375 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host test - debouncing state machine (debounce_core) on a virtual clock.
+ *
+ * Checks the state transitions documented in debounce_core.h and
+ * measures the cost of debounceInput & debounceProcess for 32 VBs,
+ * compared to a model of the former esp_timer create/start/delete per event.
+ * */
+
+#include <stdlib.h>
+#include "host_test.h"
+#include "debounce_core.h"
+
+/** @brief Configured times & recorded output of one test run */
+typedef struct {
+  uint16_t press[DEBOUNCE_VB_MAX];
+  uint16_t release[DEBOUNCE_VB_MAX];
+  uint16_t idle[DEBOUNCE_VB_MAX];
+  /** @brief Virtual clock [us] */
+  int64_t now;
+  /** @brief Recorded output events */
+  struct {
+    uint32_t vb;
+    uint8_t press;
+    uint8_t debounced;
+    uint32_t origin;
+    int64_t time;
+  } out[64];
+  uint32_t outCount;
+} debounceTest_t;
+
+static uint16_t testTime(void *ctx, uint32_t vb, debounce_time_t which)
+{
+  debounceTest_t *t = ctx;
+  switch(which)
+  {
+    case DEBOUNCE_TIME_PRESS: return t->press[vb];
+    case DEBOUNCE_TIME_RELEASE: return t->release[vb];
+    case DEBOUNCE_TIME_IDLE: return t->idle[vb];
+    default: return 0;
+  }
+}
+
+static void testSink(void *ctx, uint32_t vb, uint8_t press, uint32_t origin,
+  uint32_t start, uint8_t debounced)
+{
+  debounceTest_t *t = ctx;
+  (void)start;
+  if(t->outCount >= sizeof(t->out)/sizeof(t->out[0])) return;
+  t->out[t->outCount].vb = vb;
+  t->out[t->outCount].press = press;
+  t->out[t->outCount].debounced = debounced;
+  t->out[t->outCount].origin = origin;
+  t->out[t->outCount].time = t->now;
+  t->outCount++;
+}
+
+/** @brief Advance the virtual clock to 'to' [ms], processing each deadline on time */
+static void advance(debounce_core_t *d, debounceTest_t *t, int64_t to)
+{
+  int64_t next;
+  to *= 1000;
+  while(debounceNextDeadline(d, &next) && next <= to)
+  {
+    if(next > t->now) t->now = next;
+    debounceProcess(d, t->now);
+  }
+  t->now = to;
+}
+
+/** @brief Feed an input event at time 'at' [ms] */
+static void input(debounce_core_t *d, debounceTest_t *t, uint32_t vb, uint8_t press, int64_t at)
+{
+  advance(d, t, at);
+  debounceInput(d, vb, press, t->now, (uint32_t)at, (uint32_t)at);
+}
+
+static void setup(debounce_core_t *d, debounceTest_t *t)
+{
+  memset(t, 0, sizeof(*t));
+  debounceInit(d, 8, 0, 2, testTime, testSink, t);
+}
+
+static void testPress(void)
+{
+  debounce_core_t d;
+  debounceTest_t t;
+  setup(&d, &t);
+  t.press[1] = 30;
+  t.release[1] = 20;
+
+  //press is sent after exactly 30ms, release after 20ms
+  input(&d, &t, 1, 1, 100);
+  advance(&d, &t, 129);
+  CHECK(t.outCount == 0, "press sent early");
+  CHECK(debounceGetState(&d, 1) == DEBOUNCE_PRESS, "state %d", debounceGetState(&d, 1));
+  advance(&d, &t, 130);
+  CHECK(t.outCount == 1 && t.out[0].press == 1 && t.out[0].debounced == 1 &&
+    t.out[0].time == 130000 && t.out[0].origin == 100, "press at %lld", (long long)t.out[0].time);
+  input(&d, &t, 1, 0, 200);
+  advance(&d, &t, 300);
+  CHECK(t.outCount == 2 && t.out[1].press == 0 && t.out[1].time == 220000,
+    "release at %lld", (long long)t.out[1].time);
+  CHECK(debounceGetState(&d, 1) == DEBOUNCE_IDLE, "not idle");
+}
+
+static void testBounce(void)
+{
+  debounce_core_t d;
+  debounceTest_t t;
+  setup(&d, &t);
+  t.press[0] = 20;
+
+  //release while press is debounced is sent directly (no sticky keys)
+  input(&d, &t, 0, 1, 10);
+  input(&d, &t, 0, 0, 12);
+  CHECK(t.outCount == 1 && t.out[0].press == 0 && t.out[0].debounced == 0, "bounce release");
+  //next press restarts the press time
+  input(&d, &t, 0, 1, 14);
+  advance(&d, &t, 33);
+  CHECK(t.outCount == 1, "press sent early");
+  advance(&d, &t, 34);
+  CHECK(t.outCount == 2 && t.out[1].press == 1 && t.out[1].time == 34000, "restarted press");
+}
+
+static void testDirectAndDefault(void)
+{
+  debounce_core_t d;
+  debounceTest_t t;
+
+  //time up to mintime is sent directly
+  setup(&d, &t);
+  t.press[2] = 2;
+  input(&d, &t, 2, 1, 5);
+  CHECK(t.outCount == 1 && t.out[0].debounced == 0 && t.out[0].time == 5000, "direct press");
+
+  //no configured time -> default time
+  debounceInit(&d, 8, 15, 2, testTime, testSink, &t);
+  t.outCount = 0;
+  input(&d, &t, 3, 1, 10);
+  advance(&d, &t, 40);
+  CHECK(t.outCount == 1 && t.out[0].time == 25000, "default time %lld", (long long)t.out[0].time);
+
+  //out of range
+  CHECK(debounceInput(&d, 8, 1, 0, 0, 0) == -1, "vb out of range accepted");
+}
+
+static void testDeadtimeAndTremor(void)
+{
+  debounce_core_t d;
+  debounceTest_t t;
+  setup(&d, &t);
+  t.press[4] = 10;
+  t.idle[4] = 50;
+  t.release[5] = 30;
+  t.press[5] = 1;
+
+  //everything within 50ms after the debounced press is ignored
+  input(&d, &t, 4, 1, 0);
+  advance(&d, &t, 10);
+  CHECK(t.outCount == 1 && debounceGetState(&d, 4) == DEBOUNCE_DEADTIME, "deadtime not started");
+  input(&d, &t, 4, 0, 20);
+  input(&d, &t, 4, 1, 40);
+  advance(&d, &t, 59);
+  CHECK(t.outCount == 1, "event during deadtime");
+  advance(&d, &t, 60);
+  CHECK(debounceGetState(&d, 4) == DEBOUNCE_IDLE, "deadtime not finished");
+
+  //anti-tremor: press during release debouncing cancels the release
+  t.outCount = 0;
+  input(&d, &t, 5, 1, 100);
+  input(&d, &t, 5, 0, 110);
+  input(&d, &t, 5, 1, 120);
+  advance(&d, &t, 200);
+  CHECK(t.outCount == 1 && t.out[0].press == 1, "tremor release not cancelled (%u)", t.outCount);
+}
+
+static void testDeadlineAndCancel(void)
+{
+  debounce_core_t d;
+  debounceTest_t t;
+  int64_t next = 0;
+  setup(&d, &t);
+  t.press[1] = 40;
+  t.press[6] = 25;
+
+  CHECK(debounceNextDeadline(&d, &next) == 0, "deadline without input");
+  input(&d, &t, 1, 1, 0);
+  input(&d, &t, 6, 1, 5);
+  CHECK(debounceNextDeadline(&d, &next) == 1 && next == 30000, "next %lld", (long long)next);
+  debounceCancel(&d, 6);
+  CHECK(debounceNextDeadline(&d, &next) == 1 && next == 40000, "next %lld", (long long)next);
+  debounceCancel(&d, DEBOUNCE_VB_MAX);
+  CHECK(debounceNextDeadline(&d, &next) == 0, "cancel all");
+  advance(&d, &t, 100);
+  CHECK(t.outCount == 0, "cancelled event sent");
+}
+
+/** @brief Sink for the benchmark, only counts */
+static void benchSink(void *ctx, uint32_t vb, uint8_t press, uint32_t origin,
+  uint32_t start, uint8_t debounced)
+{
+  (void)vb; (void)press; (void)origin; (void)start; (void)debounced;
+  (*(uint32_t *)ctx)++;
+}
+
+static uint16_t benchTime(void *ctx, uint32_t vb, debounce_time_t which)
+{
+  (void)ctx;
+  if(which == DEBOUNCE_TIME_IDLE) return (vb & 1) ? 5 : 0;
+  return 5 + (vb % 4) * 5;
+}
+
+/** @brief Model of one esp_timer, as created per event by the former debouncer task */
+typedef struct oldTimer {
+  struct oldTimer *next;
+  int64_t deadline;
+  uint32_t vb;
+  uint8_t dir;
+} oldTimer_t;
+
+/** @brief Model of the former debouncer: one esp_timer handle & direction per VB
+ * and esp_timer's deadline sorted list of armed timers. */
+typedef struct {
+  oldTimer_t *handle[DEBOUNCE_VB_MAX];
+  uint8_t dir[DEBOUNCE_VB_MAX];
+  oldTimer_t *armed;
+  uint32_t sent;
+} oldDebouncer_t;
+
+/** @brief esp_timer_stop & esp_timer_delete: unlink from the armed list & free */
+static void oldCancel(oldDebouncer_t *o, uint32_t vb)
+{
+  oldTimer_t **link = &o->armed;
+  if(o->handle[vb] == NULL) return;
+  while(*link != NULL && *link != o->handle[vb]) link = &(*link)->next;
+  if(*link != NULL) *link = o->handle[vb]->next;
+  free(o->handle[vb]);
+  o->handle[vb] = NULL;
+  o->dir[vb] = DEBOUNCE_IDLE;
+}
+
+/** @brief esp_timer_create & esp_timer_start_once: malloc & sorted insert */
+static void oldStart(oldDebouncer_t *o, uint32_t vb, uint8_t dir, int64_t now, uint16_t time)
+{
+  if(o->dir[vb] != DEBOUNCE_IDLE) oldCancel(o, vb);
+  oldTimer_t *t = malloc(sizeof(oldTimer_t));
+  if(t == NULL) return;
+  oldTimer_t **link = &o->armed;
+  t->deadline = now + time * 1000;
+  t->vb = vb;
+  t->dir = dir;
+  while(*link != NULL && (*link)->deadline <= t->deadline) link = &(*link)->next;
+  t->next = *link;
+  *link = t;
+  o->handle[vb] = t;
+  o->dir[vb] = dir;
+}
+
+/** @brief Former debouncerCallback for each expired timer */
+static void oldProcess(oldDebouncer_t *o, int64_t now)
+{
+  while(o->armed != NULL && o->armed->deadline <= now)
+  {
+    oldTimer_t *t = o->armed;
+    uint32_t vb = t->vb;
+    uint8_t dir = t->dir;
+    oldCancel(o, vb);
+    if(dir == DEBOUNCE_DEADTIME) continue;
+    o->sent++;
+    uint16_t idle = benchTime(NULL, vb, DEBOUNCE_TIME_IDLE);
+    if(idle != 0) oldStart(o, vb, DEBOUNCE_DEADTIME, now, idle);
+  }
+}
+
+/** @brief Former task_debouncer handling of one raw input */
+static void oldInput(oldDebouncer_t *o, uint32_t vb, uint8_t press, int64_t now)
+{
+  switch(o->dir[vb])
+  {
+    case DEBOUNCE_IDLE:
+    {
+      uint16_t time = benchTime(NULL, vb, press ? DEBOUNCE_TIME_PRESS : DEBOUNCE_TIME_RELEASE);
+      if(time > 2) oldStart(o, vb, press ? DEBOUNCE_PRESS : DEBOUNCE_RELEASE, now, time);
+      else o->sent++;
+      break;
+    }
+    case DEBOUNCE_PRESS:
+      if(!press) { oldCancel(o, vb); o->sent++; }
+      break;
+    case DEBOUNCE_RELEASE:
+      if(press) oldCancel(o, vb);
+      break;
+    default: break;
+  }
+}
+
+static void benchmark(void)
+{
+  enum { N = 2000000 };
+  debounce_core_t d;
+  uint32_t sent = 0, seed = 7, processed = 0;
+  uint8_t state[DEBOUNCE_VB_MAX] = {0};
+  int64_t now = 0, next;
+
+  debounceInit(&d, DEBOUNCE_VB_MAX, 10, 2, benchTime, benchSink, &sent);
+  uint64_t t0 = hostTestNow();
+  for(uint32_t i = 0; i < N; i++)
+  {
+    //random VB toggles every ~1ms
+    now += 200 + hostTestRand(&seed) % 1600;
+    uint32_t vb = hostTestRand(&seed) % DEBOUNCE_VB_MAX;
+    state[vb] ^= 1;
+    debounceInput(&d, vb, state[vb], now, (uint32_t)now, (uint32_t)now);
+    if(debounceNextDeadline(&d, &next) && next <= now)
+    {
+      debounceProcess(&d, now);
+      processed++;
+    }
+  }
+  uint64_t t1 = hostTestNow();
+  printf("bench: %u inputs, %u process calls, %u sent: %.1f ns per input (32 VBs)\n",
+    N, processed, sent, (double)(t1-t0)/N);
+
+  //same input stream through the former per event esp_timer path
+  oldDebouncer_t *o = calloc(1, sizeof(oldDebouncer_t));
+  if(o == NULL) return;
+  seed = 7;
+  now = 0;
+  memset(state, 0, sizeof(state));
+  t0 = hostTestNow();
+  for(uint32_t i = 0; i < N; i++)
+  {
+    now += 200 + hostTestRand(&seed) % 1600;
+    uint32_t vb = hostTestRand(&seed) % DEBOUNCE_VB_MAX;
+    state[vb] ^= 1;
+    oldInput(o, vb, state[vb], now);
+    oldProcess(o, now);
+  }
+  t1 = hostTestNow();
+  printf("bench: %u inputs, %u sent: %.1f ns per input (32 VBs, esp_timer per event)\n",
+    N, o->sent, (double)(t1-t0)/N);
+  CHECK(o->sent == sent, "esp_timer model sent %u, debounce_core %u", o->sent, sent);
+  for(uint32_t vb = 0; vb < DEBOUNCE_VB_MAX; vb++) oldCancel(o, vb);
+  free(o);
+}
+
+int main(void)
+{
+  testPress();
+  testBounce();
+  testDirectAndDefault();
+  testDeadtimeAndTremor();
+  testDeadlineAndCancel();
+  benchmark();
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,225 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host test - gesture recognizer (gesture) on a virtual clock.
+ *
+ * Checks double/triple taps, long holds & chords (including the
+ * timing limits & a wrap of the 32bit clock) and measures the cost
+ * per input event.
+ * */
+
+#include <stdlib.h>
+#include "host_test.h"
+#include "gesture.h"
+
+/** @brief First gesture VB, as VB_GESTURE_FIRST of the FLipMouse */
+#define TEST_FIRSTVB 20
+
+/** @brief Recorded gesture output */
+typedef struct {
+  struct { uint32_t vb; uint8_t press; uint32_t origin; } out[32];
+  uint32_t count;
+} gestureOut_t;
+
+static void testSink(void *ctx, uint32_t vb, uint8_t press, uint32_t origin)
+{
+  gestureOut_t *o = ctx;
+  if(o->count >= sizeof(o->out)/sizeof(o->out[0])) return;
+  o->out[o->count].vb = vb;
+  o->out[o->count].press = press;
+  o->out[o->count].origin = origin;
+  o->count++;
+}
+
+/** @brief Feed a press at 'at' & a release at 'at' + 'len' [ms] */
+static void tap(gesture_engine_t *e, uint32_t vb, uint32_t at, uint32_t len)
+{
+  gestureInput(e, vb, 1, at, at);
+  gestureInput(e, vb, 0, at + len, at + len);
+}
+
+/** @brief Run all deadlines up to 'to' [ms] on time */
+static void advance(gesture_engine_t *e, uint32_t to)
+{
+  uint32_t next;
+  while(gestureNextDeadline(e, &next) && (int32_t)(to - next) >= 0) gestureProcess(e, next);
+}
+
+static void testCompile(void)
+{
+  gesture_engine_t e;
+  gestureOut_t o = {0};
+  const gesture_cfg_t cfg[] = {
+    { GESTURE_DOUBLE, 1, 0, 300 },
+    { GESTURE_NONE, 2, 0, 300 },
+    { GESTURE_LONG, 3, 0, 0 },        //time 0
+    { GESTURE_CHORD, 4, 4, 100 },     //same VB twice
+    { GESTURE_CHORD, 4, 40, 100 },    //vb2 out of range
+    { GESTURE_TYPE_MAX, 5, 0, 100 },  //unknown type
+    { GESTURE_CHORD, 6, 7, 100 },
+  };
+  CHECK(gestureCompile(&e, cfg, 7, 20, TEST_FIRSTVB, testSink, &o) == 2, "invalid gestures compiled");
+  CHECK(gestureGetUsed(&e) == ((1u<<1) | (1u<<6) | (1u<<7)), "used 0x%08X", gestureGetUsed(&e));
+
+  //VBs without gestures are ignored
+  tap(&e, 2, 0, 10);
+  tap(&e, 2, 20, 10);
+  gestureInput(&e, 99, 1, 40, 40);
+  CHECK(o.count == 0, "output for unused VBs");
+}
+
+static void testTaps(void)
+{
+  gesture_engine_t e;
+  gestureOut_t o = {0};
+  const gesture_cfg_t cfg[] = {
+    { GESTURE_DOUBLE, 0, 0, 200 },
+    { GESTURE_TRIPLE, 1, 0, 200 },
+  };
+  gestureCompile(&e, cfg, 2, 20, TEST_FIRSTVB, testSink, &o);
+
+  //double tap: press & release of the gesture VB after the second tap
+  tap(&e, 0, 0, 50);
+  CHECK(o.count == 0, "gesture after one tap");
+  tap(&e, 0, 150, 50);
+  CHECK(o.count == 2 && o.out[0].vb == TEST_FIRSTVB && o.out[0].press == 1 &&
+    o.out[1].press == 0 && o.out[0].origin == 200, "double tap (%u)", o.count);
+
+  //pause too long
+  o.count = 0;
+  tap(&e, 0, 1000, 50);
+  tap(&e, 0, 1300, 50);
+  CHECK(o.count == 0, "double tap with a long pause");
+  //press too long (second tap is the first of a new sequence)
+  tap(&e, 0, 2000, 50);
+  tap(&e, 0, 2100, 250);
+  CHECK(o.count == 0, "double tap with a long press");
+
+  //triple tap, the double tap of VB 0 is not affected
+  tap(&e, 1, 3000, 30);
+  tap(&e, 1, 3100, 30);
+  CHECK(o.count == 0, "triple tap after two taps");
+  tap(&e, 1, 3200, 30);
+  CHECK(o.count == 2 && o.out[0].vb == TEST_FIRSTVB + 1, "triple tap (%u)", o.count);
+}
+
+static void testLong(void)
+{
+  gesture_engine_t e;
+  gestureOut_t o = {0};
+  uint32_t next;
+  const gesture_cfg_t cfg[] = { { GESTURE_LONG, 5, 0, 500 } };
+  gestureCompile(&e, cfg, 1, 20, TEST_FIRSTVB, testSink, &o);
+
+  //short press: no gesture, no deadline afterwards
+  tap(&e, 5, 0, 400);
+  advance(&e, 2000);
+  CHECK(o.count == 0 && gestureNextDeadline(&e, &next) == 0, "short press");
+
+  //long hold: press after exactly 500ms (origin 0, no latency), release with the VB
+  gestureInput(&e, 5, 1, 3000, 3000);
+  CHECK(gestureNextDeadline(&e, &next) == 1 && next == 3500, "deadline %u", next);
+  advance(&e, 3499);
+  CHECK(o.count == 0, "long hold too early");
+  advance(&e, 3500);
+  CHECK(o.count == 1 && o.out[0].press == 1 && o.out[0].origin == 0, "long hold press");
+  gestureInput(&e, 5, 0, 4200, 4200);
+  CHECK(o.count == 2 && o.out[1].press == 0 && o.out[1].origin == 4200, "long hold release");
+
+  //deadline across a wrap of the 32bit clock
+  o.count = 0;
+  gestureInput(&e, 5, 1, 0xFFFFFF00u, 0);
+  gestureProcess(&e, 0xFFFFFFF0u);
+  CHECK(o.count == 0, "wrapped deadline too early");
+  gestureProcess(&e, 0x00000100u);
+  CHECK(o.count == 1, "wrapped deadline missed");
+
+  //reset: no release is signalled
+  gestureReset(&e);
+  gestureInput(&e, 5, 0, 0x200, 0x200);
+  CHECK(o.count == 1, "release after reset");
+}
+
+static void testChord(void)
+{
+  gesture_engine_t e;
+  gestureOut_t o = {0};
+  const gesture_cfg_t cfg[] = { { GESTURE_CHORD, 2, 3, 80 } };
+  gestureCompile(&e, cfg, 1, 20, TEST_FIRSTVB, testSink, &o);
+
+  //second VB within time: press with the second, release with the first released
+  gestureInput(&e, 3, 1, 0, 0);
+  gestureInput(&e, 2, 1, 60, 60);
+  CHECK(o.count == 1 && o.out[0].press == 1 && o.out[0].origin == 60, "chord press");
+  gestureInput(&e, 2, 0, 300, 300);
+  CHECK(o.count == 2 && o.out[1].press == 0, "chord release");
+  gestureInput(&e, 3, 0, 320, 320);
+  CHECK(o.count == 2, "second release");
+
+  //second VB too late
+  o.count = 0;
+  gestureInput(&e, 2, 1, 1000, 1000);
+  gestureInput(&e, 3, 1, 1100, 1100);
+  gestureInput(&e, 2, 0, 1200, 1200);
+  gestureInput(&e, 3, 0, 1200, 1200);
+  CHECK(o.count == 0, "chord with a late second VB");
+}
+
+static void benchmark(void)
+{
+  enum { N = 4000000 };
+  gesture_engine_t e;
+  uint32_t seed = 3, now = 0, next;
+  uint8_t state[20] = {0};
+  gesture_cfg_t cfg[GESTURE_MAX];
+
+  //all 8 gestures, two of them on VB 0 (worst case per event)
+  for(uint32_t i = 0; i < GESTURE_MAX; i++)
+  {
+    cfg[i].type = GESTURE_DOUBLE + (i % 4);
+    cfg[i].vb = i / 2;
+    cfg[i].vb2 = 10 + i;
+    cfg[i].time = 100 + i*50;
+  }
+  gestureCompile(&e, cfg, GESTURE_MAX, 20, TEST_FIRSTVB, NULL, NULL);
+
+  uint64_t t0 = hostTestNow();
+  for(uint32_t i = 0; i < N; i++)
+  {
+    now += 1 + hostTestRand(&seed) % 100;
+    uint32_t vb = hostTestRand(&seed) % 20;
+    state[vb] ^= 1;
+    gestureInput(&e, vb, state[vb], now, now);
+    if(gestureNextDeadline(&e, &next) && (int32_t)(now - next) >= 0) gestureProcess(&e, now);
+  }
+  uint64_t t1 = hostTestNow();
+  printf("bench: %.1f ns per event (8 gestures, 20 VBs, incl. deadline check)\n",
+    (double)(t1-t0)/N);
+}
+
+int main(void)
+{
+  testCompile();
+  testTaps();
+  testLong();
+  testChord();
+  benchmark();
+  return HOST_TEST_RESULT();
+}
@@ -0,0 +1,218 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host test - IR codec (ir_codec) round trip & compression ratio.
+ *
+ * A corpus of generated recordings (NEC, Sony 12/20 bit, RC5, RC6, a
+ * pulse distance protocol without own decoder & noise) with a jitter of
+ * about +/-7% is encoded & decoded again. Each edge must keep its level,
+ * durations must be within the codec tolerance. The encoded size is
+ * compared to the raw storage (4 bytes per RMT item).
+ * */
+
+#include <stdlib.h>
+#include "host_test.h"
+#include "ir_codec.h"
+
+/** @brief Maximum count of RMT items of a recording */
+#define TEST_ITEMS 300
+
+/** @brief Shortcut for durations in [us] */
+#define US IR_CODEC_US
+
+/** @brief Recording under construction: signed durations (mark > 0, space < 0) */
+static int32_t seg[2*TEST_ITEMS];
+static uint32_t segCount;
+static uint32_t seed = 1;
+
+/** @brief Append a duration, merging it with the last one of the same level */
+static void add(int32_t v)
+{
+  if(v == 0) return;
+  if(segCount == 0 && v < 0) return;
+  if(segCount != 0 && ((seg[segCount-1] > 0) == (v > 0)))
+  {
+    seg[segCount-1] += v;
+    return;
+  }
+  seg[segCount++] = v;
+}
+
+/** @brief Convert the recording to RMT items, adding a jitter of about +/-7%
+ * @return Count of items (including the terminating one) */
+static uint16_t build(rmt_item32_t *it, uint8_t jitter)
+{
+  uint32_t h = 0;
+  while(segCount != 0 && seg[segCount-1] < 0) segCount--;
+  memset(it, 0, sizeof(rmt_item32_t) * TEST_ITEMS);
+  for(uint32_t i = 0; i < segCount; i++)
+  {
+    uint32_t d = abs(seg[i]);
+    if(jitter) d = d + hostTestRand(&seed) % (d/7+1) - d/14;
+    if(h % 2 == 0)
+    {
+      it[h/2].duration0 = d;
+      it[h/2].level0 = seg[i] > 0;
+    } else {
+      it[h/2].duration1 = d;
+      it[h/2].level1 = seg[i] > 0;
+    }
+    h++;
+  }
+  return h/2 + 1;
+}
+
+/** @brief Get one edge (half item) of an item array */
+static void edge(const rmt_item32_t *it, uint32_t h, uint32_t *d, uint32_t *l)
+{
+  *d = (h % 2) ? it[h/2].duration1 : it[h/2].duration0;
+  *l = (h % 2) ? it[h/2].level1 : it[h/2].level0;
+}
+
+/** @brief Totals of the corpus */
+static uint32_t totalRaw, totalEnc;
+
+/** @brief Encode & decode one recording, compare the edges */
+static void roundTrip(const char *name, rmt_item32_t *it, uint16_t count, uint8_t expected)
+{
+  uint8_t out[IR_CODEC_MAX_LENGTH(TEST_ITEMS)];
+  uint16_t len = 0, decCount = 0;
+  rmt_item32_t *dec = NULL;
+
+  CHECK(irCodecEncode(it, count, out, &len) == ESP_OK, "%s: encode", name);
+  CHECK(out[0] == expected, "%s: encoded as %s", name, irCodecName(out[0]));
+  if(irCodecDecode(out, len, &dec, &decCount) != ESP_OK)
+  {
+    CHECK(0, "%s: decode", name);
+    return;
+  }
+
+  uint32_t maxDev = 0;
+  for(uint32_t h = 0; h < 2u*count; h++)
+  {
+    uint32_t d, l, e, el;
+    edge(it, h, &d, &l);
+    if(d == 0) break;
+    CHECK(h/2 < decCount, "%s: decoded %u items, edge %u missing", name, decCount, h);
+    if(h/2 >= decCount) break;
+    edge(dec, h, &e, &el);
+    uint32_t dev = (d > e) ? d - e : e - d;
+    if(dev > maxDev) maxDev = dev;
+    //raw is exact, RLE is quantised, protocols use nominal durations
+    uint32_t tol = 0;
+    if(expected == IR_CODEC_RLE) tol = IR_CODEC_QUANTUM + e/IR_CODEC_TOLERANCE;
+    else if(expected != IR_CODEC_RAW) tol = e/IR_CODEC_TOLERANCE + 2;
+    CHECK(l == el && dev <= tol, "%s: edge %u: %u/%u vs %u/%u", name, h, l, d, el, e);
+  }
+  free(dec);
+
+  totalRaw += count * sizeof(rmt_item32_t);
+  totalEnc += len;
+  printf("%-12s %-6s %4u bytes (raw %4u), ratio %5.1f, max dev %u ticks\n", name,
+    irCodecName(out[0]), len, (unsigned)(count * sizeof(rmt_item32_t)),
+    (double)count * sizeof(rmt_item32_t) / len, maxDev);
+}
+
+static void corpus(void)
+{
+  rmt_item32_t it[TEST_ITEMS];
+
+  for(uint32_t t = 0; t < 3; t++)
+  {
+    uint32_t d;
+
+    //NEC: 9ms/4.5ms header, pulse distance, 32 bits LSB first
+    segCount = 0;
+    d = 0x12ED40BF + t;
+    add(US(9000)); add(-US(4500));
+    for(int i = 0; i < 32; i++) { add(US(560)); add(-(((d >> i) & 1) ? US(1690) : US(560))); }
+    add(US(560)); add(-US(20000));
+    roundTrip("NEC", it, build(it, 1), IR_CODEC_NEC);
+
+    //Sony 12 & 20 bit: pulse width, 2.4ms header
+    segCount = 0;
+    d = 0x95 + t;
+    add(US(2400)); add(-US(600));
+    for(int i = 0; i < 12; i++) { add(((d >> i) & 1) ? US(1200) : US(600)); add(-US(600)); }
+    roundTrip("Sony12", it, build(it, 1), IR_CODEC_SONY);
+    segCount = 0;
+    d = 0x12345 + t;
+    add(US(2400)); add(-US(600));
+    for(int i = 0; i < 20; i++) { add(((d >> i) & 1) ? US(1200) : US(600)); add(-US(600)); }
+    roundTrip("Sony20", it, build(it, 1), IR_CODEC_SONY);
+
+    //RC5: bi-phase 889us, 14 bits MSB first (1 is space -> mark)
+    segCount = 0;
+    d = 0x3000 | (t << 11) | 0x15 << 6 | 0x2A;
+    for(int i = 13; i >= 0; i--) { int32_t h = ((d >> i) & 1) ? US(889) : -US(889); add(-h); add(h); }
+    roundTrip("RC5", it, build(it, 1), IR_CODEC_RC5);
+
+    //RC6 mode 0: 2.666ms leader, start bit, 3 mode bits, double length toggle, 16 bits
+    segCount = 0;
+    d = 0x0C1A + t;
+    add(6*US(444)); add(-2*US(444));
+    for(int i = 3; i >= 0; i--) { int32_t h = ((0x8 >> i) & 1) ? US(444) : -US(444); add(h); add(-h); }
+    {
+      int32_t h = (t & 1) ? 2*US(444) : -2*US(444);
+      add(h); add(-h);
+    }
+    for(int i = 15; i >= 0; i--) { int32_t h = ((d >> i) & 1) ? US(444) : -US(444); add(h); add(-h); }
+    roundTrip("RC6", it, build(it, 1), IR_CODEC_RC6);
+
+    //pulse distance with 48 bits & a repeated frame (e.g. Panasonic), no own decoder
+    segCount = 0;
+    for(int f = 0; f < 2; f++)
+    {
+      add(US(3500)); add(-US(1700));
+      for(int i = 0; i < 48; i++) { add(US(430)); add(-((hostTestRand(&seed) & 1) ? US(1300) : US(430))); }
+      add(US(430)); add(-US(15000));
+    }
+    roundTrip("PulseDist48", it, build(it, 1), IR_CODEC_RLE);
+
+    //noise: no structure, has to be stored unchanged
+    segCount = 0;
+    for(int i = 0; i < 120; i++) add((i % 2 ? -1 : 1) * (int32_t)(100 + hostTestRand(&seed) % 20000));
+    roundTrip("noise", it, build(it, 0), IR_CODEC_RAW);
+  }
+  printf("corpus: %u bytes raw, %u bytes encoded, ratio %.1f\n",
+    totalRaw, totalEnc, (double)totalRaw / totalEnc);
+}
+
+static void testInvalid(void)
+{
+  rmt_item32_t *items = NULL;
+  uint16_t count = 0;
+  const uint8_t badRle[] = { IR_CODEC_RLE, 0xFF, 0xFF, 3, 0 };
+  const uint8_t badId[] = { IR_CODEC_MAX, 0 };
+  const uint8_t shortNec[] = { IR_CODEC_NEC, 0x12 };
+
+  //invalid data must be rejected, not decoded (errors are logged)
+  CHECK(irCodecDecode(badRle, sizeof(badRle), &items, &count) != ESP_OK, "bad RLE accepted");
+  CHECK(irCodecDecode(badId, sizeof(badId), &items, &count) != ESP_OK, "bad id accepted");
+  CHECK(irCodecDecode(shortNec, sizeof(shortNec), &items, &count) != ESP_OK, "short NEC accepted");
+  CHECK(irCodecEncode(NULL, 10, NULL, &count) != ESP_OK, "encode without items");
+}
+
+int main(void)
+{
+  corpus();
+  testInvalid();
+  return HOST_TEST_RESULT();
+}